@@ -12,6 +12,7 @@
 
 #include <map>
 #include <memory>
+#include <set>
 #include <vector>
 
 #include <osquery/core.h>
@@ -288,6 +289,9 @@ class Config : private boost::noncopyable {
    * the content of each configuration pack. There is an optional black list
    * parameter to differentiate pack content.
    *
+   * A parser is skipped when the keys it requests did not change since its
+   * last update from the same source, or the same pack of that source.
+   *
    * @param source The input configuration source name.
    * @param obj The input configuration JSON.
    * @param pack True if the JSON was built from pack data, otherwise false.
@@ -296,6 +300,12 @@ class Config : private boost::noncopyable {
                     const rapidjson::Value& obj,
                     bool pack = false);
 
+  /// Remove the packs of a source that were not provided by its last update.
+  void removeStalePacks(const std::string& source);
+
+  /// Forget the content parsers received from a source or removed pack.
+  void removeParserContent(const std::string& source);
+
   /**
    * @brief When config sources are updated the config will 'purge'.
    *
@@ -326,6 +336,21 @@ class Config : private boost::noncopyable {
   /// A set of hashes for each source of the config.
   std::map<std::string, std::string> hash_;
 
+  /// A hash of each pack's content, keyed by source and pack name.
+  std::map<std::string, std::string> pack_hash_;
+
+  /// The packs, by source and pack name, provided by the updating source.
+  std::set<std::string> applied_packs_;
+
+  /// A hash of the content last given to each parser, by source and parser.
+  std::map<std::string, std::map<std::string, std::string>> parser_hash_;
+
+  /// Set when an update added, replaced, or removed packs.
+  bool schedule_changed_{false};
+
+  /// Set when an update gave parsers new content or added a source.
+  bool needs_reconfigure_{false};
+
   /// Check if the config received valid/parsable content from a config plugin.
   bool valid_{false};
 
@@ -357,6 +382,7 @@ class Config : private boost::noncopyable {
   FRIEND_TEST(ConfigTests, test_config_refresh);
   FRIEND_TEST(ConfigTests, test_get_scheduled_queries);
   FRIEND_TEST(ConfigTests, test_nonblacklist_query);
+  FRIEND_TEST(ConfigTests, test_incremental_update);
   FRIEND_TEST(OptionsConfigParserPluginTests, test_get_option);
   FRIEND_TEST(ViewsConfigParserPluginTests, test_add_view);
   FRIEND_TEST(ViewsConfigParserPluginTests, test_swap_view);
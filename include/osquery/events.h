@@ -690,6 +690,14 @@ class EventSubscriberPlugin : public Plugin, public Eventer {
   /// Lock used when recording queries executing against this subscriber.
   mutable Mutex event_query_record_;
 
+  /// Batches, stored and dropped events not yet recorded as metrics.
+  std::atomic<size_t> metric_batches_{0};
+  std::atomic<size_t> metric_events_{0};
+  std::atomic<size_t> metric_dropped_{0};
+
+  /// Steady clock time, in milliseconds, the metrics were last recorded.
+  std::atomic<long long> metric_record_time_{0};
+
  private:
   friend class EventFactory;
   friend class EventPublisherPlugin;
@@ -848,6 +856,15 @@ class EventFactory : private boost::noncopyable {
    */
   static void configUpdate();
 
+  /**
+   * @brief Apply the schedule to each subscriber's expiration details.
+   *
+   * This is the part of configUpdate that depends on scheduled queries only.
+   * The Config calls it alone when an update changed packs but no parser
+   * content, which leaves publisher state, such as file watches, untouched.
+   */
+  static void scheduleUpdate();
+
  public:
   /// The dispatched event thread's entry-point (if needed).
   static Status run(const std::string& type_id);
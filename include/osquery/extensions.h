@@ -47,6 +47,9 @@ inline std::string getExtensionSocket(
 /// External (extensions) SQL implementation of the osquery query API.
 Status queryExternal(const std::string& query, QueryData& results);
 
+/// External (extensions) SQL query API, results are returned by column.
+Status queryExternal(const std::string& query, QueryDataColumns& results);
+
 /// External (extensions) SQL implementation of the osquery getQueryColumns API.
 Status getQueryColumnsExternal(const std::string& query, TableColumns& columns);
 
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <functional>
 #include <map>
 #include <set>
 #include <string>
@@ -391,6 +392,37 @@ Status readRawMem(size_t base, size_t length, void** buffer);
 Status archive(const std::set<boost::filesystem::path>& path,
                const boost::filesystem::path& out);
 
+/// The files of a streamed archive, and the size recorded for each.
+using ArchiveEntries = std::map<boost::filesystem::path, size_t>;
+
+/// Receives the bytes of a streamed archive, in order.
+using ArchiveStreamWriter = std::function<Status(const char* data, size_t size)>;
+
+/*
+ * @brief Stream a tar archive of the files, optionally compressed with zstd.
+ *
+ * Nothing is written to disk, the archive is passed to the writer as it is
+ * produced. Each entry contains exactly the recorded size: a file that has
+ * shrunk is padded with zeros and one that has grown is truncated.
+ *
+ * @param entries The files to archive and their sizes
+ * @param compress Compress the tar stream with zstd
+ * @param writer Called with each part of the archive, a failure stops the
+ * archive
+ * @return A status containing the success or failure of the operation
+ */
+Status archive(const ArchiveEntries& entries,
+               bool compress,
+               const ArchiveStreamWriter& writer);
+
+/*
+ * @brief Compute the size of the uncompressed archive of the files.
+ *
+ * The tar framing is produced without reading the files, the size matches
+ * the output of a streamed archive of the same entries.
+ */
+Status archiveSize(const ArchiveEntries& entries, size_t& size);
+
 /*
  * @brief Given a path, compress it with zstd and save to out.
  *
@@ -106,6 +106,30 @@ enum LoggerFeatures {
  */
 #define RLOG(n) "[Ref #" #n "] "
 
+/**
+ * @brief Out-of-band details of a chunk of serialized query results.
+ *
+ * Each field is also present in the serialized lines.
+ */
+struct QueryLogMetadata {
+  /// The scheduled query name.
+  std::string name;
+
+  /// The lines are snapshot results rather than differential results.
+  bool snapshot{false};
+
+  /// Each line holds a single row, otherwise the line holds the whole result.
+  bool events{false};
+
+  /// The number of rows in the whole result, across all chunks.
+  size_t rows{0};
+
+  /// The query execution time, and the epoch and counter of the results.
+  size_t time{0};
+  uint64_t epoch{0};
+  uint64_t counter{0};
+};
+
 /**
  * @brief Superclass for the pluggable logging facilities.
  *
@@ -218,6 +242,29 @@ class LoggerPlugin : public Plugin {
     return logString(s);
   }
 
+  /**
+   * @brief Optionally handle a chunk of result lines from a single query.
+   *
+   * Query results are serialized and forwarded in bounded chunks, together
+   * with what the scheduler knows about the query. A plugin that routes,
+   * partitions or writes several lines at once should implement
+   * logQueryResults and use the metadata rather than parsing the lines, which
+   * may be moved from. Otherwise each line is forwarded to logString, or
+   * logSnapshot for snapshot results.
+   *
+   * @param metadata The query the lines were serialized from.
+   * @param lines Serialized result lines, at most logger_batch_lines.
+   * @return log status of the last line
+   */
+  virtual Status logQueryResults(const QueryLogMetadata& metadata,
+                                 std::vector<std::string>& lines) {
+    Status status;
+    for (const auto& line : lines) {
+      status = (metadata.snapshot) ? logSnapshot(line) : logString(line);
+    }
+    return status;
+  }
+
   /**
    * @brief Optionally handle each published event via the logger.
    *
@@ -12,6 +12,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include <osquery/core/conversions.h>
 #include <osquery/expected.h>
@@ -33,6 +34,12 @@ enum class PreAggregationType {
   Sum,
   Min,
   Max,
+  /**
+   * Values are counted in a histogram, which is flushed as the points
+   * "<path>.p50", "<path>.p90", "<path>.p99" and "<path>.max".
+   * It expects non-negative values, such as latencies or sizes.
+   */
+  Histogram,
   // not existing PreAggregationType, upper limit definition
   InvalidTypeUpperLimit,
 };
@@ -61,6 +68,32 @@ void record(const std::string& path,
             PreAggregationType pre_aggregation = PreAggregationType::None,
             TimePoint time_point = Clock::now());
 
+/**
+ * @brief Returns true if points are recorded.
+ *
+ * Hot paths may check this before they build paths or measure values.
+ */
+bool isEnabled();
+
+/**
+ * A point as it was dispatched to the numeric monitoring plugins.
+ */
+struct RecordedPoint {
+  std::string path;
+  ValueType value;
+  PreAggregationType pre_aggregation;
+  TimePoint time_point;
+};
+
+/**
+ * @brief The most recent point dispatched for every path.
+ *
+ * These are the points of the last flush of the pre-aggregation buffer, and
+ * older points for paths without a record since. Used by the osquery_metrics
+ * table.
+ */
+std::vector<RecordedPoint> getRecordedPoints();
+
 /**
  * Force flush the pre-aggregation buffer.
  * Only for tests, please do not use it anywhere.
@@ -10,6 +10,7 @@
 
 #pragma once
 
+#include <functional>
 #include <map>
 #include <set>
 #include <string>
@@ -96,6 +97,26 @@ Status deserializeRowJSON(const std::string& json, Row& r);
  */
 using QueryData = std::vector<Row>;
 
+/**
+ * @brief A result set stored by column
+ *
+ * QueryDataColumns keeps each column name once and a vector of values per
+ * column, so large results do not allocate a Row map per row. Every column
+ * vector holds the same number of values.
+ */
+struct QueryDataColumns {
+  /// The result column names, in query order.
+  ColumnNames columns;
+
+  /// The values of each column, values[i] belongs to columns[i].
+  std::vector<std::vector<RowData>> values;
+
+  /// The number of result rows.
+  size_t rows() const {
+    return (values.empty()) ? 0 : values.front().size();
+  }
+};
+
 /**
  * @brief Set representation result returned from a osquery SQL query
  *
@@ -410,6 +431,28 @@ Status serializeQueryLogItemAsEvents(const QueryLogItem& item, JSON& json);
 Status serializeQueryLogItemAsEventsJSON(const QueryLogItem& i,
                                          std::vector<std::string>& items);
 
+/// Receives a chunk of serialized event lines, which may be moved from.
+using QueryLogItemLineSink =
+    std::function<Status(std::vector<std::string>& lines)>;
+
+/**
+ * @brief Serialize a QueryLogItem object into JSON event lines, a chunk at a
+ * time.
+ *
+ * The rows are written directly as lines and handed to the sink once
+ * chunk_size lines are pending, the results are never materialized as a JSON
+ * document. The legacy fields and decorations are rendered once per item.
+ *
+ * @param item the QueryLogItem to serialize
+ * @param chunk_size the maximum number of lines given to the sink at once
+ * @param sink called with each chunk, serialization stops if it fails
+ *
+ * @return Status indicating the success or failure of the operation
+ */
+Status serializeQueryLogItemAsEventsJSON(const QueryLogItem& item,
+                                         size_t chunk_size,
+                                         const QueryLogItemLineSink& sink);
+
 /**
  * @brief Interact with the historical on-disk storage for a given query.
  */
@@ -28,6 +28,7 @@
 #include <boost/optional.hpp>
 
 #include <osquery/core.h>
+#include <osquery/mutex.h>
 #include <osquery/plugin.h>
 #include <osquery/query.h>
 
@@ -753,6 +754,17 @@ class TablePlugin : public Plugin {
     return TableAttributes::NONE;
   }
 
+  /**
+   * @brief Paths to the files this table's results are generated from.
+   *
+   * When set, the table's results are kept in memory and reused until one of
+   * these files is replaced or modified. This is defined by the 'cache_source'
+   * attribute in the table spec.
+   */
+  virtual std::vector<std::string> cacheSources() const {
+    return {};
+  }
+
   /**
    * @brief Generate a complete table representation.
    *
@@ -894,6 +906,53 @@ class TablePlugin : public Plugin {
   /// The last interval in seconds when the table data was cached.
   size_t last_interval_{0};
 
+ protected:
+  /**
+   * @brief Read the state of the cacheSources files.
+   *
+   * The state must be read before generating results, such that a change of
+   * the sources during the generation invalidates the cached results. The
+   * state is empty, and caching is disabled, if any source can not be read.
+   */
+  std::vector<std::string> getCacheSourceState() const;
+
+  /**
+   * @brief Copy the results cached for the given state of the cache sources.
+   *
+   * @return True if results were cached and the sources did not change.
+   */
+  bool getSourceCache(const std::vector<std::string>& state,
+                      const QueryContext& ctx,
+                      QueryData& results);
+
+  /// Check if the results generated for a query context may be cached.
+  bool sourceCacheAllowed(const QueryContext& ctx) const;
+
+  /**
+   * @brief Account for a row kept for the cache.
+   *
+   * @return False once the rows no longer fit in table_source_cache_size.
+   */
+  bool sourceCacheFits(const Row& row, size_t& cache_size) const;
+
+  /// Cache the results generated for the given state of the cache sources.
+  void setSourceCache(std::vector<std::string> state,
+                      const QueryContext& ctx,
+                      const QueryData& results);
+
+  /// Release the results cached for the cache sources.
+  void clearSourceCache();
+
+ private:
+  /// Protects the results cached for the cache sources.
+  mutable Mutex source_cache_mutex_;
+
+  /// The state of the cache sources when the cached results were generated.
+  std::vector<std::string> source_cache_state_;
+
+  /// Results cached for the cache sources.
+  QueryData source_cache_;
+
  public:
   /**
    * @brief The scheduled interval for the executing query.
@@ -51,6 +51,13 @@ struct ExtensionResponse {
   2:ExtensionPluginResponse response,
 }
 
+/// Query results by column: values[i] holds every value of columns[i].
+struct ExtensionColumnarResponse {
+  1:ExtensionStatus status,
+  2:list<string> columns,
+  3:list<list<string>> values,
+}
+
 exception ExtensionException {
   1:i32 code,
   2:string message,
@@ -93,4 +100,8 @@ service ExtensionManager extends Extension {
   ExtensionResponse getQueryColumns(
     1:string sql,
   ),
+  /// Allow an extension to query using an SQL string, results by column.
+  ExtensionColumnarResponse queryColumnar(
+    1:string sql,
+  ),
 }
@@ -14,6 +14,11 @@
 #include <Windows.h>
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <queue>
+
 #include <boost/algorithm/string.hpp>
 
 #include <osquery/database.h>
@@ -26,8 +31,11 @@
 #include "osquery/core/conversions.h"
 #include "osquery/core/hashing.h"
 #include "osquery/core/json.h"
+#include "osquery/core/process.h"
 #include "osquery/filesystem/fileops.h"
+#include "osquery/remote/requests.h"
 #include "osquery/remote/serializers/json.h"
+#include "osquery/remote/transports/tls.h"
 #include "osquery/remote/utility.h"
 
 namespace fs = boost::filesystem;
@@ -70,7 +78,56 @@ CLI_FLAG(bool,
          false,
          "Compress archives using zstd prior to upload (default false)");
 
-DECLARE_uint64(read_max);
+CLI_FLAG(uint32,
+         carver_parallel_uploads,
+         4,
+         "Number of carve blocks POSTed concurrently (default 4)");
+
+CLI_FLAG(uint32,
+         carver_block_retries,
+         3,
+         "Number of times a failed carve block POST is retried (default 3)");
+
+CLI_FLAG(bool,
+         carver_binary_blocks,
+         false,
+         "POST carve blocks as raw bytes rather than base64 JSON");
+
+namespace {
+
+/**
+ * @brief Sends the "data" of a carve block as the raw request body.
+ *
+ * The block and session identifiers are then part of the request URI. The
+ * responses of the carve endpoints are JSON.
+ */
+class CarveBlockSerializer : public Serializer {
+ public:
+  std::string getContentType() const override {
+    return "application/octet-stream";
+  }
+
+  Status serialize(const JSON& json, std::string& serialized) override {
+    auto it = json.doc().FindMember("data");
+    if (it == json.doc().MemberEnd() || !it->value.IsString()) {
+      return Status(1, "Carve block has no data");
+    }
+    serialized.assign(it->value.GetString(), it->value.GetStringLength());
+    return Status(0, "OK");
+  }
+
+  Status deserialize(const std::string& serialized, JSON& json) override {
+    return JSONSerializer().deserialize(serialized, json);
+  }
+};
+
+template <class TSerializer>
+Status postCarveBlock(const std::string& uri, const JSON& params) {
+  Request<TLSTransport, TSerializer> request(uri);
+  request.setOption("hostname", FLAGS_tls_hostname);
+  return request.call(params);
+}
+} // namespace
 
 /// Helper function to update values related to a carve
 void updateCarveValue(const std::string& guid,
@@ -123,7 +180,8 @@ Carver::Carver(const std::set<std::string>& paths,
   // Stash the work ID to be POSTed with the carve initial request
   requestId_ = requestId;
 
-  // TODO: Adding in a manifest file of all carved files might be nice.
+  // Only a compressed archive is staged on disk, its size is not known
+  // until it has been produced.
   carveDir_ =
       fs::temp_directory_path() / fs::path(kCarvePathPrefix + carveGuid_);
   auto ret = fs::create_directory(carveDir_);
@@ -132,8 +190,6 @@ Carver::Carver(const std::set<std::string>& paths,
     return;
   }
 
-  // Store the path to our archive for later exfiltration
-  archivePath_ = carveDir_ / fs::path(kCarveNamePrefix + carveGuid_ + ".tar");
   compressPath_ =
       carveDir_ / fs::path(kCarveNamePrefix + carveGuid_ + ".tar.zst");
 
@@ -151,6 +207,8 @@ void Carver::start() {
     LOG(WARNING) << "Carver has not been properly constructed";
     return;
   }
+
+  ArchiveEntries entries;
   for (const auto& p : carvePaths_) {
     // Ensure the file is a flat file on disk before carving
     PlatformFile pFile(p, PF_OPEN_EXISTING | PF_READ);
@@ -158,98 +216,73 @@ void Carver::start() {
       VLOG(1) << "File does not exist on disk or is subdirectory: " << p;
       continue;
     }
-    Status s = carve(p);
-    if (!s.ok()) {
-      VLOG(1) << "Failed to carve file " << p << " " << s.getMessage();
-    }
-  }
-
-  std::set<fs::path> carvedFiles;
-  for (const auto& p : platformGlob((carveDir_ / "*").string())) {
-    carvedFiles.insert(fs::path(p));
+    // The archive entries keep the sizes seen here.
+    entries[p] = static_cast<size_t>(pFile.size());
   }
 
-  auto s = archive(carvedFiles, archivePath_);
-  if (!s.ok()) {
-    VLOG(1) << "Failed to create carve archive: " << s.getMessage();
-    updateCarveValue(carveGuid_, "status", "ARCHIVE FAILED");
-    return;
-  }
-
-  fs::path uploadPath;
+  size_t carveSize = 0;
+  Hash hash(HASH_TYPE_SHA256);
+  Status s;
   if (FLAGS_carver_compression) {
-    uploadPath = compressPath_;
-    s = compress(archivePath_, compressPath_);
+    s = compressCarve(entries, hash, carveSize);
     if (!s.ok()) {
       VLOG(1) << "Failed to compress carve archive: " << s.getMessage();
       updateCarveValue(carveGuid_, "status", "COMPRESS FAILED");
       return;
     }
   } else {
-    uploadPath = archivePath_;
-  }
-
-  PlatformFile uploadFile(uploadPath, PF_OPEN_EXISTING | PF_READ);
-  updateCarveValue(carveGuid_, "size", std::to_string(uploadFile.size()));
-
-  std::string uploadHash =
-      (uploadFile.size() > FLAGS_read_max)
-          ? "-1"
-          : hashFromFile(HashType::HASH_TYPE_SHA256, uploadPath.string());
-  if (uploadHash == "-1") {
-    VLOG(1)
-        << "Archive file size exceeds read max, skipping integrity computation";
+    s = archiveSize(entries, carveSize);
+    if (!s.ok()) {
+      VLOG(1) << "Failed to create carve archive: " << s.getMessage();
+      updateCarveValue(carveGuid_, "status", "ARCHIVE FAILED");
+      return;
+    }
   }
-  updateCarveValue(carveGuid_, "sha256", uploadHash);
+  updateCarveValue(carveGuid_, "size", std::to_string(carveSize));
 
-  s = postCarve(uploadPath);
+  s = postCarve(entries, hash, carveSize);
   if (!s.ok()) {
     VLOG(1) << "Failed to post carve: " << s.getMessage();
     updateCarveValue(carveGuid_, "status", "DATA POST FAILED");
     return;
   }
-};
 
-Status Carver::carve(const boost::filesystem::path& path) {
-  PlatformFile src(path, PF_OPEN_EXISTING | PF_READ);
-  PlatformFile dst(carveDir_ / path.leaf(), PF_CREATE_NEW | PF_WRITE);
+  updateCarveValue(carveGuid_, "sha256", hash.digest());
+  updateCarveValue(carveGuid_, "status", "SUCCESS");
+};
 
+Status Carver::compressCarve(const ArchiveEntries& entries,
+                             Hash& hash,
+                             size_t& size) {
+  PlatformFile dst(compressPath_, PF_CREATE_ALWAYS | PF_WRITE);
   if (!dst.isValid()) {
     return Status(1, "Destination tmp FS is not valid.");
   }
 
-  auto blkCount = ceil(static_cast<double>(src.size()) /
-                       static_cast<double>(FLAGS_carver_block_size));
-
-  std::vector<char> inBuff(FLAGS_carver_block_size, 0);
-  for (size_t i = 0; i < blkCount; i++) {
-    inBuff.clear();
-    auto bytesRead = src.read(inBuff.data(), FLAGS_carver_block_size);
-    if (bytesRead > 0) {
-      auto bytesWritten = dst.write(inBuff.data(), bytesRead);
-      if (bytesWritten < 0) {
-        return Status(1, "Error writing bytes to tmp fs");
-      }
+  size = 0;
+  return archive(entries, true, [&](const char* data, size_t length) {
+    if (dst.write(data, length) != static_cast<ssize_t>(length)) {
+      return Status(1, "Error writing bytes to tmp fs");
     }
-  }
-
-  return Status(0, "Ok");
-};
+    hash.update(data, length);
+    size += length;
+    return Status(0, "Ok");
+  });
+}
 
-Status Carver::postCarve(const boost::filesystem::path& path) {
+Status Carver::startSession(size_t carveSize) {
   Request<TLSTransport, JSONSerializer> startRequest(startUri_);
   startRequest.setOption("hostname", FLAGS_tls_hostname);
 
   // Perform the start request to get the session id
-  PlatformFile pFile(path, PF_OPEN_EXISTING | PF_READ);
   auto blkCount =
-      static_cast<size_t>(ceil(static_cast<double>(pFile.size()) /
+      static_cast<size_t>(ceil(static_cast<double>(carveSize) /
                                static_cast<double>(FLAGS_carver_block_size)));
   JSON startParams;
 
   startParams.add("block_count", blkCount);
   startParams.add("block_size", size_t(FLAGS_carver_block_size));
-  startParams.add("carve_size", pFile.size());
+  startParams.add("carve_size", carveSize);
   startParams.add("carve_id", carveGuid_);
   startParams.add("request_id", requestId_);
   startParams.add("node_key", getNodeKey("tls"));
@@ -274,41 +307,152 @@ Status Carver::postCarve(const boost::filesystem::path& path) {
     return Status(1, "Invalid session_id received from remote endpoint");
   }
 
-  std::string session_id = it->value.GetString();
-  if (session_id.empty()) {
+  sessionId_ = it->value.GetString();
+  if (sessionId_.empty()) {
     return Status(1, "Empty session_id received from remote endpoint");
   }
+  return Status(0, "Ok");
+}
 
-  Request<TLSTransport, JSONSerializer> contRequest(contUri_);
-  contRequest.setOption("hostname", FLAGS_tls_hostname);
-  for (size_t i = 0; i < blkCount; i++) {
-    std::vector<char> block(FLAGS_carver_block_size, 0);
-    auto r = pFile.read(block.data(), FLAGS_carver_block_size);
+Status Carver::postCarve(const ArchiveEntries& entries,
+                         Hash& hash,
+                         size_t carveSize) {
+  auto status = startSession(carveSize);
+  if (!status.ok()) {
+    return status;
+  }
 
-    if (r != FLAGS_carver_block_size && r > 0) {
-      // resize the buffer to size we read as last block is likely smaller
-      block.resize(r);
+  // Blocks are cut from the archive stream as it is produced.
+  size_t blockSize = FLAGS_carver_block_size;
+  size_t blockId = 0;
+  size_t streamed = 0;
+  std::string block;
+  block.reserve(blockSize);
+  auto L_AddData = [&](const char* data, size_t length) {
+    streamed += length;
+    while (length > 0) {
+      auto size = std::min(length, blockSize - block.size());
+      block.append(data, size);
+      data += size;
+      length -= size;
+      if (block.size() == blockSize) {
+        queueBlock(blockId++, std::move(block));
+        block.clear();
+        block.reserve(blockSize);
+        if (!uploadStatus_.ok()) {
+          // Stop producing the archive once any block fails to upload.
+          return uploadStatus_;
+        }
+      }
     }
+    return (interrupted()) ? Status(1, "Carve interrupted") : Status(0, "Ok");
+  };
 
-    JSON params;
-    params.add("block_id", i);
-    params.add("session_id", session_id);
-    params.add("request_id", requestId_);
-    params.add("data", base64Encode(std::string(block.begin(), block.end())));
-
-    // TODO: Error sending files.
-    status = contRequest.call(params);
-    if (!status.ok()) {
-      VLOG(1) << "Post of carved block " << i
-              << " failed: " << status.getMessage();
-      continue;
+  if (FLAGS_carver_compression) {
+    // The compressed archive was hashed while it was written.
+    PlatformFile src(compressPath_, PF_OPEN_EXISTING | PF_READ);
+    std::vector<char> buffer(blockSize, 0);
+    while (status.ok()) {
+      auto r = src.read(buffer.data(), blockSize);
+      if (r <= 0) {
+        break;
+      }
+      status = L_AddData(buffer.data(), static_cast<size_t>(r));
     }
+  } else {
+    status = archive(entries, false, [&](const char* data, size_t length) {
+      hash.update(data, length);
+      return L_AddData(data, length);
+    });
   }
 
-  updateCarveValue(carveGuid_, "status", "SUCCESS");
-  return Status(0, "Ok");
+  if (status.ok() && !block.empty()) {
+    queueBlock(blockId++, std::move(block));
+  }
+
+  auto uploadStatus = waitForBlocks();
+  if (!status.ok()) {
+    return status;
+  }
+  if (streamed != carveSize) {
+    return Status(1, "Carve archive size changed during upload");
+  }
+  return uploadStatus;
 };
 
+Status Carver::postBlock(size_t blockId, const std::string& block) {
+  JSON params;
+  params.add("block_id", blockId);
+  params.add("session_id", sessionId_);
+  params.add("request_id", requestId_);
+
+  std::string uri = contUri_;
+  if (FLAGS_carver_binary_blocks) {
+    uri += ((uri.find('?') != std::string::npos) ? "&" : "?");
+    uri += "session_id=" + sessionId_ + "&request_id=" + requestId_ +
+           "&block_id=" + std::to_string(blockId);
+    params.addCopy("data", block);
+  } else {
+    params.add("data", base64Encode(block));
+  }
+
+  Status status;
+  for (size_t attempt = 0; attempt <= FLAGS_carver_block_retries; attempt++) {
+    if (attempt > 0) {
+      sleepFor(attempt * 1000);
+    }
+
+    status = (FLAGS_carver_binary_blocks)
+                 ? postCarveBlock<CarveBlockSerializer>(uri, params)
+                 : postCarveBlock<JSONSerializer>(uri, params);
+    if (status.ok() || interrupted()) {
+      break;
+    }
+    VLOG(1) << "Post of carved block " << blockId
+            << " failed: " << status.getMessage();
+  }
+  return status;
+}
+
+void Carver::queueBlock(size_t blockId, std::string block) {
+  // Bound the blocks held in memory and the requests in flight.
+  size_t maxUploads = std::max<size_t>(FLAGS_carver_parallel_uploads, 1);
+  while (!uploads_.empty()) {
+    auto& upload = uploads_.front();
+    if (uploads_.size() < maxUploads &&
+        upload.wait_for(std::chrono::seconds(0)) !=
+            std::future_status::ready) {
+      break;
+    }
+    auto status = upload.get();
+    uploads_.pop();
+    if (!status.ok() && uploadStatus_.ok()) {
+      uploadStatus_ = status;
+    }
+  }
+
+  if (!uploadStatus_.ok()) {
+    // The carve has already failed, do not send the remaining blocks.
+    return;
+  }
+
+  uploads_.push(std::async(
+      std::launch::async, [this, blockId, data = std::move(block)]() {
+        return postBlock(blockId, data);
+      }));
+}
+
+Status Carver::waitForBlocks() {
+  while (!uploads_.empty()) {
+    auto status = uploads_.front().get();
+    uploads_.pop();
+    if (!status.ok() && uploadStatus_.ok()) {
+      uploadStatus_ = status;
+    }
+  }
+  return uploadStatus_;
+}
+
 Status carvePaths(const std::set<std::string>& paths) {
   Status s;
   auto guid = generateNewUUID();
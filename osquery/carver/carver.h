@@ -10,6 +10,8 @@
 
 #pragma once
 
+#include <future>
+#include <queue>
 #include <set>
 #include <string>
 
@@ -17,6 +19,8 @@
 #include <osquery/filesystem.h>
 #include <osquery/status.h>
 
+#include "osquery/core/hashing.h"
+
 namespace osquery {
 
 /// Database domain where we store carve table entries
@@ -50,21 +54,34 @@ class Carver : public InternalRunnable {
 
  private:
   /*
-   * @brief A helper function to 'carve' files from disk
+   * @brief Stream the compressed archive of the carve to the temp FS.
    *
-   * This function performs a "forensic carve" of a specified path to the
-   * users tmp directory
+   * The size of the compressed archive is needed before the upload starts,
+   * it is the only file written during a carve. The archive is hashed as it
+   * is written.
    */
-  Status carve(const boost::filesystem::path& path);
+  Status compressCarve(const ArchiveEntries& entries, Hash& hash, size_t& size);
+
+  /// Perform the start request, which returns the session id.
+  Status startSession(size_t carveSize);
 
   /*
    * @brief Helper function to POST a carve to the graph endpoint.
    *
-   * Once all of the files have been carved and the tgz has been
-   * created, we POST the carved file to an endpoint specified by the
-   * carver_start_endpoint and carver_continue_endpoint
+   * The archive is cut into blocks as it is produced, and blocks are POSTed
+   * to the carver_continue_endpoint with a bounded number in flight. An
+   * uncompressed archive is hashed as it is streamed.
    */
-  Status postCarve(const boost::filesystem::path& path);
+  Status postCarve(const ArchiveEntries& entries, Hash& hash, size_t carveSize);
+
+  /// POST a single block, retrying failures.
+  Status postBlock(size_t blockId, const std::string& block);
+
+  /// Start the upload of a block, waits while too many are in flight.
+  void queueBlock(size_t blockId, std::string block);
+
+  /// Wait for the queued blocks, returns the first upload failure.
+  Status waitForBlocks();
 
   // Getter for the carver status
   Status getStatus() {
@@ -79,9 +96,8 @@ class Carver : public InternalRunnable {
   /*
    * @brief a variable to keep track of the temp fs used in carving
    *
-   * This variable represents the location in which we store all of our carved
-   * files. When a carve has completed all of the desired files, as well
-   * as the tar archive should reside in this directory
+   * This variable represents the location in which we store the compressed
+   * archive of a carve, uncompressed carves are streamed without staging.
    */
   boost::filesystem::path carveDir_;
 
@@ -93,14 +109,6 @@ class Carver : public InternalRunnable {
    */
   std::set<boost::filesystem::path> carvePaths_;
 
-  /*
-   * @brief a helper variable for keeping track of the posix tar archive.
-   *
-   * This variable is the absolute location of the tar archive created from
-   * tar'ing all of the carved files from the carve temp dir.
-   */
-  boost::filesystem::path archivePath_;
-
   /*
    * @brief a helper variable for keeping track of the compressed tar.
    *
@@ -137,6 +145,15 @@ class Carver : public InternalRunnable {
   /// The uri used to receive the data blocks of a carve
   std::string contUri_;
 
+  /// The session id returned by the start request
+  std::string sessionId_;
+
+  /// The block uploads in flight, in block order
+  std::queue<std::future<Status>> uploads_;
+
+  /// The first failure of a block upload
+  Status uploadStatus_;
+
   // Running status of the carver
   Status status_;
 
@@ -68,32 +68,61 @@ class CarverTests : public testing::Test {
 
 TEST_F(CarverTests, test_carve_files_locally) {
   auto guid_ = genGuid();
-  auto paths_ = getCarvePaths();
   std::string requestId = "";
   Carver carve(getCarvePaths(), guid_, requestId);
 
-  Status s;
-  for (const auto& p : paths_) {
-    s = carve.carve(fs::path(p));
-    EXPECT_TRUE(s.ok());
-  }
-
-  std::string carveFSPath = carve.getCarveDir().string();
-  auto paths = platformGlob(carveFSPath + "/*");
   std::set<fs::path> carves;
-  for (const auto& p : paths) {
+  ArchiveEntries entries;
+  for (const auto& p : getCarvePaths()) {
+    PlatformFile pFile(p, PF_OPEN_EXISTING | PF_READ);
     carves.insert(fs::path(p));
+    entries[fs::path(p)] = static_cast<size_t>(pFile.size());
   }
+  EXPECT_EQ(entries.size(), 2U);
 
-  EXPECT_EQ(carves.size(), 2U);
-  s = archive(carves,
-              carveFSPath + "/" + kTestCarveNamePrefix + guid_ + ".tar");
+  std::string carveFSPath = carve.getCarveDir().string();
+  auto tarPath = carveFSPath + "/" + kTestCarveNamePrefix + guid_ + ".tar";
+  auto s = archive(carves, tarPath);
   EXPECT_TRUE(s.ok());
 
-  auto tarPath = carveFSPath + "/" + kTestCarveNamePrefix + guid_ + ".tar";
-  PlatformFile tar(tarPath, PF_OPEN_EXISTING | PF_READ);
-  EXPECT_TRUE(tar.isValid());
+  std::string tar;
+  ASSERT_TRUE(readFile(tarPath, tar).ok());
   EXPECT_GT(tar.size(), 0U);
+
+  // The streamed archive matches the archive written to disk.
+  std::string streamed;
+  s = archive(entries, false, [&streamed](const char* data, size_t size) {
+    streamed.append(data, size);
+    return Status(0);
+  });
+  EXPECT_TRUE(s.ok());
+  EXPECT_EQ(streamed, tar);
+
+  size_t size = 0;
+  EXPECT_TRUE(archiveSize(entries, size).ok());
+  EXPECT_EQ(size, tar.size());
+
+  // A compressed stream decompresses to the same archive.
+  auto zstPath = carveFSPath + "/" + kTestCarveNamePrefix + guid_ + ".tar.zst";
+  PlatformFile zst(zstPath, PF_CREATE_ALWAYS | PF_WRITE);
+  s = archive(entries, true, [&zst](const char* data, size_t length) {
+    zst.write(data, length);
+    return Status(0);
+  });
+  EXPECT_TRUE(s.ok());
+
+  auto extractPath = carveFSPath + "/extract.tar";
+  EXPECT_TRUE(decompress(zstPath, extractPath).ok());
+  std::string extracted;
+  ASSERT_TRUE(readFile(extractPath, extracted).ok());
+  EXPECT_EQ(extracted, tar);
+
+  // A failing writer stops the archive.
+  s = archive(entries, false, [](const char* data, size_t length) {
+    return Status(1, "Writer failed");
+  });
+  EXPECT_FALSE(s.ok());
+  EXPECT_EQ(s.getMessage(), "Writer failed");
 }
 
 TEST_F(CarverTests, test_compression) {
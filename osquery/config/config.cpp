@@ -146,6 +146,9 @@ class Schedule : private boost::noncopyable {
   /// Remove all packs by source.
   void removeAll(const std::string& source);
 
+  /// Check if a pack with this name and source is in the schedule.
+  bool exists(const std::string& pack, const std::string& source) const;
+
   /// Boost gives us a nice template for maintaining the state of the iterator
   using iterator = boost::filter_iterator<Step, container::iterator>;
 
@@ -185,7 +188,13 @@ bool Schedule::Step::operator()(const PackRef& pack) const {
 }
 
 void Schedule::add(PackRef pack) {
-  remove(pack->getName(), pack->getSource());
+  // A replaced pack keeps its files, the config parsers update them.
+  auto new_end = std::remove_if(
+      packs_.begin(), packs_.end(), [&pack](const PackRef& p) {
+        return p->getName() == pack->getName() &&
+               p->getSource() == pack->getSource();
+      });
+  packs_.erase(new_end, packs_.end());
   packs_.push_back(std::move(pack));
 }
 
@@ -220,6 +229,14 @@ void Schedule::removeAll(const std::string& source) {
   packs_.erase(new_end, packs_.end());
 }
 
+bool Schedule::exists(const std::string& pack,
+                      const std::string& source) const {
+  return std::any_of(
+      packs_.begin(), packs_.end(), [&pack, &source](const PackRef& p) {
+        return p->getName() == pack && p->getSource() == source;
+      });
+}
+
 Schedule::iterator Schedule::begin() {
   return Schedule::iterator(packs_.begin(), packs_.end());
 }
@@ -306,6 +323,37 @@ Schedule::Schedule() {
   }
 }
 
+/// Hash the compact serialization of a JSON value.
+static std::string hashValue(const rj::Value& value) {
+  rj::StringBuffer buffer;
+  rj::Writer<rj::StringBuffer> writer(buffer);
+  value.Accept(writer);
+  return getBufferSHA1(buffer.GetString(), buffer.GetSize());
+}
+
+/// Hash the top-level keys requested by a parser, empty if none are set.
+static std::string hashParserContent(const rj::Value& obj,
+                                     const std::vector<std::string>& keys) {
+  rj::StringBuffer buffer;
+  rj::Writer<rj::StringBuffer> writer(buffer);
+
+  bool found = false;
+  writer.StartObject();
+  for (const auto& key : keys) {
+    if (obj.HasMember(key) && !obj[key].IsNull()) {
+      writer.Key(key.c_str(), static_cast<rj::SizeType>(key.size()));
+      obj[key].Accept(writer);
+      found = true;
+    }
+  }
+  writer.EndObject();
+
+  if (!found) {
+    return std::string();
+  }
+  return getBufferSHA1(buffer.GetString(), buffer.GetSize());
+}
+
 Config::Config()
     : schedule_(std::make_unique<Schedule>()),
       valid_(false),
@@ -324,10 +372,26 @@ void Config::addPack(const std::string& name,
   auto addSinglePack = ([this, &source](const std::string pack_name,
                                         const rj::Value& pack_obj) {
     RecursiveLock wlock(config_schedule_mutex_);
+    auto pack_source = source + FLAGS_pack_delimiter + pack_name;
+    applied_packs_.insert(pack_source);
+
+    // An unchanged pack keeps its queries, discovery state, and parsed content.
+    auto pack_hash = hashValue(pack_obj);
+    auto last_hash = pack_hash_.find(pack_source);
+    if (last_hash != pack_hash_.end() && last_hash->second == pack_hash &&
+        schedule_->exists(pack_name, source)) {
+      return;
+    }
+
     try {
       schedule_->add(std::make_unique<Pack>(pack_name, source, pack_obj));
+      pack_hash_[pack_source] = pack_hash;
+      schedule_changed_ = true;
       if (schedule_->last()->shouldPackExecute()) {
-        applyParsers(source + FLAGS_pack_delimiter + pack_name, pack_obj, true);
+        applyParsers(pack_source, pack_obj, true);
+      } else {
+        removeFiles(pack_source);
+        removeParserContent(pack_source);
       }
     } catch (const std::exception& e) {
       LOG(WARNING) << "Error adding pack: " << pack_name << ": " << e.what();
@@ -535,6 +599,9 @@ void stripConfigComments(std::string& json) {
 
 Status Config::updateSource(const std::string& source,
                             const std::string& json) {
+  // A new source always requests that plugins reconfigure.
+  bool new_source = getHash(source).empty();
+
   // Compute a 'synthesized' hash using the content before it is parsed.
   if (!hashSource(source, json)) {
     // This source did not change, the returned status allows the caller to
@@ -544,10 +611,10 @@ Status Config::updateSource(const std::string& source,
 
   {
     RecursiveLock lock(config_schedule_mutex_);
-    // Remove all packs from this source.
-    schedule_->removeAll(source);
-    // Remove all files from this source.
-    removeFiles(source);
+    applied_packs_.clear();
+    if (new_source) {
+      needs_reconfigure_ = true;
+    }
   }
 
   // load the config (source.second) into a JSON object.
@@ -556,6 +623,8 @@ Status Config::updateSource(const std::string& source,
   stripConfigComments(clone);
 
   if (!doc.fromString(clone) || !doc.doc().IsObject()) {
+    // Content that cannot be parsed provides no packs.
+    removeStalePacks(source);
     return Status(1, "Error parsing the config JSON");
   }
 
@@ -588,10 +657,47 @@ Status Config::updateSource(const std::string& source,
     }
   }
 
+  // Packs that are no longer provided by this source are removed.
+  removeStalePacks(source);
+
   applyParsers(source, doc.doc(), false);
   return Status();
 }
 
+void Config::removeStalePacks(const std::string& source) {
+  RecursiveLock lock(config_schedule_mutex_);
+  std::vector<std::string> stale_packs;
+  for (const auto& pack : schedule_->packs_) {
+    auto pack_source = source + FLAGS_pack_delimiter + pack->getName();
+    if (pack->getSource() == source && applied_packs_.count(pack_source) == 0) {
+      stale_packs.push_back(pack->getName());
+    }
+  }
+
+  for (const auto& pack : stale_packs) {
+    schedule_->remove(pack, source);
+    pack_hash_.erase(source + FLAGS_pack_delimiter + pack);
+    removeParserContent(source + FLAGS_pack_delimiter + pack);
+    schedule_changed_ = true;
+  }
+}
+
+void Config::removeParserContent(const std::string& source) {
+  RecursiveLock lock(config_schedule_mutex_);
+  auto hashes = parser_hash_.find(source);
+  if (hashes == parser_hash_.end()) {
+    return;
+  }
+
+  // Parsers that had content from this source must drop what it provided.
+  for (const auto& hash : hashes->second) {
+    if (!hash.second.empty()) {
+      needs_reconfigure_ = true;
+    }
+  }
+  parser_hash_.erase(hashes);
+}
+
 Status Config::genPack(const std::string& name,
                        const std::string& source,
                        const std::string& target) {
@@ -641,6 +747,16 @@ void Config::applyParsers(const std::string& source,
       continue;
     }
 
+    // A source or pack only gives a parser the keys that changed since that
+    // parser's last update from it. Packs are keyed by source and pack name.
+    auto parser_hash = hashParserContent(obj, parser->keys());
+    auto& last_hash = parser_hash_[source][plugin.first];
+    if (last_hash == parser_hash) {
+      continue;
+    }
+    last_hash = std::move(parser_hash);
+    needs_reconfigure_ = true;
+
     // For each key requested by the parser, add a property tree reference.
     std::map<std::string, JSON> parser_config;
     for (const auto& key : parser->keys()) {
@@ -690,7 +806,12 @@ Status Config::update(const std::map<std::string, std::string>& config) {
   // Before this occurs, take an opportunity to purge stale state.
   purge();
 
-  bool needs_reconfigure = false;
+  {
+    RecursiveLock lock(config_schedule_mutex_);
+    schedule_changed_ = false;
+    needs_reconfigure_ = false;
+  }
+
   for (const auto& source : config) {
     auto status = updateSource(source.first, source.second);
     if (status.getCode() == 2) {
@@ -702,9 +823,21 @@ Status Config::update(const std::map<std::string, std::string>& config) {
       // The content was not parsed correctly.
       return status;
     }
-    // If a source was updated and the content has changed, then the registry
-    // should be reconfigured. File watches may have changed, etc.
-    needs_reconfigure = true;
+  }
+
+  // If a source was updated and parser content has changed, then the registry
+  // should be reconfigured. File watches may have changed, etc. Changes to
+  // packs alone only affect how subscribers expire events.
+  bool schedule_changed = false;
+  bool needs_reconfigure = false;
+  {
+    RecursiveLock lock(config_schedule_mutex_);
+    schedule_changed = schedule_changed_;
+    needs_reconfigure = needs_reconfigure_;
+  }
+
+  if (loaded_ && !needs_reconfigure && schedule_changed) {
+    EventFactory::scheduleUpdate();
   }
 
   if (loaded_ && needs_reconfigure) {
@@ -801,6 +934,9 @@ void Config::reset() {
   std::map<std::string, QueryPerformance>().swap(performance_);
   std::map<std::string, FileCategories>().swap(files_);
   std::map<std::string, std::string>().swap(hash_);
+  std::map<std::string, std::string>().swap(pack_hash_);
+  std::set<std::string>().swap(applied_packs_);
+  parser_hash_.clear();
   valid_ = false;
   loaded_ = false;
 
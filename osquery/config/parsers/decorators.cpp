@@ -13,6 +13,7 @@
 #include <osquery/logger.h>
 #include <osquery/registry_factory.h>
 #include <osquery/sql.h>
+#include <osquery/system.h>
 
 #include "osquery/config/parsers/decorators.h"
 
@@ -41,6 +42,32 @@ using DecorationStore = std::map<std::string, KeyValueMap>;
 
 namespace {
 
+/// Events that require an 'always' decorator to run again.
+enum class DecoratorInvalidation {
+  /// Run once per scheduler step (the default).
+  STEP,
+  /// Run when the configured number of seconds elapsed.
+  TTL,
+  /// Run when the system hostname changes.
+  HOSTNAME,
+  /// Run once after each configuration update.
+  CONFIG,
+};
+
+/// An 'always' decorator query and the state of its last execution.
+struct AlwaysDecorator {
+  std::string query;
+  DecoratorInvalidation invalidation{DecoratorInvalidation::STEP};
+
+  /// Seconds between executions when using the TTL invalidation.
+  size_t ttl{0};
+
+  bool executed{false};
+  size_t last_time{0};
+  std::string last_hostname;
+  std::string last_config_hash;
+};
+
 /**
  * @brief A simple ConfigParserPlugin for a "decorators" dictionary key.
  *
@@ -53,6 +80,12 @@ namespace {
  * always: run these decorators for every query immediate before
  * interval: run these decorators on an interval.
  *
+ * The results of 'always' decorators are reused for every query launched
+ * within the same scheduler step. A decorator may instead be an object such as
+ * {"query": "...", "ttl": 3600} or {"query": "...", "invalidate": "hostname"},
+ * to be executed again only when its TTL expires, the hostname changes, or
+ * the configuration is updated ("invalidate": "config").
+ *
  * When 'interval' is used, the value is a dictionary of intervals, each of the
  * subkeys are treated as the requested interval in sections. The internals
  * are emulated by the query schedule.
@@ -85,7 +118,7 @@ class DecoratorsConfigParserPlugin : public ConfigParserPlugin {
 
  public:
   /// Set of configuration sources to the set of decorator queries.
-  std::map<std::string, std::vector<std::string>> always_;
+  std::map<std::string, std::vector<AlwaysDecorator>> always_;
 
   /// Set of configuration sources to the set of on-load decorator queries.
   std::map<std::string, std::vector<std::string>> load_;
@@ -102,12 +135,46 @@ class DecoratorsConfigParserPlugin : public ConfigParserPlugin {
 
   /// Protect the configuration controlled content.
   static Mutex kDecorationsConfigMutex;
+
+  /// Protect the execution state of 'always' decorators.
+  static Mutex kDecorationsAlwaysMutex;
 };
+
+/// Parse an 'always' decorator, either a query or an object with a query.
+bool parseAlwaysDecorator(const rj::Value& item, AlwaysDecorator& decorator) {
+  if (item.IsString()) {
+    decorator.query = item.GetString();
+    return true;
+  }
+
+  if (!item.IsObject() || !item.HasMember("query") ||
+      !item["query"].IsString()) {
+    return false;
+  }
+
+  decorator.query = item["query"].GetString();
+  if (item.HasMember("ttl")) {
+    decorator.invalidation = DecoratorInvalidation::TTL;
+    decorator.ttl = JSON::valueToSize(item["ttl"]);
+  } else if (item.HasMember("invalidate") && item["invalidate"].IsString()) {
+    std::string invalidate = item["invalidate"].GetString();
+    if (invalidate == "hostname") {
+      decorator.invalidation = DecoratorInvalidation::HOSTNAME;
+    } else if (invalidate == "config") {
+      decorator.invalidation = DecoratorInvalidation::CONFIG;
+    } else if (invalidate != "step") {
+      return false;
+    }
+  }
+
+  return true;
+}
 }
 
 DecorationStore DecoratorsConfigParserPlugin::kDecorations;
 Mutex DecoratorsConfigParserPlugin::kDecorationsMutex;
 Mutex DecoratorsConfigParserPlugin::kDecorationsConfigMutex;
+Mutex DecoratorsConfigParserPlugin::kDecorationsAlwaysMutex;
 
 Status DecoratorsConfigParserPlugin::setUp() {
   // Decorators are kept within customized data structures.
@@ -177,8 +244,12 @@ void DecoratorsConfigParserPlugin::updateDecorations(const std::string& source,
     auto& always = doc.doc()[always_key];
     if (always.IsArray()) {
       for (const auto& item : always.GetArray()) {
-        if (item.IsString()) {
-          always_[source].push_back(item.GetString());
+        AlwaysDecorator decorator;
+        if (parseAlwaysDecorator(item, decorator)) {
+          always_[source].push_back(std::move(decorator));
+        } else {
+          LOG(WARNING) << "Invalid always decorator in config source: "
+                       << source;
         }
       }
     }
@@ -220,23 +291,82 @@ inline void addDecoration(const std::string& source,
   DecoratorsConfigParserPlugin::kDecorations[source][name] = value;
 }
 
+inline void runDecorator(const std::string& source, const std::string& query) {
+  SQL results(query);
+  if (results.rows().size() > 0) {
+    // Notice the warning above about undefined behavior when:
+    // 1: You include decorators that emit the same column name
+    // 2: You include a query that returns more than 1 row.
+    for (const auto& column : results.rows()[0]) {
+      addDecoration(source, column.first, column.second);
+    }
+  }
+
+  if (results.rows().size() > 1) {
+    // Multiple rows exhibit undefined behavior.
+    LOG(WARNING) << "Multiple rows returned for decorator query: " << query;
+  }
+}
+
 inline void runDecorators(const std::string& source,
                           const std::vector<std::string>& queries) {
   for (const auto& query : queries) {
-    SQL results(query);
-    if (results.rows().size() > 0) {
-      // Notice the warning above about undefined behavior when:
-      // 1: You include decorators that emit the same column name
-      // 2: You include a query that returns more than 1 row.
-      for (const auto& column : results.rows()[0]) {
-        addDecoration(source, column.first, column.second);
-      }
+    runDecorator(source, query);
+  }
+}
+
+/// Check if an 'always' decorator must run, a time of 0 forces execution.
+inline bool isDecoratorInvalid(const AlwaysDecorator& decorator,
+                               size_t time,
+                               const std::string& hostname,
+                               const std::string& config_hash) {
+  if (!decorator.executed || time == 0) {
+    return true;
+  }
+
+  switch (decorator.invalidation) {
+  case DecoratorInvalidation::STEP:
+    return time != decorator.last_time;
+  case DecoratorInvalidation::TTL:
+    return time < decorator.last_time ||
+           time - decorator.last_time >= decorator.ttl;
+  case DecoratorInvalidation::HOSTNAME:
+    return hostname != decorator.last_hostname;
+  case DecoratorInvalidation::CONFIG:
+    return config_hash != decorator.last_config_hash;
+  }
+
+  return true;
+}
+
+inline void runAlwaysDecorators(const std::string& source,
+                                std::vector<AlwaysDecorator>& decorators,
+                                size_t time) {
+  // The hostname and config hash are only read when a decorator depends on
+  // them. Unchanged decorators survive config updates, so the source hash
+  // tells when the configuration was updated.
+  std::string hostname;
+  std::string config_hash;
+  for (const auto& decorator : decorators) {
+    if (decorator.invalidation == DecoratorInvalidation::HOSTNAME &&
+        hostname.empty()) {
+      hostname = getHostname();
+    } else if (decorator.invalidation == DecoratorInvalidation::CONFIG &&
+               config_hash.empty()) {
+      config_hash = Config::get().getHash(source);
     }
+  }
 
-    if (results.rows().size() > 1) {
-      // Multiple rows exhibit undefined behavior.
-      LOG(WARNING) << "Multiple rows returned for decorator query: " << query;
+  for (auto& decorator : decorators) {
+    if (!isDecoratorInvalid(decorator, time, hostname, config_hash)) {
+      continue;
     }
+
+    runDecorator(source, decorator.query);
+    decorator.executed = true;
+    decorator.last_time = time;
+    decorator.last_hostname = hostname;
+    decorator.last_config_hash = config_hash;
   }
 }
 
@@ -268,9 +398,10 @@ void runDecorators(DecorationPoint point,
       }
     }
   } else if (point == DECORATE_ALWAYS) {
-    for (const auto& target_source : dp->always_) {
+    WriteLock always_lock(DecoratorsConfigParserPlugin::kDecorationsAlwaysMutex);
+    for (auto& target_source : dp->always_) {
       if (source.empty() || target_source.first == source) {
-        runDecorators(target_source.first, target_source.second);
+        runAlwaysDecorators(target_source.first, target_source.second, time);
       }
     }
   } else if (point == DECORATE_INTERVAL) {
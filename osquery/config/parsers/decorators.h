@@ -34,8 +34,12 @@ extern const std::map<DecorationPoint, std::string> kDecorationPointKeys;
  * The configuration maintains various sources, each may contain a set of
  * decorators. The source tracking is abstracted for the decorator iterator.
  *
+ * The results of 'always' decorators are cached, they only run again when
+ * invalidated: once per distinct time (scheduler step) by default.
+ *
  * @param point request execution of decorators for this given point.
- * @param time an optional time for points using intervals.
+ * @param time an optional time for points using intervals or caching, 0 forces
+ * 'always' decorators to run.
  * @param source restrict run to a specific config source.
  */
 void runDecorators(DecorationPoint point,
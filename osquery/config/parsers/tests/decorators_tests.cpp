@@ -107,6 +107,78 @@ TEST_F(DecoratorsConfigParserPluginTests, test_decorators_run_interval) {
   ASSERT_EQ(second_item.decorations.size(), 2U);
 }
 
+TEST_F(DecoratorsConfigParserPluginTests, test_decorators_run_always) {
+  std::map<std::string, std::string> config_data;
+  config_data["awesome"] =
+      "{\"decorators\": {\"always\": [\"select 'test' as step_test\", "
+      "{\"query\": \"select 'test' as ttl_test\", \"ttl\": 60}, "
+      "{\"query\": \"select 'test' as config_test\", "
+      "\"invalidate\": \"config\"}]}}";
+
+  FLAGS_disable_decorators = false;
+  Config::get().update(config_data);
+  runDecorators(DECORATE_ALWAYS, 100);
+
+  std::map<std::string, std::string> decorations;
+  getDecorations(decorations);
+  EXPECT_EQ(decorations.size(), 3U);
+
+  // Within the same step the decorators are not executed again.
+  clearDecorations("awesome");
+  runDecorators(DECORATE_ALWAYS, 100);
+  decorations.clear();
+  getDecorations(decorations);
+  EXPECT_EQ(decorations.size(), 0U);
+
+  // Only the per-step decorator runs in the next step.
+  runDecorators(DECORATE_ALWAYS, 101);
+  decorations.clear();
+  getDecorations(decorations);
+  ASSERT_EQ(decorations.size(), 1U);
+  EXPECT_EQ(decorations.count("step_test"), 1U);
+
+  // Then the TTL expires.
+  runDecorators(DECORATE_ALWAYS, 160);
+  decorations.clear();
+  getDecorations(decorations);
+  EXPECT_EQ(decorations.count("ttl_test"), 1U);
+  EXPECT_EQ(decorations.count("config_test"), 0U);
+
+  // A config update runs every decorator again.
+  config_data["awesome"] += " ";
+  Config::get().update(config_data);
+  runDecorators(DECORATE_ALWAYS, 160);
+  decorations.clear();
+  getDecorations(decorations);
+  EXPECT_EQ(decorations.size(), 3U);
+}
+
+TEST_F(DecoratorsConfigParserPluginTests, test_decorators_serialize_events) {
+  FLAGS_disable_decorators = false;
+  Config::get().update(config_data_);
+
+  QueryLogItem item;
+  item.results.added.push_back({{"a", "1"}});
+  item.results.added.push_back({{"a", "2"}});
+  getDecorations(item.decorations);
+  ASSERT_EQ(item.decorations.size(), 3U);
+
+  // The pre-rendered decorations match the document serialization.
+  std::vector<std::string> items;
+  ASSERT_TRUE(serializeQueryLogItemAsEventsJSON(item, items).ok());
+  ASSERT_EQ(items.size(), 2U);
+
+  auto doc = JSON::newArray();
+  ASSERT_TRUE(serializeQueryLogItemAsEvents(item, doc).ok());
+  for (size_t i = 0; i < items.size(); ++i) {
+    auto event = JSON::newObject();
+    ASSERT_TRUE(event.fromString(items[i]).ok());
+    EXPECT_TRUE(event.doc() == doc.doc()[static_cast<rapidjson::SizeType>(i)]);
+    EXPECT_EQ(std::string(event.doc()["decorations"]["load_test"].GetString()),
+              "test");
+  }
+}
+
 TEST_F(DecoratorsConfigParserPluginTests, test_decorators_run_load_top_level) {
   // Re-enable the decorators, then update the config.
   // The 'load' decorator set should run every time the config is updated.
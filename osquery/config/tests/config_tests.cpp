@@ -446,6 +446,80 @@ TEST_F(ConfigTests, test_plugin_reconfigure) {
   rf.registry("config_parser")->remove("placebo");
 }
 
+class CountingConfigParserPlugin : public ConfigParserPlugin {
+ public:
+  std::vector<std::string> keys() const override {
+    return {"dictionary"};
+  }
+
+  Status update(const std::string&, const ParserConfig&) override {
+    updates++;
+    return Status();
+  }
+
+  size_t updates{0};
+};
+
+TEST_F(ConfigTests, test_incremental_update) {
+  auto& rf = RegistryFactory::get();
+  auto counter = std::make_shared<CountingConfigParserPlugin>();
+  rf.registry("config_parser")->add("counter", counter);
+
+  auto pack = [](const std::string& query) {
+    return "{\"queries\": {\"q\": {\"query\": \"" + query +
+           "\", \"interval\": 60}}, \"dictionary\": {\"pack\": \"1\"}}";
+  };
+  auto content = [&pack](const std::string& dictionary,
+                         const std::string& first,
+                         const std::string& second) {
+    std::string packs = "\"first\": " + pack(first);
+    if (!second.empty()) {
+      packs += ", \"second\": " + pack(second);
+    }
+    return "{\"dictionary\": {\"key\": \"" + dictionary + "\"}, \"packs\": {" +
+           packs + "}}";
+  };
+
+  std::map<std::string, const Pack*> packs;
+  auto collectPacks = [this, &packs]() {
+    packs.clear();
+    get().packs([&packs](const Pack& p) { packs[p.getName()] = &p; });
+  };
+
+  // The parser receives the source content and the content of each pack.
+  get().update({{"data", content("a", "select 1", "select 2")}});
+  EXPECT_EQ(counter->updates, 3U);
+  collectPacks();
+  ASSERT_EQ(packs.size(), 2U);
+  auto second_pack = packs["second"];
+
+  // Changing one pack replaces only that pack and skips unchanged parsers.
+  get().update({{"data", content("a", "select 3", "select 2")}});
+  EXPECT_EQ(counter->updates, 3U);
+  EXPECT_FALSE(get().needs_reconfigure_);
+  collectPacks();
+  ASSERT_EQ(packs.size(), 2U);
+  EXPECT_EQ(packs["second"], second_pack);
+  EXPECT_EQ(packs["first"]->getSchedule().at("q").query, "select 3");
+
+  // Changing the parser content updates the parser and keeps both packs.
+  get().update({{"data", content("b", "select 3", "select 2")}});
+  EXPECT_EQ(counter->updates, 4U);
+  EXPECT_TRUE(get().needs_reconfigure_);
+  collectPacks();
+  EXPECT_EQ(packs["second"], second_pack);
+
+  // A pack missing from the source is removed, with its parser content.
+  get().update({{"data", content("b", "select 3", "")}});
+  EXPECT_EQ(counter->updates, 4U);
+  EXPECT_TRUE(get().needs_reconfigure_);
+  collectPacks();
+  EXPECT_EQ(packs.size(), 1U);
+  EXPECT_EQ(packs.count("second"), 0U);
+
+  rf.registry("config_parser")->remove("counter");
+}
+
 TEST_F(ConfigTests, test_pack_file_paths) {
   size_t count = 0;
   auto fileCounter = [&count](const std::string& c,
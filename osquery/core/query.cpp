@@ -9,6 +9,8 @@
  */
 
 #include <algorithm>
+#include <iterator>
+#include <limits>
 #include <string>
 #include <vector>
 
@@ -383,6 +385,108 @@ inline void addLegacyFieldsAndDecorations(const QueryLogItem& item,
   }
 }
 
+/**
+ * @brief Render the decorations as JSON members.
+ *
+ * Every log item produced from a scheduler step carries the same decorations,
+ * the rendered members are reused while the decorations do not change.
+ */
+const std::string& getDecorationsFragment(
+    const std::map<std::string, std::string>& decorations) {
+  thread_local std::map<std::string, std::string> cached_decorations;
+  thread_local bool cached_top_level{false};
+  thread_local std::string fragment;
+
+  if (fragment.empty() || cached_top_level != FLAGS_decorations_top_level ||
+      cached_decorations != decorations) {
+    auto doc = JSON::newObject();
+    for (const auto& name : decorations) {
+      doc.addRef(name.first, name.second);
+    }
+
+    std::string json;
+    doc.toString(json);
+    if (FLAGS_decorations_top_level) {
+      // Remove the enclosing braces.
+      fragment = json.substr(1, json.size() - 2);
+    } else {
+      fragment = "\"decorations\":" + json;
+    }
+
+    cached_decorations = decorations;
+    cached_top_level = FLAGS_decorations_top_level;
+  }
+
+  return fragment;
+}
+
+/// Append the decorations as the last members of a serialized JSON object.
+inline void appendDecorations(const QueryLogItem& item, std::string& json) {
+  if (item.decorations.empty() || json.size() < 2 || json.back() != '}') {
+    return;
+  }
+
+  const auto& fragment = getDecorationsFragment(item.decorations);
+  json.pop_back();
+  if (json.size() > 1) {
+    json += ',';
+  }
+  json += fragment;
+  json += '}';
+}
+
+using RowWriter = rj::Writer<rj::StringBuffer>;
+
+/// Write a row as a JSON object, columns are filtered and ordered by cols.
+inline void writeRow(const Row& r, const ColumnNames& cols, RowWriter& writer) {
+  writer.StartObject();
+  if (cols.empty()) {
+    for (const auto& i : r) {
+      writer.Key(i.first.data(), static_cast<rj::SizeType>(i.first.size()));
+      writer.String(i.second.data(),
+                    static_cast<rj::SizeType>(i.second.size()));
+    }
+  } else {
+    for (const auto& c : cols) {
+      auto i = r.find(c);
+      if (i != r.end()) {
+        writer.Key(c.data(), static_cast<rj::SizeType>(c.size()));
+        writer.String(i->second.data(),
+                      static_cast<rj::SizeType>(i->second.size()));
+      }
+    }
+  }
+  writer.EndObject();
+}
+
+inline void writeRows(const QueryData& q,
+                      const ColumnNames& cols,
+                      RowWriter& writer) {
+  writer.StartArray();
+  for (const auto& r : q) {
+    writeRow(r, cols, writer);
+  }
+  writer.EndArray();
+}
+
+/// Write the legacy fields, the members of an open object.
+inline void writeLegacyFields(const QueryLogItem& item, RowWriter& writer) {
+  writer.Key("name");
+  writer.String(item.name.data(), static_cast<rj::SizeType>(item.name.size()));
+  writer.Key("hostIdentifier");
+  writer.String(item.identifier.data(),
+                static_cast<rj::SizeType>(item.identifier.size()));
+  writer.Key("calendarTime");
+  writer.String(item.calendar_time.data(),
+                static_cast<rj::SizeType>(item.calendar_time.size()));
+  writer.Key("unixTime");
+  writer.Uint64(item.time);
+  writer.Key("epoch");
+  writer.Uint64(item.epoch);
+  writer.Key("counter");
+  writer.Uint64(item.counter);
+}
+
 inline void getLegacyFieldsAndDecorations(const JSON& doc, QueryLogItem& item) {
   if (doc.doc().HasMember("decorations")) {
     if (doc.doc()["decorations"].IsObject()) {
@@ -471,13 +575,30 @@ Status serializeQueryLogItemAsEvents(const QueryLogItem& item, JSON& doc) {
 }
 
 Status serializeQueryLogItemJSON(const QueryLogItem& item, std::string& json) {
-  auto doc = JSON::newObject();
-  auto status = serializeQueryLogItem(item, doc);
-  if (!status.ok()) {
-    return status;
+  // Write the rows directly, a document of the results is never built.
+  rj::StringBuffer sb;
+  RowWriter writer(sb);
+  writer.StartObject();
+  if (!item.results.added.empty() || !item.results.removed.empty()) {
+    writer.Key("diffResults");
+    writer.StartObject();
+    writer.Key("removed");
+    writeRows(item.results.removed, item.columns, writer);
+    writer.Key("added");
+    writeRows(item.results.added, item.columns, writer);
+    writer.EndObject();
+  } else {
+    writer.Key("snapshot");
+    writeRows(item.snapshot_results, item.columns, writer);
+    writer.Key("action");
+    writer.String("snapshot");
   }
+  writeLegacyFields(item, writer);
+  writer.EndObject();
 
-  return doc.toString(json);
+  json.assign(sb.GetString(), sb.GetSize());
+  appendDecorations(item, json);
+  return Status();
 }
 
 Status deserializeQueryLogItem(const JSON& doc, QueryLogItem& item) {
@@ -513,21 +634,82 @@ Status deserializeQueryLogItemJSON(const std::string& json,
 }
 
 Status serializeQueryLogItemAsEventsJSON(const QueryLogItem& item,
-                                         std::vector<std::string>& items) {
-  auto doc = JSON::newArray();
-  auto status = serializeQueryLogItemAsEvents(item, doc);
-  if (!status.ok()) {
-    return status;
+                                         size_t chunk_size,
+                                         const QueryLogItemLineSink& sink) {
+  bool differential =
+      !item.results.added.empty() || !item.results.removed.empty();
+  if (!differential && item.snapshot_results.empty()) {
+    // This error case may also be represented in serializeQueryLogItem.
+    return Status(1, "No differential or snapshot results");
   }
 
-  // return doc.toString()
-  for (auto& event : doc.doc().GetArray()) {
-    rj::StringBuffer sb;
-    rj::Writer<rj::StringBuffer> writer(sb);
-    event.Accept(writer);
-    items.push_back(sb.GetString());
+  // Every line starts with the same legacy fields, render them once.
+  rj::StringBuffer sb;
+  {
+    RowWriter writer(sb);
+    writer.StartObject();
+    writeLegacyFields(item, writer);
+    writer.EndObject();
+  }
+  std::string header(sb.GetString(), sb.GetSize() - 1);
+  header += ",\"columns\":";
+
+  chunk_size = std::max<size_t>(chunk_size, 1);
+  std::vector<std::string> lines;
+  lines.reserve(chunk_size);
+
+  Status status;
+  auto L_SerializeRows = [&](const QueryData& rows,
+                             const ColumnNames& cols,
+                             const std::string& action) {
+    for (const auto& r : rows) {
+      sb.Clear();
+      RowWriter writer(sb);
+      writeRow(r, cols, writer);
+
+      lines.push_back(header);
+      auto& line = lines.back();
+      line.append(sb.GetString(), sb.GetSize());
+      line += ",\"action\":\"";
+      line += action;
+      line += "\"}";
+      appendDecorations(item, line);
+
+      if (lines.size() >= chunk_size) {
+        status = sink(lines);
+        lines.clear();
+        if (!status.ok()) {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+
+  if (differential) {
+    // Removed rows are logged first, as in serializeDiffResults.
+    if (L_SerializeRows(item.results.removed, item.columns, "removed")) {
+      L_SerializeRows(item.results.added, item.columns, "added");
+    }
+  } else {
+    L_SerializeRows(item.snapshot_results, {}, "snapshot");
   }
-  return Status();
+
+  if (status.ok() && !lines.empty()) {
+    status = sink(lines);
+  }
+  return status;
+}
+
+Status serializeQueryLogItemAsEventsJSON(const QueryLogItem& item,
+                                         std::vector<std::string>& items) {
+  return serializeQueryLogItemAsEventsJSON(
+      item,
+      std::numeric_limits<size_t>::max(),
+      [&items](std::vector<std::string>& lines) {
+        std::move(lines.begin(), lines.end(), std::back_inserter(items));
+        return Status();
+      });
 }
 
 Status serializeQueryData(const QueryData& q,
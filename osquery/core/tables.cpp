@@ -8,6 +8,8 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <sys/stat.h>
+
 #include "osquery/core/json.h"
 
 #include <osquery/database.h>
@@ -28,10 +30,25 @@ QueryContext queryContextFromRequest(const PluginRequest& request) {
 
   return context;
 };
+
+/// Approximate memory used by the content of a row.
+size_t getRowContentSize(const Row& row) {
+  size_t size = 0;
+  for (const auto& column : row) {
+    size += column.first.size() + column.second.size();
+  }
+  return size;
+}
 } // namespace
 
 FLAG(bool, disable_caching, false, "Disable scheduled query caching");
 
+HIDDEN_FLAG(uint64,
+            table_source_cache_size,
+            32,
+            "Maximum MB of results a table keeps for its cache sources (0 = "
+            "unlimited)");
+
 CREATE_LAZY_REGISTRY(TablePlugin, "table");
 
 size_t TablePlugin::kCacheInterval = 0;
@@ -237,6 +254,122 @@ void TablePlugin::setCache(size_t step,
   }
 }
 
+std::vector<std::string> TablePlugin::getCacheSourceState() const {
+  std::vector<std::string> state;
+  for (const auto& source : cacheSources()) {
+    // A replaced file is detected by its inode, a modification by its mtime.
+    // Results generated while a source is missing can not be invalidated.
+    struct stat file;
+    if (::stat(source.c_str(), &file) != 0) {
+      return {};
+    }
+
+    auto file_state = std::to_string(file.st_dev) + ':' +
+                      std::to_string(file.st_ino) + ':' +
+                      std::to_string(file.st_size) + ':' +
+                      std::to_string(file.st_mtime);
+#if defined(__linux__)
+    file_state += '.' + std::to_string(file.st_mtim.tv_nsec);
+#elif !defined(WIN32)
+    file_state += '.' + std::to_string(file.st_mtimespec.tv_nsec);
+#endif
+    state.push_back(std::move(file_state));
+  }
+  return state;
+}
+
+bool TablePlugin::getSourceCache(const std::vector<std::string>& state,
+                                 const QueryContext& ctx,
+                                 QueryData& results) {
+  bool stale = false;
+  {
+    ReadLock lock(source_cache_mutex_);
+    stale = !source_cache_state_.empty() &&
+            (state.empty() || source_cache_state_ != state);
+  }
+
+  // Results cached for another state of the sources are never used again.
+  if (stale) {
+    clearSourceCache();
+    return false;
+  }
+
+  if (FLAGS_disable_caching || state.empty()) {
+    return false;
+  }
+
+  // Constraints on these columns change the content of the generated rows.
+  // Other constraints are applied by SQLite to the complete cached results.
+  auto content_options = ColumnOptions::REQUIRED | ColumnOptions::ADDITIONAL |
+                         ColumnOptions::OPTIMIZED;
+  for (const auto& column : columns()) {
+    if (!(std::get<2>(column) & content_options)) {
+      continue;
+    }
+
+    auto constraint = ctx.constraints.find(std::get<0>(column));
+    if (constraint != ctx.constraints.end() && constraint->second.exists()) {
+      return false;
+    }
+  }
+
+  ReadLock lock(source_cache_mutex_);
+  if (source_cache_state_ != state) {
+    return false;
+  }
+
+  results = source_cache_;
+  return true;
+}
+
+bool TablePlugin::sourceCacheAllowed(const QueryContext& ctx) const {
+  if (FLAGS_disable_caching) {
+    return false;
+  }
+
+  // Only complete results are cached, generators may filter on constraints.
+  for (const auto& constraint : ctx.constraints) {
+    if (constraint.second.exists()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool TablePlugin::sourceCacheFits(const Row& row, size_t& cache_size) const {
+  cache_size += getRowContentSize(row);
+  return FLAGS_table_source_cache_size == 0 ||
+         cache_size <= FLAGS_table_source_cache_size * 1024 * 1024;
+}
+
+void TablePlugin::setSourceCache(std::vector<std::string> state,
+                                 const QueryContext& ctx,
+                                 const QueryData& results) {
+  if (state.empty() || !sourceCacheAllowed(ctx)) {
+    return;
+  }
+
+  size_t cache_size = 0;
+  for (const auto& row : results) {
+    if (!sourceCacheFits(row, cache_size)) {
+      VLOG(1) << "Results of table " << getName()
+              << " are too large to be cached";
+      clearSourceCache();
+      return;
+    }
+  }
+
+  WriteLock lock(source_cache_mutex_);
+  source_cache_state_ = std::move(state);
+  source_cache_ = results;
+}
+
+void TablePlugin::clearSourceCache() {
+  WriteLock lock(source_cache_mutex_);
+  source_cache_state_.clear();
+  QueryData().swap(source_cache_);
+}
+
 std::string columnDefinition(const TableColumns& columns, bool is_extension) {
   std::map<std::string, bool> epilog;
   bool indexed = false;
@@ -10,10 +10,16 @@
 
 #include <gtest/gtest.h>
 
+#include <osquery/filesystem.h>
+#include <osquery/flags.h>
 #include <osquery/tables.h>
 
+#include "osquery/tests/test_util.h"
+
 namespace osquery {
 
+DECLARE_uint64(table_source_cache_size);
+
 class TablesTests : public testing::Test {};
 
 TEST_F(TablesTests, test_constraint) {
@@ -179,4 +185,65 @@ TEST_F(TablesTests, test_caching) {
   EXPECT_TRUE(test.testIsCached(6));
   EXPECT_FALSE(test.testIsCached(7));
 }
+
+class TestSourceTablePlugin : public TablePlugin {
+ public:
+  std::vector<std::string> cacheSources() const override {
+    return {kTestWorkingDirectory + "cache_source.txt"};
+  }
+
+  bool testGetSourceCache(const QueryContext& ctx, QueryData& results) {
+    return getSourceCache(getCacheSourceState(), ctx, results);
+  }
+
+  void testSetSourceCache(const QueryContext& ctx, const QueryData& results) {
+    setSourceCache(getCacheSourceState(), ctx, results);
+  }
+};
+
+TEST_F(TablesTests, test_source_caching) {
+  TestSourceTablePlugin test;
+  auto source = test.cacheSources()[0];
+  ASSERT_TRUE(writeTextFile(source, "version 1").ok());
+
+  QueryContext ctx;
+  QueryData results;
+  EXPECT_FALSE(test.testGetSourceCache(ctx, results));
+
+  // Results generated with constraints are not complete, they are not cached.
+  QueryContext constrained_ctx;
+  constrained_ctx.constraints["name"].add(Constraint(EQUALS, "test"));
+  test.testSetSourceCache(constrained_ctx, {{{"name", "test"}}});
+  EXPECT_FALSE(test.testGetSourceCache(ctx, results));
+
+  test.testSetSourceCache(ctx, {{{"name", "test"}}, {{"name", "other"}}});
+  ASSERT_TRUE(test.testGetSourceCache(ctx, results));
+  EXPECT_EQ(results.size(), 2U);
+
+  // Complete results may be used by a constrained query.
+  results.clear();
+  ASSERT_TRUE(test.testGetSourceCache(constrained_ctx, results));
+  EXPECT_EQ(results.size(), 2U);
+
+  // A change of the source invalidates the cache.
+  ASSERT_TRUE(writeTextFile(source, "version 2 of the source").ok());
+  EXPECT_FALSE(test.testGetSourceCache(ctx, results));
+
+  // Results can not be cached while a source is missing.
+  removePath(source);
+  test.testSetSourceCache(ctx, {{{"name", "test"}}});
+  EXPECT_FALSE(test.testGetSourceCache(ctx, results));
+
+  // Results over the size limit are not cached.
+  ASSERT_TRUE(writeTextFile(source, "version 3").ok());
+  auto cache_size = FLAGS_table_source_cache_size;
+  FLAGS_table_source_cache_size = 1;
+  test.testSetSourceCache(ctx, {{{"name", std::string(2 * 1024 * 1024, 'a')}}});
+  EXPECT_FALSE(test.testGetSourceCache(ctx, results));
+
+  FLAGS_table_source_cache_size = cache_size;
+  test.testSetSourceCache(ctx, {{{"name", std::string(2 * 1024 * 1024, 'a')}}});
+  EXPECT_TRUE(test.testGetSourceCache(ctx, results));
+  removePath(source);
+}
 }
@@ -11,6 +11,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <boost/thread.hpp>
+
 #include <osquery/core.h>
 #include <osquery/tables.h>
 
@@ -196,15 +198,16 @@ class FakeWatcherRunner : public WatcherRunner {
   /**
    * @brief What the runner's internals will use as process state.
    *
-   * Internal calls to getProcessRow will return this structure.
+   * Internal calls to getProcessSample will return this structure.
    */
-  void setProcessRow(QueryData qd) {
-    qd_ = std::move(qd);
+  void setProcessSample(const ProcessSample& sample) {
+    sample_ = sample;
   }
 
-  /// The tests do not have access to the processes table.
-  QueryData getProcessRow(pid_t pid) const {
-    return qd_;
+  /// The tests control the sampled process counters.
+  Status getProcessSample(pid_t pid, ProcessSample& sample) const {
+    sample = sample_;
+    return Status(0);
   }
 
  private:
@@ -212,20 +215,20 @@ class FakeWatcherRunner : public WatcherRunner {
   void stopChild(const PlatformProcess& child) const {}
 
  private:
-  QueryData qd_;
+  ProcessSample sample_;
 };
 
 TEST_F(WatcherTests, test_watcherrunner_watcherhealth) {
   FakeWatcherRunner runner(0, nullptr, true);
 
-  // Construct a process state, assume this would have been returned from the
-  // processes table, which the WorkerRunner normally uses internally.
-  Row r;
-  r["parent"] = INTEGER(1);
-  r["user_time"] = INTEGER(100);
-  r["system_time"] = INTEGER(100);
-  r["resident_size"] = INTEGER(100);
-  runner.setProcessRow({r});
+  // Construct a process state, assume this would have been sampled from the
+  // process counters, which the WorkerRunner normally reads internally.
+  ProcessSample r;
+  r.parent = 1;
+  r.user_time = 100;
+  r.system_time = 100;
+  r.resident_size = 100;
+  runner.setProcessSample(r);
 
   // Hold the process and process state externally.
   // Normally the WatcherRunner's entry point will persist these and use them
@@ -247,24 +250,57 @@ TEST_F(WatcherTests, test_watcherrunner_watcherhealth) {
 
   // Now we can alter the performance.
   // Let us emulate the watcher having just allocated 1G of memory.
-  r["resident_size"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.resident_size = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
 
   auto status = runner.isWatcherHealthy(*test_process, state);
   EXPECT_FALSE(status.ok());
   EXPECT_EQ(status.getMessage(), "Memory limits exceeded");
 
   // Now emulate a rapid increase in CPU requirements.
-  r["user_time"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.user_time = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
   runner.isWatcherHealthy(*test_process, state);
   EXPECT_EQ(1U, state.sustained_latency);
 
   // And again, the CPU continues to increase from the system perspective.
-  r["system_time"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.system_time = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
   runner.isWatcherHealthy(*test_process, state);
   EXPECT_EQ(2U, state.sustained_latency);
+
+  // A single busy interval is smoothed by the moving average.
+  PerformanceState smoothed;
+  r.user_time = 0;
+  r.system_time = 0;
+  r.resident_size = 100;
+  runner.setProcessSample(r);
+  EXPECT_TRUE(runner.isWatcherHealthy(*test_process, smoothed));
+  runner.isWatcherHealthy(*test_process, smoothed);
+  // The CPU time (ms) allowed per interval, exceeded by half in one interval.
+  auto allowed = getWorkerLimit(WatchdogLimitType::UTILIZATION_LIMIT) *
+                 getWorkerLimit(WatchdogLimitType::INTERVAL) * 10 *
+                 boost::thread::physical_concurrency();
+  r.user_time = allowed + allowed / 2;
+  runner.setProcessSample(r);
+  runner.isWatcherHealthy(*test_process, smoothed);
+  EXPECT_EQ(0U, smoothed.sustained_latency);
+}
+
+TEST_F(WatcherTests, test_watcherrunner_process_sample) {
+  WatcherRunner runner(0, nullptr, false);
+
+  // The runner samples its own process counters directly.
+  auto test_process = PlatformProcess::getCurrentProcess();
+  ProcessSample sample;
+  ASSERT_TRUE(runner.getProcessSample(test_process->pid(), sample).ok());
+  EXPECT_GT(sample.resident_size, 0U);
+#ifndef WIN32
+  EXPECT_EQ(getppid(), sample.parent);
+#endif
+
+  // A process that does not exist cannot be sampled.
+  EXPECT_FALSE(runner.getProcessSample(-1, sample).ok());
 }
 
 TEST_F(WatcherTests, test_watcherrunner_unhealthy_delay) {
@@ -275,19 +311,19 @@ TEST_F(WatcherTests, test_watcherrunner_unhealthy_delay) {
   fake_test_process.setStatus(PROCESS_STILL_ALIVE, 0);
 
   // Set up a fake test process and place it into an healthy state.
-  Row r;
-  r["parent"] = INTEGER(test_process->pid());
-  r["user_time"] = INTEGER(100);
-  r["system_time"] = INTEGER(100);
-  r["resident_size"] = INTEGER(100);
-  runner.setProcessRow({r});
+  ProcessSample r;
+  r.parent = test_process->pid();
+  r.user_time = 100;
+  r.system_time = 100;
+  r.resident_size = 100;
+  runner.setProcessSample(r);
 
   // Check the fake process sanity, which records the state at t=0.
   EXPECT_TRUE(runner.isChildSane(fake_test_process));
 
   // Update the fake process resident memory, make it unhealthy.
-  r["resident_size"] = INTEGER(1024 * 1024 * 1024);
-  runner.setProcessRow({r});
+  r.resident_size = 1024 * 1024 * 1024;
+  runner.setProcessSample(r);
 
   // Set the watchdog to delay 1000s.
   auto delay = FLAGS_watchdog_delay;
@@ -8,6 +8,7 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <chrono>
 #include <cstring>
 
 #include <math.h>
@@ -17,6 +18,12 @@
 #include <sys/wait.h>
 #endif
 
+#ifdef __linux__
+#include <poll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -30,6 +37,14 @@
 #include "osquery/core/watcher.h"
 #include "osquery/filesystem/fileops.h"
 
+#ifdef __linux__
+#include "osquery/filesystem/linux/proc.h"
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+#endif
+
 namespace fs = boost::filesystem;
 
 namespace osquery {
@@ -99,11 +114,28 @@ CLI_FLAG(bool,
 
 CLI_FLAG(bool, disable_watchdog, false, "Disable userland watchdog process");
 
+HIDDEN_FLAG(uint64,
+            watchdog_sample_weight,
+            50,
+            "Weight (percent) of the latest watchdog sample in the averages");
+
+HIDDEN_FLAG(bool,
+            watchdog_exit_notify,
+            true,
+            "Wake the watchdog as soon as a child exits (Linux pidfd)");
+
+#ifdef __linux__
+/// Longest uninterruptible wait for child exit notifications.
+const int kExitPollSliceMs = 1000;
+#endif
+
 void Watcher::resetWorkerCounters(size_t respawn_time) {
   // Reset the monitoring counters for the watcher.
   state_.sustained_latency = 0;
   state_.user_time = 0;
   state_.system_time = 0;
+  state_.cpu_average = -1;
+  state_.memory_average = -1;
   state_.last_respawn_time = respawn_time;
 }
 
@@ -114,6 +146,8 @@ void Watcher::resetExtensionCounters(const std::string& extension,
   state.sustained_latency = 0;
   state.user_time = 0;
   state.system_time = 0;
+  state.cpu_average = -1;
+  state.memory_average = -1;
   state.last_respawn_time = respawn_time;
 }
 
@@ -246,7 +280,7 @@ void WatcherRunner::start() {
       // A test harness can end the thread immediately.
       break;
     }
-    pauseMilli(getWorkerLimit(WatchdogLimitType::INTERVAL) * 1000);
+    waitForInterval(getWorkerLimit(WatchdogLimitType::INTERVAL) * 1000);
   } while (!interrupted() && ok());
 }
 
@@ -360,20 +394,27 @@ void WatcherRunner::stopChild(const PlatformProcess& child) const {
   }
 }
 
-PerformanceChange getChange(const Row& r, PerformanceState& state) {
+/// Fold a new sample into an exponential moving average.
+static double updateAverage(double average, double sample) {
+  if (average < 0) {
+    // The first sample seeds the average.
+    return sample;
+  }
+
+  auto weight = static_cast<size_t>(FLAGS_watchdog_sample_weight);
+  weight = std::max(std::min(weight, 100_sz), 1_sz);
+  return (sample * weight + average * (100 - weight)) / 100;
+}
+
+PerformanceChange getChange(const ProcessSample& sample,
+                            PerformanceState& state) {
   PerformanceChange change;
 
   // IV is the check interval in seconds, and utilization is set per-second.
   change.iv = std::max(getWorkerLimit(WatchdogLimitType::INTERVAL), 1_sz);
-  UNSIGNED_BIGINT_LITERAL user_time = 0, system_time = 0;
-  try {
-    change.parent = static_cast<pid_t>(std::stoll(r.at("parent")));
-    user_time = std::stoll(r.at("user_time"));
-    system_time = std::stoll(r.at("system_time"));
-    change.footprint = std::stoll(r.at("resident_size"));
-  } catch (const std::exception& /* e */) {
-    state.sustained_latency = 0;
-  }
+  change.parent = sample.parent;
+  UNSIGNED_BIGINT_LITERAL user_time = sample.user_time;
+  UNSIGNED_BIGINT_LITERAL system_time = sample.system_time;
 
   // Check the difference of CPU time used since last check.
   auto percent_ul = getWorkerLimit(WatchdogLimitType::UTILIZATION_LIMIT);
@@ -383,11 +424,20 @@ PerformanceChange getChange(const Row& r, PerformanceState& state) {
   UNSIGNED_BIGINT_LITERAL cpu_ul =
       (percent_ul * iv_milliseconds * kNumOfCPUs) / 100;
 
-  auto user_time_diff = user_time - state.user_time;
-  auto sys_time_diff = system_time - state.system_time;
-  auto cpu_utilization_time = user_time_diff + sys_time_diff;
+  // A counter that went backwards belongs to a new process image.
+  auto user_time_diff =
+      (user_time >= state.user_time) ? user_time - state.user_time : 0;
+  auto sys_time_diff =
+      (system_time >= state.system_time) ? system_time - state.system_time : 0;
 
-  if (cpu_utilization_time > cpu_ul) {
+  // Limits apply to the averages, a single busy interval is smoothed out.
+  state.cpu_average = updateAverage(
+      state.cpu_average, static_cast<double>(user_time_diff + sys_time_diff));
+  state.memory_average = updateAverage(
+      state.memory_average, static_cast<double>(sample.resident_size));
+  change.footprint = static_cast<size_t>(state.memory_average);
+
+  if (state.cpu_average > cpu_ul) {
     state.sustained_latency++;
   } else {
     state.sustained_latency = 0;
@@ -436,13 +486,13 @@ static bool exceededCyclesLimit(const PerformanceChange& change) {
 
 Status WatcherRunner::isWatcherHealthy(const PlatformProcess& watcher,
                                        PerformanceState& watcher_state) const {
-  auto rows = getProcessRow(watcher.pid());
-  if (rows.size() == 0) {
+  ProcessSample sample;
+  if (!getProcessSample(watcher.pid(), sample).ok()) {
     // Could not find worker process?
     return Status(1, "Cannot find watcher process");
   }
 
-  auto change = getChange(rows[0], watcher_state);
+  auto change = getChange(sample, watcher_state);
   if (exceededMemoryLimit(change)) {
     return Status(1, "Memory limits exceeded");
   }
@@ -450,7 +500,62 @@ Status WatcherRunner::isWatcherHealthy(const PlatformProcess& watcher,
   return Status(0);
 }
 
-QueryData WatcherRunner::getProcessRow(pid_t pid) const {
+Status WatcherRunner::getProcessSample(pid_t pid,
+                                       ProcessSample& sample) const {
+#ifdef __linux__
+  static const auto kClockTicks = sysconf(_SC_CLK_TCK);
+  static const auto kPageSize = sysconf(_SC_PAGESIZE);
+
+  ProcDirectory proc(std::to_string(pid));
+  if (!proc.isValid()) {
+    return Status(1, "Cannot open process directory");
+  }
+
+  boost::string_ref content;
+  if (!proc.read("stat", content).ok()) {
+    return Status(1, "Cannot read /proc/stat");
+  }
+
+  // The fields after the command name: "<state> <ppid> ... <utime> <stime>".
+  auto start = content.rfind(')');
+  if (start == boost::string_ref::npos || content.size() <= start + 2) {
+    return Status(1, "Invalid /proc/stat header");
+  }
+
+  boost::string_ref details[13];
+  size_t count = 0;
+  ProcTokenizer stat_tokens(content.substr(start + 2), " \n");
+  while (count < 13 && stat_tokens.next(details[count])) {
+    count++;
+  }
+
+  std::uint64_t parent = 0, user_ticks = 0, system_ticks = 0;
+  if (count < 13 || !procParseUInt(details[1], parent) ||
+      !procParseUInt(details[11], user_ticks) ||
+      !procParseUInt(details[12], system_ticks)) {
+    return Status(1, "Invalid /proc/stat content");
+  }
+
+  sample.parent = static_cast<pid_t>(parent);
+  sample.user_time = user_ticks * 1000 / kClockTicks;
+  sample.system_time = system_ticks * 1000 / kClockTicks;
+
+  // The second statm field is the resident set size in pages.
+  if (!proc.read("statm", content).ok()) {
+    return Status(1, "Cannot read /proc/statm");
+  }
+
+  boost::string_ref pages;
+  std::uint64_t resident_pages = 0;
+  ProcTokenizer statm_tokens(content, " \n");
+  if (!statm_tokens.next(pages) || !statm_tokens.next(pages) ||
+      !procParseUInt(pages, resident_pages)) {
+    return Status(1, "Invalid /proc/statm content");
+  }
+
+  sample.resident_size = resident_pages * kPageSize;
+  return Status(0);
+#else
   // On Windows, pid_t = DWORD, which is unsigned. However invalidity
   // of processes is denoted by a pid_t of -1. We check for this
   // by comparing the max value of DWORD, or ULONG_MAX, and then casting
@@ -460,17 +565,95 @@ QueryData WatcherRunner::getProcessRow(pid_t pid) const {
 #ifdef WIN32
   p = (pid == ULONG_MAX) ? -1 : pid;
 #endif
-  return SQL::selectFrom(
+  auto rows = SQL::selectFrom(
       {"parent", "user_time", "system_time", "resident_size"},
       "processes",
       "pid",
       EQUALS,
       INTEGER(p));
+  if (rows.size() == 0) {
+    return Status(1, "Cannot find process");
+  }
+
+  try {
+    sample.parent = static_cast<pid_t>(std::stoll(rows[0].at("parent")));
+    sample.user_time = std::stoull(rows[0].at("user_time"));
+    sample.system_time = std::stoull(rows[0].at("system_time"));
+    sample.resident_size = std::stoull(rows[0].at("resident_size"));
+  } catch (const std::exception& /* e */) {
+    return Status(1, "Invalid process row");
+  }
+  return Status(0);
+#endif
+}
+
+void WatcherRunner::waitForInterval(size_t milliseconds) {
+#ifdef __linux__
+  std::vector<struct pollfd> fds;
+  if (FLAGS_watchdog_exit_notify) {
+    auto watch_exit = [&fds](const PlatformProcess& child) {
+      if (!child.isValid()) {
+        return;
+      }
+
+      auto fd = static_cast<int>(syscall(__NR_pidfd_open, child.pid(), 0));
+      if (fd < 0) {
+        // Kernels before 5.3 do not support pidfd, the wait is a pause.
+        return;
+      }
+
+      // A child that already exited is handled by the next check, and would
+      // otherwise end every wait immediately.
+      struct pollfd pfd = {fd, POLLIN, 0};
+      if (::poll(&pfd, 1, 0) == 0) {
+        fds.push_back(pfd);
+      } else {
+        ::close(fd);
+      }
+    };
+
+    auto& watcher = Watcher::get();
+    if (use_worker_) {
+      watch_exit(watcher.getWorker());
+    }
+    for (const auto& extension : watcher.extensions()) {
+      watch_exit(*extension.second);
+    }
+  }
+
+  if (!fds.empty()) {
+    // Poll in slices so a request to stop the watcher is still noticed.
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(milliseconds);
+    while (!interrupted()) {
+      auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           deadline - std::chrono::steady_clock::now())
+                           .count();
+      if (remaining <= 0) {
+        break;
+      }
+
+      auto timeout = (remaining < kExitPollSliceMs)
+                         ? static_cast<int>(remaining)
+                         : kExitPollSliceMs;
+      if (::poll(fds.data(), fds.size(), timeout) != 0) {
+        // A child exited (or the poll failed), check the children now.
+        break;
+      }
+    }
+
+    for (const auto& pfd : fds) {
+      ::close(pfd.fd);
+    }
+    return;
+  }
+#endif
+  pauseMilli(milliseconds);
 }
 
 Status WatcherRunner::isChildSane(const PlatformProcess& child) const {
-  auto rows = getProcessRow(child.pid());
-  if (rows.size() == 0) {
+  ProcessSample sample;
+  if (!getProcessSample(child.pid(), sample).ok()) {
     // Could not find worker process?
     return Status(1, "Cannot find process");
   }
@@ -479,7 +662,7 @@ Status WatcherRunner::isChildSane(const PlatformProcess& child) const {
   {
     WatcherExtensionsLocker locker;
     auto& state = Watcher::get().getState(child);
-    change = getChange(rows[0], state);
+    change = getChange(sample, state);
   }
 
   // Only make a decision about the child sanity if it is still the watcher's
@@ -11,6 +11,7 @@
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <string>
 
 #ifndef WIN32
@@ -70,15 +71,35 @@ struct PerformanceState {
   /// The initial (or as close as possible) process image footprint.
   size_t initial_footprint;
 
+  /// Moving average of the CPU time (ms) used per interval.
+  double cpu_average;
+  /// Moving average of the resident memory (bytes).
+  double memory_average;
+
   PerformanceState() {
     sustained_latency = 0;
     user_time = 0;
     system_time = 0;
     last_respawn_time = 0;
     initial_footprint = 0;
+    cpu_average = -1;
+    memory_average = -1;
   }
 };
 
+/**
+ * @brief A point-in-time resource sample of a watched process.
+ *
+ * CPU times are in milliseconds and the resident size is in bytes, the same
+ * units the processes table reports.
+ */
+struct ProcessSample {
+  pid_t parent{0};
+  std::uint64_t user_time{0};
+  std::uint64_t system_time{0};
+  std::uint64_t resident_size{0};
+};
+
 /**
  * @brief Thread-safe watched child process state manager.
  *
@@ -312,8 +333,21 @@ class WatcherRunner : public InternalRunnable {
   virtual Status isWatcherHealthy(const PlatformProcess& watcher,
                                   PerformanceState& watcher_state) const;
 
-  /// Get row data from the processes table for a given pid.
-  virtual QueryData getProcessRow(pid_t pid) const;
+  /**
+   * @brief Sample the CPU and memory counters of a process.
+   *
+   * On Linux the counters are read directly from /proc/<pid>/stat and statm,
+   * other platforms query the processes table.
+   */
+  virtual Status getProcessSample(pid_t pid, ProcessSample& sample) const;
+
+  /**
+   * @brief Wait for the next check interval, or until a watched child exits.
+   *
+   * Uses pidfd exit notifications where the kernel supports them, otherwise
+   * this is a plain pause.
+   */
+  virtual void waitForInterval(size_t milliseconds);
 
  private:
   /// Fork and execute a worker process.
@@ -358,6 +392,7 @@ class WatcherRunner : public InternalRunnable {
   FRIEND_TEST(WatcherTests, test_watcherrunner_loop_disabled);
   FRIEND_TEST(WatcherTests, test_watcherrunner_watcherhealth);
   FRIEND_TEST(WatcherTests, test_watcherrunner_unhealthy_delay);
+  FRIEND_TEST(WatcherTests, test_watcherrunner_process_sample);
 };
 
 /// The WatcherWatcher is spawned within the worker and watches the watcher.
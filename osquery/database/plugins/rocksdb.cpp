@@ -8,6 +8,8 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <chrono>
+
 #include <sys/stat.h>
 
 #include <rocksdb/db.h>
@@ -16,6 +18,7 @@
 
 #include <osquery/filesystem.h>
 #include <osquery/logger.h>
+#include <osquery/numeric_monitoring.h>
 #include <osquery/registry_factory.h>
 
 #include "osquery/core/conversions.h"
@@ -34,6 +37,58 @@ HIDDEN_FLAG(uint64, rocksdb_buffer_blocks, 256, "Write buffer blocks (4k)");
 
 DECLARE_string(database_path);
 
+namespace {
+
+/// Only one in this many operations of a thread has its latency recorded.
+const std::uint64_t kOperationSampleRate = 32;
+
+/// Operation sizes are summed per thread and recorded at most this often.
+const std::chrono::seconds kOperationRecordInterval{1};
+
+/// The database operations that are recorded.
+enum class Operation { Get, Put };
+
+/// The operations of a thread that have not been recorded yet.
+struct OperationMetrics {
+  std::uint64_t count{0};
+  std::uint64_t bytes{0};
+  std::chrono::steady_clock::time_point last_record;
+};
+
+/// Record the size, and a sample of the latency, of a database operation.
+void recordOperation(Operation operation,
+                     std::chrono::steady_clock::time_point start,
+                     size_t bytes) {
+  if (!monitoring::isEnabled()) {
+    return;
+  }
+
+  thread_local OperationMetrics thread_metrics[2];
+  auto& metrics = thread_metrics[operation == Operation::Get ? 0 : 1];
+  auto path = (operation == Operation::Get) ? "database.rocksdb.get"
+                                            : "database.rocksdb.put";
+  auto now = std::chrono::steady_clock::now();
+
+  if (metrics.count++ % kOperationSampleRate == 0) {
+    monitoring::record(
+        std::string(path) + ".latency_us",
+        std::chrono::duration_cast<std::chrono::microseconds>(now - start)
+            .count(),
+        monitoring::PreAggregationType::Histogram);
+  }
+
+  metrics.bytes += bytes;
+  if (now - metrics.last_record >= kOperationRecordInterval) {
+    monitoring::record(std::string(path) + ".bytes",
+                       static_cast<monitoring::ValueType>(metrics.bytes),
+                       monitoring::PreAggregationType::Sum);
+    metrics.bytes = 0;
+    metrics.last_record = now;
+  }
+}
+
+} // namespace
+
 /**
  * @brief Track external systems marking the RocksDB database as corrupted.
  *
@@ -247,7 +302,9 @@ Status RocksDBDatabasePlugin::get(const std::string& domain,
   if (cfh == nullptr) {
     return Status(1, "Could not get column family for " + domain);
   }
+  auto start = std::chrono::steady_clock::now();
   auto s = getDB()->Get(rocksdb::ReadOptions(), cfh, key, &value);
+  recordOperation(Operation::Get, start, s.ok() ? value.size() : 0);
   return Status(s.code(), s.ToString());
 }
 
@@ -291,15 +348,19 @@ Status RocksDBDatabasePlugin::putBatch(const std::string& domain,
     options.sync = true;
   }
 
+  auto start = std::chrono::steady_clock::now();
+  size_t bytes = 0;
   rocksdb::WriteBatch batch;
   for (const auto& p : data) {
     const auto& key = p.first;
     const auto& value = p.second;
 
     batch.Put(cfh, key, value);
+    bytes += key.size() + value.size();
   }
 
   auto s = getDB()->Write(options, &batch);
+  recordOperation(Operation::Put, start, bytes);
   if (s.code() != 0 && s.IsIOError()) {
     // An error occurred, check if it is an IO error and remove the offending
     // specific filename or log name.
@@ -135,6 +135,37 @@ TEST_F(ResultsTests, test_serialize_query_log_item_json) {
   EXPECT_EQ(results.first, json);
 }
 
+TEST_F(ResultsTests, test_serialize_query_log_item_events_chunked) {
+  auto results = getSerializedQueryLogItem();
+  std::vector<std::string> items;
+  ASSERT_TRUE(serializeQueryLogItemAsEventsJSON(results.second, items).ok());
+  ASSERT_GT(items.size(), 2U);
+
+  // Chunks hold at most chunk_size lines, in the same order.
+  std::vector<std::string> chunked;
+  size_t chunks = 0;
+  auto s = serializeQueryLogItemAsEventsJSON(
+      results.second, 2, [&](std::vector<std::string>& lines) {
+        EXPECT_LE(lines.size(), 2U);
+        chunks++;
+        chunked.insert(chunked.end(), lines.begin(), lines.end());
+        return Status();
+      });
+  EXPECT_TRUE(s.ok());
+  EXPECT_EQ(chunks, (items.size() + 1) / 2);
+  EXPECT_EQ(chunked, items);
+
+  // A failing sink stops the serialization.
+  chunks = 0;
+  s = serializeQueryLogItemAsEventsJSON(
+      results.second, 1, [&chunks](std::vector<std::string>& lines) {
+        chunks++;
+        return Status(1, "Sink failed");
+      });
+  EXPECT_FALSE(s.ok());
+  EXPECT_EQ(chunks, 1U);
+}
+
 TEST_F(ResultsTests, test_deserialize_query_log_item_json) {
   auto results = getSerializedQueryLogItemJSON();
 
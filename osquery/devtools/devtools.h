@@ -66,6 +66,16 @@ void prettyPrint(const QueryData& results,
                  const std::vector<std::string>& columns,
                  std::map<std::string, size_t>& lengths);
 
+/**
+ * @brief Pretty print a QueryDataColumns object
+ *
+ * Column widths are computed from each column's values before printing,
+ * rows are printed without building a Row map.
+ *
+ * @param results The QueryDataColumns object to print
+ */
+void prettyPrint(const QueryDataColumns& results);
+
 /**
  * @brief JSON print a QueryData object
  *
@@ -76,6 +86,22 @@ void prettyPrint(const QueryData& results,
  */
 void jsonPrint(const QueryData& q);
 
+/**
+ * @brief Generate a JSON object string for a single result row
+ *
+ * The shell streams JSON output with this as SQLite steps, keys are written in
+ * the result column order and NULL values are replaced with --nullvalue.
+ *
+ * @param count The number of columns
+ * @param columns The result column names
+ * @param values The result values, nullptr for NULL
+ *
+ * @return A compact JSON object string, without a newline
+ */
+std::string generateJSONRow(int count,
+                            const char* const* columns,
+                            const char* const* values);
+
 /**
  * @brief Compute a map of metadata about the supplied QueryData object
  *
@@ -101,6 +127,15 @@ void computeRowLengths(const Row& r,
 std::string generateToken(const std::map<std::string, size_t>& lengths,
                           const std::vector<std::string>& columns);
 
+/**
+ * @brief Generate the separator string from the length of each column
+ *
+ * @param lengths The printed width of each column, in column order
+ *
+ * @return A string, with a newline, representing your separator
+ */
+std::string generateToken(const std::vector<size_t>& lengths);
+
 /**
  * @brief Generate the header string for query results
  *
@@ -112,6 +147,17 @@ std::string generateToken(const std::map<std::string, size_t>& lengths,
 std::string generateHeader(const std::map<std::string, size_t>& lengths,
                            const std::vector<std::string>& columns);
 
+/**
+ * @brief Generate the header string from the length of each column
+ *
+ * @param lengths The printed width of each column, in column order
+ * @param columns The column names
+ *
+ * @return A string, with a newline, representing your header
+ */
+std::string generateHeader(const std::vector<size_t>& lengths,
+                           const std::vector<std::string>& columns);
+
 /**
  * @brief Generate a row string for query results
  *
@@ -11,6 +11,9 @@
 #include <iostream>
 #include <sstream>
 
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
 #include <osquery/core.h>
 #include <osquery/flags.h>
 
@@ -24,12 +27,21 @@ DECLARE_string(nullvalue);
 
 static std::vector<char> kOffset = {0, 0};
 static std::string kToken = "|";
+static const std::string kEmpty;
 
 std::string generateToken(const std::map<std::string, size_t>& lengths,
                           const std::vector<std::string>& columns) {
-  std::string out = "+";
+  std::vector<size_t> sizes;
   for (const auto& col : columns) {
-    size_t size = ((lengths.count(col) > 0) ? lengths.at(col) : col.size()) + 2;
+    sizes.push_back((lengths.count(col) > 0) ? lengths.at(col) : col.size());
+  }
+  return generateToken(sizes);
+}
+
+std::string generateToken(const std::vector<size_t>& lengths) {
+  std::string out = "+";
+  for (const auto& length : lengths) {
+    size_t size = length + 2;
     if (getEnvVar("ENHANCE").is_initialized()) {
       std::string e = "\xF0\x9F\x90\x8C";
       e[2] += kOffset[1];
@@ -59,14 +71,24 @@ std::string generateToken(const std::map<std::string, size_t>& lengths,
 
 std::string generateHeader(const std::map<std::string, size_t>& lengths,
                            const std::vector<std::string>& columns) {
+  std::vector<size_t> sizes;
+  for (const auto& col : columns) {
+    sizes.push_back((lengths.count(col) > 0) ? lengths.at(col) : 0);
+  }
+  return generateHeader(sizes, columns);
+}
+
+std::string generateHeader(const std::vector<size_t>& lengths,
+                           const std::vector<std::string>& columns) {
   if (getEnvVar("ENHANCE").is_initialized()) {
     kToken = "\xF0\x9F\x91\x8D";
   }
   std::string out = kToken;
-  for (const auto& col : columns) {
+  for (size_t i = 0; i < columns.size(); ++i) {
+    const auto& col = columns[i];
     out += " " + col;
-    if (lengths.count(col) > 0) {
-      int buffer_size = static_cast<int>(lengths.at(col) - utf8StringSize(col));
+    if (i < lengths.size()) {
+      int buffer_size = static_cast<int>(lengths[i] - utf8StringSize(col));
       if (buffer_size > 0) {
         out += std::string(buffer_size, ' ');
       }
@@ -131,6 +153,63 @@ void prettyPrint(const QueryData& results,
   printf("%s", separator.c_str());
 }
 
+void prettyPrint(const QueryDataColumns& results) {
+  if (results.rows() == 0) {
+    return;
+  }
+
+  // Each column's width is computed in one pass over its values.
+  std::vector<size_t> lengths;
+  for (size_t i = 0; i < results.columns.size(); ++i) {
+    size_t length = utf8StringSize(results.columns[i]);
+    if (i < results.values.size()) {
+      for (const auto& value : results.values[i]) {
+        length = std::max(length, utf8StringSize(value));
+      }
+    }
+    lengths.push_back(length);
+  }
+
+  auto separator = generateToken(lengths);
+  auto header =
+      separator + generateHeader(lengths, results.columns) + separator;
+  printf("%s", header.c_str());
+
+  // Reuse a single line buffer for every row.
+  std::string out;
+  auto columns = std::min(results.columns.size(), results.values.size());
+  for (size_t row = 0; row < results.rows(); ++row) {
+    out.clear();
+    for (size_t i = 0; i < columns; ++i) {
+      // A short column is printed as empty rather than read past its end.
+      const auto& value =
+          (row < results.values[i].size()) ? results.values[i][row] : kEmpty;
+      out += kToken;
+      out += ' ';
+      out += value;
+      out.append(lengths[i] - utf8StringSize(value) + 1, ' ');
+    }
+    out += kToken;
+    out += '\n';
+    printf("%s", out.c_str());
+  }
+  printf("%s", separator.c_str());
+}
+
+std::string generateJSONRow(int count,
+                            const char* const* columns,
+                            const char* const* values) {
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  writer.StartObject();
+  for (int i = 0; i < count; ++i) {
+    writer.Key((columns[i] != nullptr) ? columns[i] : "");
+    writer.String((values[i] != nullptr) ? values[i] : FLAGS_nullvalue.c_str());
+  }
+  writer.EndObject();
+  return std::string(buffer.GetString(), buffer.GetSize());
+}
+
 void jsonPrint(const QueryData& q) {
   printf("[\n");
   for (size_t i = 0; i < q.size(); ++i) {
@@ -57,6 +57,7 @@ namespace osquery {
 /// Define flags used by the shell. They are parsed by the drop-in shell.
 SHELL_FLAG(bool, csv, false, "Set output mode to 'csv'");
 SHELL_FLAG(bool, json, false, "Set output mode to 'json'");
+SHELL_FLAG(bool, jsonl, false, "Set output mode to 'jsonl'");
 SHELL_FLAG(bool, line, false, "Set output mode to 'line'");
 SHELL_FLAG(bool, list, false, "Set output mode to 'list'");
 SHELL_FLAG(string, separator, "|", "Set output field separator, default '|'");
@@ -94,6 +95,8 @@ static char zHelp[] =
     ".mode MODE       Set output mode where MODE is one of:\n"
     "                   csv      Comma-separated values\n"
     "                   column   Left-aligned columns see .width\n"
+    "                   json     A JSON array of row objects\n"
+    "                   jsonl    One JSON row object per line\n"
     "                   line     One value per line\n"
     "                   list     Values delimited by .separator string\n"
     "                   pretty   Pretty printed SQL results (default)\n"
@@ -118,9 +121,11 @@ static char zTimerHelp[] =
 #define MODE_Semi 3 // Same as MODE_List but append ";" to each line
 #define MODE_Csv 4 // Quote strings, numbers are plain
 #define MODE_Pretty 5 // Pretty print the SQL results
+#define MODE_Json 6 // A JSON array with one object per record
+#define MODE_JsonLines 7 // One JSON object per line
 
 static const char* modeDescr[] = {
-    "line", "column", "list", "semi", "csv", "pretty",
+    "line", "column", "list", "semi", "csv", "pretty", "json", "jsonl",
 };
 
 // ctype macros that work with signed characters
@@ -346,9 +351,7 @@ static char* one_input_line(FILE* in, char* zPrior, int isContinuation) {
 ** Pretty print structure
 */
 struct prettyprint_data {
-  osquery::QueryData results;
-  std::vector<std::string> columns;
-  std::map<std::string, size_t> lengths;
+  osquery::QueryDataColumns results;
 };
 
 /*
@@ -359,6 +362,7 @@ struct prettyprint_data {
 struct callback_data {
   int echoOn; /* True to echo input commands */
   int cnt; /* Number of records displayed so far */
+  int jsonCnt; /* Number of records written to the open JSON array */
   FILE* out; /* Write results here */
   FILE* traceOut; /* Output for sqlite3_trace() */
   int mode; /* An output mode setting */
@@ -517,22 +521,41 @@ static int shell_callback(
 
   switch (p->mode) {
   case MODE_Pretty: {
-    if (p->prettyPrint->columns.empty()) {
+    // Column widths depend on every row, keep the values by column.
+    auto& results = p->prettyPrint->results;
+    if (results.columns.empty()) {
       for (i = 0; i < nArg; i++) {
-        p->prettyPrint->columns.push_back(std::string(azCol[i]));
+        results.columns.push_back(azCol[i] != nullptr ? azCol[i] : "");
       }
+      results.values.resize(results.columns.size());
     }
 
-    osquery::Row r;
-    for (i = 0; i < nArg; ++i) {
-      if (azCol[i] != nullptr) {
-        r[std::string(azCol[i])] = (azArg[i] == nullptr)
-                                       ? osquery::FLAGS_nullvalue
-                                       : std::string(azArg[i]);
+    for (size_t column = 0; column < results.values.size(); column++) {
+      const char* value = nullptr;
+      if (static_cast<int>(column) < nArg) {
+        value = azArg[column];
       }
+      results.values[column].emplace_back(
+          (value == nullptr) ? osquery::FLAGS_nullvalue : value);
     }
-    osquery::computeRowLengths(r, p->prettyPrint->lengths);
-    p->prettyPrint->results.push_back(r);
+    break;
+  }
+  case MODE_Json: {
+    if (azArg == nullptr) {
+      break;
+    }
+    fprintf(p->out,
+            "%s  %s",
+            (p->jsonCnt++ == 0) ? "[\n" : ",\n",
+            osquery::generateJSONRow(nArg, azCol, azArg).c_str());
+    break;
+  }
+  case MODE_JsonLines: {
+    if (azArg == nullptr) {
+      break;
+    }
+    fprintf(
+        p->out, "%s\n", osquery::generateJSONRow(nArg, azCol, azArg).c_str());
     break;
   }
   case MODE_Line: {
@@ -909,16 +932,12 @@ static int shell_exec(
   dbc->clearAffectedTables();
 
   if ((pArg != nullptr) && pArg->mode == MODE_Pretty) {
-    if (osquery::FLAGS_json) {
-      osquery::jsonPrint(pArg->prettyPrint->results);
-    } else {
-      osquery::prettyPrint(pArg->prettyPrint->results,
-                           pArg->prettyPrint->columns,
-                           pArg->prettyPrint->lengths);
-    }
-    pArg->prettyPrint->results.clear();
-    pArg->prettyPrint->columns.clear();
-    pArg->prettyPrint->lengths.clear();
+    osquery::prettyPrint(pArg->prettyPrint->results);
+    pArg->prettyPrint->results = osquery::QueryDataColumns();
+  } else if ((pArg != nullptr) && pArg->mode == MODE_Json) {
+    // Rows were streamed as they were stepped, close the array.
+    fprintf(pArg->out, "%s\n]\n", (pArg->jsonCnt == 0) ? "[\n" : "");
+    pArg->jsonCnt = 0;
   }
 
   return rc;
@@ -1323,10 +1342,14 @@ static int do_meta_command(char* zLine, struct callback_data* p) {
     } else if (n2 == 3 && strncmp(azArg[1], "csv", n2) == 0) {
       p->mode = MODE_Csv;
       sqlite3_snprintf(sizeof(p->separator), p->separator, ",");
+    } else if (n2 == 4 && strncmp(azArg[1], "json", n2) == 0) {
+      p->mode = MODE_Json;
+    } else if (n2 == 5 && strncmp(azArg[1], "jsonl", n2) == 0) {
+      p->mode = MODE_JsonLines;
     } else {
       fprintf(stderr,
               "Error: mode should be one of: "
-              "column csv line list pretty\n");
+              "column csv json jsonl line list pretty\n");
       rc = 1;
     }
   } else if (c == 'n' && strncmp(azArg[0], "nullvalue", n) == 0 && nArg == 2) {
@@ -1690,6 +1713,10 @@ int launchIntoShell(int argc, char** argv) {
   } else if (FLAGS_csv) {
     data.mode = MODE_Csv;
     data.separator[0] = ',';
+  } else if (FLAGS_json) {
+    data.mode = MODE_Json;
+  } else if (FLAGS_jsonl) {
+    data.mode = MODE_JsonLines;
   } else {
     data.mode = MODE_Pretty;
   }
@@ -103,4 +103,28 @@ TEST_F(PrinterTests, test_unicode) {
   std::map<std::string, size_t> expected = {{"name", 10}};
   EXPECT_EQ(lengths, expected);
 }
+
+TEST_F(PrinterTests, test_generate_column_lengths) {
+  std::map<std::string, size_t> lengths;
+  for (const auto& row : q) {
+    computeRowLengths(row, lengths);
+  }
+
+  // The column-ordered lengths produce the same output as the map.
+  std::vector<size_t> ordered;
+  for (const auto& column : order) {
+    ordered.push_back(lengths.at(column));
+  }
+  EXPECT_EQ(generateToken(ordered), generateToken(lengths, order));
+  EXPECT_EQ(generateHeader(ordered, order), generateHeader(lengths, order));
+}
+
+TEST_F(PrinterTests, test_generate_json_row) {
+  const char* columns[] = {"name", "age", "quote"};
+  const char* values[] = {"Mike Jones", nullptr, "say \"hi\""};
+
+  auto results = generateJSONRow(3, columns, values);
+  auto expected = R"({"name":"Mike Jones","age":"","quote":"say \"hi\""})";
+  EXPECT_EQ(results, expected);
+}
 }
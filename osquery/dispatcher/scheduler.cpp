@@ -15,6 +15,7 @@
 #include <osquery/database.h>
 #include <osquery/flags.h>
 #include <osquery/logger.h>
+#include <osquery/numeric_monitoring.h>
 #include <osquery/query.h>
 #include <osquery/system.h>
 
@@ -88,17 +89,32 @@ SQLInternal monitor(const std::string& name, const ScheduledQuery& query) {
   return sql;
 }
 
-inline void launchQuery(const std::string& name, const ScheduledQuery& query) {
+inline void launchQuery(const std::string& name,
+                        const ScheduledQuery& query,
+                        size_t step) {
   // Execute the scheduled query and create a named query object.
   LOG(INFO) << "Executing scheduled query " << name << ": " << query.query;
-  runDecorators(DECORATE_ALWAYS);
+  // Decorations are computed once for the queries launched in this step.
+  runDecorators(DECORATE_ALWAYS, step);
 
+  auto start_time = std::chrono::steady_clock::now();
   auto sql = monitor(name, query);
+  const auto metric_path = "scheduler.query." + name;
+  monitoring::record(metric_path + ".duration_ms",
+                     std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start_time)
+                         .count(),
+                     monitoring::PreAggregationType::Histogram);
   if (!sql.ok()) {
     LOG(ERROR) << "Error executing scheduled query " << name << ": "
                << sql.getMessageString();
+    monitoring::record(
+        metric_path + ".errors", 1, monitoring::PreAggregationType::Sum);
     return;
   }
+  monitoring::record(metric_path + ".rows",
+                     sql.rows().size(),
+                     monitoring::PreAggregationType::Sum);
 
   // Fill in a host identifier fields based on configuration or availability.
   std::string ident = getHostIdentifier();
@@ -150,6 +166,10 @@ inline void launchQuery(const std::string& name, const ScheduledQuery& query) {
     diff_results.removed.clear();
   }
 
+  monitoring::record(metric_path + ".diff_rows",
+                     diff_results.added.size() + diff_results.removed.size(),
+                     monitoring::PreAggregationType::Sum);
+
   if (diff_results.added.empty() && diff_results.removed.empty()) {
     // No diff results or events to emit.
     return;
@@ -177,7 +197,7 @@ void SchedulerRunner::start() {
           if (query.splayed_interval > 0 && i % query.splayed_interval == 0) {
             TablePlugin::kCacheInterval = query.splayed_interval;
             TablePlugin::kCacheStep = i;
-            launchQuery(name, query);
+            launchQuery(name, query, i);
           }
         }));
     // Configuration decorators run on 60 second intervals only.
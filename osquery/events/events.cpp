@@ -21,6 +21,7 @@
 #include <osquery/events.h>
 #include <osquery/flags.h>
 #include <osquery/logger.h>
+#include <osquery/numeric_monitoring.h>
 #include <osquery/registry_factory.h>
 #include <osquery/sql.h>
 #include <osquery/system.h>
@@ -35,6 +36,12 @@ CREATE_REGISTRY(EventSubscriberPlugin, "event_subscriber");
 /// Checkpoint interval to inspect max event buffering.
 #define EVENTS_CHECKPOINT 256
 
+/// Only one in this many batches of a subscriber has its size recorded.
+const size_t kEventsMetricSampleRate = 16;
+
+/// Event counts are summed per subscriber and recorded at most this often.
+const std::chrono::milliseconds kEventsMetricInterval{1000};
+
 FLAG(bool, disable_events, false, "Disable osquery publish/subscribe system");
 
 FLAG(bool,
@@ -623,7 +630,40 @@ Status EventSubscriberPlugin::addBatch(std::vector<Row>& row_list,
     event_count_++;
   }
 
+  auto L_RecordBatch = [this, &row_list](size_t stored) {
+    if (!monitoring::isEnabled()) {
+      return;
+    }
+
+    metric_events_ += stored;
+    metric_dropped_ += row_list.size() - stored;
+    if (metric_batches_++ % kEventsMetricSampleRate == 0) {
+      monitoring::record("events." + getName() + ".batch_size",
+                         row_list.size(),
+                         monitoring::PreAggregationType::Histogram);
+    }
+
+    // A single caller records the sums of the interval.
+    auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+    auto last = metric_record_time_.load();
+    if (now - last < kEventsMetricInterval.count() ||
+        !metric_record_time_.compare_exchange_strong(last, now)) {
+      return;
+    }
+
+    const auto metric_path = "events." + getName();
+    monitoring::record(metric_path + ".events",
+                       metric_events_.exchange(0),
+                       monitoring::PreAggregationType::Sum);
+    monitoring::record(metric_path + ".dropped",
+                       metric_dropped_.exchange(0),
+                       monitoring::PreAggregationType::Sum);
+  };
+
   if (database_data.empty()) {
+    L_RecordBatch(0);
     return Status(1, "Failed to process the rows");
   }
 
@@ -636,9 +676,11 @@ Status EventSubscriberPlugin::addBatch(std::vector<Row>& row_list,
   // Save the batched data inside the database
   auto status = setDatabaseBatch(kEvents, database_data);
   if (!status.ok()) {
+    L_RecordBatch(0);
     return status;
   }
 
+  L_RecordBatch(database_data.size());
   return recordEvents(event_id_list, event_time);
 }
 
@@ -707,6 +749,16 @@ void EventFactory::forwardEvent(const std::string& event) {
 }
 
 void EventFactory::configUpdate() {
+  scheduleUpdate();
+
+  // If events are enabled configure the subscribers before publishers.
+  if (!FLAGS_disable_events) {
+    RegistryFactory::get().registry("event_subscriber")->configure();
+    RegistryFactory::get().registry("event_publisher")->configure();
+  }
+}
+
+void EventFactory::scheduleUpdate() {
   // Scan the schedule for queries that touch "_events" tables.
   // We will count the queries
   std::map<std::string, SubscriberExpirationDetails> subscriber_details;
@@ -758,12 +810,6 @@ void EventFactory::configUpdate() {
     WriteLock subscriber_lock(subscriber->event_query_record_);
     subscriber->queries_.clear();
   }
-
-  // If events are enabled configure the subscribers before publishers.
-  if (!FLAGS_disable_events) {
-    RegistryFactory::get().registry("event_subscriber")->configure();
-    RegistryFactory::get().registry("event_publisher")->configure();
-  }
 }
 
 Status EventFactory::run(const std::string& type_id) {
@@ -10,19 +10,26 @@
 
 #include <linux/audit.h>
 #include <poll.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
 
 #include <boost/utility/string_ref.hpp>
 
 #include <osquery/flags.h>
 #include <osquery/logger.h>
+#include <osquery/numeric_monitoring.h>
 
 #include "osquery/core/conversions.h"
 #include "osquery/events/linux/auditdnetlink.h"
+#include "osquery/events/linux/auditfilter.h"
 #include "osquery/tables/events/linux/process_events.h"
 #include "osquery/tables/events/linux/process_file_events.h"
 #include "osquery/tables/events/linux/selinux_events.h"
@@ -54,6 +61,12 @@ FLAG(bool,
      false,
      "Configure the audit subsystem from scratch");
 
+/// Audit records are parsed by several threads, sharded by audit event id
+HIDDEN_FLAG(uint64,
+            audit_parser_threads,
+            0,
+            "Number of audit record parser threads (0 selects automatically)");
+
 // External flags; they are used to determine which rules need to be installed
 DECLARE_bool(audit_allow_fim_events);
 DECLARE_bool(audit_allow_process_events);
@@ -64,6 +77,51 @@ DECLARE_bool(audit_allow_selinux_events);
 // user messages should be filtered
 // also, we should handle the 2nd user message type
 namespace {
+/// Number of netlink messages received with a single recvmmsg call
+const std::size_t kAuditReplyBatchSize = 64U;
+
+/// Maximum number of messages read before the reader checks the handle
+const std::size_t kAuditMaxRecordsPerRead = 4096U;
+
+/// Maximum number of parsed batches kept around for reuse
+const std::size_t kAuditMaxFreeReplyBatches = 8U;
+
+/// Upper bound of the automatically selected parser thread count
+const std::size_t kAuditMaxAutoParserThreads = 4U;
+
+std::size_t GetAuditParserThreadCount() noexcept {
+  if (FLAGS_audit_parser_threads != 0) {
+    return static_cast<std::size_t>(FLAGS_audit_parser_threads);
+  }
+
+  // Leave half of the cores to the reader, the publisher and everything else
+  std::size_t thread_count = std::thread::hardware_concurrency() / 2U;
+  return std::max<std::size_t>(
+      1U, std::min(thread_count, kAuditMaxAutoParserThreads));
+}
+
+/// Selects the parser shard for a record, by audit event id
+std::size_t GetAuditRecordShard(const audit_reply& reply,
+                                std::size_t shard_count) noexcept {
+  if (shard_count <= 1U || reply.message == nullptr) {
+    return 0U;
+  }
+
+  unsigned long int time = 0U;
+  std::uint64_t audit_id = 0U;
+  std::size_t preamble_size = 0U;
+
+  boost::string_ref message_view(reply.message,
+                                 static_cast<unsigned int>(reply.len));
+  if (!AuditdNetlinkParser::ParseAuditPreamble(
+          message_view, time, audit_id, preamble_size)) {
+    return 0U;
+  }
+
+  // The serial number alone spreads events evenly across shards
+  return static_cast<std::size_t>(audit_id & 0xFFFFFFFFULL) % shard_count;
+}
+
 bool IsSELinuxRecord(const audit_reply& reply) noexcept {
   static const auto& selinux_event_set = SELinuxEventSubscriber::GetEventSet();
   return (selinux_event_set.find(reply.type) != selinux_event_set.end());
@@ -103,11 +161,16 @@ AuditdNetlink::AuditdNetlink() {
   try {
     auditd_context_ = std::make_shared<AuditdContext>();
 
+    auto parser_thread_count = GetAuditParserThreadCount();
+    auditd_context_->unprocessed_records.resize(parser_thread_count);
+
     Dispatcher::addService(
         std::make_shared<AuditdNetlinkReader>(auditd_context_));
 
-    Dispatcher::addService(
-        std::make_shared<AuditdNetlinkParser>(auditd_context_));
+    for (std::size_t i = 0U; i < parser_thread_count; ++i) {
+      Dispatcher::addService(
+          std::make_shared<AuditdNetlinkParser>(auditd_context_, i));
+    }
 
   } catch (const std::bad_alloc&) {
     VLOG(1) << "Failed to initialize the AuditdNetlink services due to a "
@@ -117,33 +180,33 @@ AuditdNetlink::AuditdNetlink() {
 }
 
 std::vector<AuditEventRecord> AuditdNetlink::getEvents() noexcept {
-  std::vector<AuditEventRecord> record_list;
+  auto& processed_events = auditd_context_->processed_events;
 
-  {
+  if (processed_events.empty()) {
     std::unique_lock<std::mutex> queue_lock(
         auditd_context_->processed_events_mutex);
 
-    if (auditd_context_->processed_records_cv.wait_for(
-            queue_lock, std::chrono::seconds(1)) ==
-        std::cv_status::no_timeout) {
-      record_list = std::move(auditd_context_->processed_events);
-      auditd_context_->processed_events.clear();
-    }
+    auditd_context_->processed_records_cv.wait_for(
+        queue_lock, std::chrono::seconds(1), [&processed_events]() {
+          return !processed_events.empty();
+        });
   }
 
-  return record_list;
+  return processed_events.takeAll();
+}
+
+void AuditdNetlink::reloadRules() noexcept {
+  auditd_context_->reload_rules = true;
 }
 
 AuditdNetlinkReader::AuditdNetlinkReader(AuditdContextRef context)
     : InternalRunnable("AuditdNetlinkReader"),
       auditd_context_(std::move(context)) {
-  const size_t read_buffer_size = 4096U;
+  message_header_list_.resize(kAuditReplyBatchSize);
+  message_iovec_list_.resize(kAuditReplyBatchSize);
+  message_address_list_.resize(kAuditReplyBatchSize);
 
-  read_buffer_.resize(read_buffer_size);
-  if (read_buffer_.size() != read_buffer_size) {
-    LOG(ERROR) << "Memory allocation error";
-    throw std::bad_alloc();
-  }
+  read_batch_ = acquireBatch();
 }
 
 void AuditdNetlinkReader::start() {
@@ -168,6 +231,11 @@ void AuditdNetlinkReader::start() {
       counter_to_next_status_request = status_request_countdown;
     }
 
+    // Rules installed from an older filter could keep suppressing records
+    if (auditd_context_->reload_rules.exchange(false)) {
+      reinstallSyscallRules();
+    }
+
     if (counter_to_next_status_request == 0) {
       errno = 0;
 
@@ -212,17 +280,12 @@ void AuditdNetlinkReader::stop() {
 bool AuditdNetlinkReader::acquireMessages() noexcept {
   pollfd fds[] = {{audit_netlink_handle_, POLLIN, 0}};
 
-  struct sockaddr_nl nladdr = {};
-  socklen_t nladdrlen = sizeof(nladdr);
-
   bool reset_handle = false;
   size_t events_received = 0;
 
   // Attempt to read as many messages as possible before we exit, and terminate
   // early if we have been asked to terminate
-  for (events_received = 0;
-       !interrupted() && events_received < read_buffer_.size();
-       events_received++) {
+  while (!interrupted() && events_received < kAuditMaxRecordsPerRead) {
     errno = 0;
     int poll_status = ::poll(fds, 1, 2000);
     if (poll_status == 0) {
@@ -242,67 +305,220 @@ bool AuditdNetlinkReader::acquireMessages() noexcept {
       break;
     }
 
-    audit_reply reply = {};
-    ssize_t len = recvfrom(audit_netlink_handle_,
-                           &reply.msg,
-                           sizeof(reply.msg),
-                           0,
-                           reinterpret_cast<struct sockaddr*>(&nladdr),
-                           &nladdrlen);
-
-    if (len < 0) {
-      VLOG(1) << "Failed to receive data from the audit netlink";
+    try {
+      if (read_batch_ == nullptr) {
+        read_batch_ = acquireBatch();
+      }
+    } catch (const std::bad_alloc&) {
+      LOG(ERROR) << "Memory allocation error";
       reset_handle = true;
       break;
     }
 
-    if (nladdrlen != sizeof(nladdr)) {
-      VLOG(1) << "Protocol error";
+    auto capacity = read_batch_->reply_list.size() - read_batch_->count;
+
+    size_t received = 0;
+    if (!receiveBatch(*read_batch_, received)) {
       reset_handle = true;
+    }
+    events_received += received;
+
+    // Hand off full batches, and partial ones once the socket is drained
+    if (reset_handle || received < capacity ||
+        read_batch_->count == read_batch_->reply_list.size()) {
+      publishBatch(read_batch_);
+    }
+
+    if (reset_handle) {
       break;
     }
+  }
 
-    if (nladdr.nl_pid) {
+  if (read_batch_ != nullptr) {
+    publishBatch(read_batch_);
+  }
+
+  if (events_received > 0) {
+    monitoring::record("audit.netlink.records",
+                       events_received,
+                       monitoring::PreAggregationType::Sum);
+  }
+
+  if (reset_handle) {
+    VLOG(1) << "Requesting audit handle reset";
+    return false;
+  }
+
+  return true;
+}
+
+bool AuditdNetlinkReader::receiveBatch(AuditReplyBatch& batch,
+                                       size_t& received) noexcept {
+  received = 0;
+
+  auto capacity = batch.reply_list.size() - batch.count;
+  if (capacity > message_header_list_.size()) {
+    capacity = message_header_list_.size();
+  }
+
+  // Every message is received directly into its final audit_reply slot
+  for (size_t i = 0; i < capacity; ++i) {
+    auto& reply = batch.reply_list[batch.count + i];
+    message_iovec_list_[i] = {&reply.msg, sizeof(reply.msg)};
+    message_address_list_[i] = {};
+
+    auto& header = message_header_list_[i];
+    header = {};
+    header.msg_hdr.msg_name = &message_address_list_[i];
+    header.msg_hdr.msg_namelen = sizeof(struct sockaddr_nl);
+    header.msg_hdr.msg_iov = &message_iovec_list_[i];
+    header.msg_hdr.msg_iovlen = 1;
+  }
+
+  int message_count = 0;
+  do {
+    errno = 0;
+    message_count = recvmmsg(audit_netlink_handle_,
+                             message_header_list_.data(),
+                             static_cast<unsigned int>(capacity),
+                             MSG_DONTWAIT,
+                             nullptr);
+  } while (message_count < 0 && errno == EINTR);
+
+  if (message_count < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      return true;
+    }
+
+    // The kernel dropped messages; keep reading to drain the backlog
+    if (errno == ENOBUFS) {
+      VLOG(1) << "The audit netlink receive buffer has overflowed";
+      monitoring::record("audit.netlink.overflows",
+                         1,
+                         monitoring::PreAggregationType::Sum);
+      return true;
+    }
+
+    VLOG(1) << "Failed to receive data from the audit netlink";
+    return false;
+  }
+
+  for (int i = 0; i < message_count; ++i) {
+    const auto& header = message_header_list_[i];
+    auto& reply = batch.reply_list[batch.count];
+
+    if (header.msg_hdr.msg_namelen != sizeof(struct sockaddr_nl)) {
+      VLOG(1) << "Protocol error";
+      return false;
+    }
+
+    if (message_address_list_[i].nl_pid) {
       VLOG(1) << "Invalid netlink endpoint";
-      reset_handle = true;
-      break;
+      return false;
     }
 
-    if (!NLMSG_OK(&reply.msg.nlh, static_cast<unsigned int>(len))) {
-      if (len == sizeof(reply.msg)) {
+    if (!NLMSG_OK(&reply.msg.nlh, header.msg_len)) {
+      if (header.msg_len == sizeof(reply.msg)) {
         VLOG(1) << "Netlink event too big (EFBIG)";
       } else {
         VLOG(1) << "Broken netlink event (EBADE)";
       }
 
-      reset_handle = true;
-      break;
+      return false;
     }
 
-    read_buffer_[events_received] = reply;
+    batch.count++;
+    received++;
   }
 
-  if (events_received != 0) {
-    std::unique_lock<std::mutex> lock(
+  return true;
+}
+
+AuditReplyBatchRef AuditdNetlinkReader::acquireBatch() {
+  {
+    std::lock_guard<std::mutex> lock(
         auditd_context_->unprocessed_records_mutex);
 
-    auditd_context_->unprocessed_records.reserve(
-        auditd_context_->unprocessed_records.size() + events_received);
+    auto& free_batches = auditd_context_->free_reply_batches;
+    if (!free_batches.empty()) {
+      auto batch = std::move(free_batches.back());
+      free_batches.pop_back();
+      return batch;
+    }
+  }
 
-    auditd_context_->unprocessed_records.insert(
-        auditd_context_->unprocessed_records.end(),
-        read_buffer_.begin(),
-        std::next(read_buffer_.begin(), events_received));
+  auto batch = std::make_shared<AuditReplyBatch>();
+  batch->reply_list.resize(kAuditReplyBatchSize);
+  return batch;
+}
 
-    auditd_context_->unprocessed_records_cv.notify_all();
+void AuditdNetlinkReader::publishBatch(AuditReplyBatchRef& batch) {
+  if (batch->count == 0) {
+    return;
   }
 
-  if (reset_handle) {
-    VLOG(1) << "Requesting audit handle reset";
-    return false;
+  // A partially filled batch would pin every one of its slots until the
+  // parsers are done; hand off a copy of the used slots and keep reading
+  // into the full-size storage instead
+  AuditReplyBatchRef published;
+  if (batch->count < batch->reply_list.size()) {
+    try {
+      published = std::make_shared<AuditReplyBatch>();
+      published->reply_list.assign(
+          batch->reply_list.begin(),
+          batch->reply_list.begin() +
+              static_cast<std::ptrdiff_t>(batch->count));
+      published->count = batch->count;
+    } catch (const std::bad_alloc&) {
+      LOG(ERROR) << "Memory allocation error";
+      published = batch;
+    }
+  } else {
+    published = batch;
   }
 
-  return true;
+  // Every shard parses its records into the batch's own slots
+  try {
+    published->record_list.clear();
+    published->record_list.resize(published->count);
+    published->parsed_list.assign(published->count, 0U);
+    published->shard_list.resize(published->count);
+  } catch (const std::bad_alloc&) {
+    LOG(ERROR) << "Memory allocation error, dropping audit records";
+    batch->count = 0;
+    return;
+  }
+
+  // Prepare the records and pick their shards once, parser shards only read
+  // them
+  const auto shard_count = auditd_context_->unprocessed_records.size();
+  for (size_t i = 0; i < published->count; ++i) {
+    auto& reply = published->reply_list[i];
+    AuditdNetlinkParser::AdjustAuditReply(reply);
+    published->shard_list[i] = GetAuditRecordShard(reply, shard_count);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(
+        auditd_context_->unprocessed_records_mutex);
+
+    published->sequence = auditd_context_->next_batch_sequence++;
+
+    auto& shard_queues = auditd_context_->unprocessed_records;
+    published->pending_shards = shard_queues.size();
+    for (auto& shard_queue : shard_queues) {
+      shard_queue.push_back(published);
+    }
+
+    auditd_context_->unprocessed_records_cv.notify_all();
+  }
+
+  if (published == batch) {
+    // The next read takes a recycled batch
+    batch.reset();
+  } else {
+    batch->count = 0;
+  }
 }
 
 bool AuditdNetlinkReader::configureAuditService() noexcept {
@@ -327,7 +543,7 @@ bool AuditdNetlinkReader::configureAuditService() noexcept {
     VLOG(1) << "Enabling audit rules for the socket_events table";
 
     for (int syscall : SocketEventSubscriber::GetSyscallSet()) {
-      monitored_syscall_list_.insert(syscall);
+      monitored_syscall_list_.insert({syscall, "socket_events"});
     }
   }
 
@@ -336,7 +552,7 @@ bool AuditdNetlinkReader::configureAuditService() noexcept {
     VLOG(1) << "Enabling audit rules for the process_events table";
 
     for (int syscall : AuditProcessEventSubscriber::GetSyscallSet()) {
-      monitored_syscall_list_.insert(syscall);
+      monitored_syscall_list_.insert({syscall, "process_events"});
     }
   }
 
@@ -345,55 +561,152 @@ bool AuditdNetlinkReader::configureAuditService() noexcept {
     VLOG(1) << "Enabling audit rules for the process_file_events table";
 
     for (int syscall : ProcessFileEventSubscriber::GetSyscallSet()) {
-      monitored_syscall_list_.insert(syscall);
+      monitored_syscall_list_.insert({syscall, "process_file_events"});
     }
   }
 
   // Attempt to add each one of the rules we collected
-  for (int syscall_number : monitored_syscall_list_) {
-    audit_rule_data rule = {};
-    audit_rule_syscall_data(&rule, syscall_number);
-
-    // clang-format off
-    int rule_add_error = audit_add_rule_data(audit_netlink_handle_, &rule,
-      // We want to be notified when we exit from the syscall
-      AUDIT_FILTER_EXIT,
-
-      // Always audit this syscall event
-      AUDIT_ALWAYS
-    );
-    // clang-format on
-
-    // When exiting, don't remove the rules that were already installed, unless
-    // we have been asked to
-    if (rule_add_error >= 0) {
-      if (FLAGS_audit_debug) {
-        std::cout << "Audit rule installed for syscall " << syscall_number
-                  << std::endl;
-      }
+  for (const auto& syscall : monitored_syscall_list_) {
+    installSyscallRules(syscall.first, syscall.second);
+  }
 
-      installed_rule_list_.push_back(rule);
+  return true;
+}
+
+void AuditdNetlinkReader::installSyscallRules(int syscall_number,
+                                              const std::string& table_name) {
+  AuditRuleDataObject base_rule(sizeof(audit_rule_data), 0U);
+  audit_rule_syscall_data(
+      reinterpret_cast<audit_rule_data*>(base_rule.data()), syscall_number);
+
+  // Each syscall belongs to a single table, so its filters can be moved
+  // into the kernel; rules with fields the kernel doesn't know are only
+  // evaluated by the table
+  auto filter = GetAuditTableFilter(table_name);
+
+  for (const auto& exclude_rule : filter->exclude_list) {
+    bool kernel_rule = std::all_of(exclude_rule.begin(),
+                                   exclude_rule.end(),
+                                   IsKernelAuditFilterCondition);
+    if (!kernel_rule) {
       continue;
     }
 
-    if (FLAGS_audit_debug) {
-      std::cout << "Audit rule for syscall " << syscall_number
-                << " could not be installed. Errno: " << (-errno) << std::endl;
+    // Exclusions must be evaluated before the rules that enable auditing
+    auto rule_object = base_rule;
+    if (AppendAuditRuleConditions(rule_object, exclude_rule)) {
+      installAuditRule(rule_object,
+                       AUDIT_FILTER_EXIT | AUDIT_FILTER_PREPEND,
+                       AUDIT_NEVER,
+                       syscall_number);
     }
+  }
 
-    if (FLAGS_audit_force_unconfigure) {
-      installed_rule_list_.push_back(rule);
+  // Inclusions become one rule each, holding the conditions the kernel
+  // supports; the table then checks the remaining ones
+  bool filtered_rules = !filter->include_list.empty();
+  for (const auto& include_rule : filter->include_list) {
+    if (std::none_of(include_rule.begin(),
+                     include_rule.end(),
+                     IsKernelAuditFilterCondition)) {
+      filtered_rules = false;
+      break;
     }
+  }
+
+  if (filtered_rules) {
+    for (const auto& include_rule : filter->include_list) {
+      auto rule_object = base_rule;
+      if (!AppendAuditRuleConditions(rule_object, include_rule) ||
+          !installAuditRule(
+              rule_object, AUDIT_FILTER_EXIT, AUDIT_ALWAYS, syscall_number)) {
+        filtered_rules = false;
+        break;
+      }
+    }
+
+    if (filtered_rules) {
+      return;
+    }
+
+    VLOG(1) << "Falling back to unfiltered audit rules for syscall "
+            << syscall_number;
+  }
 
-    rule_add_error = -rule_add_error;
+  installAuditRule(base_rule, AUDIT_FILTER_EXIT, AUDIT_ALWAYS, syscall_number);
+}
+
+void AuditdNetlinkReader::reinstallSyscallRules() noexcept {
+  if (audit_netlink_handle_ == -1 || monitored_syscall_list_.empty()) {
+    return;
+  }
+
+  VLOG(1) << "The audit filters have changed, reinstalling the audit rules";
+
+  for (auto& installed_rule : installed_rule_list_) {
+    auto rule =
+        reinterpret_cast<audit_rule_data*>(installed_rule.rule_object.data());
+
+    audit_delete_rule_data(audit_netlink_handle_,
+                           rule,
+                           installed_rule.flags,
+                           installed_rule.action);
+  }
+
+  installed_rule_list_.clear();
+
+  try {
+    for (const auto& syscall : monitored_syscall_list_) {
+      installSyscallRules(syscall.first, syscall.second);
+    }
+  } catch (const std::bad_alloc&) {
+    LOG(ERROR) << "Memory allocation error, requesting an audit handle reset";
+    auditd_context_->acquire_handle = true;
+  }
+}
 
-    if (rule_add_error != EEXIST) {
-      VLOG(1) << "The following syscall number could not be added to the audit "
-                 "service rules: "
-              << syscall_number << ". Some of the auditd "
-              << "table may not work properly (process_events, "
-              << "socket_events, process_file_events, user_events)";
+bool AuditdNetlinkReader::installAuditRule(
+    const AuditRuleDataObject& rule_object,
+    int flags,
+    int action,
+    int syscall_number) {
+  AuditInstalledRule installed_rule = {rule_object, flags, action};
+  auto rule =
+      reinterpret_cast<audit_rule_data*>(installed_rule.rule_object.data());
+
+  int rule_add_error =
+      audit_add_rule_data(audit_netlink_handle_, rule, flags, action);
+
+  // When exiting, don't remove the rules that were already installed, unless
+  // we have been asked to
+  if (rule_add_error >= 0) {
+    if (FLAGS_audit_debug) {
+      std::cout << "Audit rule installed for syscall " << syscall_number
+                << std::endl;
     }
+
+    installed_rule_list_.push_back(std::move(installed_rule));
+    return true;
+  }
+
+  if (FLAGS_audit_debug) {
+    std::cout << "Audit rule for syscall " << syscall_number
+              << " could not be installed. Errno: " << (-errno) << std::endl;
+  }
+
+  if (FLAGS_audit_force_unconfigure) {
+    installed_rule_list_.push_back(std::move(installed_rule));
+  }
+
+  rule_add_error = -rule_add_error;
+
+  if (rule_add_error != EEXIST) {
+    VLOG(1) << "The following syscall number could not be added to the audit "
+               "service rules: "
+            << syscall_number << ". Some of the auditd "
+            << "table may not work properly (process_events, "
+            << "socket_events, process_file_events, user_events)";
+    return false;
   }
 
   return true;
@@ -557,9 +870,14 @@ void AuditdNetlinkReader::restoreAuditServiceConfiguration() noexcept {
   // Remove the rules we have added
   VLOG(1) << "Uninstalling the audit rules we have installed";
 
-  for (auto& rule : installed_rule_list_) {
-    audit_delete_rule_data(
-        audit_netlink_handle_, &rule, AUDIT_FILTER_EXIT, AUDIT_ALWAYS);
+  for (auto& installed_rule : installed_rule_list_) {
+    auto rule =
+        reinterpret_cast<audit_rule_data*>(installed_rule.rule_object.data());
+
+    audit_delete_rule_data(audit_netlink_handle_,
+                           rule,
+                           installed_rule.flags,
+                           installed_rule.action);
   }
 
   installed_rule_list_.clear();
@@ -668,90 +986,184 @@ NetlinkStatus AuditdNetlinkReader::acquireHandle() noexcept {
   return NetlinkStatus::ActiveMutable;
 }
 
-AuditdNetlinkParser::AuditdNetlinkParser(AuditdContextRef context)
+AuditdNetlinkParser::AuditdNetlinkParser(AuditdContextRef context,
+                                         std::size_t shard_index)
     : InternalRunnable("AuditdNetlinkParser"),
-      auditd_context_(std::move(context)) {}
+      auditd_context_(std::move(context)),
+      shard_index_(shard_index) {}
 
 void AuditdNetlinkParser::start() {
   while (!interrupted()) {
-    std::vector<audit_reply> queue;
+    std::vector<AuditReplyBatchRef> batch_list;
 
     {
       std::unique_lock<std::mutex> lock(
           auditd_context_->unprocessed_records_mutex);
 
-      while (auditd_context_->unprocessed_records.empty() && !interrupted()) {
+      auto& shard_queue = auditd_context_->unprocessed_records[shard_index_];
+      while (shard_queue.empty() && !interrupted()) {
         auditd_context_->unprocessed_records_cv.wait(lock);
       }
 
-      queue = std::move(auditd_context_->unprocessed_records);
-      auditd_context_->unprocessed_records.clear();
+      batch_list = std::move(shard_queue);
+      shard_queue.clear();
     }
 
-    std::vector<AuditEventRecord> audit_event_record_queue;
-    audit_event_record_queue.reserve(queue.size());
-
-    for (auto& reply : queue) {
-      if (interrupted()) {
-        break;
-      }
+    for (const auto& batch : batch_list) {
+      for (size_t i = 0; i < batch->count && !interrupted(); ++i) {
+        const auto& reply = batch->reply_list[i];
 
-      AdjustAuditReply(reply);
+        // This record carries the process id of the controlling daemon; in
+        // case we lost control of the audit service, we are going to request
+        // a reset as soon as we finish processing the pending queue
+        if (reply.type == AUDIT_GET) {
+          if (shard_index_ != 0U) {
+            continue;
+          }
 
-      // This record carries the process id of the controlling daemon; in case
-      // we lost control of the audit service, we are going to request a reset
-      // as soon as we finish processing the pending queue
-      if (reply.type == AUDIT_GET) {
-        reply.status = static_cast<struct audit_status*>(NLMSG_DATA(reply.nlh));
-        auto new_pid = static_cast<pid_t>(reply.status->pid);
+          auto status =
+              static_cast<struct audit_status*>(NLMSG_DATA(reply.nlh));
+          auto new_pid = static_cast<pid_t>(status->pid);
 
-        if (new_pid != getpid()) {
-          VLOG(1) << "Audit control lost to pid: " << new_pid;
+          if (new_pid != getpid()) {
+            VLOG(1) << "Audit control lost to pid: " << new_pid;
 
-          if (FLAGS_audit_persist) {
-            VLOG(1) << "Attempting to reacquire control of the audit service";
-            auditd_context_->acquire_handle = true;
+            if (FLAGS_audit_persist) {
+              VLOG(1)
+                  << "Attempting to reacquire control of the audit service";
+              auditd_context_->acquire_handle = true;
+            }
           }
+
+          continue;
         }
 
-        continue;
-      }
+        // We are not interested in all messages; only get the ones related
+        // to user events, syscalls and SELinux events
+        if (!ShouldHandle(reply)) {
+          continue;
+        }
 
-      // We are not interested in all messages; only get the ones related to
-      // user events, syscalls and SELinux events
-      if (!ShouldHandle(reply)) {
-        continue;
-      }
+        // Every record of an event is handled by the same shard
+        if (batch->shard_list[i] != shard_index_) {
+          continue;
+        }
 
-      AuditEventRecord audit_event_record = {};
-      if (!ParseAuditReply(reply, audit_event_record)) {
-        VLOG(1) << "Malformed audit record received";
-        continue;
+        // Records are parsed in place so that the last shard can release
+        // them in the order they were read
+        auto& audit_event_record = batch->record_list[i];
+        if (!ParseAuditReply(reply, audit_event_record)) {
+          VLOG(1) << "Malformed audit record received";
+          audit_event_record = {};
+          continue;
+        }
+
+        batch->parsed_list[i] = 1U;
       }
+    }
 
-      audit_event_record_queue.push_back(audit_event_record);
+    for (auto& batch : batch_list) {
+      releaseBatch(batch);
     }
+  }
+}
 
-    // Save the new records and notify the reader
-    if (!audit_event_record_queue.empty()) {
+void AuditdNetlinkParser::releaseBatch(AuditReplyBatchRef& batch) {
+  if (batch->pending_shards.fetch_sub(1U) != 1U) {
+    return;
+  }
+
+  // This was the last shard; save the new records and notify the reader
+  std::vector<AuditEventRecord> record_list;
+  for (size_t i = 0; i < batch->count; ++i) {
+    if (batch->parsed_list[i] != 0U) {
+      record_list.push_back(std::move(batch->record_list[i]));
+    }
+  }
+
+  auto& processed_events = auditd_context_->processed_events;
+  processed_events.push(batch->sequence, std::move(record_list));
+
+  if (!processed_events.empty()) {
+    // Synchronize with a consumer that is about to wait
+    {
       std::lock_guard<std::mutex> queue_lock(
           auditd_context_->processed_events_mutex);
+    }
 
-      auditd_context_->processed_events.reserve(
-          auditd_context_->processed_events.size() +
-          audit_event_record_queue.size());
+    auditd_context_->processed_records_cv.notify_all();
+  }
+
+  // Return the raw record storage to the reader
+  std::lock_guard<std::mutex> lock(auditd_context_->unprocessed_records_mutex);
 
-      auditd_context_->processed_events.insert(
-          auditd_context_->processed_events.end(),
-          audit_event_record_queue.begin(),
-          audit_event_record_queue.end());
+  // Only full-size batches are worth keeping; copies of partial reads are
+  // sized to their contents
+  auto& free_batches = auditd_context_->free_reply_batches;
+  if (batch->reply_list.size() == kAuditReplyBatchSize &&
+      free_batches.size() < kAuditMaxFreeReplyBatches) {
+    batch->count = 0;
+    free_batches.push_back(std::move(batch));
+  }
+}
 
-      auditd_context_->processed_records_cv.notify_all();
+bool AuditdNetlinkParser::ParseAuditPreamble(
+    boost::string_ref message,
+    unsigned long int& time,
+    std::uint64_t& audit_id,
+    std::size_t& preamble_size) noexcept {
+  static const boost::string_ref kPreambleStart("audit(");
+  static const boost::string_ref kPreambleEnd("): ");
+
+  if (!message.starts_with(kPreambleStart)) {
+    return false;
+  }
+
+  auto preamble_end = message.find(kPreambleEnd);
+  if (preamble_end == boost::string_ref::npos) {
+    return false;
+  }
+
+  // Decode the digits in place: "<time>.<msec>:<serial>"
+  std::uint64_t seconds = 0U;
+  std::uint64_t serial = 0U;
+  std::uint64_t* current_value = &seconds;
+  bool found_serial = false;
+
+  for (auto i = kPreambleStart.size(); i < preamble_end; ++i) {
+    auto c = message[i];
+
+    if (c >= '0' && c <= '9') {
+      *current_value = (*current_value * 10U) + static_cast<unsigned>(c - '0');
+
+    } else if (c == '.' && current_value == &seconds) {
+      // Milliseconds are not part of the id
+      current_value = nullptr;
+      while (i + 1 < preamble_end && message[i + 1] != ':') {
+        ++i;
+      }
+
+    } else if (c == ':' && !found_serial) {
+      found_serial = true;
+      current_value = &serial;
+
+    } else {
+      return false;
     }
 
-    queue.clear();
-    audit_event_record_queue.clear();
+    if (current_value == nullptr && (i + 1 >= preamble_end)) {
+      return false;
+    }
   }
+
+  if (!found_serial) {
+    return false;
+  }
+
+  time = static_cast<unsigned long int>(seconds);
+  audit_id = (seconds << 32U) | (serial & 0xFFFFFFFFULL);
+  preamble_size = preamble_end + kPreambleEnd.size();
+  return true;
 }
 
 bool AuditdNetlinkParser::ParseAuditReply(
@@ -768,56 +1180,74 @@ bool AuditdNetlinkParser::ParseAuditReply(
   boost::string_ref message_view(reply.message,
                                  static_cast<unsigned int>(reply.len));
 
-  auto preamble_end = message_view.find("): ");
-  if (preamble_end == std::string::npos) {
-    return false;
+  // Reply buffers are reused; never read past the message terminator
+  auto message_end = message_view.find('\0');
+  if (message_end != boost::string_ref::npos) {
+    message_view = message_view.substr(0, message_end);
   }
 
-  safeStrtoul(message_view.substr(6, 10).to_string(), 10, event_record.time);
-  event_record.audit_id = message_view.substr(6, preamble_end - 6).to_string();
+  std::size_t preamble_size = 0U;
+  if (!ParseAuditPreamble(message_view,
+                          event_record.time,
+                          event_record.audit_id,
+                          preamble_size)) {
+    return false;
+  }
 
   // SELinux doesn't output valid audit records; just save them as they are
   if (IsSELinuxRecord(reply)) {
-    event_record.raw_data = reply.message;
+    event_record.raw_data = message_view.to_string();
     return true;
   }
 
-  // Tokenize the message
-  boost::string_ref field_view(message_view.substr(preamble_end + 3));
+  // Copy the field text once, every key and value is a view into it
+  boost::string_ref field_view(message_view.substr(preamble_size));
 
-  // The linear search will construct series of key value pairs.
-  std::string key, value;
-  key.reserve(20);
-  value.reserve(256);
+  std::shared_ptr<const std::string> text;
+  try {
+    text = std::make_shared<const std::string>(field_view.data(),
+                                               field_view.size());
+  } catch (const std::bad_alloc&) {
+    return false;
+  }
+
+  event_record.fields.reset(text);
+
+  // The linear search will find series of key value pairs.
+  const char* data = text->data();
+  std::size_t key_begin = 0U;
+  std::size_t key_size = 0U;
+  std::size_t value_begin = 0U;
+  std::size_t value_size = 0U;
 
   // There are several ways of representing value data (enclosed strings,
   // etc).
   bool found_assignment{false};
   bool found_enclose{false};
 
-  for (const auto& c : field_view) {
+  for (std::size_t i = 0U; i < text->size(); ++i) {
+    auto c = data[i];
+
     // Iterate over each character in the audit message.
     if ((found_enclose && c == '"') || (!found_enclose && c == ' ')) {
       if (c == '"') {
-        value += c;
+        ++value_size;
       }
 
       // This is a terminating sequence, the end of an enclosure or space
       // tok.
-      if (!key.empty()) {
+      if (key_size != 0U) {
         // Multiple space tokens are supported.
-        event_record.fields.emplace(
-            std::make_pair(std::move(key), std::move(value)));
+        event_record.fields.add(
+            boost::string_ref(data + key_begin, key_size),
+            boost::string_ref(data + value_begin, value_size));
       }
 
       found_enclose = false;
       found_assignment = false;
 
-      key.clear();
-      value.clear();
-
-    } else if (!found_assignment && c == ' ') {
-      // A field tokenizer.
+      key_size = 0U;
+      value_size = 0U;
 
     } else if (found_assignment) {
       // Enclosure sequences appear immediately following assignment.
@@ -825,20 +1255,25 @@ bool AuditdNetlinkParser::ParseAuditReply(
         found_enclose = true;
       }
 
-      value += c;
+      ++value_size;
 
     } else if (c == '=') {
       found_assignment = true;
+      value_begin = i + 1;
 
     } else {
-      key += c;
+      if (key_size == 0U) {
+        key_begin = i;
+      }
+
+      ++key_size;
     }
   }
 
   // Last step, if there was no trailing tokenizer.
-  if (!key.empty()) {
-    event_record.fields.emplace(
-        std::make_pair(std::move(key), std::move(value)));
+  if (key_size != 0U) {
+    event_record.fields.add(boost::string_ref(data + key_begin, key_size),
+                            boost::string_ref(data + value_begin, value_size));
   }
 
   return true;
@@ -888,4 +1323,78 @@ void AuditdNetlinkParser::AdjustAuditReply(audit_reply& reply) noexcept {
     break;
   }
 }
+
+void AuditRecordQueue::push(std::uint64_t sequence,
+                            std::vector<AuditEventRecord> record_list) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_[sequence] = std::move(record_list);
+}
+
+std::vector<AuditEventRecord> AuditRecordQueue::takeAll() {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Release batches until the first gap in the read order
+  auto end = pending_.begin();
+  std::size_t record_count = 0U;
+  for (; end != pending_.end() && end->first == next_sequence_; ++end) {
+    record_count += end->second.size();
+    ++next_sequence_;
+  }
+
+  std::vector<AuditEventRecord> record_list;
+  record_list.reserve(record_count);
+
+  for (auto it = pending_.begin(); it != end; ++it) {
+    record_list.insert(record_list.end(),
+                       std::make_move_iterator(it->second.begin()),
+                       std::make_move_iterator(it->second.end()));
+  }
+
+  pending_.erase(pending_.begin(), end);
+  return record_list;
+}
+
+bool AuditRecordQueue::empty() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_.empty() || pending_.begin()->first != next_sequence_;
+}
+
+void AuditFieldList::reset(std::shared_ptr<const std::string> text) {
+  text_ = std::move(text);
+  field_list_.clear();
+}
+
+const std::string& AuditFieldList::text() const {
+  static const std::string kEmptyText;
+  return (text_ != nullptr) ? *text_ : kEmptyText;
+}
+
+void AuditFieldList::add(boost::string_ref key, boost::string_ref value) {
+  field_list_.emplace_back(key, value);
+}
+
+AuditFieldList::const_iterator AuditFieldList::find(
+    boost::string_ref key) const {
+  return std::find_if(field_list_.begin(),
+                      field_list_.end(),
+                      [key](const Field& field) { return field.first == key; });
+}
+
+std::size_t AuditFieldList::count(boost::string_ref key) const {
+  return (find(key) != end()) ? 1U : 0U;
+}
+
+std::string AuditFieldList::at(boost::string_ref key) const {
+  auto it = find(key);
+  if (it == end()) {
+    throw std::out_of_range("Missing audit record field: " + key.to_string());
+  }
+
+  return it->second.to_string();
+}
+
+std::string AuditFieldList::operator[](boost::string_ref key) const {
+  auto it = find(key);
+  return (it != end()) ? it->second.to_string() : std::string();
+}
 } // namespace osquery
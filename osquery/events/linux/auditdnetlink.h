@@ -11,17 +11,20 @@
 #pragma once
 
 #include <libaudit.h>
+#include <sys/socket.h>
 
 #include <atomic>
 #include <condition_variable>
 #include <future>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <unordered_map>
 #include <vector>
 
 #include <boost/algorithm/hex.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include <osquery/dispatcher.h>
 
@@ -33,6 +36,69 @@ enum class NetlinkStatus { ActiveMutable, ActiveImmutable, Disabled, Error };
 /// Contains an audit_rule_data structure
 using AuditRuleDataObject = std::vector<std::uint8_t>;
 
+/// An audit rule we have installed, with the filter list and action used
+struct AuditInstalledRule final {
+  AuditRuleDataObject rule_object;
+  int flags;
+  int action;
+};
+
+/**
+ * @brief The fields of a single audit record, tokenized in place.
+ *
+ * The record text is copied once and shared between copies of the record;
+ * keys and values are views into that text. Lookups scan the flat field
+ * list and strings are only materialized for the fields that are read.
+ * Fields are kept in record order; like a map, lookups of duplicated keys
+ * return the first occurrence.
+ */
+class AuditFieldList final {
+ public:
+  using Field = std::pair<boost::string_ref, boost::string_ref>;
+  using const_iterator = std::vector<Field>::const_iterator;
+
+  /// Replace the record text, this removes all fields.
+  void reset(std::shared_ptr<const std::string> text);
+
+  /// The record text that keys and values reference.
+  const std::string& text() const;
+
+  /// Append a field, the key and value must reference text().
+  void add(boost::string_ref key, boost::string_ref value);
+
+  const_iterator find(boost::string_ref key) const;
+  std::size_t count(boost::string_ref key) const;
+
+  /// Materialize a value, throws std::out_of_range if the key is missing.
+  std::string at(boost::string_ref key) const;
+
+  /// Materialize a value, or an empty string if the key is missing.
+  std::string operator[](boost::string_ref key) const;
+
+  const_iterator begin() const {
+    return field_list_.begin();
+  }
+
+  const_iterator end() const {
+    return field_list_.end();
+  }
+
+  std::size_t size() const {
+    return field_list_.size();
+  }
+
+  bool empty() const {
+    return field_list_.empty();
+  }
+
+ private:
+  /// Shared, immutable record text.
+  std::shared_ptr<const std::string> text_;
+
+  /// Views into text_.
+  std::vector<Field> field_list_;
+};
+
 /// A single, prepared audit event record.
 struct AuditEventRecord final {
   /// Record type (i.e.: AUDIT_SYSCALL, AUDIT_PATH, ...)
@@ -42,11 +108,12 @@ struct AuditEventRecord final {
   unsigned long int time;
 
   /// Audit event id that owns this record. Remember: PRIMARY KEY(id, timestamp)
-  std::string audit_id;
+  /// The event time is kept in the upper 32 bits, the serial in the lower.
+  std::uint64_t audit_id;
 
   /// The field list for this record. Valid for everything except SELinux
   /// records
-  std::map<std::string, std::string> fields;
+  AuditFieldList fields;
 
   /// The raw message, only valid for SELinux records (because they have broken
   /// syntax)
@@ -56,14 +123,72 @@ struct AuditEventRecord final {
 static_assert(std::is_move_constructible<AuditEventRecord>::value,
               "not move constructible");
 
+/// A set of raw audit records, received with as few syscalls as possible.
+struct AuditReplyBatch final {
+  /// Record storage; full-size batches are reused across reads, partial
+  /// reads are published as copies sized to their contents.
+  std::vector<audit_reply> reply_list;
+
+  /// How many entries of reply_list have been received.
+  std::size_t count{0U};
+
+  /// Parser shards that have not finished with this batch yet.
+  std::atomic<std::size_t> pending_shards{0U};
+
+  /// Position of this batch in the netlink read order.
+  std::uint64_t sequence{0U};
+
+  /// Parsed records, one slot per reply; each shard only fills its own.
+  std::vector<AuditEventRecord> record_list;
+
+  /// Marks the record_list slots that hold a parsed record.
+  std::vector<std::uint8_t> parsed_list;
+
+  /// The parser shard of each reply, chosen by its audit event id.
+  std::vector<std::size_t> shard_list;
+};
+
+using AuditReplyBatchRef = std::shared_ptr<AuditReplyBatch>;
+
+/**
+ * @brief Hands off parsed records to the event assembler in read order.
+ *
+ * Parser shards finish batches in any order; the records of a batch are
+ * only released once every batch read before it has been pushed.
+ *
+ * This is a mutex and a map rather than a lock-free queue: it is touched
+ * once per batch by the last shard and once per wakeup by the consumer, so
+ * the lock is not contended per record, and batches must be reordered by
+ * sequence before release, which a lock-free FIFO cannot do.
+ */
+class AuditRecordQueue final : private boost::noncopyable {
+ public:
+  /// Store the records parsed from a batch, safe to call from any thread.
+  void push(std::uint64_t sequence,
+            std::vector<AuditEventRecord> record_list);
+
+  /// Remove and return the records of every batch that is next in sequence.
+  std::vector<AuditEventRecord> takeAll();
+
+  /// True until the next batch in sequence has been pushed.
+  bool empty() const;
+
+ private:
+  mutable std::mutex mutex_;
+
+  /// Sequence number of the next batch to release.
+  std::uint64_t next_sequence_{0U};
+
+  /// Batches that have been parsed but not taken yet.
+  std::map<std::uint64_t, std::vector<AuditEventRecord>> pending_;
+};
+
 // This structure is used to share data between the reading and processing
 // services
 struct AuditdContext final {
-  /// Unprocessed audit records
-  std::vector<audit_reply> unprocessed_records;
-  static_assert(
-      std::is_move_constructible<decltype(unprocessed_records)>::value,
-      "not move constructible");
+  /// Unprocessed audit records; there is a queue for each parser shard and
+  /// every shard receives every batch
+  std::vector<std::vector<AuditReplyBatchRef>> unprocessed_records;
 
   /// Mutex for the list of unprocessed records
   std::mutex unprocessed_records_mutex;
@@ -71,10 +196,17 @@ struct AuditdContext final {
   /// Processed events condition variable
   std::condition_variable unprocessed_records_cv;
 
+  /// Parsed batches returned to the reader; protected by the same mutex
+  std::vector<AuditReplyBatchRef> free_reply_batches;
+
+  /// Sequence number for the next published batch; protected by the same
+  /// mutex
+  std::uint64_t next_batch_sequence{0U};
+
   /// This queue contains processed events
-  std::vector<AuditEventRecord> processed_events;
+  AuditRecordQueue processed_events;
 
-  /// Processed events queue mutex.
+  /// Only used to sleep until processed events are available
   std::mutex processed_events_mutex;
 
   /// Used to wake up the thread that processes the raw audit records
@@ -82,6 +214,9 @@ struct AuditdContext final {
 
   /// When set to true, the audit handle is (re)acquired
   std::atomic_bool acquire_handle{true};
+
+  /// When set to true, the syscall rules are reinstalled from the filters
+  std::atomic_bool reload_rules{false};
 };
 
 using AuditdContextRef = std::shared_ptr<AuditdContext>;
@@ -99,9 +234,30 @@ class AuditdNetlinkReader final : public InternalRunnable {
   /// Reads as many audit event records as possible before returning.
   bool acquireMessages() noexcept;
 
+  /// Receives up to a batch of messages, returns false on handle errors.
+  bool receiveBatch(AuditReplyBatch& batch, std::size_t& received) noexcept;
+
+  /// Takes a recycled batch, or allocates a new one.
+  AuditReplyBatchRef acquireBatch();
+
+  /// Hands a batch of records to every parser shard.
+  void publishBatch(AuditReplyBatchRef& batch);
+
   /// Configures the audit service and applies required rules
   bool configureAuditService() noexcept;
 
+  /// Installs the syscall rules for one syscall, applying the table filters
+  void installSyscallRules(int syscall_number, const std::string& table_name);
+
+  /// Replaces the installed syscall rules after a filter change
+  void reinstallSyscallRules() noexcept;
+
+  /// Adds a rule to the exit filter, returns true if it is now active
+  bool installAuditRule(const AuditRuleDataObject& rule_object,
+                        int flags,
+                        int action,
+                        int syscall_number);
+
   /// Clears out the audit configuration
   bool clearAuditConfiguration() noexcept;
 
@@ -118,23 +274,34 @@ class AuditdNetlinkReader final : public InternalRunnable {
   /// Shared data
   AuditdContextRef auditd_context_;
 
-  /// Read buffer used when receiving events from the netlink
-  std::vector<audit_reply> read_buffer_;
+  /// The batch currently being filled
+  AuditReplyBatchRef read_batch_;
+
+  /// recvmmsg headers, iovecs and addresses for a whole batch
+  std::vector<struct mmsghdr> message_header_list_;
+  std::vector<struct iovec> message_iovec_list_;
+  std::vector<struct sockaddr_nl> message_address_list_;
 
   /// The set of rules we applied (and that we'll uninstall when exiting)
-  std::vector<audit_rule_data> installed_rule_list_;
+  std::vector<AuditInstalledRule> installed_rule_list_;
 
-  /// The syscalls we are listening for
-  std::set<int> monitored_syscall_list_;
+  /// The syscalls we are listening for, and the table that requested them
+  std::map<int, std::string> monitored_syscall_list_;
 
   /// Netlink handle.
   int audit_netlink_handle_{-1};
 };
 
-/// This service parses the raw audit records
+/**
+ * @brief This service parses the raw audit records
+ *
+ * Records are sharded by audit event id across parser services. Each one
+ * sees every batch but only parses the records of its own events, so the
+ * records of an event are always parsed by one thread, in order.
+ */
 class AuditdNetlinkParser final : public InternalRunnable {
  public:
-  explicit AuditdNetlinkParser(AuditdContextRef context);
+  AuditdNetlinkParser(AuditdContextRef context, std::size_t shard_index);
   virtual void start() override;
 
   /// Parses an audit_reply structure into an AuditEventRecord object
@@ -144,9 +311,22 @@ class AuditdNetlinkParser final : public InternalRunnable {
   /// Adjusts the internal pointers of the audit_reply object
   static void AdjustAuditReply(audit_reply& reply) noexcept;
 
+  /// Parses the "audit(<time>.<msec>:<serial>): " record preamble in place
+  static bool ParseAuditPreamble(boost::string_ref message,
+                                 unsigned long int& time,
+                                 std::uint64_t& audit_id,
+                                 std::size_t& preamble_size) noexcept;
+
+ private:
+  /// Releases this shard's reference to a batch, the last one recycles it
+  void releaseBatch(AuditReplyBatchRef& batch);
+
  private:
   /// Shared data
   AuditdContextRef auditd_context_;
+
+  /// The unprocessed_records queue, and the event ids, this shard handles
+  std::size_t shard_index_{0U};
 };
 
 /// This class provides access to the audit netlink data
@@ -158,6 +338,9 @@ class AuditdNetlink final : private boost::noncopyable {
   /// Prepares the raw audit event records stored in the given context.
   std::vector<AuditEventRecord> getEvents() noexcept;
 
+  /// Asks the reader to reinstall the syscall rules, i.e. on filter changes.
+  void reloadRules() noexcept;
+
  private:
   /// Shared data
   AuditdContextRef auditd_context_;
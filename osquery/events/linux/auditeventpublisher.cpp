@@ -9,6 +9,10 @@
  */
 
 #include <array>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
 
 #include <osquery/flags.h>
 #include <osquery/logger.h>
@@ -16,6 +20,7 @@
 
 #include "osquery/core/conversions.h"
 #include "osquery/events/linux/auditeventpublisher.h"
+#include "osquery/events/linux/auditfilter.h"
 #include "osquery/tables/events/linux/selinux_events.h"
 
 namespace osquery {
@@ -67,8 +72,13 @@ void AuditEventPublisher::configure() {
     return;
   }
 
+  // Filters must be known before the audit rules are installed
+  auto filters_changed = UpdateAuditFilters();
+
   if (audit_netlink_ == nullptr) {
     audit_netlink_ = std::make_unique<AuditdNetlink>();
+  } else if (filters_changed) {
+    audit_netlink_->reloadRules();
   }
 }
 
@@ -273,30 +283,10 @@ void AuditEventPublisher::ProcessEvents(
   std::time_t current_time;
   std::time(&current_time);
 
-  std::unordered_map<std::string, std::time_t> timestamp_cache;
-
-  // The first part of the audit id is a timestamp: 1501323932.710:7670542
+  // The upper half of the audit id is the event timestamp
   for (auto event_it = trace_context.begin();
        event_it != trace_context.end();) {
-    const auto& audit_event_id = event_it->first;
-    std::time_t event_timestamp;
-
-    auto timestamp_it = timestamp_cache.find(audit_event_id);
-    if (timestamp_it == timestamp_cache.end()) {
-      std::string string_timestamp = audit_event_id.substr(0, 10);
-
-      long long int converted_value;
-      if (!safeStrtoll(string_timestamp, 10, converted_value)) {
-        event_timestamp = 0;
-      } else {
-        event_timestamp = static_cast<std::time_t>(converted_value);
-      }
-
-      timestamp_cache[audit_event_id] = event_timestamp;
-
-    } else {
-      event_timestamp = timestamp_it->second;
-    }
+    auto event_timestamp = static_cast<std::time_t>(event_it->first >> 32U);
 
     if (current_time - event_timestamp >= 300) {
       event_it = trace_context.erase(event_it);
@@ -322,7 +312,7 @@ const AuditEventRecord* GetEventRecord(const AuditEvent& event,
 };
 
 bool GetStringFieldFromMap(std::string& value,
-                           const std::map<std::string, std::string>& fields,
+                           const AuditFieldList& fields,
                            const std::string& name,
                            const std::string& default_value) noexcept {
   auto it = fields.find(name);
@@ -331,23 +321,32 @@ bool GetStringFieldFromMap(std::string& value,
     return false;
   }
 
-  value = it->second;
+  value.assign(it->second.data(), it->second.size());
   return true;
 }
 
 bool GetIntegerFieldFromMap(std::uint64_t& value,
-                            const std::map<std::string, std::string>& field_map,
+                            const AuditFieldList& field_map,
                             const std::string& field_name,
                             std::size_t base,
                             std::uint64_t default_value) noexcept {
-  std::string string_value;
-  if (!GetStringFieldFromMap(string_value, field_map, field_name, "")) {
+  auto it = field_map.find(field_name);
+
+  // Decode from a stack copy of the value, integers never need a string.
+  char buffer[32] = {};
+  if (it == field_map.end() || it->second.empty() ||
+      it->second.size() >= sizeof(buffer)) {
     value = default_value;
     return false;
   }
 
-  long long temp;
-  if (!safeStrtoll(string_value, base, temp)) {
+  std::memcpy(buffer, it->second.data(), it->second.size());
+
+  char* end{nullptr};
+  errno = 0;
+  auto temp = std::strtoll(buffer, &end, static_cast<int>(base));
+  if (end == nullptr || end == buffer || *end != '\0' ||
+      ((temp == LLONG_MIN || temp == LLONG_MAX) && errno == ERANGE)) {
     value = default_value;
     return false;
   }
@@ -357,7 +356,7 @@ bool GetIntegerFieldFromMap(std::uint64_t& value,
 }
 
 void CopyFieldFromMap(Row& row,
-                      const std::map<std::string, std::string>& fields,
+                      const AuditFieldList& fields,
                       const std::string& name,
                       const std::string& default_value) noexcept {
   GetStringFieldFromMap(row[name], fields, name, default_value);
@@ -13,6 +13,7 @@
 #include <cstdint>
 #include <limits>
 #include <memory>
+#include <unordered_map>
 
 #include <boost/variant.hpp>
 
@@ -67,7 +68,7 @@ using AuditEventContextRef = std::shared_ptr<AuditEventContext>;
 using AuditSubscriptionContextRef = std::shared_ptr<AuditSubscriptionContext>;
 
 /// This type maps audit event id with the corresponding audit event object
-using AuditTraceContext = std::map<std::string, AuditEvent>;
+using AuditTraceContext = std::unordered_map<std::uint64_t, AuditEvent>;
 
 class AuditEventPublisher final
     : public EventPublisher<AuditSubscriptionContext, AuditEventContext> {
@@ -103,26 +104,26 @@ class AuditEventPublisher final
 const AuditEventRecord* GetEventRecord(const AuditEvent& event,
                                        int record_type) noexcept;
 
-/// Extracts the specified string key from the given string map
+/// Extracts the specified string key from the given field list
 bool GetStringFieldFromMap(
     std::string& value,
-    const std::map<std::string, std::string>& fields,
+    const AuditFieldList& fields,
     const std::string& name,
     const std::string& default_value = std::string()) noexcept;
 
-/// Extracts the specified integer key from the given string map
+/// Extracts the specified integer key from the given field list
 bool GetIntegerFieldFromMap(
     std::uint64_t& value,
-    const std::map<std::string, std::string>& field_map,
+    const AuditFieldList& field_map,
     const std::string& field_name,
     std::size_t base = 10,
     std::uint64_t default_value =
         std::numeric_limits<std::uint64_t>::max()) noexcept;
 
-/// Copies a named field from the 'fields' map to the specified row
+/// Copies a named field from the 'fields' list to the specified row
 void CopyFieldFromMap(
     Row& row,
-    const std::map<std::string, std::string>& fields,
+    const AuditFieldList& fields,
     const std::string& name,
     const std::string& default_value = std::string()) noexcept;
 } // namespace osquery
@@ -0,0 +1,409 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under both the Apache 2.0 license (found in the
+ *  LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ *  in the COPYING file in the root directory of this source tree).
+ *  You may select, at your option, one of the above-listed licenses.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+#include <osquery/config.h>
+#include <osquery/logger.h>
+
+#include "osquery/events/linux/auditfilter.h"
+
+namespace osquery {
+
+const std::string kAuditFiltersConfigKey{"audit_filters"};
+
+namespace {
+/// The id the kernel reports for unset (e.g. login) ids
+const std::uint64_t kAuditUnsetId = 4294967295U;
+
+/// The tables that accept audit filters
+const std::vector<std::string> kAuditFilterTables = {"process_events",
+                                                     "socket_events"};
+
+struct AuditFilterFieldDescriptor final {
+  AuditFilterField field;
+
+  /// Name of the field in the AUDIT_SYSCALL record, empty if not found there
+  const char* record_field;
+
+  /// Kernel audit field, or -1 if the kernel can't filter on it
+  int kernel_field;
+
+  bool is_string;
+};
+
+const std::map<std::string, AuditFilterFieldDescriptor> kAuditFilterFields = {
+    {"uid", {AuditFilterField::Uid, "uid", AUDIT_UID, false}},
+    {"euid", {AuditFilterField::Euid, "euid", AUDIT_EUID, false}},
+    {"gid", {AuditFilterField::Gid, "gid", AUDIT_GID, false}},
+    {"auid", {AuditFilterField::Auid, "auid", AUDIT_LOGINUID, false}},
+    {"pid", {AuditFilterField::Pid, "pid", AUDIT_PID, false}},
+    {"exe", {AuditFilterField::Exe, "exe", AUDIT_EXE, true}},
+    {"family", {AuditFilterField::Family, "", -1, false}}};
+
+const AuditFilterFieldDescriptor& GetFieldDescriptor(AuditFilterField field) {
+  for (const auto& descriptor : kAuditFilterFields) {
+    if (descriptor.second.field == field) {
+      return descriptor.second;
+    }
+  }
+
+  // The map covers every enum value
+  return kAuditFilterFields.begin()->second;
+}
+
+/// Parses an unsigned integer field value; ids are 32-bit (auid -1 is unset)
+bool ParseNumericValue(const char* value, std::uint64_t& number) {
+  if (value == nullptr || *value == 0) {
+    return false;
+  }
+
+  errno = 0;
+  char* end = nullptr;
+  auto converted = std::strtoll(value, &end, 10);
+  if (errno != 0 || end == value || *end != 0) {
+    return false;
+  }
+
+  if (converted < 0) {
+    number = static_cast<std::uint32_t>(converted);
+  } else {
+    number = static_cast<std::uint64_t>(converted);
+  }
+
+  return true;
+}
+
+Status ParseAuditFilterRule(const rapidjson::Value& rule_object,
+                            AuditFilterRule& rule) {
+  if (!rule_object.IsObject()) {
+    return Status(1, "Audit filter rules must be objects");
+  }
+
+  for (const auto& member : rule_object.GetObject()) {
+    std::string field_name = member.name.GetString();
+
+    auto descriptor_it = kAuditFilterFields.find(field_name);
+    if (descriptor_it == kAuditFilterFields.end()) {
+      return Status(1, "Unknown audit filter field: " + field_name);
+    }
+
+    const auto& descriptor = descriptor_it->second;
+
+    AuditFilterCondition condition;
+    condition.field = descriptor.field;
+
+    if (member.value.IsString()) {
+      condition.value = member.value.GetString();
+    } else if (member.value.IsInt64()) {
+      condition.value = std::to_string(member.value.GetInt64());
+    } else if (member.value.IsUint64()) {
+      condition.value = std::to_string(member.value.GetUint64());
+    } else {
+      return Status(1, "Invalid value for audit filter field: " + field_name);
+    }
+
+    if (!descriptor.is_string) {
+      if (!ParseNumericValue(condition.value.c_str(), condition.number)) {
+        return Status(1, "Invalid number for audit filter field: " + field_name);
+      }
+
+      condition.value = std::to_string(condition.number);
+    }
+
+    rule.push_back(std::move(condition));
+  }
+
+  if (rule.empty()) {
+    return Status(1, "Empty audit filter rule");
+  }
+
+  return Status(0, "OK");
+}
+
+Status ParseAuditFilterRuleList(const rapidjson::Value& table_object,
+                                const char* key,
+                                std::vector<AuditFilterRule>& rule_list) {
+  if (!table_object.HasMember(key)) {
+    return Status(0, "OK");
+  }
+
+  const auto& rule_array = table_object[key];
+  if (!rule_array.IsArray()) {
+    return Status(1, std::string("The audit filter '") + key +
+                         "' key must be an array");
+  }
+
+  for (const auto& rule_object : rule_array.GetArray()) {
+    AuditFilterRule rule;
+    auto status = ParseAuditFilterRule(rule_object, rule);
+    if (!status.ok()) {
+      return status;
+    }
+
+    rule_list.push_back(std::move(rule));
+  }
+
+  return Status(0, "OK");
+}
+
+bool ConditionMatches(const AuditFilterCondition& condition,
+                      const AuditFieldList& syscall_fields,
+                      int family) {
+  if (condition.field == AuditFilterField::Family) {
+    return family >= 0 && static_cast<std::uint64_t>(family) == condition.number;
+  }
+
+  const auto& descriptor = GetFieldDescriptor(condition.field);
+
+  auto field_it = syscall_fields.find(descriptor.record_field);
+  if (field_it == syscall_fields.end()) {
+    return false;
+  }
+
+  const auto& value = field_it->second;
+  if (descriptor.is_string) {
+    // Paths are quoted, or hex-encoded when they contain special characters
+    if (value.size() == condition.value.size() + 2U && value.front() == '"' &&
+        value.back() == '"') {
+      return value.substr(1U, condition.value.size()) == condition.value;
+    }
+
+    return DecodeAuditPathValues(value.to_string()) == condition.value;
+  }
+
+  // Ids are short; avoid allocating for the conversion
+  char buffer[32] = {};
+  if (value.size() >= sizeof(buffer)) {
+    return false;
+  }
+  std::memcpy(buffer, value.data(), value.size());
+
+  std::uint64_t number = 0U;
+  return ParseNumericValue(buffer, number) && number == condition.number;
+}
+
+bool RuleMatches(const AuditFilterRule& rule,
+                 const AuditFieldList& syscall_fields,
+                 int family) {
+  for (const auto& condition : rule) {
+    if (!ConditionMatches(condition, syscall_fields, family)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool SameAuditFilterRules(const std::vector<AuditFilterRule>& lhs,
+                          const std::vector<AuditFilterRule>& rhs) {
+  auto L_SameCondition = [](const AuditFilterCondition& a,
+                            const AuditFilterCondition& b) {
+    return a.field == b.field && a.value == b.value && a.number == b.number;
+  };
+
+  auto L_SameRule = [&L_SameCondition](const AuditFilterRule& a,
+                                       const AuditFilterRule& b) {
+    return a.size() == b.size() &&
+           std::equal(a.begin(), a.end(), b.begin(), L_SameCondition);
+  };
+
+  return lhs.size() == rhs.size() &&
+         std::equal(lhs.begin(), lhs.end(), rhs.begin(), L_SameRule);
+}
+
+bool SameAuditTableFilter(const AuditTableFilter& lhs,
+                          const AuditTableFilter& rhs) {
+  return SameAuditFilterRules(lhs.include_list, rhs.include_list) &&
+         SameAuditFilterRules(lhs.exclude_list, rhs.exclude_list);
+}
+
+std::mutex audit_filter_mutex;
+std::map<std::string, AuditTableFilterRef> audit_filter_map;
+bool audit_filters_loaded{false};
+} // namespace
+
+bool AuditTableFilter::empty() const noexcept {
+  return include_list.empty() && exclude_list.empty();
+}
+
+bool AuditTableFilter::accepts(const AuditFieldList& syscall_fields,
+                               int family) const noexcept {
+  for (const auto& rule : exclude_list) {
+    if (RuleMatches(rule, syscall_fields, family)) {
+      return false;
+    }
+  }
+
+  if (include_list.empty()) {
+    return true;
+  }
+
+  for (const auto& rule : include_list) {
+    if (RuleMatches(rule, syscall_fields, family)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+Status ParseAuditTableFilter(const rapidjson::Value& table_object,
+                             AuditTableFilter& filter) {
+  filter = {};
+
+  if (!table_object.IsObject()) {
+    return Status(1, "The audit filter of a table must be an object");
+  }
+
+  auto status =
+      ParseAuditFilterRuleList(table_object, "include", filter.include_list);
+  if (!status.ok()) {
+    return status;
+  }
+
+  return ParseAuditFilterRuleList(table_object, "exclude", filter.exclude_list);
+}
+
+bool UpdateAuditFilters() {
+  std::map<std::string, AuditTableFilterRef> filter_map;
+
+  auto plugin = Config::get().getParser("events");
+  if (plugin != nullptr) {
+    const auto& doc = plugin->getData().doc();
+
+    if (doc.HasMember("events") && doc["events"].IsObject() &&
+        doc["events"].HasMember(kAuditFiltersConfigKey)) {
+      const auto& root = doc["events"][kAuditFiltersConfigKey];
+
+      for (const auto& table_name : kAuditFilterTables) {
+        if (!root.IsObject() || !root.HasMember(table_name)) {
+          continue;
+        }
+
+        auto filter = std::make_shared<AuditTableFilter>();
+        auto status = ParseAuditTableFilter(root[table_name], *filter);
+        if (!status.ok()) {
+          LOG(WARNING) << "Ignoring the audit filters of " << table_name
+                       << ": " << status.getMessage();
+          continue;
+        }
+
+        filter_map[table_name] = filter;
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(audit_filter_mutex);
+
+  // Tables without rules behave as if they had an empty filter
+  bool changed = !audit_filters_loaded;
+  for (const auto& table_name : kAuditFilterTables) {
+    auto old_it = audit_filter_map.find(table_name);
+    auto new_it = filter_map.find(table_name);
+
+    AuditTableFilter empty_filter;
+    const auto& old_filter =
+        old_it != audit_filter_map.end() ? *old_it->second : empty_filter;
+    const auto& new_filter =
+        new_it != filter_map.end() ? *new_it->second : empty_filter;
+
+    if (!SameAuditTableFilter(old_filter, new_filter)) {
+      changed = true;
+    }
+  }
+
+  audit_filter_map = std::move(filter_map);
+  audit_filters_loaded = true;
+  return changed;
+}
+
+AuditTableFilterRef GetAuditTableFilter(const std::string& table_name) {
+  static const AuditTableFilterRef empty_filter =
+      std::make_shared<AuditTableFilter>();
+
+  {
+    std::lock_guard<std::mutex> lock(audit_filter_mutex);
+    if (audit_filters_loaded) {
+      auto filter_it = audit_filter_map.find(table_name);
+      return filter_it != audit_filter_map.end() ? filter_it->second
+                                                 : empty_filter;
+    }
+  }
+
+  UpdateAuditFilters();
+  return GetAuditTableFilter(table_name);
+}
+
+bool IsKernelAuditFilterCondition(const AuditFilterCondition& condition) {
+  const auto& descriptor = GetFieldDescriptor(condition.field);
+  if (descriptor.kernel_field < 0) {
+    return false;
+  }
+
+  // The kernel refuses rules on the unset id; leave those to the table
+  switch (condition.field) {
+  case AuditFilterField::Uid:
+  case AuditFilterField::Euid:
+  case AuditFilterField::Gid:
+  case AuditFilterField::Auid:
+    return condition.number != kAuditUnsetId;
+
+  default:
+    return true;
+  }
+}
+
+bool AppendAuditRuleConditions(AuditRuleDataObject& rule_object,
+                               const AuditFilterRule& rule) {
+  if (rule_object.size() < sizeof(audit_rule_data)) {
+    return false;
+  }
+
+  for (const auto& condition : rule) {
+    if (!IsKernelAuditFilterCondition(condition)) {
+      continue;
+    }
+
+    const auto& descriptor = GetFieldDescriptor(condition.field);
+
+    auto rule_data = reinterpret_cast<audit_rule_data*>(rule_object.data());
+    auto field_index = rule_data->field_count;
+    if (field_index >= AUDIT_MAX_FIELDS) {
+      return false;
+    }
+
+    rule_data->fields[field_index] = static_cast<__u32>(descriptor.kernel_field);
+    rule_data->fieldflags[field_index] = AUDIT_EQUAL;
+
+    if (descriptor.is_string) {
+      // String values are appended to the buffer that follows the structure
+      rule_data->values[field_index] =
+          static_cast<__u32>(condition.value.size());
+      rule_data->buflen += static_cast<__u32>(condition.value.size());
+      rule_data->field_count++;
+
+      rule_object.insert(
+          rule_object.end(), condition.value.begin(), condition.value.end());
+
+    } else {
+      rule_data->values[field_index] = static_cast<__u32>(condition.number);
+      rule_data->field_count++;
+    }
+  }
+
+  return true;
+}
+} // namespace osquery
@@ -0,0 +1,109 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under both the Apache 2.0 license (found in the
+ *  LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ *  in the COPYING file in the root directory of this source tree).
+ *  You may select, at your option, one of the above-listed licenses.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <osquery/status.h>
+
+#include "osquery/core/json.h"
+#include "osquery/events/linux/auditdnetlink.h"
+
+namespace osquery {
+
+/// Root key of the audit filters, inside the "events" configuration
+extern const std::string kAuditFiltersConfigKey;
+
+/// The event fields that can be used by audit filters
+enum class AuditFilterField { Uid, Euid, Gid, Auid, Pid, Exe, Family };
+
+/// A single "field": value equality test
+struct AuditFilterCondition final {
+  AuditFilterField field;
+
+  /// The value, as found in the audit record (decoded for paths)
+  std::string value;
+
+  /// The numeric value, unused for string fields
+  std::uint64_t number{0U};
+};
+
+/// A rule matches when all of its conditions match
+using AuditFilterRule = std::vector<AuditFilterCondition>;
+
+/**
+ * @brief The include and exclude rules of a single audit table.
+ *
+ * An event is kept when it matches no exclude rule and, if include rules are
+ * present, at least one of them. Example configuration:
+ *
+ *   "events": {
+ *     "audit_filters": {
+ *       "process_events": {
+ *         "exclude": [{"uid": 0, "exe": "/usr/bin/ci-agent"}, {"auid": 1001}]
+ *       },
+ *       "socket_events": {"include": [{"family": 2}, {"family": 10}]}
+ *     }
+ *   }
+ *
+ * Rules that only use fields known to the kernel are also compiled into the
+ * syscall rules installed by the audit publisher, so that these events are
+ * never sent to userspace. The rules are reinstalled when the filters change.
+ * The kernel rejects the unset id (-1, e.g. {"auid": -1}); such conditions
+ * are only evaluated by the table.
+ */
+struct AuditTableFilter final {
+  std::vector<AuditFilterRule> include_list;
+  std::vector<AuditFilterRule> exclude_list;
+
+  /// Returns true if no rule has been set
+  bool empty() const noexcept;
+
+  /**
+   * @brief Userspace predicate, evaluated on the AUDIT_SYSCALL record.
+   *
+   * @param family The socket family, or -1 when it does not apply.
+   */
+  bool accepts(const AuditFieldList& syscall_fields,
+               int family = -1) const noexcept;
+};
+
+using AuditTableFilterRef = std::shared_ptr<const AuditTableFilter>;
+
+/// Parses the filter of a single table ("include" and "exclude" arrays)
+Status ParseAuditTableFilter(const rapidjson::Value& table_object,
+                             AuditTableFilter& filter);
+
+/**
+ * @brief Reloads the filters of every table from the "events" configuration.
+ *
+ * @return true if any table filter differs from the previous configuration.
+ */
+bool UpdateAuditFilters();
+
+/// Returns the current filter for the given table; never null
+AuditTableFilterRef GetAuditTableFilter(const std::string& table_name);
+
+/// Returns true if the kernel can evaluate the given condition
+bool IsKernelAuditFilterCondition(const AuditFilterCondition& condition);
+
+/**
+ * @brief Appends the given conditions to an audit rule.
+ *
+ * The rule object must contain an audit_rule_data structure. Conditions the
+ * kernel can not evaluate are ignored.
+ */
+bool AppendAuditRuleConditions(AuditRuleDataObject& rule_object,
+                               const AuditFilterRule& rule);
+} // namespace osquery
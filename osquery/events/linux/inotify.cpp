@@ -8,16 +8,21 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <algorithm>
+#include <future>
 #include <sstream>
 
+#include <dirent.h>
 #include <fnmatch.h>
 #include <linux/limits.h>
 #include <poll.h>
+#include <stdlib.h>
 
 #include <boost/filesystem.hpp>
 
 #include <osquery/config.h>
 #include <osquery/filesystem.h>
+#include <osquery/flags.h>
 #include <osquery/logger.h>
 #include <osquery/registry_factory.h>
 #include <osquery/system.h>
@@ -28,12 +33,25 @@ namespace fs = boost::filesystem;
 
 namespace osquery {
 
+HIDDEN_FLAG(uint64,
+            inotify_discovery_threads,
+            4,
+            "Threads used to list directories of recursive inotify paths");
+
+HIDDEN_FLAG(uint64,
+            inotify_configure_directories,
+            4096,
+            "Directories discovered before an inotify configure returns");
+
 static const size_t kINotifyMaxEvents = 512;
 static const size_t kINotifyEventSize =
     sizeof(struct inotify_event) + (NAME_MAX + 1);
 static const size_t kINotifyBufferSize =
     (kINotifyMaxEvents * kINotifyEventSize);
 
+/// Directories discovered by the publisher thread between inotify reads.
+static const size_t kINotifyDiscoveryBatch = 1024;
+
 std::map<int, std::string> kMaskActions = {
     {IN_ACCESS, "ACCESSED"},
     {IN_ATTRIB, "ATTRIBUTES_MODIFIED"},
@@ -53,6 +71,185 @@ const uint32_t kFileAccessMasks = IN_OPEN | IN_ACCESS;
 
 REGISTER(INotifyEventPublisher, "event_publisher", "inotify");
 
+const INotifyPathTree::NodeId INotifyPathTree::kRoot;
+
+INotifyPathTree::INotifyPathTree() {
+  nodes_.emplace_back();
+}
+
+std::vector<INotifyPathTree::NodeId>::const_iterator INotifyPathTree::findChild(
+    NodeId node, const std::string& name) const {
+  const auto& children = nodes_[node].children;
+  return std::lower_bound(
+      children.begin(),
+      children.end(),
+      name,
+      [this](NodeId child, const std::string& value) {
+        return nodes_[child].name < value;
+      });
+}
+
+INotifyPathTree::NodeId INotifyPathTree::insert(const std::string& path) {
+  NodeId node = kRoot;
+  size_t start = 0;
+  while (start < path.size()) {
+    auto end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+
+    if (end > start) {
+      auto name = path.substr(start, end - start);
+      auto child = findChild(node, name);
+      if (child != nodes_[node].children.end() && nodes_[*child].name == name) {
+        node = *child;
+      } else {
+        auto position = child - nodes_[node].children.begin();
+        NodeId id;
+        if (free_.empty()) {
+          id = static_cast<NodeId>(nodes_.size());
+          nodes_.emplace_back();
+        } else {
+          id = free_.back();
+          free_.pop_back();
+        }
+
+        nodes_[id].parent = node;
+        nodes_[id].name = std::move(name);
+        auto& children = nodes_[node].children;
+        children.insert(children.begin() + position, id);
+        node = id;
+      }
+    }
+    start = end + 1;
+  }
+
+  nodes_[node].directory = (!path.empty() && path.back() == '/');
+  return node;
+}
+
+bool INotifyPathTree::find(const std::string& path, NodeId& node) const {
+  node = kRoot;
+  size_t start = 0;
+  while (start < path.size()) {
+    auto end = path.find('/', start);
+    if (end == std::string::npos) {
+      end = path.size();
+    }
+
+    if (end > start) {
+      auto name = path.substr(start, end - start);
+      auto child = findChild(node, name);
+      if (child == nodes_[node].children.end() || nodes_[*child].name != name) {
+        return false;
+      }
+      node = *child;
+    }
+    start = end + 1;
+  }
+  return true;
+}
+
+std::string INotifyPathTree::getPath(NodeId node) const {
+  std::vector<NodeId> lineage;
+  for (auto current = node; current != kRoot;
+       current = nodes_[current].parent) {
+    lineage.push_back(current);
+  }
+
+  std::string path;
+  for (auto it = lineage.rbegin(); it != lineage.rend(); ++it) {
+    path += '/';
+    path += nodes_[*it].name;
+  }
+
+  if (path.empty() || nodes_[node].directory) {
+    path += '/';
+  }
+  return path;
+}
+
+bool INotifyPathTree::isWithin(NodeId node, NodeId ancestor) const {
+  while (node != ancestor) {
+    if (node == kRoot) {
+      return false;
+    }
+    node = nodes_[node].parent;
+  }
+  return true;
+}
+
+void INotifyPathTree::setDescriptor(NodeId node, int descriptor) {
+  nodes_[node].watched = true;
+  nodes_[node].descriptor = descriptor;
+}
+
+bool INotifyPathTree::getDescriptor(NodeId node, int& descriptor) const {
+  descriptor = nodes_[node].descriptor;
+  return nodes_[node].watched;
+}
+
+void INotifyPathTree::clearDescriptor(NodeId node) {
+  nodes_[node].watched = false;
+  nodes_[node].descriptor = -1;
+  release(node);
+}
+
+void INotifyPathTree::release(NodeId node) {
+  while (node != kRoot && !nodes_[node].watched &&
+         nodes_[node].children.empty()) {
+    auto parent = nodes_[node].parent;
+    auto& siblings = nodes_[parent].children;
+    auto it = findChild(parent, nodes_[node].name);
+    if (it != siblings.end() && *it == node) {
+      siblings.erase(it);
+    }
+
+    nodes_[node] = Node();
+    free_.push_back(node);
+    node = parent;
+  }
+}
+
+/**
+ * @brief Append the paths of a directory's subdirectories.
+ *
+ * This reads the directory entries once instead of globbing, symlinks to
+ * directories are resolved to their canonical path. Every path ends with '/'.
+ */
+static void listSubdirectories(const std::string& path,
+                               std::vector<std::string>& children) {
+  auto dir = ::opendir(path.c_str());
+  if (dir == nullptr) {
+    return;
+  }
+
+  struct dirent* entry = nullptr;
+  while ((entry = ::readdir(dir)) != nullptr) {
+    std::string name = entry->d_name;
+    if (name == "." || name == "..") {
+      continue;
+    }
+
+    auto child = path + name;
+    if (entry->d_type == DT_DIR) {
+      children.push_back(child + '/');
+    } else if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+      struct stat child_stat;
+      if (::stat(child.c_str(), &child_stat) != 0 ||
+          !S_ISDIR(child_stat.st_mode)) {
+        continue;
+      }
+
+      char resolved[PATH_MAX];
+      if (::realpath(child.c_str(), resolved) != nullptr) {
+        children.push_back(std::string(resolved) + '/');
+      }
+    }
+  }
+  ::closedir(dir);
+}
+
 Status INotifyEventPublisher::setUp() {
   inotify_handle_ = ::inotify_init();
   // If this does not work throw an exception.
@@ -73,21 +270,22 @@ bool INotifyEventPublisher::needMonitoring(const std::string& path,
                                            uint32_t mask,
                                            bool recursive,
                                            bool add_watch) {
-  bool rc = true;
-  struct stat file_dir_stat;
-  time_t sc_time = isc->path_sc_time_[path];
+  if (isc->roots_.count(path) > 0 && isWatched(path)) {
+    // Watches within a registered root follow the filesystem through events.
+    return true;
+  }
 
+  struct stat file_dir_stat;
   if (stat(path.c_str(), &file_dir_stat) == -1) {
     LOG(WARNING) << "Failed to do stat on: " << path;
     return false;
   }
 
-  if (sc_time != file_dir_stat.st_ctime) {
-    if ((rc = addMonitor(path, isc, isc->mask, isc->recursive, add_watch))) {
-      isc->path_sc_time_[path] = file_dir_stat.st_ctime;
-    }
+  if (!addMonitor(path, isc, isc->mask, isc->recursive, add_watch)) {
+    return false;
   }
-  return rc;
+  isc->roots_.insert(path);
+  return true;
 }
 
 bool INotifyEventPublisher::monitorSubscription(
@@ -99,6 +297,8 @@ bool INotifyEventPublisher::monitorSubscription(
     sc->path = discovered;
   }
 
+  std::vector<std::string> roots;
+  bool resolved = false;
   if (sc->path.find('*') != std::string::npos) {
     // If the wildcard exists within the file (leaf), remove and monitor the
     // directory instead. Apply a fnmatch on fired events to filter leafs.
@@ -110,22 +310,188 @@ bool INotifyEventPublisher::monitorSubscription(
     if (discovered.find('*') != std::string::npos) {
       // If a wildcard exists within the tree (stem), resolve at configure
       // time and monitor each path.
-      std::vector<std::string> paths;
-      resolveFilePattern(discovered, paths);
+      resolveFilePattern(discovered, roots);
       sc->recursive_match = sc->recursive;
-      for (const auto& _path : paths) {
-        needMonitoring(_path, sc, sc->mask, sc->recursive, add_watch);
+      resolved = true;
+    }
+  }
+
+  if (!resolved) {
+    if (isDirectory(discovered) && discovered.back() != '/') {
+      sc->path += '/';
+      discovered += '/';
+    }
+    roots.push_back(discovered);
+  }
+
+  // Only reconcile the difference: drop roots that no longer resolve.
+  std::set<std::string> current(roots.begin(), roots.end());
+  for (auto root = sc->roots_.begin(); root != sc->roots_.end();) {
+    if (current.count(*root) == 0) {
+      removeRoot(sc, *root);
+      root = sc->roots_.erase(root);
+    } else {
+      ++root;
+    }
+  }
+
+  bool rc = true;
+  for (const auto& root : roots) {
+    rc = needMonitoring(root, sc, sc->mask, sc->recursive, add_watch) && rc;
+  }
+  return (resolved) ? true : rc;
+}
+
+void INotifyEventPublisher::removeRoot(const INotifySubscriptionContextRef& isc,
+                                       const std::string& root) {
+  std::vector<int> watches;
+  {
+    WriteLock lock(path_mutex_);
+    INotifyPathTree::NodeId root_node;
+    if (paths_.find(root, root_node)) {
+      for (const auto& watch : descriptor_inosubctx_) {
+        if (watch.second.isc == isc &&
+            paths_.isWithin(watch.second.node, root_node)) {
+          watches.push_back(watch.first);
+        }
       }
-      return true;
     }
   }
 
-  if (isDirectory(discovered) && discovered.back() != '/') {
-    sc->path += '/';
-    discovered += '/';
+  {
+    auto prefix = (root.back() == '/') ? root : root + '/';
+    WriteLock lock(pending_mutex_);
+    pending_directories_.erase(
+        std::remove_if(pending_directories_.begin(),
+                       pending_directories_.end(),
+                       [&isc, &prefix](const INotifyPendingDirectory& dir) {
+                         return dir.first == isc &&
+                                dir.second.compare(
+                                    0, prefix.size(), prefix) == 0;
+                       }),
+        pending_directories_.end());
+  }
+
+  for (const auto& watch : watches) {
+    removeMonitor(watch, true);
   }
+}
 
-  return needMonitoring(discovered, sc, sc->mask, sc->recursive, add_watch);
+void INotifyEventPublisher::removeSubscriptionMonitors(
+    const INotifySubscriptionContextRef& isc) {
+  std::vector<int> watches;
+  {
+    WriteLock lock(path_mutex_);
+    for (const auto& watch : descriptor_inosubctx_) {
+      if (watch.second.isc == isc) {
+        watches.push_back(watch.first);
+      }
+    }
+  }
+
+  {
+    WriteLock lock(pending_mutex_);
+    pending_directories_.erase(
+        std::remove_if(pending_directories_.begin(),
+                       pending_directories_.end(),
+                       [&isc](const INotifyPendingDirectory& dir) {
+                         return dir.first == isc;
+                       }),
+        pending_directories_.end());
+  }
+
+  for (const auto& watch : watches) {
+    removeMonitor(watch, true);
+  }
+  isc->roots_.clear();
+}
+
+bool INotifyEventPublisher::isWatched(
+    const std::string& path, const INotifySubscriptionContextRef& isc) const {
+  WriteLock lock(path_mutex_);
+  INotifyPathTree::NodeId node;
+  int watch = -1;
+  if (!paths_.find(path, node) || !paths_.getDescriptor(node, watch)) {
+    return false;
+  }
+
+  if (isc == nullptr) {
+    return true;
+  }
+  auto it = descriptor_inosubctx_.find(watch);
+  return (it != descriptor_inosubctx_.end() && it->second.isc == isc);
+}
+
+size_t INotifyEventPublisher::registerPendingDirectories(size_t limit) {
+  size_t visited = 0;
+  while (visited < limit) {
+    std::vector<INotifyPendingDirectory> batch;
+    {
+      WriteLock lock(pending_mutex_);
+      auto count = std::min(limit - visited, pending_directories_.size());
+      count = std::min(count, kINotifyDiscoveryBatch);
+      if (count == 0) {
+        break;
+      }
+
+      auto end = pending_directories_.begin() + count;
+      batch.assign(std::make_move_iterator(pending_directories_.begin()),
+                   std::make_move_iterator(end));
+      pending_directories_.erase(pending_directories_.begin(), end);
+    }
+    visited += batch.size();
+
+    // List the batch in parallel, each thread takes every n-th directory.
+    std::vector<std::vector<std::string>> children(batch.size());
+    auto threads = std::max<size_t>(
+        1, std::min<size_t>(FLAGS_inotify_discovery_threads, batch.size()));
+    auto list = [&batch, &children, threads](size_t offset) {
+      for (size_t i = offset; i < batch.size(); i += threads) {
+        listSubdirectories(batch[i].second, children[i]);
+      }
+    };
+
+    std::vector<std::future<void>> listings;
+    for (size_t offset = 1; offset < threads; offset++) {
+      listings.push_back(std::async(std::launch::async, list, offset));
+    }
+    list(0);
+    for (auto& listing : listings) {
+      listing.wait();
+    }
+
+    // Watches are added from this thread, the kernel serializes them anyway.
+    std::vector<INotifyPendingDirectory> discovered;
+    for (size_t i = 0; i < batch.size(); i++) {
+      auto& isc = batch[i].first;
+      if (isc->mark_for_deletion) {
+        continue;
+      }
+
+      for (auto& child : children[i]) {
+        // Skips symlink loops and directories reached through another root.
+        if (isWatched(child, isc)) {
+          continue;
+        }
+
+        if (addMonitor(child, isc, isc->mask, false)) {
+          discovered.push_back(std::make_pair(isc, std::move(child)));
+        }
+      }
+    }
+
+    WriteLock lock(pending_mutex_);
+    std::move(discovered.begin(),
+              discovered.end(),
+              std::back_inserter(pending_directories_));
+  }
+
+  auto remaining = numPendingDirectories();
+  if (visited > 0) {
+    VLOG(1) << "inotify registered " << numDescriptors() << " watches, "
+            << remaining << " directories pending discovery";
+  }
+  return remaining;
 }
 
 void INotifyEventPublisher::buildExcludePathsSet() {
@@ -174,11 +540,7 @@ void INotifyEventPublisher::configure() {
   }
 
   for (auto& sub : delete_subscriptions) {
-    auto ino_sc = getSubscriptionContext(sub->context);
-    for (const auto& path : ino_sc->descriptor_paths_) {
-      removeMonitor(path.first, true, true);
-    }
-    ino_sc->descriptor_paths_.clear();
+    removeSubscriptionMonitors(getSubscriptionContext(sub->context));
   }
   delete_subscriptions.clear();
 
@@ -187,10 +549,13 @@ void INotifyEventPublisher::configure() {
   for (auto& sub : subscriptions_) {
     // Anytime a configure is called, try to monitor all subscriptions.
     // Configure is called as a response to removing/adding subscriptions.
-    // This means recalculating all monitored paths.
+    // Roots that are already watched are kept, only new roots are added.
     auto sc = getSubscriptionContext(sub->context);
     monitorSubscription(sc);
   }
+
+  // Large trees continue to be discovered from the publisher's run loop.
+  registerPendingDirectories(FLAGS_inotify_configure_directories);
 }
 
 void INotifyEventPublisher::tearDown() {
@@ -220,10 +585,14 @@ void INotifyEventPublisher::handleOverflow() {
 }
 
 Status INotifyEventPublisher::run() {
+  // Discover part of the pending directories, then service events. Do not
+  // wait on the handle while directories remain.
+  auto pending = registerPendingDirectories(kINotifyDiscoveryBatch);
+
   struct pollfd fds[1];
   fds[0].fd = getHandle();
   fds[0].events = POLLIN;
-  int selector = ::poll(fds, 1, 1000);
+  int selector = ::poll(fds, 1, (pending > 0) ? 0 : 1000);
   if (selector == -1) {
     if (errno == EINTR) {
       return Status(0, "inotify poll interrupted");
@@ -284,13 +653,13 @@ INotifyEventContextRef INotifyEventPublisher::createEventContextFrom(
   // Get the pathname the watch fired on.
   {
     WriteLock lock(path_mutex_);
-    if (descriptor_inosubctx_.find(event->wd) == descriptor_inosubctx_.end()) {
+    auto watch = descriptor_inosubctx_.find(event->wd);
+    if (watch == descriptor_inosubctx_.end()) {
       // return a blank event context if we can't find the paths for the event
       return ec;
     } else {
-      auto isc = descriptor_inosubctx_.at(event->wd);
-      ec->path = isc->descriptor_paths_.at(event->wd);
-      ec->isub_ctx = isc;
+      ec->path = paths_.getPath(watch->second.node);
+      ec->isub_ctx = watch->second.isc;
     }
   }
 
@@ -354,19 +723,25 @@ bool INotifyEventPublisher::addMonitor(const std::string& path,
       return false;
     }
 
-    if (descriptor_inosubctx_.find(watch) != descriptor_inosubctx_.end()) {
-      auto ino_sc = descriptor_inosubctx_.at(watch);
-      if (inotify_sanity_check) {
-        std::string watched_path = ino_sc->descriptor_paths_[watch];
-        path_descriptors_.erase(watched_path);
-      }
-      ino_sc->descriptor_paths_.erase(watch);
-      descriptor_inosubctx_.erase(watch);
+    auto existing = descriptor_inosubctx_.find(watch);
+    if (inotify_sanity_check && existing != descriptor_inosubctx_.end()) {
+      path_descriptors_.erase(paths_.getPath(existing->second.node));
     }
 
-    // Keep a map of (descriptor -> path)
-    isc->descriptor_paths_[watch] = path;
-    descriptor_inosubctx_[watch] = isc;
+    auto node = paths_.insert(path);
+    int previous = -1;
+    if (paths_.getDescriptor(node, previous) && previous != watch) {
+      // The path was replaced, the previous watch is stale.
+      descriptor_inosubctx_.erase(previous);
+    }
+
+    // Keep a map of (descriptor -> subscription, path)
+    paths_.setDescriptor(node, watch);
+    if (existing != descriptor_inosubctx_.end() &&
+        existing->second.node != node) {
+      paths_.clearDescriptor(existing->second.node);
+    }
+    descriptor_inosubctx_[watch] = {isc, node};
     if (inotify_sanity_check) {
       // Keep a map of the path -> watch descriptor
       path_descriptors_[path] = watch;
@@ -374,40 +749,27 @@ bool INotifyEventPublisher::addMonitor(const std::string& path,
   }
 
   if (recursive && isDirectory(path).ok()) {
-    std::vector<std::string> children;
-    // Get a list of children of this directory (requested recursive watches).
-    listDirectoriesInDirectory(path, children, true);
-
-    boost::system::error_code ec;
-    for (const auto& child : children) {
-      auto canonicalized = fs::canonical(child, ec).string() + '/';
-      addMonitor(canonicalized, isc, mask, false);
-    }
+    // Subdirectories are discovered (requested recursive watches) in batches.
+    WriteLock lock(pending_mutex_);
+    pending_directories_.push_back(std::make_pair(isc, path));
   }
 
   return true;
 }
 
-bool INotifyEventPublisher::removeMonitor(int watch,
-                                          bool force,
-                                          bool batch_del) {
+bool INotifyEventPublisher::removeMonitor(int watch, bool force) {
   {
     WriteLock lock(path_mutex_);
-    if (descriptor_inosubctx_.find(watch) == descriptor_inosubctx_.end()) {
+    auto it = descriptor_inosubctx_.find(watch);
+    if (it == descriptor_inosubctx_.end()) {
       return false;
     }
 
-    auto isc = descriptor_inosubctx_.at(watch);
-    descriptor_inosubctx_.erase(watch);
-
     if (inotify_sanity_check) {
-      std::string watched_path = isc->descriptor_paths_[watch];
-      path_descriptors_.erase(watched_path);
-    }
-
-    if (!batch_del) {
-      isc->descriptor_paths_.erase(watch);
+      path_descriptors_.erase(paths_.getPath(it->second.node));
     }
+    paths_.clearDescriptor(it->second.node);
+    descriptor_inosubctx_.erase(it);
   }
 
   if (force) {
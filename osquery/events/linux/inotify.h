@@ -10,12 +10,17 @@
 
 #pragma once
 
+#include <deque>
 #include <map>
+#include <set>
+#include <unordered_map>
 #include <vector>
 
 #include <sys/inotify.h>
 #include <sys/stat.h>
 
+#include <boost/noncopyable.hpp>
+
 #include <osquery/events.h>
 
 #include "osquery/events/pathset.h"
@@ -29,8 +34,92 @@ extern const uint32_t kFileAccessMasks;
 
 // INotifySubscriptionContext containers
 using PathDescriptorMap = std::map<std::string, int>;
-using DescriptorPathMap = std::map<int, std::string>;
-using PathStatusChangeTimeMap = std::map<std::string, time_t>;
+
+/**
+ * @brief A shared-prefix tree of the paths watched by INotifyEventPublisher.
+ *
+ * Large recursive subscriptions produce hundreds of thousands of watches that
+ * mostly share their leading directories. Each node stores a single path
+ * component and a reference to its parent, so a watched path costs one short
+ * string instead of a full copy per lookup table.
+ *
+ * Nodes are addressed by index and recycled through a free list; a node that
+ * is neither watched nor the parent of another node is released.
+ * This structure is not thread safe, the publisher's path_mutex_ protects it.
+ */
+class INotifyPathTree : private boost::noncopyable {
+ public:
+  using NodeId = uint32_t;
+
+  /// The root node is the filesystem root, it is never released.
+  static const NodeId kRoot = 0;
+
+  INotifyPathTree();
+
+  /**
+   * @brief Create (or find) the node for an absolute path.
+   *
+   * A trailing '/' is remembered so getPath reproduces the watched path.
+   */
+  NodeId insert(const std::string& path);
+
+  /// Find the node for an absolute path, without creating it.
+  bool find(const std::string& path, NodeId& node) const;
+
+  /// Rebuild the absolute path string of a node.
+  std::string getPath(NodeId node) const;
+
+  /// Check if a node is the same as, or beneath, another node.
+  bool isWithin(NodeId node, NodeId ancestor) const;
+
+  /// Attach an inotify watch descriptor to a node.
+  void setDescriptor(NodeId node, int descriptor);
+
+  /// Get the watch descriptor of a node, if the node is watched.
+  bool getDescriptor(NodeId node, int& descriptor) const;
+
+  /// Detach the watch descriptor and release unused nodes.
+  void clearDescriptor(NodeId node);
+
+  /// The number of nodes in use, including the root.
+  size_t size() const {
+    return nodes_.size() - free_.size();
+  }
+
+ private:
+  struct Node {
+    /// Index of the parent node.
+    NodeId parent{kRoot};
+
+    /// Watch descriptor, only valid if watched is set.
+    int descriptor{-1};
+
+    /// The node has a watch descriptor attached.
+    bool watched{false};
+
+    /// The node was inserted as a directory path (with a trailing '/').
+    bool directory{false};
+
+    /// The single path component this node represents.
+    std::string name;
+
+    /// Child node indexes, sorted by name.
+    std::vector<NodeId> children;
+  };
+
+  /// Position of a named child within the sorted children of a node.
+  std::vector<NodeId>::const_iterator findChild(NodeId node,
+                                                const std::string& name) const;
+
+  /// Release a node and every parent that is no longer used.
+  void release(NodeId node);
+
+ private:
+  std::vector<Node> nodes_;
+
+  /// Released node indexes available for reuse.
+  std::vector<NodeId> free_;
+};
 
 /**
  * @brief Subscription details for INotifyEventPublisher events.
@@ -81,11 +170,8 @@ struct INotifySubscriptionContext : public SubscriptionContext {
   /// A configure-time pattern was expanded to match absolute paths.
   bool recursive_match{false};
 
-  /// Map of inotify watch file descriptor to watched path string.
-  DescriptorPathMap descriptor_paths_;
-
-  /// Map of path and status change time of file/directory.
-  PathStatusChangeTimeMap path_sc_time_;
+  /// Resolved paths this subscription registered watches (and discovery) for.
+  std::set<std::string> roots_;
 
  private:
   friend class INotifyEventPublisher;
@@ -122,8 +208,16 @@ struct INotifyEventContext : public EventContext {
 
 using INotifyEventContextRef = std::shared_ptr<INotifyEventContext>;
 
-// Publisher container
-using DescriptorINotifySubCtxMap = std::map<int, INotifySubscriptionContextRef>;
+/// An inotify watch: the subscription owning it and the watched path.
+struct INotifyWatch {
+  INotifySubscriptionContextRef isc;
+  INotifyPathTree::NodeId node{INotifyPathTree::kRoot};
+};
+
+// Publisher containers
+using DescriptorINotifySubCtxMap = std::unordered_map<int, INotifyWatch>;
+using INotifyPendingDirectory =
+    std::pair<INotifySubscriptionContextRef, std::string>;
 
 using ExcludePathSet = PathSet<patternedPath>;
 
@@ -191,12 +285,12 @@ class INotifyEventPublisher
    * and existing monitor and this is a non-directory leaf? On success the
    * file descriptor is stored for lookup when events fire.
    *
-   * A recursive flag will tell addMonitor to enumerate all subdirectories
-   * recursively and add monitors to them.
+   * A recursive flag will queue the directory for discovery, its
+   * subdirectories are watched by registerPendingDirectories.
    *
    * @param path complete (non-glob) canonical path to monitor.
    * @param subscription context tracking the path.
-   * @param recursive perform a single recursive search of subdirectories.
+   * @param recursive queue subdirectories for recursive discovery.
    * @param add_watch (testing only) should an inotify watch be created.
    * @return success if the inotify watch was created.
    */
@@ -209,9 +303,8 @@ class INotifyEventPublisher
   /**
    * Some decision making code refactored in needMonitoring before calling
    * addMonitor in the context of monitorSubscription.
-   * Decision to call addMonitor from the context of monitorSubscription
-   * is done based on the status change time of file/directory, since
-   * creation time is not available on linux.
+   * A root path the subscription already registered, and which is still
+   * watched, is left untouched so a configure only pays for what changed.
    */
   bool needMonitoring(const std::string& path,
                       INotifySubscriptionContextRef& isc,
@@ -223,11 +316,45 @@ class INotifyEventPublisher
   bool monitorSubscription(INotifySubscriptionContextRef& sc,
                            bool add_watch = true);
 
+  /// Remove the watches a subscription owns within (and including) a root.
+  void removeRoot(const INotifySubscriptionContextRef& isc,
+                  const std::string& root);
+
+  /// Remove every watch owned by a subscription.
+  void removeSubscriptionMonitors(const INotifySubscriptionContextRef& isc);
+
+  /**
+   * @brief Check if a path is watched.
+   *
+   * @param path complete path, as given to addMonitor.
+   * @param isc if set, the watch must also be owned by this subscription.
+   */
+  bool isWatched(const std::string& path,
+                 const INotifySubscriptionContextRef& isc = nullptr) const;
+
+  /**
+   * @brief Watch the subdirectories of queued directories.
+   *
+   * Directories are listed in parallel, new subdirectories are watched and
+   * queued in turn. Stops after visiting a limit of directories so callers
+   * can service events while a large tree is being registered.
+   *
+   * @param limit the maximum number of queued directories to visit.
+   * @return the number of directories still queued.
+   */
+  size_t registerPendingDirectories(size_t limit);
+
+  /// Get the number of directories waiting for discovery.
+  size_t numPendingDirectories() const {
+    WriteLock lock(pending_mutex_);
+    return pending_directories_.size();
+  }
+
   /// Build the set of excluded paths for which events are not to be propogated.
   void buildExcludePathsSet();
 
   /// Remove an INotify watch (monitor) from our tracking.
-  bool removeMonitor(int watch, bool force = false, bool batch_del = false);
+  bool removeMonitor(int watch, bool force = false);
 
   /// Given a SubscriptionContext and INotifyEventContext match path and action.
   bool shouldFire(const INotifySubscriptionContextRef& mc,
@@ -250,9 +377,15 @@ class INotifyEventPublisher
   /// Used for sanity check from unit test(s).
   PathDescriptorMap path_descriptors_;
 
-  /// Map of inotify watch file descriptor to subscription context.
+  /// Map of inotify watch file descriptor to subscription context and path.
   DescriptorINotifySubCtxMap descriptor_inosubctx_;
 
+  /// The paths of every watch, see INotifyWatch.
+  INotifyPathTree paths_;
+
+  /// Recursive directories whose subdirectories are not yet watched.
+  std::deque<INotifyPendingDirectory> pending_directories_;
+
   /// Events pertaining to these paths not to be propagated.
   ExcludePathSet exclude_paths_;
 
@@ -285,6 +418,9 @@ class INotifyEventPublisher
   /// Access the Inofity response scratch space.
   mutable Mutex scratch_mutex_;
 
+  /// Access to the directories pending discovery.
+  mutable Mutex pending_mutex_;
+
  public:
   friend class INotifyTests;
   FRIEND_TEST(INotifyTests, test_inotify_init);
@@ -292,5 +428,6 @@ class INotifyEventPublisher
   FRIEND_TEST(INotifyTests, test_inotify_recursion);
   FRIEND_TEST(INotifyTests, test_inotify_match_subscription);
   FRIEND_TEST(INotifyTests, test_inotify_embedded_wildcards);
+  FRIEND_TEST(INotifyTests, test_inotify_incremental_configure);
 };
 }
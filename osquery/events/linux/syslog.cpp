@@ -16,14 +16,11 @@
 #include <time.h>
 #include <unistd.h>
 
-#include <istream>
+#include <cctype>
+#include <cstring>
 #include <string>
 
-#include <boost/algorithm/string/trim.hpp>
 #include <boost/filesystem.hpp>
-#include <boost/lexical_cast.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/tokenizer.hpp>
 #include <osquery/registry_factory.h>
 
 #include <osquery/filesystem.h>
@@ -44,8 +41,14 @@ FLAG(string,
 
 FLAG(uint64,
      syslog_rate_limit,
-     100,
-     "Maximum number of logs to ingest per run (~200ms between runs)");
+     0,
+     "Maximum number of logs to ingest per run, 0 for no limit");
+
+FLAG(uint64,
+     syslog_cpu_budget,
+     50,
+     "Milliseconds of CPU time to spend ingesting logs per run (~200ms "
+     "between runs)");
 
 REGISTER(SyslogEventPublisher, "event_publisher", "syslog");
 
@@ -57,6 +60,34 @@ const std::vector<std::string> kCsvFields = {
     "time", "host", "severity", "facility", "tag", "message"};
 const size_t kErrorThreshold = 10;
 
+/// Initial size of the pipe read buffer.
+const size_t kReadBufferSize = 64 * 1024;
+
+/// The buffer grows to fit long lines, longer lines are dropped.
+const size_t kMaxLineSize = 1024 * 1024;
+
+/// Milliseconds of CPU time used by the calling thread.
+static uint64_t getThreadCPUTime() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// Remove the leading and trailing whitespace of a field.
+static boost::string_ref trimField(boost::string_ref value) {
+  while (!value.empty() &&
+         std::isspace(static_cast<unsigned char>(value.front()))) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() &&
+         std::isspace(static_cast<unsigned char>(value.back()))) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
 Status SyslogEventPublisher::setUp() {
   if (!FLAGS_enable_syslog) {
     return Status(1, "Publisher disabled via configuration");
@@ -84,16 +115,16 @@ Status SyslogEventPublisher::setUp() {
     return s;
   }
 
-  // Opening with both flags appears to be the only way to open the pipe
-  // without blocking for a writer. We won't ever write to the pipe, but we
-  // don't want to block here and will instead block waiting for a read in the
-  // run() method
-  readStream_.open(FLAGS_syslog_pipe_path,
-                   std::ifstream::in | std::ifstream::out);
-  if (!readStream_.good()) {
+  // Opening for reading and writing does not block for a writer, and keeps
+  // reads from seeing end-of-file when rsyslog closes its end. We won't ever
+  // write to the pipe. Reads do not block, run() drains what is pending.
+  readFd_ =
+      open(FLAGS_syslog_pipe_path.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+  if (readFd_ == -1) {
     return Status(1,
                   "Error opening pipe for reading: " + FLAGS_syslog_pipe_path);
   }
+  buffer_.resize(kReadBufferSize);
   VLOG(1) << "Successfully opened pipe for syslog ingestion: "
           << FLAGS_syslog_pipe_path;
 
@@ -149,23 +180,86 @@ void SyslogEventPublisher::unlockPipe() {
 }
 
 Status SyslogEventPublisher::run() {
-  // This run function will be called by the event factory with ~100ms pause
-  // (see InterruptableRunnable::pause()) between runs. In case something goes
-  // weird and there is a huge amount of input, we limit how many logs we
-  // take in per run to avoid pegging the CPU.
-  for (size_t i = 0; i < FLAGS_syslog_rate_limit; ++i) {
-    if (readStream_.rdbuf()->in_avail() == 0) {
+  // This run function will be called by the event factory with ~200ms pause
+  // (see InterruptableRunnable::pause()) between runs. Pending input is read
+  // until the pipe is drained. In case there is a huge amount of input, we
+  // limit the CPU time spent per run to avoid pegging the CPU; the rest stays
+  // buffered in the pipe for the next run.
+  auto budget_end = getThreadCPUTime() + FLAGS_syslog_cpu_budget;
+  size_t lines = 0;
+  while (true) {
+    if (bufferUsed_ == buffer_.size()) {
+      if (buffer_.size() < kMaxLineSize) {
+        buffer_.resize(buffer_.size() * 2);
+      } else {
+        LOG(ERROR) << "Dropping syslog line longer than " << kMaxLineSize
+                   << " bytes";
+        bufferUsed_ = 0;
+        discarding_ = true;
+      }
+    }
+
+    auto bytes = read(
+        readFd_, buffer_.data() + bufferUsed_, buffer_.size() - bufferUsed_);
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    } else if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
       // If there is no pending data, we have flushed everything and can wait
       // until the next time EventFactory calls run(). This also allows the
       // thread to join when it is stopped by EventFactory.
       return Status(0, "OK");
+    } else if (bytes <= 0) {
+      return Status(
+          1, "Error reading from pipe: " + std::string(strerror(errno)));
     }
-    std::string line;
-    std::getline(readStream_, line);
+    bufferUsed_ += static_cast<size_t>(bytes);
+
+    // Every complete line from this read is fired as a single event.
     auto ec = createEventContext();
-    Status status = populateEventContext(line, ec);
-    if (status.ok()) {
+    auto status = parseBuffer(ec);
+    lines += ec->rows.size();
+    if (!ec->rows.empty()) {
       fire(ec);
+    }
+
+    if (!status.ok()) {
+      return status;
+    }
+
+    if (getThreadCPUTime() >= budget_end ||
+        (FLAGS_syslog_rate_limit > 0 && lines >= FLAGS_syslog_rate_limit)) {
+      return Status(0, "OK");
+    }
+  }
+}
+
+Status SyslogEventPublisher::parseBuffer(SyslogEventContextRef& ec) {
+  Status status;
+  const char* data = buffer_.data();
+  size_t start = 0;
+  while (start < bufferUsed_) {
+    auto newline = static_cast<const char*>(
+        memchr(data + start, '\n', bufferUsed_ - start));
+    if (newline == nullptr) {
+      break;
+    }
+
+    boost::string_ref line(data + start, newline - (data + start));
+    start = static_cast<size_t>(newline - data) + 1;
+    if (discarding_) {
+      // The end of a dropped line.
+      discarding_ = false;
+      continue;
+    }
+
+    if (line.empty()) {
+      continue;
+    }
+
+    Row fields;
+    status = populateEventContext(line, fields);
+    if (status.ok()) {
+      ec->rows.push_back(std::move(fields));
       if (errorCount_ > 0) {
         --errorCount_;
       }
@@ -173,43 +267,115 @@ Status SyslogEventPublisher::run() {
       LOG(ERROR) << status.getMessage() << " in line: " << line;
       ++errorCount_;
       if (errorCount_ >= kErrorThreshold) {
-        return Status(1, "Too many errors in syslog parsing.");
+        status = Status(1, "Too many errors in syslog parsing.");
+        break;
       }
+      status = Status(0, "OK");
     }
   }
-  return Status(0, "OK");
+
+  // Move the partial line to the front, the next read completes it.
+  if (start > 0) {
+    memmove(buffer_.data(), data + start, bufferUsed_ - start);
+    bufferUsed_ -= start;
+  }
+  return status;
 }
 
 void SyslogEventPublisher::tearDown() {
   unlockPipe();
+  if (readFd_ != -1) {
+    close(readFd_);
+    readFd_ = -1;
+  }
 }
 
-Status SyslogEventPublisher::populateEventContext(const std::string& line,
-                                                  SyslogEventContextRef& ec) {
-  boost::tokenizer<RsyslogCsvSeparator> tokenizer(line);
-  auto key = kCsvFields.begin();
-  for (std::string value : tokenizer) {
-    if (key == kCsvFields.end()) {
-      return Status(1, "Received more fields than expected");
-    }
+Status SyslogEventPublisher::populateEventContext(boost::string_ref line,
+                                                  Row& fields) {
+  splitRsyslogCsv(line, csvFields_);
+  if (csvFields_.size() > kCsvFields.size()) {
+    return Status(1, "Received more fields than expected");
+  } else if (csvFields_.size() < kCsvFields.size()) {
+    return Status(1, "Received fewer fields than expected");
+  }
 
-    boost::trim(value);
-    if (*key == "time") {
-      ec->fields["datetime"] = value;
-    } else if (*key == "tag" && !value.empty() && value.back() == ':') {
+  for (size_t i = 0; i < kCsvFields.size(); ++i) {
+    const auto& key = kCsvFields[i];
+    auto value = trimField(csvFields_[i]);
+    if (key == "time") {
+      fields["datetime"] = value.to_string();
+    } else if (key == "tag" && !value.empty() && value.back() == ':') {
       // rsyslog sends "tag" with a trailing colon that we don't need
-      ec->fields.emplace(*key, value.substr(0, value.size() - 1));
+      fields.emplace(key, value.substr(0, value.size() - 1).to_string());
     } else {
-      ec->fields.emplace(*key, value);
+      fields.emplace(key, value.to_string());
     }
-    ++key;
   }
+  return Status(0, "OK");
+}
 
-  if (key == kCsvFields.end()) {
-    return Status(0, "OK");
-  } else {
-    return Status(1, "Received fewer fields than expected");
+void splitRsyslogCsv(boost::string_ref line, std::vector<std::string>& fields) {
+  size_t count = 0;
+  if (line.empty()) {
+    fields.clear();
+    return;
+  }
+
+  const char* next = line.data();
+  const char* end = line.data() + line.size();
+  while (true) {
+    if (count == fields.size()) {
+      fields.emplace_back();
+    }
+    auto& field = fields[count++];
+    field.clear();
+
+    // Scan to the next separator, quotes toggle whether commas separate.
+    bool in_quote = false;
+    bool separated = false;
+    while (next != end) {
+      if (in_quote) {
+        auto quote = static_cast<const char*>(memchr(next, '"', end - next));
+        if (quote == nullptr) {
+          // An unterminated quote runs to the end of the line.
+          field.append(next, end);
+          next = end;
+          break;
+        }
+        field.append(next, quote);
+        next = quote + 1;
+        if (next != end && *next == '"') {
+          // rsyslog escapes " with "", so reverse this by inserting "
+          field += '"';
+          ++next;
+        } else {
+          in_quote = false;
+        }
+        continue;
+      }
+
+      auto stop = next;
+      while (stop != end && *stop != ',' && *stop != '"') {
+        ++stop;
+      }
+      field.append(next, stop);
+      next = stop;
+      if (next == end) {
+        break;
+      }
+      ++next;
+      if (*stop == ',') {
+        separated = true;
+        break;
+      }
+      in_quote = true;
+    }
+
+    if (!separated) {
+      break;
+    }
   }
+  fields.resize(count);
 }
 
 bool SyslogEventPublisher::shouldFire(const SyslogSubscriptionContextRef& sc,
@@ -10,10 +10,11 @@
 
 #pragma once
 
-#include <stdio.h>
-
-#include <fstream>
 #include <map>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_ref.hpp>
 
 #include <osquery/events.h>
 
@@ -33,14 +34,16 @@ struct SyslogSubscriptionContext : public SubscriptionContext {
 
 /**
  * @brief Event details for SyslogEventPublisher events
+ *
+ * Lines read together from the pipe are fired as a single event.
  */
 struct SyslogEventContext : public EventContext {
   /**
-   * @brief The syslog message tokenized into fields.
+   * @brief The syslog messages tokenized into fields, one row per line.
    *
    * Fields will be stripped of extra space
    */
-  std::map<std::string, std::string> fields;
+  std::vector<Row> rows;
 };
 
 using SyslogEventContextRef = std::shared_ptr<SyslogEventContext>;
@@ -49,9 +52,9 @@ using SyslogSubscriptionContextRef = std::shared_ptr<SyslogSubscriptionContext>;
 /**
  * @brief Event publisher for syslog lines forwarded through rsyslog
  *
- * This event publisher ingests JSON representations of syslog entries, and
+ * This event publisher ingests CSV representations of syslog entries, and
  * publishes them to it's subscribers. In order for it to function properly,
- * rsyslog must be configured to forward JSON to a named pipe that this
+ * rsyslog must be configured to forward CSV to a named pipe that this
  * publisher will read from.
  */
 class SyslogEventPublisher
@@ -104,18 +107,34 @@ class SyslogEventPublisher
   void unlockPipe();
 
   /**
-   * @brief Populate the SyslogEventContext with the syslog JSON.
+   * @brief Parse the complete lines at the front of the read buffer.
    *
-   * Performs basic cleanup on the JSON data as it is populated into the
-   * context.
+   * Rows are appended to the event context, a trailing partial line is moved
+   * to the front of the buffer to be completed by the next read.
    */
-  static Status populateEventContext(const std::string& line,
-                                     SyslogEventContextRef& ec);
+  Status parseBuffer(SyslogEventContextRef& ec);
 
   /**
-   * @brief Input stream for reading from the pipe.
+   * @brief Populate a row with the fields of a syslog CSV line.
+   *
+   * Performs basic cleanup on the CSV data as it is populated into the row.
    */
-  std::fstream readStream_;
+  Status populateEventContext(boost::string_ref line, Row& fields);
+
+  /// Non-blocking descriptor for reading from the pipe.
+  int readFd_{-1};
+
+  /// Bytes read from the pipe that do not yet form a complete line.
+  std::vector<char> buffer_;
+
+  /// The number of bytes used at the front of buffer_.
+  size_t bufferUsed_{0};
+
+  /// Skip input up to the next newline, the line did not fit the buffer.
+  bool discarding_{false};
+
+  /// The fields of the line being parsed, reused between lines.
+  std::vector<std::string> csvFields_;
 
   /**
    * @brief Counter used to shut down thread when too many errors occur.
@@ -131,76 +150,25 @@ class SyslogEventPublisher
    * @brief File descriptor used to lock the pipe for reading.
    *
    * This fd should not be used for reading from the pipe, instead use
-   * readStream_.
+   * readFd_.
    */
   int lockFd_;
 
  private:
   FRIEND_TEST(SyslogTests, test_populate_event_context);
+  FRIEND_TEST(SyslogTests, test_parse_buffer);
 };
 
 /**
- * Boost TokenizerFunction functor for tokenizing rsyslog CSV data
+ * @brief Split a line of rsyslog CSV data into fields.
  *
- * This functor is intended to be used with boost::tokenizer in order to
- * properly parse CSV data generated by rsyslog. The default
- * boost::escaped_list_separator provided with boost::tokenizer chokes on
- * rsyslog CSV output, because rsyslog escapes " with "", and also does not
- * escape backslashes. Our implementation closely follows the one provided with
- * Boost, but allows for the idiosyncrasies of rsyslog output and simplifies
- * the implementation for our limited use case.
+ * rsyslog escapes " with "", and also does not escape backslashes, which the
+ * Boost CSV tokenizer chokes on. Fields are appended a run at a time, quoted
+ * runs end at the next quote found with memchr. A trailing comma produces an
+ * empty last field, an empty line produces no fields.
+ *
+ * @param line One line of CSV data, without the newline.
+ * @param fields Output, cleared first; the strings are reused.
  */
-class RsyslogCsvSeparator {
- public:
-  RsyslogCsvSeparator() : last_(false) {}
-
-  void reset() {
-    last_ = false;
-  }
-
-  template <typename InputIterator, typename Token>
-  bool operator()(InputIterator& next, InputIterator end, Token& tok) {
-    bool in_quote = false;
-    tok = Token();
-
-    if (next == end) {
-      if (last_) {
-        // The last character was a comma, so we got an empty field at the end
-        last_ = false;
-        return true;
-      } else {
-        return false;
-      }
-    }
-    last_ = false;
-    for (; next != end; ++next) {
-      if (*next == ',') {
-        if (!in_quote) {
-          ++next;
-          last_ = true;
-          return true;
-        } else {
-          tok += *next;
-        }
-      } else if (*next == '"') {
-        auto after = next + 1;
-        if (!in_quote) {
-          in_quote = true;
-        } else if (after != end && *after == '"') {
-          // rsyslog escapes " with "", so reverse this by inserting "
-          tok += "\"";
-          ++next;
-        } else {
-          in_quote = false;
-        }
-      } else {
-        tok += *next;
-      }
-    }
-    return true;
-  }
-
- private:
-  bool last_;
-};
+void splitRsyslogCsv(boost::string_ref line, std::vector<std::string>& fields);
 }
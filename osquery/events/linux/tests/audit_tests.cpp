@@ -21,7 +21,9 @@
 #include <osquery/flags.h>
 #include <osquery/tables.h>
 
+#include "osquery/core/json.h"
 #include "osquery/events/linux/auditdnetlink.h"
+#include "osquery/events/linux/auditfilter.h"
 #include "osquery/tests/test_util.h"
 
 namespace osquery {
@@ -72,7 +74,8 @@ TEST_F(AuditTests, test_handle_reply) {
   free((char*)reply.message);
 
   EXPECT_EQ(reply.type, audit_event_record.type);
-  EXPECT_EQ("1440542781.644:403030", audit_event_record.audit_id);
+  EXPECT_EQ(audit_event_record.time, 1440542781U);
+  EXPECT_EQ(audit_event_record.audit_id, (1440542781ULL << 32U) | 403030U);
   EXPECT_EQ(audit_event_record.fields.size(), 4U);
   EXPECT_EQ(audit_event_record.fields.count("argc"), 1U);
   EXPECT_EQ(audit_event_record.fields["argc"], "3");
@@ -81,6 +84,88 @@ TEST_F(AuditTests, test_handle_reply) {
   EXPECT_EQ(audit_event_record.fields["a2"], "c");
 }
 
+TEST_F(AuditTests, test_handle_reply_reused_buffer) {
+  // Reply buffers are recycled, data after the terminator must be ignored.
+  std::string message("audit(1440542781.644:403031): pid=1 exe=\"/bin/ls\"");
+  message.push_back('\0');
+  message += " stale=1";
+
+  audit_reply reply = {};
+  reply.type = 1;
+  reply.len = message.size();
+  reply.message = &message[0];
+
+  AuditEventRecord audit_event_record = {};
+  ASSERT_TRUE(AuditdNetlinkParser::ParseAuditReply(reply, audit_event_record));
+
+  // Copies share the tokenized text, and outlive the reply buffer.
+  auto record_copy = audit_event_record;
+  message.assign(message.size(), 'X');
+  audit_event_record = {};
+
+  EXPECT_EQ(record_copy.fields.size(), 2U);
+  EXPECT_EQ(record_copy.fields.count("stale"), 0U);
+  EXPECT_EQ(record_copy.fields.at("pid"), "1");
+  EXPECT_EQ(record_copy.fields["exe"], "\"/bin/ls\"");
+  EXPECT_EQ(record_copy.fields["missing"], "");
+}
+
+TEST_F(AuditTests, test_parse_preamble) {
+  unsigned long int time = 0U;
+  std::uint64_t audit_id = 0U;
+  std::size_t preamble_size = 0U;
+
+  boost::string_ref message("audit(1440542781.644:7): pid=1");
+  ASSERT_TRUE(AuditdNetlinkParser::ParseAuditPreamble(
+      message, time, audit_id, preamble_size));
+  EXPECT_EQ(time, 1440542781U);
+  EXPECT_EQ(audit_id, (1440542781ULL << 32U) | 7U);
+  EXPECT_EQ(message.substr(preamble_size), "pid=1");
+
+  // Records without a serial number or with bad digits are rejected.
+  EXPECT_FALSE(AuditdNetlinkParser::ParseAuditPreamble(
+      "audit(1440542781.644): pid=1", time, audit_id, preamble_size));
+  EXPECT_FALSE(AuditdNetlinkParser::ParseAuditPreamble(
+      "audit(144054a781.644:7): pid=1", time, audit_id, preamble_size));
+  EXPECT_FALSE(AuditdNetlinkParser::ParseAuditPreamble(
+      "type=1 pid=1", time, audit_id, preamble_size));
+}
+
+TEST_F(AuditTests, test_record_queue_order) {
+  AuditRecordQueue queue;
+  EXPECT_TRUE(queue.empty());
+
+  auto L_Records = [](std::uint64_t audit_id) {
+    AuditEventRecord record = {};
+    record.audit_id = audit_id;
+    return std::vector<AuditEventRecord>{record};
+  };
+
+  // Batches parsed out of order are held back until the gap is filled
+  queue.push(2U, L_Records(2U));
+  queue.push(1U, {});
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.takeAll().empty());
+
+  queue.push(0U, L_Records(0U));
+  EXPECT_FALSE(queue.empty());
+
+  auto record_list = queue.takeAll();
+  ASSERT_EQ(record_list.size(), 2U);
+  EXPECT_EQ(record_list[0].audit_id, 0U);
+  EXPECT_EQ(record_list[1].audit_id, 2U);
+  EXPECT_TRUE(queue.empty());
+
+  queue.push(4U, L_Records(4U));
+  queue.push(3U, L_Records(3U));
+
+  record_list = queue.takeAll();
+  ASSERT_EQ(record_list.size(), 2U);
+  EXPECT_EQ(record_list[0].audit_id, 3U);
+  EXPECT_EQ(record_list[1].audit_id, 4U);
+  EXPECT_TRUE(queue.empty());
+}
+
 TEST_F(AuditTests, test_audit_value_decode) {
   // In the normal case the decoding only removes '"' characters from the ends.
   auto decoded_normal = DecodeAuditPathValues("\"/bin/ls\"");
@@ -95,6 +180,74 @@ TEST_F(AuditTests, test_audit_value_decode) {
   EXPECT_EQ(decoded_fail, "7");
 }
 
+TEST_F(AuditTests, test_audit_table_filter) {
+  auto doc = JSON::newObject();
+  ASSERT_TRUE(doc.fromString("{\"exclude\": [{\"uid\": 0, \"exe\": "
+                             "\"/usr/bin/agent\"}, {\"auid\": -1}],"
+                             "\"include\": [{\"family\": 2}]}")
+                  .ok());
+
+  AuditTableFilter filter;
+  ASSERT_TRUE(ParseAuditTableFilter(doc.doc(), filter).ok());
+  ASSERT_EQ(filter.exclude_list.size(), 2U);
+  ASSERT_EQ(filter.include_list.size(), 1U);
+  EXPECT_EQ(filter.exclude_list[1][0].number, 4294967295U);
+
+  auto L_ParseFields = [](const std::string& text) -> AuditEventRecord {
+    std::string message = "audit(1440542781.644:1): " + text;
+
+    audit_reply reply = {};
+    reply.type = AUDIT_SYSCALL;
+    reply.len = message.size();
+    reply.message = &message[0];
+
+    AuditEventRecord record = {};
+    AuditdNetlinkParser::ParseAuditReply(reply, record);
+    return record;
+  };
+
+  // Exclusions match on every field of a rule, paths may be hex-encoded.
+  auto agent = L_ParseFields("auid=1000 uid=0 exe=\"/usr/bin/agent\"");
+  EXPECT_FALSE(filter.accepts(agent.fields, 2));
+  agent = L_ParseFields("auid=1000 uid=0 exe=2F7573722F62696E2F6167656E74");
+  EXPECT_FALSE(filter.accepts(agent.fields, 2));
+
+  auto shell = L_ParseFields("auid=1000 uid=0 exe=\"/bin/sh\"");
+  EXPECT_TRUE(filter.accepts(shell.fields, 2));
+  EXPECT_FALSE(filter.accepts(shell.fields, 10));
+  EXPECT_FALSE(filter.accepts(shell.fields));
+
+  auto daemon = L_ParseFields("auid=4294967295 uid=0 exe=\"/bin/sh\"");
+  EXPECT_FALSE(filter.accepts(daemon.fields, 2));
+
+  // Unknown fields are rejected.
+  ASSERT_TRUE(doc.fromString("{\"exclude\": [{\"comm\": \"sh\"}]}").ok());
+  EXPECT_FALSE(ParseAuditTableFilter(doc.doc(), filter).ok());
+}
+
+TEST_F(AuditTests, test_audit_rule_conditions) {
+  AuditFilterRule rule = {{AuditFilterField::Uid, "0", 0U},
+                          {AuditFilterField::Family, "2", 2U},
+                          {AuditFilterField::Exe, "/bin/sh", 0U}};
+
+  EXPECT_TRUE(IsKernelAuditFilterCondition(rule[0]));
+  EXPECT_FALSE(IsKernelAuditFilterCondition(rule[1]));
+
+  AuditRuleDataObject rule_object(sizeof(audit_rule_data), 0U);
+  ASSERT_TRUE(AppendAuditRuleConditions(rule_object, rule));
+  ASSERT_EQ(rule_object.size(), sizeof(audit_rule_data) + 7U);
+
+  // The socket family is not known to the kernel and is skipped.
+  auto rule_data = reinterpret_cast<audit_rule_data*>(rule_object.data());
+  ASSERT_EQ(rule_data->field_count, 2U);
+  EXPECT_EQ(rule_data->fields[0], static_cast<__u32>(AUDIT_UID));
+  EXPECT_EQ(rule_data->values[0], 0U);
+  EXPECT_EQ(rule_data->fields[1], static_cast<__u32>(AUDIT_EXE));
+  EXPECT_EQ(rule_data->values[1], 7U);
+  EXPECT_EQ(rule_data->buflen, 7U);
+  EXPECT_EQ(std::string(rule_data->buf, rule_data->buflen), "/bin/sh");
+}
+
 size_t kAuditCounter{0};
 
 bool SimpleUpdate(size_t t, const StringMap& f, StringMap& m) {
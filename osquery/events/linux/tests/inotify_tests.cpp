@@ -17,6 +17,7 @@
 
 #include <osquery/events.h>
 #include <osquery/filesystem.h>
+#include <osquery/flags.h>
 #include <osquery/registry_factory.h>
 #include <osquery/tables.h>
 
@@ -27,6 +28,8 @@ namespace fs = boost::filesystem;
 
 namespace osquery {
 
+DECLARE_uint64(inotify_configure_directories);
+
 const int kMaxEventLatency = 3000;
 
 class INotifyTests : public testing::Test {
@@ -336,6 +339,7 @@ class TestINotifyEventSubscriber
   FRIEND_TEST(INotifyTests, test_inotify_directory_watch);
   FRIEND_TEST(INotifyTests, test_inotify_recursion);
   FRIEND_TEST(INotifyTests, test_inotify_embedded_wildcards);
+  FRIEND_TEST(INotifyTests, test_inotify_incremental_configure);
 };
 
 TEST_F(INotifyTests, test_inotify_run) {
@@ -500,7 +504,8 @@ TEST_F(INotifyTests, test_inotify_recursion) {
   pub->configure();
 
   // Also expect canonicalized resolution (to prevent loops).
-  EXPECT_EQ(pub->path_descriptors_.size(), 9U);
+  // The link resolves to the already watched root and adds no watches.
+  EXPECT_EQ(pub->path_descriptors_.size(), 11U);
   RemoveAll(pub);
 
   // Remove mock directory structure.
@@ -534,4 +539,82 @@ TEST_F(INotifyTests, test_inotify_embedded_wildcards) {
   ASSERT_EQ(event_pub_->numDescriptors(), 1U);
   EXPECT_EQ(event_pub_->path_descriptors_.count(real_test_dir + "/2/1/"), 1U);
 }
+
+TEST_F(INotifyTests, test_inotify_incremental_configure) {
+  auto pub = std::make_shared<INotifyEventPublisher>(true);
+  EventFactory::registerEventPublisher(pub);
+  auto sub = std::make_shared<TestINotifyEventSubscriber>();
+  createMockFileStructure();
+
+  // Only discover part of the tree while configuring.
+  auto configure_directories = FLAGS_inotify_configure_directories;
+  FLAGS_inotify_configure_directories = 2;
+
+  auto sc = sub->createSubscriptionContext();
+  sc->path = kFakeDirectory + "/**";
+  sub->subscribe(&TestINotifyEventSubscriber::Callback, sc);
+  pub->configure();
+  EXPECT_LT(pub->numDescriptors(), 11U);
+  EXPECT_GT(pub->numPendingDirectories(), 0U);
+
+  // The run loop continues the discovery.
+  EXPECT_EQ(pub->registerPendingDirectories(100), 0U);
+  EXPECT_EQ(pub->numDescriptors(), 11U);
+  FLAGS_inotify_configure_directories = configure_directories;
+
+  // A later configure keeps every existing watch.
+  auto watches = pub->path_descriptors_;
+  pub->configure();
+  EXPECT_EQ(pub->path_descriptors_, watches);
+  EXPECT_EQ(pub->numPendingDirectories(), 0U);
+
+  // Removing the subscription removes the watches of the discovered tree.
+  pub->removeSubscriptions(sub->getName());
+  pub->configure();
+  EXPECT_EQ(pub->numDescriptors(), 0U);
+  EXPECT_TRUE(pub->path_descriptors_.empty());
+  EXPECT_EQ(pub->paths_.size(), 1U);
+
+  tearDownMockFileStructure();
+  EventFactory::deregisterEventPublisher("inotify");
+}
+
+TEST_F(INotifyTests, test_inotify_path_tree) {
+  INotifyPathTree tree;
+  auto dir = tree.insert("/etc/ssl/");
+  auto file = tree.insert("/etc/ssl/openssl.cnf");
+  auto other = tree.insert("/etc/passwd");
+  EXPECT_EQ(tree.size(), 5U);
+
+  EXPECT_EQ(tree.getPath(dir), "/etc/ssl/");
+  EXPECT_EQ(tree.getPath(file), "/etc/ssl/openssl.cnf");
+  EXPECT_EQ(tree.getPath(INotifyPathTree::kRoot), "/");
+
+  INotifyPathTree::NodeId node;
+  EXPECT_TRUE(tree.find("/etc/ssl", node));
+  EXPECT_EQ(node, dir);
+  EXPECT_FALSE(tree.find("/etc/ssh/", node));
+
+  EXPECT_TRUE(tree.isWithin(file, dir));
+  EXPECT_TRUE(tree.isWithin(dir, dir));
+  EXPECT_FALSE(tree.isWithin(other, dir));
+
+  int descriptor = -1;
+  tree.setDescriptor(dir, 3);
+  tree.setDescriptor(file, 4);
+  EXPECT_TRUE(tree.getDescriptor(dir, descriptor));
+  EXPECT_EQ(descriptor, 3);
+  EXPECT_FALSE(tree.getDescriptor(other, descriptor));
+
+  // A watched directory keeps its node when its children are released.
+  tree.clearDescriptor(file);
+  EXPECT_FALSE(tree.find("/etc/ssl/openssl.cnf", node));
+  EXPECT_EQ(tree.size(), 4U);
+
+  // Released nodes are reused.
+  tree.clearDescriptor(dir);
+  EXPECT_EQ(tree.size(), 3U);
+  tree.insert("/var/");
+  EXPECT_EQ(tree.size(), 4U);
+}
 }
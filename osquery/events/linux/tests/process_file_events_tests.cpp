@@ -30,6 +30,8 @@
 #include "osquery/tests/test_util.h"
 
 namespace osquery {
+DECLARE_uint64(audit_fim_state_memory_limit);
+
 extern std::vector<std::pair<int, std::string>> complete_event_list;
 extern StringList included_file_paths;
 extern std::string generateAuditId(std::uint32_t event_id) noexcept;
@@ -112,6 +114,106 @@ TEST_F(AuditdFimTests, row_emission) {
 #endif
 }
 
+TEST_F(AuditdFimTests, process_map_tracking) {
+  AuditdFimProcessMap process_map;
+  process_map.save(3, 100, 1000);
+  process_map.save(4, 100, 1001);
+
+  // Duplicated and cloned descriptors share the inode
+  EXPECT_TRUE(process_map.duplicate(100, 3, 5));
+  EXPECT_TRUE(process_map.clone(100, 200));
+  EXPECT_EQ(process_map.processCount(), 2U);
+  EXPECT_EQ(process_map.fdCount(), 6U);
+
+  AuditdFimFdDescriptor* fd_desc = nullptr;
+  ASSERT_TRUE(process_map.getReference(fd_desc, 200, 5));
+  EXPECT_EQ(fd_desc->inode, 1000U);
+
+  AuditdFimFdDescriptor removed_fd_desc;
+  EXPECT_TRUE(process_map.takeAndRemove(removed_fd_desc, 200, 4));
+  EXPECT_EQ(removed_fd_desc.inode, 1001U);
+  EXPECT_FALSE(process_map.getReference(fd_desc, 200, 4));
+  EXPECT_TRUE(process_map.getReference(fd_desc, 100, 4));
+
+  // Exiting processes are dropped with all of their descriptors
+  process_map.remove(100);
+  EXPECT_EQ(process_map.processCount(), 1U);
+  EXPECT_EQ(process_map.fdCount(), 2U);
+  EXPECT_FALSE(process_map.getReference(fd_desc, 100, 3));
+}
+
+TEST_F(AuditdFimTests, inode_map_tracking) {
+  AuditdFimInodeMap inode_map;
+  inode_map.save(1000, AuditdFimInodeDescriptor::Type::File, "/etc/hosts");
+  inode_map.save(1000, AuditdFimInodeDescriptor::Type::File, "/etc/hostname");
+
+  AuditdFimInodeReference ino_ref;
+  ASSERT_TRUE(inode_map.getReference(ino_ref, 1000));
+  EXPECT_EQ(ino_ref.path, "/etc/hostname");
+
+  AuditdFimInodeDescriptor ino_desc;
+  EXPECT_TRUE(inode_map.takeAndRemove(ino_desc, 1000));
+  EXPECT_EQ(ino_desc.path, "/etc/hostname");
+  EXPECT_FALSE(inode_map.getReference(ino_ref, 1000));
+
+  // Paths stay valid when the removed ones are reclaimed
+  std::string long_path(1024, 'a');
+  for (ino_t inode = 2000; inode < 2200; ++inode) {
+    inode_map.save(inode, AuditdFimInodeDescriptor::Type::File, long_path);
+  }
+
+  for (ino_t inode = 2000; inode < 2199; ++inode) {
+    inode_map.remove(inode);
+  }
+
+  ASSERT_TRUE(inode_map.getReference(ino_ref, 2199));
+  EXPECT_EQ(ino_ref.path, long_path);
+  ASSERT_TRUE(inode_map.getReference(ino_ref, STDOUT_FILENO));
+  EXPECT_EQ(ino_ref.path, "stdout");
+}
+
+TEST_F(AuditdFimTests, state_memory_limit) {
+  auto memory_limit = FLAGS_audit_fim_state_memory_limit;
+  FLAGS_audit_fim_state_memory_limit = 1;
+
+  // Each map may use half of the limit
+  const std::size_t map_limit = 512U * 1024U;
+
+  AuditdFimInodeMap inode_map;
+  std::string long_path(1024, 'a');
+  AuditdFimInodeReference ino_ref;
+  for (ino_t inode = 10000; inode < 12000; ++inode) {
+    inode_map.save(inode, AuditdFimInodeDescriptor::Type::File, long_path);
+    EXPECT_TRUE(inode_map.getReference(ino_ref, 10000));
+  }
+
+  // The least recently used inodes are dropped, recently used ones remain
+  EXPECT_LE(inode_map.memoryUsage(), map_limit);
+  EXPECT_FALSE(inode_map.getReference(ino_ref, 10001));
+  EXPECT_TRUE(inode_map.getReference(ino_ref, 10000));
+  ASSERT_TRUE(inode_map.getReference(ino_ref, 11999));
+  EXPECT_EQ(ino_ref.path, long_path);
+
+  AuditdFimProcessMap process_map;
+  AuditdFimFdDescriptor* fd_desc = nullptr;
+  for (pid_t process_id = 1; process_id <= 8000; ++process_id) {
+    for (std::uint64_t fd = 3; fd < 7; ++fd) {
+      process_map.save(fd, process_id, 1000);
+    }
+    EXPECT_TRUE(process_map.getReference(fd_desc, 1, 3));
+  }
+
+  // Evicted processes are dropped with all of their descriptors
+  EXPECT_LE(process_map.memoryUsage(), map_limit);
+  EXPECT_LT(process_map.processCount(), 8000U);
+  EXPECT_EQ(process_map.fdCount(), process_map.processCount() * 4U);
+  EXPECT_FALSE(process_map.getReference(fd_desc, 2, 3));
+  EXPECT_TRUE(process_map.getReference(fd_desc, 1, 6));
+  EXPECT_TRUE(process_map.getReference(fd_desc, 8000, 6));
+
+  FLAGS_audit_fim_state_memory_limit = memory_limit;
+}
+
 // clang-format off
 StringList included_file_paths = {
   "/etc/ld.so.cache",
@@ -8,12 +8,11 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <cstring>
 #include <vector>
 
 #include <gtest/gtest.h>
 
-#include <boost/tokenizer.hpp>
-
 #include "osquery/events/linux/syslog.h"
 #include "osquery/tests/test_util.h"
 
@@ -22,8 +21,8 @@ namespace osquery {
 class SyslogTests : public testing::Test {
  public:
   std::vector<std::string> splitCsv(std::string line) {
-    boost::tokenizer<RsyslogCsvSeparator> tokenizer(line);
-    std::vector<std::string> result(tokenizer.begin(), tokenizer.end());
+    std::vector<std::string> result;
+    splitRsyslogCsv(line, result);
     return result;
   }
 };
@@ -32,37 +31,73 @@ TEST_F(SyslogTests, test_populate_event_context) {
   std::string line =
       R"|("2016-03-22T21:17:01.701882+00:00","vagrant-ubuntu-trusty-64","6","cron","CRON[16538]:"," (root) CMD (   cd / && run-parts --report /etc/cron.hourly)")|";
   SyslogEventPublisher pub;
-  auto ec = pub.createEventContext();
-  Status status = pub.populateEventContext(line, ec);
+  Row fields;
+  Status status = pub.populateEventContext(line, fields);
 
   ASSERT_TRUE(status.ok());
-  // Note: the time-parsing was removed to allow events to auto-assign.
-  ASSERT_EQ(0U, ec->time);
-  ASSERT_EQ("2016-03-22T21:17:01.701882+00:00", ec->fields.at("datetime"));
-  ASSERT_EQ("vagrant-ubuntu-trusty-64", ec->fields.at("host"));
-  ASSERT_EQ("6", ec->fields.at("severity"));
-  ASSERT_EQ("cron", ec->fields.at("facility"));
-  ASSERT_EQ("CRON[16538]", ec->fields.at("tag"));
+  ASSERT_EQ("2016-03-22T21:17:01.701882+00:00", fields.at("datetime"));
+  ASSERT_EQ("vagrant-ubuntu-trusty-64", fields.at("host"));
+  ASSERT_EQ("6", fields.at("severity"));
+  ASSERT_EQ("cron", fields.at("facility"));
+  ASSERT_EQ("CRON[16538]", fields.at("tag"));
   ASSERT_EQ("(root) CMD (   cd / && run-parts --report /etc/cron.hourly)",
-            ec->fields.at("message"));
+            fields.at("message"));
 
   // Too few fields
 
   std::string bad_line =
       R"("2016-03-22T21:17:01.701882+00:00","vagrant-ubuntu-trusty-64","6","cron",)";
-  ec = pub.createEventContext();
-  status = pub.populateEventContext(bad_line, ec);
+  fields.clear();
+  status = pub.populateEventContext(bad_line, fields);
   ASSERT_FALSE(status.ok());
   ASSERT_NE(std::string::npos, status.getMessage().find("fewer"));
 
   // Too many fields
   bad_line = R"("2016-03-22T21:17:01.701882+00:00","","6","","","","")";
-  ec = pub.createEventContext();
-  status = pub.populateEventContext(bad_line, ec);
+  fields.clear();
+  status = pub.populateEventContext(bad_line, fields);
   ASSERT_FALSE(status.ok());
   ASSERT_NE(std::string::npos, status.getMessage().find("more"));
 }
 
+TEST_F(SyslogTests, test_parse_buffer) {
+  std::string input =
+      R"("2016-03-22T21:17:01.701882+00:00","host","6","cron","CRON:","one")"
+      "\n\n"
+      R"("2016-03-22T21:17:02.701882+00:00","host","6","cron","CRON:","two")"
+      "\n"
+      R"("2016-03-22T21:17:03.701882+00:00","host","6","cron")";
+
+  SyslogEventPublisher pub;
+  pub.buffer_.resize(1024);
+  memcpy(pub.buffer_.data(), input.data(), input.size());
+  pub.bufferUsed_ = input.size();
+
+  // Complete lines are parsed into a batch, empty lines are skipped.
+  auto ec = pub.createEventContext();
+  ASSERT_TRUE(pub.parseBuffer(ec).ok());
+  ASSERT_EQ(2U, ec->rows.size());
+  EXPECT_EQ("one", ec->rows[0].at("message"));
+  EXPECT_EQ("two", ec->rows[1].at("message"));
+  EXPECT_EQ("CRON", ec->rows[1].at("tag"));
+  // Note: the time-parsing was removed to allow events to auto-assign.
+  EXPECT_EQ(0U, ec->time);
+
+  // The partial line is kept at the front of the buffer.
+  std::string rest(R"(,"CRON:","three")"
+                   "\n");
+  auto partial = input.substr(input.rfind('\n') + 1);
+  ASSERT_EQ(partial.size(), pub.bufferUsed_);
+  memcpy(pub.buffer_.data() + pub.bufferUsed_, rest.data(), rest.size());
+  pub.bufferUsed_ += rest.size();
+
+  ec = pub.createEventContext();
+  ASSERT_TRUE(pub.parseBuffer(ec).ok());
+  ASSERT_EQ(1U, ec->rows.size());
+  EXPECT_EQ("three", ec->rows[0].at("message"));
+  EXPECT_EQ(0U, pub.bufferUsed_);
+}
+
 TEST_F(SyslogTests, test_csv_separator) {
   ASSERT_EQ(std::vector<std::string>({"", "", "", "", ""}), splitCsv(",,,,"));
   ASSERT_EQ(std::vector<std::string>({" ", " ", " ", " ", " "}),
@@ -467,6 +467,14 @@ TEST_F(EventsTests, test_event_subscriber_configure) {
   EXPECT_EQ(sub->min_expiration_, 60U);
   EXPECT_EQ(sub->query_count_, 3U);
 
+  // Only the schedule changed, the subscriber is not configured again.
+  EXPECT_EQ(sub->timesConfigured, 1U);
+
+  // A change to config parser content configures the subscriber.
+  Config::get().update(
+      {{"data", "{\"file_paths\": {\"fake\": [\"/tmp/fake_events\"]}}"}});
+  EXPECT_EQ(sub->timesConfigured, 2U);
+
   // Register it within the event factory too.
   EventFactory::deregisterEventSubscriber(sub->getName());
   rf.registry("event_subscriber")->remove(sub->getName());
@@ -0,0 +1,119 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under both the Apache 2.0 license (found in the
+ *  LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ *  in the COPYING file in the root directory of this source tree).
+ *  You may select, at your option, one of the above-listed licenses.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <osquery/extensions.h>
+#include <osquery/filesystem.h>
+#include <osquery/registry_factory.h>
+
+#include "osquery/core/process.h"
+#include "osquery/extensions/interface.h"
+#include "osquery/filesystem/fileops.h"
+#include "osquery/tests/test_util.h"
+
+namespace osquery {
+
+class BenchmarkExtensionPlugin : public Plugin {
+ public:
+  /// Respond with the requested number of rows.
+  Status call(const PluginRequest& request, PluginResponse& response) {
+    auto rows = std::stoul(request.at("rows"));
+    for (size_t i = 0; i < rows; ++i) {
+      response.push_back({{"index", std::to_string(i)},
+                          {"path", "/usr/local/bin/benchmark"},
+                          {"value", std::string(64, 'x')}});
+    }
+    return Status(0, "OK");
+  }
+};
+
+CREATE_REGISTRY(BenchmarkExtensionPlugin, "extension_benchmark");
+
+/// Start an extension manager and wait for its socket.
+static std::string startBenchmarkManager() {
+  std::string socket_path;
+  if (isPlatform(PlatformType::TYPE_WINDOWS)) {
+    socket_path = OSQUERY_SOCKET;
+  } else {
+    socket_path = kTestWorkingDirectory;
+  }
+  socket_path += "benchextmgr" + std::to_string(rand());
+
+  if (!isPlatform(PlatformType::TYPE_WINDOWS)) {
+    removePath(socket_path);
+  }
+
+  startExtensionManager(socket_path);
+  for (size_t delay = 0; delay < 3000; delay += 20) {
+    if (socketExists(socket_path).ok()) {
+      break;
+    }
+    sleepFor(20);
+  }
+  return socket_path;
+}
+
+static void stopBenchmarkManager(const std::string& socket_path) {
+  Dispatcher::stopServices();
+  Dispatcher::joinServices();
+  if (!isPlatform(PlatformType::TYPE_WINDOWS)) {
+    removePath(socket_path);
+  }
+}
+
+static void EXTENSIONS_ping(benchmark::State& state) {
+  auto socket_path = startBenchmarkManager();
+
+  while (state.KeepRunning()) {
+    ExtensionManagerClient client(socket_path);
+    client.ping();
+  }
+
+  stopBenchmarkManager(socket_path);
+}
+
+BENCHMARK(EXTENSIONS_ping);
+
+static void EXTENSIONS_ping_reused_client(benchmark::State& state) {
+  auto socket_path = startBenchmarkManager();
+
+  {
+    ExtensionManagerClient client(socket_path);
+    while (state.KeepRunning()) {
+      client.ping();
+    }
+  }
+
+  stopBenchmarkManager(socket_path);
+}
+
+BENCHMARK(EXTENSIONS_ping_reused_client);
+
+static void EXTENSIONS_call_rows(benchmark::State& state) {
+  auto& rf = RegistryFactory::get();
+  rf.registry("extension_benchmark")
+      ->add("rows", std::make_shared<BenchmarkExtensionPlugin>());
+  auto socket_path = startBenchmarkManager();
+
+  PluginRequest request = {{"rows", std::to_string(state.range(0))}};
+  while (state.KeepRunning()) {
+    ExtensionManagerClient client(socket_path);
+    PluginResponse response;
+    client.call("extension_benchmark", "rows", request, response);
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  stopBenchmarkManager(socket_path);
+  rf.registry("extension_benchmark")->remove("rows");
+}
+
+BENCHMARK(EXTENSIONS_call_rows)->Arg(1)->Arg(100)->Arg(10000);
+} // namespace osquery
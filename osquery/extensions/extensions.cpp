@@ -546,6 +546,29 @@ Status queryExternal(const std::string& query, QueryData& results) {
   return queryExternal(FLAGS_extensions_socket, query, results);
 }
 
+Status queryExternal(const std::string& manager_path,
+                     const std::string& query,
+                     QueryDataColumns& results) {
+  // Make sure the extension path exists, and is writable.
+  auto status = extensionPathActive(manager_path);
+  if (!status.ok()) {
+    return status;
+  }
+
+  try {
+    ExtensionManagerClient client(manager_path);
+    status = client.queryColumnar(query, results);
+  } catch (const std::exception& e) {
+    return Status(1, "Extension call failed: " + std::string(e.what()));
+  }
+
+  return status;
+}
+
+Status queryExternal(const std::string& query, QueryDataColumns& results) {
+  return queryExternal(FLAGS_extensions_socket, query, results);
+}
+
 Status getQueryColumnsExternal(const std::string& manager_path,
                                const std::string& query,
                                TableColumns& columns) {
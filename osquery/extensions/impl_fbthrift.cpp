@@ -78,6 +78,10 @@ class ExtensionManagerHandler : virtual public extensions::ExtensionManagerSvIf,
   using ExtensionManagerInterface::getQueryColumns;
   void getQueryColumns(ExtensionResponse& _return,
                        const std::string& sql) override;
+
+  using ExtensionManagerInterface::queryColumnar;
+  void queryColumnar(ExtensionColumnarResponse& _return,
+                     const std::string& sql) override;
 };
 
 struct ImplExtensionRunner {
@@ -223,6 +227,21 @@ void ExtensionManagerHandler::getQueryColumns(ExtensionResponse& _return,
   }
 }
 
+void ExtensionManagerHandler::queryColumnar(ExtensionColumnarResponse& _return,
+                                            const std::string& sql) {
+  QueryDataColumns qd;
+  auto s = ExtensionManagerInterface::queryColumnar(sql, qd);
+  _return.columns = std::move(qd.columns);
+  _return.values = std::move(qd.values);
+  _return.status.message = s.getMessage();
+  if (s.ok()) {
+    _return.status.code = (int)extensions::ExtensionCode::EXT_SUCCESS;
+    _return.status.uuid = getUUID();
+  } else {
+    _return.status.code = (int)extensions::ExtensionCode::EXT_FAILED;
+  }
+}
+
 ExtensionRunnerInterface::~ExtensionRunnerInterface() {
   removePath(path_);
 
@@ -417,6 +436,16 @@ Status ExtensionManagerClient::getQueryColumns(const std::string& sql,
   return Status(er.status.code, er.status.message);
 }
 
+Status ExtensionManagerClient::queryColumnar(const std::string& sql,
+                                             QueryDataColumns& qd) {
+  ExtensionColumnarResponse er;
+  client_->em->sync_queryColumnar(er, sql);
+  qd.columns = std::move(er.columns);
+  qd.values = std::move(er.values);
+
+  return Status(er.status.code, er.status.message);
+}
+
 Status ExtensionManagerClient::deregisterExtension(RouteUUID uuid) {
   ExtensionStatus status;
   client_->em->sync_deregisterExtension(status, uuid);
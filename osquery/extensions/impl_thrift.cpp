@@ -8,13 +8,17 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <iterator>
+
 #include <osquery/core.h>
 #include <osquery/filesystem.h>
+#include <osquery/flags.h>
 #include <osquery/system.h>
 
+#include <thrift/concurrency/PlatformThreadFactory.h>
 #include <thrift/concurrency/ThreadManager.h>
 #include <thrift/protocol/TBinaryProtocol.h>
-#include <thrift/server/TThreadedServer.h>
+#include <thrift/server/TThreadPoolServer.h>
 #include <thrift/transport/TBufferTransports.h>
 
 #ifdef WIN32
@@ -45,6 +49,58 @@ using TPlatformServerSocket = TServerSocket;
 using TPlatformSocket = TSocket;
 #endif
 
+HIDDEN_FLAG(uint64,
+            extensions_max_clients,
+            64,
+            "Maximum concurrent clients served by an extension server");
+
+/// Transport buffer size, large responses are read with few system calls.
+const uint32_t kTransportBufferSize = 64 * 1024;
+
+/**
+ * @brief Thrift's thread pool server, with a pool that grows on demand.
+ *
+ * Each connected client is served by one worker until it disconnects, and
+ * workers are reused rather than created per connection. A worker is only
+ * added when none are idle, the number of clients is bounded by the server's
+ * concurrent client limit.
+ */
+class ExtensionPoolServer : public TThreadPoolServer {
+ public:
+  using TThreadPoolServer::TThreadPoolServer;
+
+ protected:
+  void onClientConnected(
+      const std::shared_ptr<TConnectedClient>& client) override {
+    auto threads = getThreadManager();
+    if (threads->idleWorkerCount() <= threads->pendingTaskCount()) {
+      threads->addWorker(1);
+    }
+    TThreadPoolServer::onClientConnected(client);
+  }
+};
+
+/// Creates buffered transports with larger buffers than Thrift's default.
+class ExtensionTransportFactory : public TTransportFactory {
+ public:
+  std::shared_ptr<TTransport> getTransport(
+      std::shared_ptr<TTransport> trans) override {
+    return std::make_shared<TBufferedTransport>(
+        trans, kTransportBufferSize, kTransportBufferSize);
+  }
+};
+
+/// Append the rows of a response to a result without copying them.
+static void moveResponse(PluginResponse& from, PluginResponse& to) {
+  if (to.empty()) {
+    to = std::move(from);
+  } else {
+    to.insert(to.end(),
+              std::make_move_iterator(from.begin()),
+              std::make_move_iterator(from.end()));
+  }
+}
+
 class ExtensionHandler : virtual public extensions::ExtensionIf,
                          public ExtensionInterface {
  public:
@@ -105,6 +161,10 @@ class ExtensionManagerHandler : virtual public extensions::ExtensionManagerIf,
   void getQueryColumns(extensions::ExtensionResponse& _return,
                        const std::string& sql) override;
 
+  using ExtensionManagerInterface::queryColumnar;
+  void queryColumnar(extensions::ExtensionColumnarResponse& _return,
+                     const std::string& sql) override;
+
  public:
   using ExtensionHandler::call;
   using ExtensionHandler::ping;
@@ -117,7 +177,7 @@ class ExtensionManagerHandler : virtual public extensions::ExtensionManagerIf,
 
 struct ImplExtensionRunner {
   std::shared_ptr<TServerTransport> transport;
-  std::shared_ptr<TThreadedServer> server;
+  std::shared_ptr<ExtensionPoolServer> server;
   std::shared_ptr<TProcessor> processor;
 };
 
@@ -153,10 +213,8 @@ void ExtensionHandler::call(extensions::ExtensionResponse& _return,
   _return.status.uuid = getUUID();
 
   if (s.ok()) {
-    for (const auto& response_item : response) {
-      // Translate a PluginResponse to an ExtensionPluginResponse.
-      _return.response.push_back(response_item);
-    }
+    // A PluginResponse is an ExtensionPluginResponse, the rows are moved.
+    _return.response = std::move(response);
   }
 }
 
@@ -228,9 +286,7 @@ void ExtensionManagerHandler::query(extensions::ExtensionResponse& _return,
                                     const std::string& sql) {
   QueryData qd;
   auto s = ExtensionManagerInterface::query(sql, qd);
-  for (auto& row : qd) {
-    _return.response.emplace_back(std::move(row));
-  }
+  _return.response = std::move(qd);
   _return.status.message = s.getMessage();
   if (s.ok()) {
     _return.status.code = (int)extensions::ExtensionCode::EXT_SUCCESS;
@@ -244,9 +300,22 @@ void ExtensionManagerHandler::getQueryColumns(
     extensions::ExtensionResponse& _return, const std::string& sql) {
   QueryData qd;
   auto s = ExtensionManagerInterface::getQueryColumns(sql, qd);
-  for (auto& row : qd) {
-    _return.response.emplace_back(std::move(row));
+  _return.response = std::move(qd);
+  _return.status.message = s.getMessage();
+  if (s.ok()) {
+    _return.status.code = (int)extensions::ExtensionCode::EXT_SUCCESS;
+    _return.status.uuid = getUUID();
+  } else {
+    _return.status.code = (int)extensions::ExtensionCode::EXT_FAILED;
   }
+}
+
+void ExtensionManagerHandler::queryColumnar(
+    extensions::ExtensionColumnarResponse& _return, const std::string& sql) {
+  QueryDataColumns qd;
+  auto s = ExtensionManagerInterface::queryColumnar(sql, qd);
+  _return.columns = std::move(qd.columns);
+  _return.values = std::move(qd.values);
   _return.status.message = s.getMessage();
   if (s.ok()) {
     _return.status.code = (int)extensions::ExtensionCode::EXT_SUCCESS;
@@ -272,11 +341,20 @@ void ExtensionRunnerInterface::connect() {
   server_->transport = std::make_shared<TPlatformServerSocket>(path_);
 
   // Construct the service's transport, protocol, thread pool.
-  auto transport_fac = std::make_shared<TBufferedTransportFactory>();
+  // The buffered (unframed) transport is kept for existing extension SDKs.
+  auto transport_fac = std::make_shared<ExtensionTransportFactory>();
   auto protocol_fac = std::make_shared<TBinaryProtocolFactory>();
-
-  server_->server = std::make_shared<TThreadedServer>(
-      server_->processor, server_->transport, transport_fac, protocol_fac);
+  auto threads = ThreadManager::newSimpleThreadManager(1);
+  threads->threadFactory(std::make_shared<PlatformThreadFactory>());
+  threads->start();
+
+  server_->server = std::make_shared<ExtensionPoolServer>(server_->processor,
+                                                          server_->transport,
+                                                          transport_fac,
+                                                          protocol_fac,
+                                                          threads);
+  auto max_clients = static_cast<int64_t>(FLAGS_extensions_max_clients);
+  server_->server->setConcurrentClientLimit(std::max<int64_t>(max_clients, 1));
 }
 
 void ExtensionRunnerInterface::init(RouteUUID uuid, bool manager) {
@@ -313,7 +391,8 @@ void ExtensionClientCore::init(const std::string& path, bool manager) {
 
   client_ = std::make_unique<ImplExtensionClient>();
   client_->socket = std::make_shared<TPlatformSocket>(path);
-  client_->transport = std::make_shared<TBufferedTransport>(client_->socket);
+  client_->transport = std::make_shared<TBufferedTransport>(
+      client_->socket, kTransportBufferSize, kTransportBufferSize);
   auto protocol = std::make_shared<TBinaryProtocol>(client_->transport);
 
   if (!manager_) {
@@ -374,9 +453,7 @@ Status ExtensionClient::call(const std::string& registry,
   extensions::ExtensionResponse er;
   auto client = manager() ? client_->em : client_->e;
   client->call(er, registry, item, request);
-  for (const auto& r : er.response) {
-    response.push_back(r);
-  }
+  moveResponse(er.response, response);
 
   return Status(er.status.code, er.status.message);
 }
@@ -429,9 +506,7 @@ Status ExtensionManagerClient::registerExtension(
 Status ExtensionManagerClient::query(const std::string& sql, QueryData& qd) {
   extensions::ExtensionResponse er;
   client_->em->query(er, sql);
-  for (const auto& row : er.response) {
-    qd.push_back(row);
-  }
+  moveResponse(er.response, qd);
 
   return Status();
 }
@@ -440,9 +515,17 @@ Status ExtensionManagerClient::getQueryColumns(const std::string& sql,
                                                QueryData& qd) {
   extensions::ExtensionResponse er;
   client_->em->getQueryColumns(er, sql);
-  for (const auto& row : er.response) {
-    qd.push_back(row);
-  }
+  moveResponse(er.response, qd);
+
+  return Status(er.status.code, er.status.message);
+}
+
+Status ExtensionManagerClient::queryColumnar(const std::string& sql,
+                                             QueryDataColumns& qd) {
+  extensions::ExtensionColumnarResponse er;
+  client_->em->queryColumnar(er, sql);
+  qd.columns = std::move(er.columns);
+  qd.values = std::move(er.values);
 
   return Status(er.status.code, er.status.message);
 }
@@ -20,6 +20,7 @@
 #include <osquery/system.h>
 
 #include "osquery/extensions/interface.h"
+#include "osquery/sql/sqlite_util.h"
 
 using chrono_clock = std::chrono::high_resolution_clock;
 
@@ -151,6 +152,14 @@ Status ExtensionManagerInterface::getQueryColumns(const std::string& sql,
   return status;
 }
 
+Status ExtensionManagerInterface::queryColumnar(const std::string& sql,
+                                                QueryDataColumns& qd) {
+  auto dbc = SQLiteDBManager::get();
+  auto status = queryInternal(sql, qd, dbc);
+  dbc->clearAffectedTables();
+  return status;
+}
+
 void ExtensionManagerInterface::refresh() {
   std::vector<RouteUUID> removed_routes;
   const auto uuids = RegistryFactory::get().routeUUIDs();
@@ -76,6 +76,8 @@ class ExtensionManagerAPI {
   virtual Status deregisterExtension(RouteUUID uuid) = 0;
   virtual Status query(const std::string& sql, QueryData& qd) = 0;
   virtual Status getQueryColumns(const std::string& sql, QueryData& qd) = 0;
+  virtual Status queryColumnar(const std::string& sql,
+                               QueryDataColumns& qd) = 0;
 };
 
 /**
@@ -191,6 +193,18 @@ class ExtensionManagerInterface : public ExtensionInterface,
   virtual Status getQueryColumns(const std::string& sql,
                                  QueryData& qd) override;
 
+  /**
+   * @brief Execute an SQL statement in osquery core, results by column.
+   *
+   * The same as query, but values are collected by column as SQLite steps
+   * and sent as one list per column, large results avoid a map per row.
+   *
+   * @param sql The sql statement.
+   * @param qd The output QueryDataColumns.
+   */
+  virtual Status queryColumnar(const std::string& sql,
+                               QueryDataColumns& qd) override;
+
  private:
   /// Check if an extension exists by the name it registered.
   bool exists(const std::string& name);
@@ -405,6 +419,9 @@ class ExtensionManagerClient : public ExtensionClient,
 
   /// Get column information from a query.
   Status getQueryColumns(const std::string& sql, QueryData& qd) override;
+
+  /// Issue a query, results by column.
+  Status queryColumnar(const std::string& sql, QueryDataColumns& qd) override;
 };
 
 /// Attempt to remove all stale extension sockets.
@@ -20,6 +20,8 @@
 #include <archive_entry.h>
 #include <zstd.h>
 
+#include <boost/noncopyable.hpp>
+
 #include <osquery/flags.h>
 #include <osquery/system.h>
 
@@ -210,4 +212,202 @@ Status archive(const std::set<boost::filesystem::path>& paths,
   archive_write_free(arch);
   return Status(0, "Ok");
 };
+
+namespace {
+
+/// The output side of a streamed archive, optionally compressed.
+class ArchiveStream : private boost::noncopyable {
+ public:
+  ArchiveStream(bool compress, const ArchiveStreamWriter& writer)
+      : compress_(compress), writer_(writer) {}
+
+  ~ArchiveStream() {
+    if (cstream_ != nullptr) {
+      ZSTD_freeCStream(cstream_);
+    }
+  }
+
+  Status init() {
+    if (!compress_) {
+      return Status(0);
+    }
+
+    cstream_ = ZSTD_createCStream();
+    if (cstream_ == nullptr) {
+      return Status(1, "Couldn't create compression stream");
+    }
+
+    if (ZSTD_isError(ZSTD_initCStream(cstream_, 1))) {
+      return Status(1, "Couldn't initialize compression stream");
+    }
+    buffOut_.resize(ZSTD_CStreamOutSize());
+    return Status(0);
+  }
+
+  /// Forward a part of the tar stream, through the compressor if enabled.
+  bool write(const char* data, size_t size) {
+    if (!compress_) {
+      return check(writer_(data, size));
+    }
+
+    ZSTD_inBuffer input = {data, size, 0};
+    while (input.pos < input.size) {
+      ZSTD_outBuffer output = {buffOut_.data(), buffOut_.size(), 0};
+      auto ret = ZSTD_compressStream(cstream_, &output, &input);
+      if (ZSTD_isError(ret)) {
+        return check(Status(1,
+                            "ZSTD_compressStream() error : " +
+                                std::string(ZSTD_getErrorName(ret))));
+      }
+      if (output.pos > 0 && !check(writer_(buffOut_.data(), output.pos))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Flush the end of the compressed stream.
+  bool finish() {
+    if (!compress_) {
+      return true;
+    }
+
+    size_t remaining = 0;
+    do {
+      ZSTD_outBuffer output = {buffOut_.data(), buffOut_.size(), 0};
+      remaining = ZSTD_endStream(cstream_, &output);
+      if (ZSTD_isError(remaining)) {
+        return check(Status(1, "Couldn't fully flush compressed stream"));
+      }
+      if (output.pos > 0 && !check(writer_(buffOut_.data(), output.pos))) {
+        return false;
+      }
+    } while (remaining > 0);
+    return true;
+  }
+
+  /// The first failure of the compressor or writer.
+  const Status& status() const {
+    return status_;
+  }
+
+ private:
+  bool check(Status status) {
+    if (!status.ok() && status_.ok()) {
+      status_ = std::move(status);
+    }
+    return status_.ok();
+  }
+
+ private:
+  bool compress_{false};
+  const ArchiveStreamWriter& writer_;
+  ZSTD_CStream* cstream_{nullptr};
+  std::vector<char> buffOut_;
+  Status status_;
+};
+
+la_ssize_t writeArchiveStream(struct archive* /*arch*/,
+                              void* client_data,
+                              const void* buffer,
+                              size_t length) {
+  auto stream = static_cast<ArchiveStream*>(client_data);
+  if (!stream->write(static_cast<const char*>(buffer), length)) {
+    return -1;
+  }
+  return static_cast<la_ssize_t>(length);
+}
+
+/// Write the tar framing, and the file contents if read_data is set.
+Status streamArchive(const ArchiveEntries& entries,
+                     bool read_data,
+                     ArchiveStream& stream) {
+  auto arch = archive_write_new();
+  if (arch == nullptr) {
+    return Status(1, "Failed to create tar archive");
+  }
+  archive_write_set_format_pax_restricted(arch);
+  // Do not pad the final block, as when the archive is written to a file.
+  archive_write_set_bytes_in_last_block(arch, 1);
+
+  auto ret = archive_write_open(
+      arch, &stream, nullptr, writeArchiveStream, nullptr);
+  if (ret == ARCHIVE_FATAL) {
+    archive_write_free(arch);
+    return Status(1, "Failed to open tar archive stream");
+  }
+
+  auto blockSize = FLAGS_carver_block_size > 0 ? FLAGS_carver_block_size : 8192;
+  std::vector<char> block(blockSize, 0);
+  Status status;
+  for (const auto& f : entries) {
+    auto entry = archive_entry_new();
+    archive_entry_set_pathname(entry, f.first.leaf().string().c_str());
+    archive_entry_set_size(entry, f.second);
+    archive_entry_set_filetype(entry, AE_IFREG);
+    archive_entry_set_perm(entry, 0644);
+    ret = archive_write_header(arch, entry);
+    archive_entry_free(entry);
+    if (ret < ARCHIVE_WARN) {
+      status = Status(1, "Failed to write tar header");
+      break;
+    }
+
+    if (!read_data) {
+      // The entry is padded to its size when it is finished.
+      continue;
+    }
+
+    PlatformFile pFile(f.first, PF_OPEN_EXISTING | PF_READ);
+    auto remaining = f.second;
+    while (pFile.isValid() && remaining > 0) {
+      auto r = pFile.read(block.data(), std::min(remaining, block.size()));
+      if (r <= 0) {
+        break;
+      }
+      if (archive_write_data(arch, block.data(), r) < 0) {
+        status = Status(1, "Failed to write tar data");
+        break;
+      }
+      remaining -= r;
+    }
+    if (!status.ok()) {
+      break;
+    }
+  }
+
+  if (archive_write_close(arch) != ARCHIVE_OK && status.ok()) {
+    status = Status(1, "Failed to close tar archive stream");
+  }
+  archive_write_free(arch);
+
+  if (status.ok()) {
+    stream.finish();
+  }
+  // A failure of the writer is the cause of the libarchive errors.
+  return (stream.status().ok()) ? status : stream.status();
+}
+} // namespace
+
+Status archive(const ArchiveEntries& entries,
+               bool compress,
+               const ArchiveStreamWriter& writer) {
+  ArchiveStream stream(compress, writer);
+  auto status = stream.init();
+  if (!status.ok()) {
+    return status;
+  }
+  return streamArchive(entries, true, stream);
+}
+
+Status archiveSize(const ArchiveEntries& entries, size_t& size) {
+  size = 0;
+  ArchiveStreamWriter writer = [&size](const char* /*data*/, size_t length) {
+    size += length;
+    return Status(0);
+  };
+
+  ArchiveStream stream(false, writer);
+  return streamArchive(entries, false, stream);
+}
 } // namespace osquery
@@ -347,6 +347,23 @@ bool platformChmod(const std::string& path, mode_t perms);
  */
 std::vector<std::string> platformGlob(const std::string& find_path);
 
+/**
+ * @brief Recursively list the non-hidden contents of a set of directories.
+ *
+ * This is the expansion of a trailing recursive wildcard. Each directory in
+ * roots is the match of the first (depth 1) wildcard; their contents are
+ * walked once, in a single pass, down to max_depth. The results follow the
+ * platformGlob conventions: directories are marked with a trailing separator
+ * and the list is ordered by depth, then path.
+ *
+ * On POSIX the walk reads each directory once using d_type, only stats
+ * symlinks and unknown entry types, and walks large trees with a bounded set
+ * of threads. Directory loops are detected using (device, inode) pairs of
+ * the ancestor chain.
+ */
+std::vector<std::string> platformGlobRecursive(
+    const std::vector<std::string>& roots, size_t max_depth);
+
 /**
  * @brief Checks to see if the current user has the permissions to perform a
  *        specified operation on a file.
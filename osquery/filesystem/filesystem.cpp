@@ -272,60 +272,34 @@ Status removePath(const fs::path& path) {
   return Status(0, std::to_string(removed_files));
 }
 
-static bool checkForLoops(std::set<int>& dsym_inos, std::string path) {
-  if (path.empty() || path.back() != '/') {
-    return false;
-  }
-
-  path.pop_back();
-  struct stat d_stat;
-  // On Windows systems (lstat not implemented) this immiedately returns
-  if (!platformLstat(path, d_stat).ok()) {
-    return false;
-  }
-
-  if ((d_stat.st_mode & 0170000) == 0) {
-    return false;
-  }
-
-  if (dsym_inos.find(d_stat.st_ino) == dsym_inos.end()) {
-    dsym_inos.insert(d_stat.st_ino);
-  } else {
-    LOG(WARNING) << "Symlink loop detected possibly involving: " << path;
-    return true;
-  }
-  return false;
-}
-
 static void genGlobs(std::string path,
                      std::vector<std::string>& results,
                      GlobLimits limits) {
   // Use our helped escape/replace for wildcards.
   replaceGlobWildcards(path, limits);
-  // inodes of directory symlinks for loop detection
-  std::set<int> dsym_inos;
 
-  // Generate a glob set and recurse for double star.
-  for (size_t glob_index = 0; ++glob_index < kMaxRecursiveGlobs;) {
-    auto glob_results = platformGlob(path);
+  // The first glob expands every wildcard, and a double star as a single.
+  auto glob_results = platformGlob(path);
 
-    for (auto& result_path : glob_results) {
-      results.push_back(result_path);
+  // A non-recursive ending is complete after a single glob.
+  size_t wild = path.rfind("**");
+  // Allow a trailing slash after the double wild indicator.
+  bool recursive = (wild <= path.size() && wild >= path.size() - 3);
 
-      if (checkForLoops(dsym_inos, result_path)) {
-        glob_index = kMaxRecursiveGlobs;
-      }
-    }
-
-    // The end state is a non-recursive ending or empty set of matches.
-    size_t wild = path.rfind("**");
-    // Allow a trailing slash after the double wild indicator.
-    if (glob_results.size() == 0 || wild > path.size() ||
-        wild < path.size() - 3) {
-      break;
+  std::vector<std::string> roots;
+  for (auto& result_path : glob_results) {
+    if (recursive && !result_path.empty() &&
+        (result_path.back() == '/' || result_path.back() == '\\')) {
+      roots.push_back(result_path);
     }
+    results.push_back(std::move(result_path));
+  }
 
-    path += "/**";
+  // Walk the directories matching the double star once, for all depths.
+  if (!roots.empty()) {
+    auto walk_results = platformGlobRecursive(roots, kMaxRecursiveGlobs - 1);
+    std::move(
+        walk_results.begin(), walk_results.end(), std::back_inserter(results));
   }
 
   // Prune results based on settings/requested glob limitations.
@@ -8,9 +8,22 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <linux/inet_diag.h>
 #include <linux/limits.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/unix_diag.h>
+#include <fcntl.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <limits>
+
 #include <boost/filesystem.hpp>
 
 #include <osquery/filesystem.h>
@@ -84,25 +97,196 @@ Status procGetProcessNamespaces(const std::string& process_id,
   return Status(0, "OK");
 }
 
-std::string procDecodeAddressFromHex(const std::string& encoded_address,
-                                     int family) {
+/// Size of the per-thread buffers used to read procfs files.
+const size_t kProcReadBufferSize = 16384;
+
+/// A per-thread buffer grown past this size is not kept for later reads.
+const size_t kProcReadBufferMaxSize = 4 * 1024 * 1024;
+
+Status procReadFile(int dirfd, const char* path, boost::string_ref& content) {
+  thread_local std::vector<char> buffer(kProcReadBufferSize);
+  content.clear();
+
+  // The previous content is no longer referenced, release an oversized
+  // buffer left by a large file.
+  if (buffer.capacity() > kProcReadBufferMaxSize) {
+    std::vector<char>(kProcReadBufferSize).swap(buffer);
+  }
+
+  int fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return Status(1, std::string("Cannot open ") + path);
+  }
+
+  // Files in procfs report no size, read until the end.
+  size_t size = 0;
+  while (true) {
+    if (size == buffer.size()) {
+      buffer.resize(buffer.size() * 2);
+    }
+
+    auto bytes = ::read(fd, buffer.data() + size, buffer.size() - size);
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    } else if (bytes < 0) {
+      close(fd);
+      return Status(1, std::string("Cannot read ") + path);
+    } else if (bytes == 0) {
+      break;
+    }
+    size += static_cast<size_t>(bytes);
+  }
+  close(fd);
+
+  content = boost::string_ref(buffer.data(), size);
+  return Status(0);
+}
+
+ProcDirectory::ProcDirectory(const std::string& pid) {
+  auto path = kLinuxProcPath + "/" + pid;
+  fd_ = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+ProcDirectory::~ProcDirectory() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+Status ProcDirectory::read(const char* name, boost::string_ref& content) const {
+  if (fd_ < 0) {
+    content.clear();
+    return Status(1, "Invalid process directory");
+  }
+  return procReadFile(fd_, name, content);
+}
+
+std::string ProcDirectory::readLink(const char* name) const {
+  if (fd_ < 0) {
+    return "";
+  }
+
+  char link[PATH_MAX];
+  auto size = readlinkat(fd_, name, link, sizeof(link));
+  if (size <= 0) {
+    return "";
+  }
+  return std::string(link, static_cast<size_t>(size));
+}
+
+bool ProcTokenizer::next(boost::string_ref& token) {
+  auto L_IsDelim = [this](char c) {
+    return c != '\0' && std::strchr(delims_, c) != nullptr;
+  };
+
+  size_t start = 0;
+  while (start < input_.size() && L_IsDelim(input_[start])) {
+    start++;
+  }
+  if (start == input_.size()) {
+    input_.clear();
+    return false;
+  }
+
+  size_t end = start;
+  while (end < input_.size() && !L_IsDelim(input_[end])) {
+    end++;
+  }
+
+  token = input_.substr(start, end - start);
+  input_.remove_prefix(end);
+  return true;
+}
+
+boost::string_ref procTrim(boost::string_ref value) {
+  while (!value.empty() &&
+         std::isspace(static_cast<unsigned char>(value.front()))) {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() &&
+         std::isspace(static_cast<unsigned char>(value.back()))) {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
+bool procSplitKeyValue(boost::string_ref line,
+                       boost::string_ref& key,
+                       boost::string_ref& value) {
+  auto delim = line.find(':');
+  if (delim == boost::string_ref::npos) {
+    return false;
+  }
+
+  key = procTrim(line.substr(0, delim));
+  value = procTrim(line.substr(delim + 1));
+  return !key.empty() && !value.empty();
+}
+
+bool procParseUInt(boost::string_ref value, std::uint64_t& number) {
+  if (value.empty() || value.size() > 20) {
+    return false;
+  }
+
+  number = 0;
+  for (auto c : value) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    auto digit = static_cast<std::uint64_t>(c - '0');
+    if (number > (std::numeric_limits<std::uint64_t>::max() - digit) / 10) {
+      return false;
+    }
+    number = number * 10 + digit;
+  }
+  return true;
+}
+
+bool procParseHex(boost::string_ref value, std::uint64_t& number) {
+  if (value.empty() || value.size() > 16) {
+    return false;
+  }
+
+  number = 0;
+  for (auto c : value) {
+    std::uint64_t digit = 0;
+    if (c >= '0' && c <= '9') {
+      digit = static_cast<std::uint64_t>(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      digit = static_cast<std::uint64_t>(c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      digit = static_cast<std::uint64_t>(c - 'A' + 10);
+    } else {
+      return false;
+    }
+    number = (number << 4) | digit;
+  }
+  return true;
+}
+
+static std::string procDecodeAddressFromHex(boost::string_ref encoded_address,
+                                            int family) {
   char addr_buffer[INET6_ADDRSTRLEN] = {0};
+  std::uint64_t word = 0;
   if (family == AF_INET) {
     struct in_addr decoded;
-    if (encoded_address.length() == 8) {
-      sscanf(encoded_address.c_str(), "%X", &(decoded.s_addr));
+    if (encoded_address.length() == 8 &&
+        procParseHex(encoded_address, word)) {
+      // The address is printed as a host order integer.
+      decoded.s_addr = static_cast<std::uint32_t>(word);
       inet_ntop(AF_INET, &decoded, addr_buffer, INET_ADDRSTRLEN);
     }
 
   } else if (family == AF_INET6) {
     struct in6_addr decoded;
     if (encoded_address.length() == 32) {
-      sscanf(encoded_address.c_str(),
-             "%8x%8x%8x%8x",
-             (unsigned int*)&(decoded.s6_addr[0]),
-             (unsigned int*)&(decoded.s6_addr[4]),
-             (unsigned int*)&(decoded.s6_addr[8]),
-             (unsigned int*)&(decoded.s6_addr[12]));
+      for (size_t i = 0; i < 4; i++) {
+        if (!procParseHex(encoded_address.substr(i * 8, 8), word)) {
+          return "";
+        }
+        auto host_word = static_cast<std::uint32_t>(word);
+        std::memcpy(&decoded.s6_addr[i * 4], &host_word, sizeof(host_word));
+      }
       inet_ntop(AF_INET6, &decoded, addr_buffer, INET6_ADDRSTRLEN);
     }
   }
@@ -110,66 +294,80 @@ std::string procDecodeAddressFromHex(const std::string& encoded_address,
   return std::string(addr_buffer);
 }
 
-unsigned short procDecodePortFromHex(const std::string& encoded_port) {
-  unsigned short decoded = 0;
-  if (encoded_port.length() == 4) {
-    sscanf(encoded_port.c_str(), "%hX", &decoded);
+static unsigned short procDecodePortFromHex(boost::string_ref encoded_port) {
+  std::uint64_t decoded = 0;
+  if (encoded_port.length() != 4 || !procParseHex(encoded_port, decoded)) {
+    return 0;
   }
-  return decoded;
+  return static_cast<unsigned short>(decoded);
+}
+
+std::string procDecodeAddressFromHex(const std::string& encoded_address,
+                                     int family) {
+  return procDecodeAddressFromHex(boost::string_ref(encoded_address), family);
+}
+
+unsigned short procDecodePortFromHex(const std::string& encoded_port) {
+  return procDecodePortFromHex(boost::string_ref(encoded_port));
 }
 
 static Status procGetSocketListInet(int family,
                                     int protocol,
                                     ino_t net_ns,
                                     const std::string& path,
-                                    const std::string& content,
+                                    boost::string_ref content,
                                     SocketInfoList& result) {
   // The system's socket information is tokenized by line.
-  bool header = true;
-  for (const auto& line : osquery::split(content, "\n")) {
-    if (header) {
-      if (line.find("sl") != 0 && line.find("sk") != 0) {
-        return Status(1, std::string("Invalid file header for ") + path);
-      }
-      header = false;
-      continue;
-    }
+  ProcTokenizer lines(content, "\n");
+  boost::string_ref line;
+  if (!lines.next(line) || (!procTrim(line).starts_with("sl") &&
+                            !procTrim(line).starts_with("sk"))) {
+    return Status(1, std::string("Invalid file header for ") + path);
+  }
 
+  while (lines.next(line)) {
     // The socket information is tokenized by spaces, each a field.
-    auto fields = osquery::split(line, " ");
-    if (fields.size() < 10) {
+    boost::string_ref fields[10];
+    size_t count = 0;
+    ProcTokenizer tokens(line, " ");
+    while (count < 10 && tokens.next(fields[count])) {
+      count++;
+    }
+    if (count < 10) {
       VLOG(1) << "Invalid socket descriptor found: '" << line
               << "'. Skipping this entry";
       continue;
     }
 
     // Two of the fields are the local/remote address/port pairs.
-    auto locals = osquery::split(fields[1], ":");
-    auto remotes = osquery::split(fields[2], ":");
-
-    if (locals.size() != 2 || remotes.size() != 2) {
+    auto local_delim = fields[1].find(':');
+    auto remote_delim = fields[2].find(':');
+    if (local_delim == boost::string_ref::npos ||
+        remote_delim == boost::string_ref::npos) {
       VLOG(1) << "Invalid socket descriptor found: '" << line
               << "'. Skipping this entry";
       continue;
     }
 
     SocketInfo socket_info = {};
-    socket_info.socket = fields[9];
+    socket_info.socket = fields[9].to_string();
     socket_info.net_ns = net_ns;
     socket_info.family = family;
     socket_info.protocol = protocol;
-    socket_info.local_address = procDecodeAddressFromHex(locals[0], family);
-    socket_info.local_port = procDecodePortFromHex(locals[1]);
-    socket_info.remote_address = procDecodeAddressFromHex(remotes[0], family);
-    socket_info.remote_port = procDecodePortFromHex(remotes[1]);
+    socket_info.local_address =
+        procDecodeAddressFromHex(fields[1].substr(0, local_delim), family);
+    socket_info.local_port =
+        procDecodePortFromHex(fields[1].substr(local_delim + 1));
+    socket_info.remote_address =
+        procDecodeAddressFromHex(fields[2].substr(0, remote_delim), family);
+    socket_info.remote_port =
+        procDecodePortFromHex(fields[2].substr(remote_delim + 1));
 
     if (protocol == IPPROTO_TCP) {
-      char* null_terminator_ptr = nullptr;
-      auto integer_socket_state =
-          std::strtoull(fields[3].data(), &null_terminator_ptr, 16);
-      if (integer_socket_state == 0 ||
-          integer_socket_state >= tcp_states.size() ||
-          null_terminator_ptr == nullptr || *null_terminator_ptr != 0) {
+      std::uint64_t integer_socket_state = 0;
+      if (!procParseHex(fields[3], integer_socket_state) ||
+          integer_socket_state == 0 ||
+          integer_socket_state >= tcp_states.size()) {
         socket_info.state = "UNKNOWN";
       } else {
         socket_info.state = tcp_states[integer_socket_state];
@@ -184,33 +382,39 @@ static Status procGetSocketListInet(int family,
 
 static Status procGetSocketListUnix(ino_t net_ns,
                                     const std::string& path,
-                                    const std::string& content,
+                                    boost::string_ref content,
                                     SocketInfoList& result) {
   // The system's socket information is tokenized by line.
-  bool header = true;
-  for (const auto& line : osquery::split(content, "\n")) {
-    if (header) {
-      if (line.find("Num") != 0) {
-        return Status(1, std::string("Invalid file header for ") + path);
-      }
-      header = false;
-      continue;
-    }
+  ProcTokenizer lines(content, "\n");
+  boost::string_ref line;
+  if (!lines.next(line) || !procTrim(line).starts_with("Num")) {
+    return Status(1, std::string("Invalid file header for ") + path);
+  }
 
+  while (lines.next(line)) {
     // The socket information is tokenized by spaces, each a field.
-    auto fields = osquery::split(line, " ");
-    if (fields.size() < 7) {
+    boost::string_ref fields[7];
+    size_t count = 0;
+    ProcTokenizer tokens(line, " ");
+    while (count < 7 && tokens.next(fields[count])) {
+      count++;
+    }
+    if (count < 7) {
       VLOG(1) << "Invalid UNIX socket descriptor found: '" << line
               << "'. Skipping this entry";
       continue;
     }
 
+    std::uint64_t protocol = 0;
+    procParseUInt(fields[2], protocol);
+
     SocketInfo socket_info = {};
-    socket_info.socket = fields[6];
+    socket_info.socket = fields[6].to_string();
     socket_info.net_ns = net_ns;
     socket_info.family = AF_UNIX;
-    socket_info.protocol = std::atoll(fields[2].data());
-    socket_info.unix_socket_path = (fields.size() >= 8) ? fields[7] : "";
+    socket_info.protocol = static_cast<int>(protocol);
+    // The path is the rest of the line.
+    socket_info.unix_socket_path = procTrim(tokens.rest()).to_string();
 
     result.push_back(std::move(socket_info));
   }
@@ -261,8 +465,8 @@ Status procGetSocketList(int family,
     return Status(1, "Invalid family " + std::to_string(family));
   }
 
-  std::string content;
-  if (!osquery::readFile(path, content).ok()) {
+  boost::string_ref content;
+  if (!procReadFile(AT_FDCWD, path.c_str(), content).ok()) {
     return Status(1, "Could not open socket information from " + path);
   }
 
@@ -282,6 +486,203 @@ Status procGetSocketList(int family,
   return status;
 }
 
+/// Large enough for the biggest message of a netlink dump.
+const size_t kSockDiagBufferSize = 65536;
+
+/// Send a NETLINK_SOCK_DIAG dump request and handle each reply.
+static Status procSockDiagDump(
+    const void* request,
+    size_t request_size,
+    const std::function<void(const struct nlmsghdr*)>& handler) {
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+  if (fd < 0) {
+    return Status(1, "Could not open a NETLINK_SOCK_DIAG socket");
+  }
+
+  struct sockaddr_nl address = {};
+  address.nl_family = AF_NETLINK;
+  if (sendto(fd,
+             request,
+             request_size,
+             0,
+             reinterpret_cast<struct sockaddr*>(&address),
+             sizeof(address)) < 0) {
+    close(fd);
+    return Status(1, "Could not send the NETLINK_SOCK_DIAG request");
+  }
+
+  std::vector<char> buffer(kSockDiagBufferSize);
+  Status status(1, "Incomplete NETLINK_SOCK_DIAG dump");
+  bool done = false;
+  while (!done) {
+    auto bytes = recv(fd, buffer.data(), buffer.size(), 0);
+    if (bytes < 0 && errno == EINTR) {
+      continue;
+    } else if (bytes <= 0) {
+      break;
+    }
+
+    auto size = static_cast<int>(bytes);
+    auto header = reinterpret_cast<const struct nlmsghdr*>(buffer.data());
+    for (; NLMSG_OK(header, size); header = NLMSG_NEXT(header, size)) {
+      if (header->nlmsg_type == NLMSG_DONE) {
+        status = Status(0);
+        done = true;
+        break;
+      } else if (header->nlmsg_type == NLMSG_ERROR) {
+        auto error = static_cast<const struct nlmsgerr*>(NLMSG_DATA(header));
+        status = Status(1,
+                        std::string("NETLINK_SOCK_DIAG error: ") +
+                            strerror(-error->error));
+        done = true;
+        break;
+      }
+
+      handler(header);
+    }
+  }
+
+  close(fd);
+  return status;
+}
+
+static bool procSockDiagAccepts(const SocketInodeToProcessInfoMap* inode_filter,
+                                const std::string& inode) {
+  return inode_filter == nullptr || inode_filter->count(inode) > 0;
+}
+
+Status procGetSocketListDiag(int family,
+                             int protocol,
+                             ino_t net_ns,
+                             std::uint32_t states,
+                             const SocketInodeToProcessInfoMap* inode_filter,
+                             SocketInfoList& result) {
+  if (family == AF_UNIX) {
+    if (protocol != IPPROTO_IP) {
+      return Status(1,
+                    "Invalid protocol " + std::to_string(protocol) +
+                        " for AF_UNIX familiy");
+    }
+
+    struct {
+      struct nlmsghdr header;
+      struct unix_diag_req request;
+    } message = {};
+    message.header.nlmsg_len = sizeof(message);
+    message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    message.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    message.request.sdiag_family = AF_UNIX;
+    message.request.udiag_states = ~0U;
+    message.request.udiag_show = UDIAG_SHOW_NAME;
+
+    return procSockDiagDump(
+        &message, sizeof(message), [&](const struct nlmsghdr* header) {
+          auto diag = static_cast<const struct unix_diag_msg*>(
+              NLMSG_DATA(header));
+          if (header->nlmsg_len < NLMSG_LENGTH(sizeof(*diag))) {
+            return;
+          }
+
+          auto inode = std::to_string(diag->udiag_ino);
+          if (!procSockDiagAccepts(inode_filter, inode)) {
+            return;
+          }
+
+          SocketInfo socket_info = {};
+          socket_info.socket = std::move(inode);
+          socket_info.net_ns = net_ns;
+          socket_info.family = AF_UNIX;
+          socket_info.protocol = IPPROTO_IP;
+
+          auto attr = reinterpret_cast<const struct rtattr*>(diag + 1);
+          int size = header->nlmsg_len - NLMSG_LENGTH(sizeof(*diag));
+          for (; RTA_OK(attr, size); attr = RTA_NEXT(attr, size)) {
+            if (attr->rta_type != UNIX_DIAG_NAME) {
+              continue;
+            }
+
+            auto& path = socket_info.unix_socket_path;
+            path.assign(static_cast<const char*>(RTA_DATA(attr)),
+                        RTA_PAYLOAD(attr));
+            if (!path.empty() && path[0] == '\0') {
+              // Abstract names show each NUL as an '@', as in /proc/net/unix.
+              std::replace(path.begin(), path.end(), '\0', '@');
+            } else {
+              // A pathname keeps the kernel's terminating NUL.
+              path.erase(path.find_last_not_of('\0') + 1);
+            }
+          }
+
+          result.push_back(std::move(socket_info));
+        });
+  }
+
+  if (family != AF_INET && family != AF_INET6) {
+    return Status(1, "Invalid family " + std::to_string(family));
+  }
+
+  if (protocol != IPPROTO_TCP && protocol != IPPROTO_UDP &&
+      protocol != IPPROTO_UDPLITE) {
+    return Status(1,
+                  "Unsupported protocol " + std::to_string(protocol) +
+                      " for NETLINK_SOCK_DIAG");
+  }
+
+  struct {
+    struct nlmsghdr header;
+    struct inet_diag_req_v2 request;
+  } message = {};
+  message.header.nlmsg_len = sizeof(message);
+  message.header.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+  message.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  message.request.sdiag_family = static_cast<__u8>(family);
+  message.request.sdiag_protocol = static_cast<__u8>(protocol);
+  message.request.idiag_states = (protocol == IPPROTO_TCP) ? states : ~0U;
+
+  return procSockDiagDump(
+      &message, sizeof(message), [&](const struct nlmsghdr* header) {
+        auto diag =
+            static_cast<const struct inet_diag_msg*>(NLMSG_DATA(header));
+        if (header->nlmsg_len < NLMSG_LENGTH(sizeof(*diag))) {
+          return;
+        }
+
+        auto inode = std::to_string(diag->idiag_inode);
+        if (!procSockDiagAccepts(inode_filter, inode)) {
+          return;
+        }
+
+        SocketInfo socket_info = {};
+        socket_info.socket = std::move(inode);
+        socket_info.net_ns = net_ns;
+        socket_info.family = family;
+        socket_info.protocol = protocol;
+
+        char address[INET6_ADDRSTRLEN] = {0};
+        inet_ntop(family, diag->id.idiag_src, address, sizeof(address));
+        socket_info.local_address = address;
+        socket_info.local_port = ntohs(diag->id.idiag_sport);
+        inet_ntop(family, diag->id.idiag_dst, address, sizeof(address));
+        socket_info.remote_address = address;
+        socket_info.remote_port = ntohs(diag->id.idiag_dport);
+
+        if (protocol == IPPROTO_TCP) {
+          if (diag->idiag_state == 0 ||
+              diag->idiag_state >= tcp_states.size()) {
+            socket_info.state = "UNKNOWN";
+          } else {
+            socket_info.state = tcp_states[diag->idiag_state];
+          }
+        }
+
+        result.push_back(std::move(socket_info));
+      });
+}
+
+Status procGetNetNamespace(ino_t& net_ns) {
+  return procGetNamespaceInode(net_ns, "net", kLinuxProcPath + "/self/ns");
+}
+
 Status procGetSocketInodeToProcessInfoMap(const std::string& pid,
                                           SocketInodeToProcessInfoMap& result) {
   auto callback = [](const std::string& _pid,
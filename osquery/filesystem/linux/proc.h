@@ -17,6 +17,8 @@
 #include <unistd.h>
 
 #include <boost/filesystem.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include <osquery/filesystem.h>
 #include <osquery/logger.h>
@@ -95,6 +97,73 @@ std::string procDecodeAddressFromHex(const std::string& encoded_address,
 
 unsigned short procDecodePortFromHex(const std::string& encoded_port);
 
+/**
+ * @brief Read a procfs file into a reusable per-thread buffer.
+ *
+ * The path is opened relative to dirfd, use AT_FDCWD for absolute paths. The
+ * content view is only valid until the next procReadFile on the same thread,
+ * fields must be copied out before another file is read. A buffer grown for
+ * a very large file is released by the next read.
+ */
+Status procReadFile(int dirfd, const char* path, boost::string_ref& content);
+
+/// A /proc/<pid> directory, its files are opened relative to it.
+class ProcDirectory : private boost::noncopyable {
+ public:
+  explicit ProcDirectory(const std::string& pid);
+  ~ProcDirectory();
+
+  bool isValid() const {
+    return fd_ >= 0;
+  }
+
+  /// See procReadFile, name is relative to the process directory.
+  Status read(const char* name, boost::string_ref& content) const;
+
+  /// Read a symlink relative to the process directory, empty on failure.
+  std::string readLink(const char* name) const;
+
+ private:
+  int fd_{-1};
+};
+
+/**
+ * @brief Iterates over the tokens of a view, without copies.
+ *
+ * As with osquery::split, consecutive delimiters produce no empty tokens.
+ */
+class ProcTokenizer final {
+ public:
+  ProcTokenizer(boost::string_ref input, const char* delims)
+      : input_(input), delims_(delims) {}
+
+  /// Find the next token, false once the input is exhausted.
+  bool next(boost::string_ref& token);
+
+  /// The input that has not been tokenized yet.
+  boost::string_ref rest() const {
+    return input_;
+  }
+
+ private:
+  boost::string_ref input_;
+  const char* delims_{nullptr};
+};
+
+/// Remove the leading and trailing whitespace of a view.
+boost::string_ref procTrim(boost::string_ref value);
+
+/// Split a "Key: Value" line, the value is trimmed.
+bool procSplitKeyValue(boost::string_ref line,
+                       boost::string_ref& key,
+                       boost::string_ref& value);
+
+/// Parse an unsigned decimal integer, the view must only contain digits.
+bool procParseUInt(boost::string_ref value, std::uint64_t& number);
+
+/// Parse an unsigned hexadecimal integer, without a 0x prefix.
+bool procParseHex(boost::string_ref value, std::uint64_t& number);
+
 /**
  * @brief Construct a map of socket inode number to socket information collected
  * from /proc/<pid>/net for a certain family and protocol under a certain pid.
@@ -114,6 +183,37 @@ Status procGetSocketList(int family,
                          const std::string& pid,
                          SocketInfoList& result);
 
+/**
+ * @brief Construct a list of sockets using NETLINK_SOCK_DIAG.
+ *
+ * This avoids formatting and parsing the /proc/net tables, which is slow on
+ * hosts with many sockets. The kernel only reports on the network namespace
+ * of the calling process, use procGetNetNamespace to compare it with the
+ * namespace of a pid.
+ *
+ * Supported are AF_INET and AF_INET6 with IPPROTO_TCP, IPPROTO_UDP or
+ * IPPROTO_UDPLITE, and AF_UNIX with IPPROTO_IP. An error is returned for
+ * anything else, or if the kernel lacks the diag module; the caller should
+ * then use procGetSocketList.
+ *
+ * @param family The socket family. One of AF_INET, AF_INET6 or AF_UNIX.
+ * @param protocol The socket protocol.
+ * @param net_ns The namespace inode to report, the caller's namespace.
+ * @param states A mask of (1 << state) TCP states, evaluated by the kernel.
+ * @param inode_filter If not null, only sockets with an inode in this map
+ * are added to the result.
+ * @param result The output parameter, values are appended.
+ */
+Status procGetSocketListDiag(int family,
+                             int protocol,
+                             ino_t net_ns,
+                             std::uint32_t states,
+                             const SocketInodeToProcessInfoMap* inode_filter,
+                             SocketInfoList& result);
+
+/// Read the network namespace inode of the calling process.
+Status procGetNetNamespace(ino_t& net_ns);
+
 /**
  * @brief Construct a map of socket inode number to process information for the
  * process that owns the socket by reading entries under /proc/<pid>/fd.
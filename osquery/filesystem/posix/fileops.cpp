@@ -8,6 +8,7 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <dirent.h>
 #include <glob.h>
 #include <pwd.h>
 #include <stdio.h>
@@ -18,9 +19,16 @@
 #include <sys/time.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
 #include <boost/optional.hpp>
 
 #include <osquery/filesystem.h>
+#include <osquery/logger.h>
 
 #include "osquery/core/process.h"
 #include "osquery/filesystem/fileops.h"
@@ -301,6 +309,203 @@ std::vector<std::string> platformGlob(const std::string& find_path) {
   return results;
 }
 
+namespace {
+
+/// Maximum number of threads used to walk a single recursive glob.
+const size_t kMaxGlobWalkThreads = 4;
+
+/// Number of pending directories before helper walk threads are started.
+const size_t kGlobWalkParallelThreshold = 64;
+
+/// A directory identity used to detect loops through directory symlinks.
+using DirectoryId = std::pair<dev_t, ino_t>;
+
+struct GlobWalkTask {
+  /// Directory path, including a trailing '/'.
+  std::string path;
+
+  /// Depth of the entries within this directory.
+  size_t depth{0};
+
+  /// Identities of every directory from the walk root to this directory.
+  std::vector<DirectoryId> ancestors;
+};
+
+/**
+ * @brief A single-pass, multi-threaded walk of a set of directories.
+ *
+ * The calling thread walks until the set of pending directories is large
+ * enough to warrant helper threads. Small trees never start a thread.
+ */
+class GlobWalker : private boost::noncopyable {
+ public:
+  explicit GlobWalker(size_t max_depth) : max_depth_(max_depth) {}
+
+  /// Add a root directory whose contents are at depth 2.
+  void addRoot(std::string path) {
+    if (path.empty()) {
+      return;
+    }
+
+    if (path.back() != '/') {
+      path += '/';
+    }
+    queue_.push_back({std::move(path), 2, {}});
+  }
+
+  std::vector<std::string> run();
+
+ private:
+  /// Worker loop, the calling thread may start helpers.
+  void work(bool owner);
+
+  /// List a single directory, collecting entries and subdirectories.
+  void walk(const GlobWalkTask& task,
+            std::vector<std::pair<size_t, std::string>>& found,
+            std::vector<GlobWalkTask>& children) const;
+
+ private:
+  size_t max_depth_{0};
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<GlobWalkTask> queue_;
+  size_t active_{0};
+
+  std::vector<std::thread> helpers_;
+  std::vector<std::pair<size_t, std::string>> results_;
+};
+
+std::vector<std::string> GlobWalker::run() {
+  work(true);
+  for (auto& helper : helpers_) {
+    helper.join();
+  }
+
+  // Keep the platformGlob ordering: each depth is a sorted set of paths.
+  std::sort(results_.begin(), results_.end());
+
+  std::vector<std::string> results;
+  results.reserve(results_.size());
+  for (auto& result : results_) {
+    results.push_back(std::move(result.second));
+  }
+  return results;
+}
+
+void GlobWalker::work(bool owner) {
+  std::vector<std::pair<size_t, std::string>> found;
+  std::vector<GlobWalkTask> children;
+  while (true) {
+    GlobWalkTask task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return !queue_.empty() || active_ == 0; });
+      if (queue_.empty()) {
+        // There is nothing queued and no walk that may add to the queue.
+        break;
+      }
+      task = std::move(queue_.front());
+      queue_.pop_front();
+      active_++;
+    }
+
+    walk(task, found, children);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (auto& child : children) {
+        queue_.push_back(std::move(child));
+      }
+      active_--;
+
+      if (owner && helpers_.empty() &&
+          queue_.size() >= kGlobWalkParallelThreshold) {
+        auto count = std::min<size_t>(kMaxGlobWalkThreads,
+                                      std::thread::hardware_concurrency());
+        for (size_t i = 1; i < count; i++) {
+          helpers_.emplace_back([this]() { work(false); });
+        }
+      }
+    }
+    children.clear();
+    cv_.notify_all();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::move(found.begin(), found.end(), std::back_inserter(results_));
+}
+
+void GlobWalker::walk(const GlobWalkTask& task,
+                      std::vector<std::pair<size_t, std::string>>& found,
+                      std::vector<GlobWalkTask>& children) const {
+  int fd = ::open(task.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    return;
+  }
+
+  struct stat dir_stat;
+  if (::fstat(fd, &dir_stat) != 0) {
+    ::close(fd);
+    return;
+  }
+
+  DirectoryId id(dir_stat.st_dev, dir_stat.st_ino);
+  if (std::find(task.ancestors.begin(), task.ancestors.end(), id) !=
+      task.ancestors.end()) {
+    LOG(WARNING) << "Symlink loop detected possibly involving: " << task.path;
+    ::close(fd);
+    return;
+  }
+
+  // The directory stream takes ownership of the descriptor.
+  DIR* dir = ::fdopendir(fd);
+  if (dir == nullptr) {
+    ::close(fd);
+    return;
+  }
+
+  struct dirent* entry = nullptr;
+  while ((entry = ::readdir(dir)) != nullptr) {
+    // A recursive wildcard, like '*', does not match hidden entries.
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    bool is_dir = (entry->d_type == DT_DIR);
+    if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN) {
+      // Only links and unknown types need a stat, links to directories
+      // are followed the same way glob follows them.
+      struct stat link_stat;
+      is_dir = (::fstatat(fd, entry->d_name, &link_stat, 0) == 0 &&
+                S_ISDIR(link_stat.st_mode));
+    }
+
+    auto path = task.path + entry->d_name;
+    if (is_dir) {
+      path += '/';
+      if (task.depth < max_depth_) {
+        GlobWalkTask child{path, task.depth + 1, task.ancestors};
+        child.ancestors.push_back(id);
+        children.push_back(std::move(child));
+      }
+    }
+    found.emplace_back(task.depth, std::move(path));
+  }
+  ::closedir(dir);
+}
+
+} // namespace
+
+std::vector<std::string> platformGlobRecursive(
+    const std::vector<std::string>& roots, size_t max_depth) {
+  GlobWalker walker(max_depth);
+  for (const auto& root : roots) {
+    walker.addRoot(root);
+  }
+  return walker.run();
+}
+
 int platformAccess(const std::string& path, mode_t mode) {
   return ::access(path.c_str(), mode);
 }
@@ -26,6 +26,8 @@
 
 // Some proc* functions are only compiled when building on linux
 #ifdef __linux__
+#include <sys/un.h>
+
 #include "osquery/filesystem/linux/proc.h"
 #endif
 
@@ -325,6 +327,45 @@ TEST_F(FilesystemTests, test_wildcard_double_folders) {
                            .string()));
 }
 
+TEST_F(FilesystemTests, test_wildcard_double_order) {
+  // Recursive results are ordered by depth, then path, like repeated globs.
+  std::vector<std::string> results;
+  resolveFilePattern(kFakeDirectory + "/deep11/%%", results);
+  std::vector<std::string> expected = {
+      fs::path(kFakeDirectory + "/deep11/deep2/").make_preferred().string(),
+      fs::path(kFakeDirectory + "/deep11/level1.txt").make_preferred().string(),
+      fs::path(kFakeDirectory + "/deep11/not_bash").make_preferred().string(),
+      fs::path(kFakeDirectory + "/deep11/deep2/deep3/")
+          .make_preferred()
+          .string(),
+      fs::path(kFakeDirectory + "/deep11/deep2/level2.txt")
+          .make_preferred()
+          .string(),
+      fs::path(kFakeDirectory + "/deep11/deep2/deep3/level3.txt")
+          .make_preferred()
+          .string(),
+  };
+  EXPECT_EQ(results, expected);
+}
+
+#ifndef WIN32
+TEST_F(FilesystemTests, test_wildcard_double_symlink_loop) {
+  // A directory symlink to an ancestor must not be walked forever.
+  boost::system::error_code ec;
+  fs::create_directory_symlink(
+      kFakeDirectory + "/deep1", kFakeDirectory + "/deep1/deep2/loop", ec);
+  ASSERT_FALSE(ec);
+
+  std::vector<std::string> results;
+  resolveFilePattern(kFakeDirectory + "/deep1/%%", results, GLOB_FOLDERS);
+  EXPECT_TRUE(contains(results, kFakeDirectory + "/deep1/deep2/loop/"));
+  EXPECT_TRUE(
+      contains(results, kFakeDirectory + "/deep1/deep2/loop/deep2/"));
+  EXPECT_FALSE(
+      contains(results, kFakeDirectory + "/deep1/deep2/loop/deep2/loop/"));
+}
+#endif
+
 TEST_F(FilesystemTests, test_wildcard_end_last_component) {
   std::vector<std::string> results;
   auto status = resolveFilePattern(kFakeDirectory + "/%11/%sh", results);
@@ -448,6 +489,142 @@ TEST_F(FilesystemTests, test_user_namespace_parser) {
   removePath(temp_path);
   EXPECT_EQ(namespace_inode, static_cast<ino_t>(112233));
 }
+
+TEST_F(FilesystemTests, test_sock_diag_socket_list) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT_GE(listener, 0);
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t address_size = sizeof(address);
+  ASSERT_EQ(bind(listener, (struct sockaddr*)&address, address_size), 0);
+  ASSERT_EQ(listen(listener, 1), 0);
+  ASSERT_EQ(getsockname(listener, (struct sockaddr*)&address, &address_size),
+            0);
+
+  struct stat socket_stat;
+  ASSERT_EQ(fstat(listener, &socket_stat), 0);
+  auto inode = std::to_string(socket_stat.st_ino);
+
+  // The diag modules may not be available, the table uses /proc/net then.
+  SocketInfoList diag_list;
+  SocketInodeToProcessInfoMap inode_filter = {{inode, {"", ""}}};
+  auto status = procGetSocketListDiag(
+      AF_INET, IPPROTO_TCP, 0, ~0U, &inode_filter, diag_list);
+  if (status.ok()) {
+    ASSERT_EQ(diag_list.size(), 1U);
+    EXPECT_EQ(diag_list[0].socket, inode);
+    EXPECT_EQ(diag_list[0].local_address, "127.0.0.1");
+    EXPECT_EQ(diag_list[0].local_port, ntohs(address.sin_port));
+    EXPECT_EQ(diag_list[0].state, "LISTEN");
+
+    // The kernel filters on the TCP state.
+    diag_list.clear();
+    status = procGetSocketListDiag(
+        AF_INET, IPPROTO_TCP, 0, 1U << 1, &inode_filter, diag_list);
+    EXPECT_TRUE(status.ok());
+    EXPECT_TRUE(diag_list.empty());
+  }
+
+  // The /proc/net parser finds the same socket while it is still open.
+  SocketInfoList proc_list;
+  ASSERT_TRUE(
+      procGetSocketList(AF_INET, IPPROTO_TCP, 0, "self", proc_list).ok());
+  auto it = std::find_if(proc_list.begin(),
+                         proc_list.end(),
+                         [&inode](const SocketInfo& socket_info) {
+                           return socket_info.socket == inode;
+                         });
+  ASSERT_NE(it, proc_list.end());
+  EXPECT_EQ(it->local_address, "127.0.0.1");
+  EXPECT_EQ(it->local_port, ntohs(address.sin_port));
+  EXPECT_EQ(it->state, "LISTEN");
+
+  close(listener);
+}
+
+TEST_F(FilesystemTests, test_sock_diag_unix_socket_path) {
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(listener, 0);
+
+  auto socket_path = kTestWorkingDirectory + "osquery-diag.sock";
+  unlink(socket_path.c_str());
+  struct sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  ASSERT_LT(socket_path.size(), sizeof(address.sun_path));
+  strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+  ASSERT_EQ(bind(listener, (struct sockaddr*)&address, sizeof(address)), 0);
+  ASSERT_EQ(listen(listener, 1), 0);
+
+  struct stat socket_stat;
+  ASSERT_EQ(fstat(listener, &socket_stat), 0);
+  auto inode = std::to_string(socket_stat.st_ino);
+
+  // The /proc/net parser and the diag request report the same path.
+  SocketInfoList proc_list;
+  ASSERT_TRUE(
+      procGetSocketList(AF_UNIX, IPPROTO_IP, 0, "self", proc_list).ok());
+  auto it = std::find_if(proc_list.begin(),
+                         proc_list.end(),
+                         [&inode](const SocketInfo& socket_info) {
+                           return socket_info.socket == inode;
+                         });
+  ASSERT_NE(it, proc_list.end());
+  EXPECT_EQ(it->unix_socket_path, socket_path);
+
+  SocketInfoList diag_list;
+  SocketInodeToProcessInfoMap inode_filter = {{inode, {"", ""}}};
+  auto status = procGetSocketListDiag(
+      AF_UNIX, IPPROTO_IP, 0, ~0U, &inode_filter, diag_list);
+  if (status.ok()) {
+    ASSERT_EQ(diag_list.size(), 1U);
+    EXPECT_EQ(diag_list[0].unix_socket_path, it->unix_socket_path);
+  }
+
+  close(listener);
+  unlink(socket_path.c_str());
+}
+
+TEST_F(FilesystemTests, test_proc_tokenizer) {
+  ProcTokenizer tokens("  sl  local_address rem\n", " \n");
+  boost::string_ref token;
+  ASSERT_TRUE(tokens.next(token));
+  EXPECT_EQ(token, "sl");
+  ASSERT_TRUE(tokens.next(token));
+  EXPECT_EQ(token, "local_address");
+  EXPECT_EQ(tokens.rest(), " rem\n");
+  ASSERT_TRUE(tokens.next(token));
+  EXPECT_EQ(token, "rem");
+  EXPECT_FALSE(tokens.next(token));
+
+  boost::string_ref key;
+  boost::string_ref value;
+  ASSERT_TRUE(procSplitKeyValue("VmRSS:\t  1234 kB", key, value));
+  EXPECT_EQ(key, "VmRSS");
+  EXPECT_EQ(value, "1234 kB");
+  EXPECT_FALSE(procSplitKeyValue("Empty:", key, value));
+
+  std::uint64_t number = 0;
+  EXPECT_TRUE(procParseUInt("18446744073709551615", number));
+  EXPECT_EQ(number, 18446744073709551615ULL);
+  EXPECT_FALSE(procParseUInt("12a", number));
+  EXPECT_TRUE(procParseHex("0A0b", number));
+  EXPECT_EQ(number, 0x0A0BU);
+  EXPECT_FALSE(procParseHex("0x1", number));
+
+  EXPECT_EQ(procDecodeAddressFromHex("0100007F", AF_INET), "127.0.0.1");
+  EXPECT_EQ(procDecodePortFromHex("1F90"), 8080);
+
+  // Files are read relative to a process directory.
+  ProcDirectory proc(std::to_string(platformGetPid()));
+  ASSERT_TRUE(proc.isValid());
+  boost::string_ref content;
+  ASSERT_TRUE(proc.read("stat", content).ok());
+  EXPECT_EQ(content.substr(0, content.find(' ')),
+            std::to_string(platformGetPid()));
+  EXPECT_FALSE(proc.readLink("exe").empty());
+}
 #endif
 
 TEST_F(FilesystemTests, test_read_proc) {
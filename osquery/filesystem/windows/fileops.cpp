@@ -1318,6 +1318,33 @@ std::vector<std::string> platformGlob(const std::string& find_path) {
   return results;
 }
 
+std::vector<std::string> platformGlobRecursive(
+    const std::vector<std::string>& roots, size_t max_depth) {
+  std::vector<std::string> results;
+
+  // Walk one level at a time, each directory is listed exactly once.
+  std::vector<std::string> level;
+  for (const auto& root : roots) {
+    if (!root.empty() && (root.back() == '\\' || root.back() == '/')) {
+      level.push_back(root);
+    }
+  }
+
+  for (size_t depth = 2; depth <= max_depth && !level.empty(); depth++) {
+    std::vector<std::string> next_level;
+    for (const auto& dir : level) {
+      for (auto& result : platformGlob(dir + "*")) {
+        if (result.back() == '\\') {
+          next_level.push_back(result);
+        }
+        results.push_back(std::move(result));
+      }
+    }
+    level.swap(next_level);
+  }
+  return results;
+}
+
 boost::optional<std::string> getHomeDirectory() {
   std::vector<char> profile(MAX_PATH);
   auto value = getEnvVar("USERPROFILE");
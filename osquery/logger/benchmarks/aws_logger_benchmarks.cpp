@@ -0,0 +1,37 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under both the Apache 2.0 license (found in the
+ *  LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ *  in the COPYING file in the root directory of this source tree).
+ *  You may select, at your option, one of the above-listed licenses.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include "osquery/logger/plugins/tests/aws_mock_forwarder.h"
+
+namespace osquery {
+
+static void AWS_LOGGER_send(benchmark::State& state) {
+  // Every request spends 10ms on the simulated round trip
+  MockAwsLogForwarder log_forwarder(static_cast<size_t>(state.range(0)),
+                                    std::chrono::milliseconds(10));
+
+  std::vector<std::string> log_lines;
+  for (size_t i = 0; i < 5000; i++) {
+    log_lines.push_back("{\"name\":\"benchmark\",\"counter\":\"" +
+                        std::to_string(i) + "\"}");
+  }
+
+  while (state.KeepRunning()) {
+    auto log_data = log_lines;
+    log_forwarder.send(log_data, "result");
+  }
+
+  state.SetItemsProcessed(state.iterations() * log_lines.size());
+}
+
+BENCHMARK(AWS_LOGGER_send)->Arg(1)->Arg(4)->Arg(16)->UseRealTime();
+}
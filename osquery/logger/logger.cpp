@@ -71,6 +71,12 @@ FLAG(int32,
      0,
      "Minimum level for statuses written to stderr");
 
+/// Bounds the serialized result lines held in memory while logging a query.
+HIDDEN_FLAG(uint64,
+            logger_batch_lines,
+            1024,
+            "Maximum result lines serialized and sent to loggers at once");
+
 /// It is difficult to set logging to stderr on/off at runtime.
 CLI_FLAG(bool, logger_stderr, true, "Write status logs to stderr");
 
@@ -611,68 +617,119 @@ Status logQueryLogItem(const QueryLogItem& results) {
   return logQueryLogItem(results, RegistryFactory::get().getActive("logger"));
 }
 
-Status logQueryLogItem(const QueryLogItem& results,
-                       const std::string& receiver) {
-  if (FLAGS_disable_logging) {
-    return Status(0, "Logging disabled");
+/// A logger plugin receiving query results, internal plugins are called
+/// directly and extension plugins through the registry.
+struct ResultLogger {
+  std::string name;
+  std::shared_ptr<LoggerPlugin> plugin;
+};
+
+static std::vector<ResultLogger> getResultLoggers(const std::string& receiver) {
+  std::vector<ResultLogger> loggers;
+  for (const auto& logger : osquery::split(receiver, ",")) {
+    if (FLAGS_logger_secondary_status_only &&
+        !BufferedLogSink::get().isPrimaryLogger(logger)) {
+      continue;
+    }
+
+    ResultLogger result_logger{logger, nullptr};
+    if (Registry::get().exists("logger", logger, true)) {
+      auto plugin = Registry::get().plugin("logger", logger);
+      result_logger.plugin = std::dynamic_pointer_cast<LoggerPlugin>(plugin);
+    }
+    loggers.push_back(std::move(result_logger));
   }
+  return loggers;
+}
 
-  std::vector<std::string> json_items;
+/// Send a chunk of serialized lines to each result logger.
+static Status logResultLines(const std::vector<ResultLogger>& loggers,
+                             const QueryLogMetadata& metadata,
+                             std::vector<std::string>& lines) {
   Status status;
-  if (FLAGS_logger_event_type) {
-    status = serializeQueryLogItemAsEventsJSON(results, json_items);
-  } else {
-    std::string json;
-    status = serializeQueryLogItemJSON(results, json);
-    json_items.emplace_back(json);
+  for (size_t i = 0; i < loggers.size(); ++i) {
+    const auto& logger = loggers[i];
+    // Only the last logger may take ownership of the lines.
+    std::vector<std::string> copy;
+    auto& chunk = (i + 1 == loggers.size()) ? lines : (copy = lines);
+
+    if (logger.plugin != nullptr) {
+      status = logger.plugin->logQueryResults(metadata, chunk);
+      continue;
+    }
+
+    for (const auto& line : chunk) {
+      if (metadata.snapshot) {
+        status = Registry::call("logger", logger.name, {{"snapshot", line}});
+      } else {
+        status = Registry::call("logger",
+                                logger.name,
+                                {{"string", line}, {"category", "event"}});
+      }
+    }
   }
+  return status;
+}
+
+static Status logResults(const QueryLogItem& item,
+                         const std::string& receiver,
+                         bool as_events,
+                         bool snapshot) {
+  auto loggers = getResultLoggers(receiver);
+  if (loggers.empty()) {
+    return Status();
+  }
+
+  QueryLogMetadata metadata;
+  metadata.name = item.name;
+  metadata.snapshot = snapshot;
+  metadata.events = as_events;
+  metadata.rows = (snapshot) ? item.snapshot_results.size()
+                             : item.results.added.size() +
+                                   item.results.removed.size();
+  metadata.time = item.time;
+  metadata.epoch = item.epoch;
+  metadata.counter = item.counter;
+
+  if (as_events) {
+    // Lines are serialized and sent in chunks, rather than all at once.
+    Status log_status;
+    auto status = serializeQueryLogItemAsEventsJSON(
+        item,
+        static_cast<size_t>(FLAGS_logger_batch_lines),
+        [&loggers, &log_status, &metadata](std::vector<std::string>& lines) {
+          log_status = logResultLines(loggers, metadata, lines);
+          return Status();
+        });
+    return (status.ok()) ? log_status : status;
+  }
+
+  std::vector<std::string> lines(1);
+  auto status = serializeQueryLogItemJSON(item, lines.back());
   if (!status.ok()) {
     return status;
   }
-
-  for (const auto& json : json_items) {
-    status = logString(json, "event", receiver);
-  }
-  return status;
+  return logResultLines(loggers, metadata, lines);
 }
 
-Status logSnapshotQuery(const QueryLogItem& item) {
+Status logQueryLogItem(const QueryLogItem& results,
+                       const std::string& receiver) {
   if (FLAGS_disable_logging) {
     return Status(0, "Logging disabled");
   }
 
-  std::vector<std::string> json_items;
-  Status status;
-  if (FLAGS_logger_snapshot_event_type) {
-    status = serializeQueryLogItemAsEventsJSON(item, json_items);
-  } else {
-    std::string json;
-    status = serializeQueryLogItemJSON(item, json);
-    json_items.emplace_back(json);
-  }
-  if (!status.ok()) {
-    return status;
-  }
-
-  for (const auto& json : json_items) {
-    auto receiver = RegistryFactory::get().getActive("logger");
-    for (const auto& logger : osquery::split(receiver, ",")) {
-      if (FLAGS_logger_secondary_status_only &&
-          !BufferedLogSink::get().isPrimaryLogger(logger)) {
-        continue;
-      }
+  return logResults(results, receiver, FLAGS_logger_event_type, false);
+}
 
-      if (Registry::get().exists("logger", logger, true)) {
-        auto plugin = Registry::get().plugin("logger", logger);
-        auto logger_plugin = std::dynamic_pointer_cast<LoggerPlugin>(plugin);
-        status = logger_plugin->logSnapshot(json);
-      } else {
-        status = Registry::call("logger", logger, {{"snapshot", json}});
-      }
-    }
+Status logSnapshotQuery(const QueryLogItem& item) {
+  if (FLAGS_disable_logging) {
+    return Status(0, "Logging disabled");
   }
 
-  return status;
+  return logResults(item,
+                    RegistryFactory::get().getActive("logger"),
+                    FLAGS_logger_snapshot_event_type,
+                    true);
 }
 
 size_t queuedStatuses() {
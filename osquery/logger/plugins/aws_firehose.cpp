@@ -33,6 +33,11 @@ FLAG(uint64,
 
 FLAG(string, aws_firehose_stream, "", "Name of Firehose stream for logging")
 
+FLAG(uint64,
+     aws_firehose_concurrency,
+     4,
+     "Max number of batches sent concurrently to Firehose (default 4)");
+
 Status FirehoseLoggerPlugin::setUp() {
   initAwsSdk();
 
@@ -98,6 +103,10 @@ size_t FirehoseLogForwarder::getMaxBytesPerBatch() const {
   return 4000000U;
 }
 
+size_t FirehoseLogForwarder::getMaxConcurrentBatches() const {
+  return static_cast<size_t>(FLAGS_aws_firehose_concurrency);
+}
+
 size_t FirehoseLogForwarder::getMaxRetryCount() const {
   return 100U;
 }
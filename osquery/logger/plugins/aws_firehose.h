@@ -50,6 +50,7 @@ class FirehoseLogForwarder final : public IFirehoseLogForwarder {
   size_t getMaxBytesPerRecord() const override;
   size_t getMaxRecordsPerBatch() const override;
   size_t getMaxBytesPerBatch() const override;
+  size_t getMaxConcurrentBatches() const override;
   size_t getMaxRetryCount() const override;
   size_t getInitialRetryDelay() const override;
   bool appendNewlineSeparators() const override;
@@ -45,6 +45,11 @@ FLAG(bool,
      false,
      "Enable random kinesis partition keys");
 
+FLAG(uint64,
+     aws_kinesis_concurrency,
+     4,
+     "Max number of batches sent concurrently to Kinesis (default 4)");
+
 Status KinesisLoggerPlugin::setUp() {
   initAwsSdk();
   forwarder_ = std::make_shared<KinesisLogForwarder>(
@@ -119,6 +124,10 @@ size_t KinesisLogForwarder::getMaxBytesPerBatch() const {
   return 5000000U;
 }
 
+size_t KinesisLogForwarder::getMaxConcurrentBatches() const {
+  return static_cast<size_t>(FLAGS_aws_kinesis_concurrency);
+}
+
 size_t KinesisLogForwarder::getMaxRetryCount() const {
   return 100U;
 }
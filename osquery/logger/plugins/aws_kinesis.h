@@ -48,6 +48,7 @@ class KinesisLogForwarder final : public IKinesisLogForwarder {
   size_t getMaxBytesPerRecord() const override;
   size_t getMaxRecordsPerBatch() const override;
   size_t getMaxBytesPerBatch() const override;
+  size_t getMaxConcurrentBatches() const override;
   size_t getMaxRetryCount() const override;
   size_t getInitialRetryDelay() const override;
   bool appendNewlineSeparators() const override;
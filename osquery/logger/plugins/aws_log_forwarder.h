@@ -10,8 +10,13 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <future>
 #include <memory>
+#include <queue>
+#include <sstream>
 #include <vector>
 
 #include <osquery/core.h>
@@ -30,6 +35,10 @@
 #endif
 
 namespace osquery {
+
+/// Upper bound, in milliseconds, for the delay between two send attempts
+const size_t kAwsMaxRetryDelay = 30000U;
+
 template <typename RecordType,
           typename ClientType,
           typename OutcomeType,
@@ -128,6 +137,7 @@ class AwsLogForwarder : public BufferedLogForwarder {
 
     Batch current_batch;
     size_t current_batch_byte_size = 0U;
+    auto max_records_per_batch = getBatchRecordLimit();
 
     for (auto& record : log_data) {
       // Initialize the line and make sure we are still within protocol limits
@@ -155,7 +165,7 @@ class AwsLogForwarder : public BufferedLogForwarder {
 
       // Complete the current batch if it's full
       if (current_batch_byte_size + record_size >= getMaxBytesPerBatch() ||
-          (current_batch.size() >= getMaxRecordsPerBatch())) {
+          (current_batch.size() >= max_records_per_batch)) {
         batch_list.push_back(current_batch);
 
         current_batch.clear();
@@ -185,21 +195,49 @@ class AwsLogForwarder : public BufferedLogForwarder {
     return batch_list;
   }
 
+  /// Returns the amount of records the next batches may contain
+  size_t getBatchRecordLimit() const {
+    auto limit = batch_record_limit_.load();
+    return (limit == 0) ? getMaxRecordsPerBatch() : limit;
+  }
+
+  /**
+   * @brief Adapts the batch size to what the stream is able to absorb
+   *
+   * Batches are halved when records are throttled and grow again, a tenth
+   * of the protocol limit at a time, when they are accepted on first try.
+   */
+  void updateBatchRecordLimit(bool throttled) {
+    auto max_limit = getMaxRecordsPerBatch();
+    auto limit = getBatchRecordLimit();
+
+    if (throttled) {
+      limit = std::max<size_t>(limit / 2U, 1U);
+    } else {
+      limit = std::min(limit + std::max<size_t>(max_limit / 10U, 1U),
+                       max_limit);
+    }
+
+    batch_record_limit_ = limit;
+  }
+
  protected:
-  /// Sends a single batch
+  /// Sends a single batch, retrying only the records that have been rejected
   bool sendBatch(Batch& batch, std::stringstream& status_output) {
     bool success = false;
 
     auto max_retry_count = getMaxRetryCount();
-    auto base_retry_delay = getInitialRetryDelay();
+    size_t retry_delay = getInitialRetryDelay();
 
     for (size_t retry = 0; retry < max_retry_count; retry++) {
       bool is_last_retry = (retry + 1 >= max_retry_count);
 
-      // Increase the resend delay at each retry
-      size_t retry_delay =
-          (retry == 0 ? 0 : base_retry_delay) + (retry * 1000U);
-      if (retry_delay != 0) {
+      // Double the resend delay at each retry
+      if (retry > 1) {
+        retry_delay = std::min(retry_delay * 2U, kAwsMaxRetryDelay);
+      }
+
+      if (retry != 0 && retry_delay != 0) {
         pauseMilli(retry_delay);
       }
 
@@ -216,12 +254,15 @@ class AwsLogForwarder : public BufferedLogForwarder {
         request_failure = false;
       }
 
+      if (retry == 0) {
+        updateBatchRecordLimit(failed_record_count != 0);
+      }
+
       size_t sent_record_count = batch.size() - failed_record_count;
 
       if (sent_record_count > 0) {
-        VLOG(1) << name_ << ": Successfully sent "
-                << batch.size() - failed_record_count << " out of "
-                << batch.size() << " log records";
+        VLOG(1) << name_ << ": Successfully sent " << sent_record_count
+                << " out of " << batch.size() << " log records";
       }
 
       if (failed_record_count == 0) {
@@ -251,19 +292,46 @@ class AwsLogForwarder : public BufferedLogForwarder {
 
       const auto& result_record_list = getResult(outcome);
 
-      for (size_t i = batch.size(); i-- > 0;) {
-        if (!result_record_list[i].GetErrorCode().empty()) {
+      Batch failed_batch;
+      failed_batch.reserve(failed_record_count);
+
+      for (size_t i = 0; i < batch.size(); i++) {
+        // Records without a result entry are considered as rejected
+        if (i < result_record_list.size() &&
+            result_record_list[i].GetErrorCode().empty()) {
           continue;
         }
 
-        auto it = std::next(batch.begin(), i);
-        batch.erase(it);
+        failed_batch.push_back(std::move(batch[i]));
       }
+
+      batch = std::move(failed_batch);
     }
 
     return success;
   }
 
+  /// Sends a single batch, dumping the records that could not be written
+  Status uploadBatch(Batch& batch) {
+    std::stringstream status_output;
+    bool success = sendBatch(batch, status_output);
+
+    if (!success) {
+      // We couldn't write some of the records; log them locally so that the
+      // administrator will at least be able to inspect them
+      dumpBatchToErrorLog(batch);
+    }
+
+    // Release the records as soon as possible
+    Batch().swap(batch);
+
+    if (!success) {
+      return Status(1, status_output.str());
+    }
+
+    return Status(0, "OK");
+  }
+
   /// Sends the specified data in one or more batches, depending on the log size
   Status send(std::vector<std::string>& log_data,
               const std::string& log_type) override {
@@ -275,20 +343,41 @@ class AwsLogForwarder : public BufferedLogForwarder {
     dumpDiscardedRecordsToErrorLog(discarded_records);
     discarded_records.clear();
 
-    // Send each batch
+    // Send the batches, keeping a bounded amount of requests in flight
+    auto max_concurrent_batches =
+        std::max<size_t>(getMaxConcurrentBatches(), 1U);
+    auto launch_policy = (max_concurrent_batches > 1U) ? std::launch::async
+                                                        : std::launch::deferred;
+
     size_t error_count = 0;
     std::stringstream status_output;
+    std::queue<std::future<Status>> pending_uploads;
+
+    auto wait_for_upload = [&error_count, &status_output, &pending_uploads]() {
+      auto s = pending_uploads.front().get();
+      pending_uploads.pop();
+
+      if (!s.ok()) {
+        if (error_count != 0 && !s.getMessage().empty()) {
+          status_output << "\n";
+        }
 
-    for (auto batch_it = batch_list.begin(); batch_it != batch_list.end();) {
-      auto& batch = *batch_it;
-      if (!sendBatch(batch, status_output)) {
-        // We couldn't write some of the records; log them locally so that the
-        // administrator will at least be able to inspect them
-        dumpBatchToErrorLog(batch);
+        status_output << s.getMessage();
         error_count++;
       }
+    };
 
-      batch_it = batch_list.erase(batch_it);
+    for (auto& batch : batch_list) {
+      if (pending_uploads.size() >= max_concurrent_batches) {
+        wait_for_upload();
+      }
+
+      pending_uploads.push(std::async(
+          launch_policy, [this, &batch]() { return uploadBatch(batch); }));
+    }
+
+    while (!pending_uploads.empty()) {
+      wait_for_upload();
     }
 
     if (error_count != 0) {
@@ -317,6 +406,9 @@ class AwsLogForwarder : public BufferedLogForwarder {
   /// Must return the amount of bytes that can fit in a single batch
   virtual size_t getMaxBytesPerBatch() const = 0;
 
+  /// Must return the amount of batches that can be sent concurrently
+  virtual size_t getMaxConcurrentBatches() const = 0;
+
   /// Must return the maximum amount of retries when sending records
   virtual size_t getMaxRetryCount() const = 0;
 
@@ -338,5 +430,9 @@ class AwsLogForwarder : public BufferedLogForwarder {
 
   /// Logger name; used when printing messages
   std::string name_;
+
+ private:
+  /// Records per batch, adapted to throttling; 0 means the protocol limit
+  std::atomic<size_t> batch_record_limit_{0};
 };
 }
@@ -11,12 +11,14 @@
 #include <algorithm>
 #include <chrono>
 #include <thread>
+#include <tuple>
 
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 
 #include <osquery/database.h>
 #include <osquery/flags.h>
+#include <osquery/numeric_monitoring.h>
 #include <osquery/registry.h>
 #include <osquery/system.h>
 
@@ -33,150 +35,338 @@ FLAG(uint64,
      1000000,
      "Maximum number of logs in buffered output plugins (0 = unlimited)");
 
+HIDDEN_FLAG(uint64,
+            buffered_log_segment_lines,
+            1024,
+            "Maximum number of log lines persisted together as a segment");
+
+HIDDEN_FLAG(uint64,
+            buffered_log_flush_interval,
+            250,
+            "Milliseconds log lines are held before being persisted (0 = "
+            "persist each line)");
+
 const std::chrono::seconds BufferedLogForwarder::kLogPeriod{
     std::chrono::seconds(4)};
 const size_t BufferedLogForwarder::kMaxLogLines{1024};
 
+namespace {
+/// Marks a value holding several lines; single lines are stored as-is
+const char kSegmentMarker = '\x1f';
+
+/// Pending lines are persisted once they use this much memory
+const size_t kMaxPendingSize = 4 * 1024 * 1024;
+
+/// Encodes the lines, from the given offset, as "<time> <size>\n<data>"
+template <typename LogLine>
+std::string encodeSegment(const std::vector<LogLine>& lines, size_t offset) {
+  size_t size = 1;
+  for (size_t i = offset; i < lines.size(); ++i) {
+    size += lines[i].data.size() + 32;
+  }
+
+  std::string value;
+  value.reserve(size);
+  value.push_back(kSegmentMarker);
+
+  for (size_t i = offset; i < lines.size(); ++i) {
+    value += std::to_string(lines[i].time);
+    value.push_back(' ');
+    value += std::to_string(lines[i].data.size());
+    value.push_back('\n');
+    value += lines[i].data;
+  }
+
+  return value;
+}
+
+/// Parses a decimal number ending with the given character, or the input end
+bool parseNumber(const std::string& input, size_t& offset, char end, size_t& n) {
+  auto end_offset =
+      (end == '\0') ? input.size() : input.find(end, offset);
+  if (end_offset == std::string::npos || end_offset == offset) {
+    return false;
+  }
+
+  n = 0;
+  for (; offset < end_offset; ++offset) {
+    if (input[offset] < '0' || input[offset] > '9') {
+      return false;
+    }
+    n = n * 10 + static_cast<size_t>(input[offset] - '0');
+  }
+
+  ++offset;
+  return true;
+}
+} // namespace
+
 Status BufferedLogForwarder::setUp() {
-  // initialize buffer_count_ by scanning the DB
-  std::vector<std::string> indexes;
-  auto status = scanDatabaseKeys(kLogs, indexes, index_name_, 0);
+  // initialize buffer_count_ by reading the segments in the DB
+  size_t line_count = 0;
+  for (bool results : {true, false}) {
+    std::vector<Segment> segments;
+    auto status = listSegments(results, segments);
+    if (!status.ok()) {
+      return Status(1, "Error scanning for buffered log count");
+    }
 
-  if (!status.ok()) {
-    return Status(1, "Error scanning for buffered log count");
+    for (const auto& segment : segments) {
+      std::vector<LogLine> lines;
+      if (readSegment(segment, lines).ok()) {
+        line_count += lines.size();
+      }
+    }
   }
 
   RecursiveLock lock(count_mutex_);
-  buffer_count_ = indexes.size();
+  buffer_count_ = line_count + pending_results_.size() + pending_statuses_.size();
   return Status(0);
 }
 
 void BufferedLogForwarder::check() {
-  // Get a list of all the buffered log items, with a max of 1024 lines.
-  std::vector<std::string> indexes;
-  auto status = scanDatabaseKeys(kLogs, indexes, index_name_, max_log_lines_);
-
-  // For each index, accumulate the log line into the result or status set.
-  std::vector<std::string> results, statuses;
-  iterate(indexes, ([&results, &statuses, this](std::string& index) {
-            std::string value;
-            auto& target = isResultIndex(index) ? results : statuses;
-            if (getDatabaseValue(kLogs, index, value)) {
-              target.emplace_back(std::move(value));
-            }
-          }));
+  backlog_ = false;
 
-  // If any results/statuses were found in the flushed buffer, send.
-  if (results.size() > 0) {
-    status = send(results, "result");
+  {
+    RecursiveLock lock(count_mutex_);
+    auto status = flushPending();
     if (!status.ok()) {
-      VLOG(1) << "Error sending results to logger: " << status.getMessage();
-    } else {
-      // Clear the results logs once they were sent.
-      iterate(indexes, ([this](std::string& index) {
-                if (!isResultIndex(index)) {
-                  return;
-                }
-                deleteValueWithCount(kLogs, index);
-              }));
+      VLOG(1) << "Error buffering logs: " << status.getMessage();
+    }
+  }
+
+  // Read whole segments, oldest first, up to max_log_lines_ lines.
+  struct ReadSegment {
+    Segment segment;
+    std::vector<LogLine> lines;
+    size_t line_count;
+  };
+
+  size_t remaining = max_log_lines_;
+  bool more_logs = false;
+
+  std::vector<ReadSegment> read_segments[2];
+  std::vector<std::string> log_data[2];
+
+  for (size_t type = 0; type < 2; ++type) {
+    std::vector<Segment> segments;
+    if (!listSegments(type == 0, segments).ok()) {
+      continue;
+    }
+
+    for (const auto& segment : segments) {
+      if (remaining == 0) {
+        more_logs = true;
+        break;
+      }
+
+      ReadSegment read_segment;
+      read_segment.segment = segment;
+      if (!readSegment(segment, read_segment.lines).ok()) {
+        continue;
+      }
+
+      auto& lines = read_segment.lines;
+      read_segment.line_count = std::min(remaining, lines.size());
+      remaining -= read_segment.line_count;
+      if (read_segment.line_count < lines.size()) {
+        more_logs = true;
+      }
+
+      for (size_t i = 0; i < read_segment.line_count; ++i) {
+        log_data[type].push_back(std::move(lines[i].data));
+      }
+
+      read_segments[type].push_back(std::move(read_segment));
     }
   }
 
-  if (statuses.size() > 0) {
-    status = send(statuses, "status");
+  // If any results/statuses were found in the flushed buffer, send.
+  bool send_failed = false;
+  for (size_t type = 0; type < 2; ++type) {
+    if (log_data[type].empty()) {
+      continue;
+    }
+
+    auto send_start = std::chrono::steady_clock::now();
+    auto status = send(log_data[type], (type == 0) ? "result" : "status");
+    monitoring::record("logger." + index_name_ + ".send_ms",
+                       std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - send_start)
+                           .count(),
+                       monitoring::PreAggregationType::Histogram);
     if (!status.ok()) {
-      VLOG(1) << "Error sending status to logger: " << status.getMessage();
-    } else {
-      // Clear the status logs once they were sent.
-      iterate(indexes, ([this](std::string& index) {
-                if (!isStatusIndex(index)) {
-                  return;
-                }
-                deleteValueWithCount(kLogs, index);
-              }));
+      VLOG(1) << "Error sending " << ((type == 0) ? "results" : "status")
+              << " to logger: " << status.getMessage();
+      monitoring::record("logger." + index_name_ + ".send_errors",
+                         1,
+                         monitoring::PreAggregationType::Sum);
+      send_failed = true;
+      continue;
+    }
+    monitoring::record("logger." + index_name_ + ".sent_lines",
+                       log_data[type].size(),
+                       monitoring::PreAggregationType::Sum);
+
+    // Truncate the segments once they were sent.
+    for (auto& read_segment : read_segments[type]) {
+      truncateSegment(
+          read_segment.segment, read_segment.lines, read_segment.line_count);
     }
   }
 
+  // Keep draining without waiting while sends succeed
+  backlog_ = more_logs && !send_failed;
+
   // Purge any logs exceeding the max after our send attempt
   if (FLAGS_buffered_log_max > 0) {
     purge();
   }
+
+  RecursiveLock lock(count_mutex_);
+  monitoring::record("logger." + index_name_ + ".backlog",
+                     buffer_count_,
+                     monitoring::PreAggregationType::Max);
 }
 
 void BufferedLogForwarder::purge() {
   RecursiveLock lock(count_mutex_);
+  auto status = flushPending();
+  if (!status.ok()) {
+    VLOG(1) << "Error buffering logs: " << status.getMessage();
+  }
+
   if (buffer_count_ <= FLAGS_buffered_log_max) {
     return;
   }
 
   size_t purge_count = buffer_count_ - FLAGS_buffered_log_max;
 
-  // Collect purge_count indexes of each type (result/status) before
-  // partitioning to find the oldest. Note this assumes that the indexes are
-  // returned in ascending lexicographic order (true for RocksDB).
-  std::vector<std::string> indexes;
-  auto status =
-      scanDatabaseKeys(kLogs, indexes, genIndexPrefix(true), purge_count);
-  if (!status.ok()) {
-    LOG(ERROR) << "Error scanning DB during buffered log purge";
-    return;
-  }
-
   LOG(WARNING) << "Purging buffered logs limit (" << FLAGS_buffered_log_max
                << ") exceeded: " << buffer_count_;
 
-  std::vector<std::string> status_indexes;
-  status = scanDatabaseKeys(
-      kLogs, status_indexes, genIndexPrefix(false), purge_count);
-  if (!status.ok()) {
-    LOG(ERROR) << "Error scanning DB during buffered log purge";
-    return;
+  // Walk the result and status segments together, oldest line first.
+  struct Cursor {
+    std::vector<Segment> segments;
+    size_t segment_index{0};
+    std::vector<LogLine> lines;
+    size_t line_index{0};
+    bool loaded{false};
+  };
+
+  Cursor cursors[2];
+  for (size_t type = 0; type < 2; ++type) {
+    if (!listSegments(type == 0, cursors[type].segments).ok()) {
+      LOG(ERROR) << "Error scanning DB during buffered log purge";
+      return;
+    }
   }
 
-  indexes.insert(indexes.end(), status_indexes.begin(), status_indexes.end());
+  // Moves a cursor to its next line, deleting segments that were consumed.
+  auto L_Advance = [this](Cursor& cursor) -> bool {
+    while (cursor.segment_index < cursor.segments.size()) {
+      if (!cursor.loaded) {
+        cursor.lines.clear();
+        cursor.line_index = 0;
+        cursor.loaded = true;
+        readSegment(cursor.segments[cursor.segment_index], cursor.lines);
+      }
+
+      if (cursor.line_index < cursor.lines.size()) {
+        return true;
+      }
+
+      truncateSegment(cursor.segments[cursor.segment_index],
+                      cursor.lines,
+                      cursor.lines.size());
+
+      ++cursor.segment_index;
+      cursor.loaded = false;
+    }
 
-  if (indexes.size() < purge_count) {
-    LOG(ERROR) << "Trying to purge " << purge_count << " logs but only found "
-               << indexes.size();
-    return;
+    return false;
+  };
+
+  size_t purged = 0;
+  for (; purged < purge_count; ++purged) {
+    bool has_result = L_Advance(cursors[0]);
+    bool has_status = L_Advance(cursors[1]);
+    if (!has_result && !has_status) {
+      break;
+    }
+
+    size_t type = has_result ? 0 : 1;
+    if (has_result && has_status) {
+      const auto& result = cursors[0];
+      const auto& status_cursor = cursors[1];
+      auto result_time = result.lines[result.line_index].time;
+      auto status_time = status_cursor.lines[status_cursor.line_index].time;
+
+      if (status_time < result_time ||
+          (status_time == result_time &&
+           status_cursor.segments[status_cursor.segment_index].sequence <
+               result.segments[result.segment_index].sequence)) {
+        type = 1;
+      }
+    }
+
+    ++cursors[type].line_index;
   }
 
-  size_t prefix_size = genIndexPrefix(true).size();
-  // Partition the indexes so that the first purge_count elements are the
-  // oldest indexes (the ones to be purged)
-  std::nth_element(indexes.begin(),
-                   indexes.begin() + purge_count - 1,
-                   indexes.end(),
-                   [&](const std::string& a, const std::string& b) {
-                     // Skip the prefix when doing comparisons
-                     return a.compare(prefix_size,
-                                      std::string::npos,
-                                      b,
-                                      prefix_size,
-                                      std::string::npos) < 0;
-                   });
-  indexes.erase(indexes.begin() + purge_count, indexes.end());
-
-  // Now only indexes of logs to be deleted remain
-  iterate(indexes, [this](const std::string& index) {
-    if (!deleteValueWithCount(kLogs, index).ok()) {
-      LOG(ERROR) << "Error deleting value during buffered log purge";
+  // Truncate the segments the cursors stopped in.
+  for (auto& cursor : cursors) {
+    if (cursor.loaded && cursor.line_index > 0) {
+      truncateSegment(cursor.segments[cursor.segment_index],
+                      cursor.lines,
+                      cursor.line_index);
     }
-  });
+  }
+
+  if (purged < purge_count) {
+    LOG(ERROR) << "Trying to purge " << purge_count << " logs but only found "
+               << purged;
+  }
 }
 
 void BufferedLogForwarder::start() {
   while (!interrupted()) {
     check();
 
-    // Cool off and time wait the configured period.
-    pauseMilli(log_period_);
+    // Cool off and time wait the configured period, unless logs are piling.
+    // Lines held in memory are persisted as their flush interval expires.
+    if (!backlog_) {
+      auto deadline = std::chrono::steady_clock::now() + log_period_;
+      auto flush_interval =
+          std::chrono::milliseconds(FLAGS_buffered_log_flush_interval);
+
+      while (!interrupted()) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+          break;
+        }
+
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - now);
+        if (flush_interval.count() > 0 && flush_interval < wait) {
+          wait = flush_interval;
+        }
+
+        pauseMilli(wait);
+
+        auto status = flushExpired();
+        if (!status.ok()) {
+          VLOG(1) << "Error buffering logs: " << status.getMessage();
+        }
+      }
+    }
   }
+
+  // Persist the lines that are still in memory.
+  flush();
 }
 
 Status BufferedLogForwarder::logString(const std::string& s, size_t time) {
-  std::string index = genResultIndex(time);
-  return addValueWithCount(kLogs, index, s);
+  return addLine(true, s, time);
 }
 
 Status BufferedLogForwarder::logStatus(const std::vector<StatusLogLine>& log,
@@ -220,8 +410,7 @@ Status BufferedLogForwarder::logStatus(const std::vector<StatusLogLine>& log,
     if (!json.empty()) {
       json.pop_back();
     }
-    std::string index = genStatusIndex(time);
-    Status status = addValueWithCount(kLogs, index, json);
+    Status status = addLine(false, std::move(json), time);
     if (!status.ok()) {
       // Do not continue if any line fails.
       return status;
@@ -264,26 +453,177 @@ std::string BufferedLogForwarder::genIndex(bool results, size_t time) {
          std::to_string(++log_index_);
 }
 
-Status BufferedLogForwarder::addValueWithCount(const std::string& domain,
-                                               const std::string& key,
-                                               const std::string& value) {
-  Status status = setDatabaseValue(domain, key, value);
-  if (status.ok()) {
-    RecursiveLock lock(count_mutex_);
-    buffer_count_++;
+Status BufferedLogForwarder::flush() {
+  RecursiveLock lock(count_mutex_);
+  return flushPending();
+}
+
+Status BufferedLogForwarder::addLine(bool results,
+                                     std::string line,
+                                     size_t time) {
+  if (time == 0) {
+    time = getUnixTime();
+  }
+
+  RecursiveLock lock(count_mutex_);
+  auto now = std::chrono::steady_clock::now();
+  if (pending_results_.empty() && pending_statuses_.empty()) {
+    pending_since_ = now;
+  }
+
+  pending_size_ += line.size();
+  auto& pending = results ? pending_results_ : pending_statuses_;
+  pending.push_back({time, std::move(line)});
+  buffer_count_++;
+
+  // Persist together the lines of a burst, within a bounded delay.
+  auto pending_lines = pending_results_.size() + pending_statuses_.size();
+  auto flush_interval =
+      std::chrono::milliseconds(FLAGS_buffered_log_flush_interval);
+
+  if (pending_lines >= FLAGS_buffered_log_segment_lines ||
+      pending_size_ >= kMaxPendingSize || now - pending_since_ >= flush_interval) {
+    return flushPending();
+  }
+
+  return Status(0);
+}
+
+Status BufferedLogForwarder::flushExpired() {
+  RecursiveLock lock(count_mutex_);
+  if (pending_results_.empty() && pending_statuses_.empty()) {
+    return Status(0);
+  }
+
+  auto flush_interval =
+      std::chrono::milliseconds(FLAGS_buffered_log_flush_interval);
+  if (std::chrono::steady_clock::now() - pending_since_ < flush_interval) {
+    return Status(0);
+  }
+
+  return flushPending();
+}
+
+Status BufferedLogForwarder::flushPending() {
+  DatabaseStringValueList segments;
+  size_t line_count = 0;
+
+  for (bool results : {true, false}) {
+    auto& pending = results ? pending_results_ : pending_statuses_;
+    if (pending.empty()) {
+      continue;
+    }
+
+    // A single line keeps the plain format, it is timed by its index.
+    auto index = genIndex(results, pending.front().time);
+    if (pending.size() == 1) {
+      segments.push_back(std::make_pair(index, std::move(pending[0].data)));
+    } else {
+      segments.push_back(std::make_pair(index, encodeSegment(pending, 0)));
+    }
+
+    line_count += pending.size();
+    pending.clear();
+  }
+
+  pending_size_ = 0;
+  if (segments.empty()) {
+    return Status(0);
+  }
+
+  auto status = setDatabaseBatch(kLogs, segments);
+  if (!status.ok()) {
+    // The lines are lost; do not account for them.
+    buffer_count_ -= std::min(buffer_count_, line_count);
   }
+
   return status;
 }
 
-Status BufferedLogForwarder::deleteValueWithCount(const std::string& domain,
-                                                  const std::string& key) {
-  Status status = deleteDatabaseValue(domain, key);
+Status BufferedLogForwarder::listSegments(bool results,
+                                          std::vector<Segment>& segments) {
+  auto prefix = genIndexPrefix(results);
+
+  std::vector<std::string> indexes;
+  auto status = scanDatabaseKeys(kLogs, indexes, prefix, 0);
+  if (!status.ok()) {
+    return status;
+  }
+
+  segments.clear();
+  segments.reserve(indexes.size());
+
+  for (auto& index : indexes) {
+    Segment segment;
+    segment.time = 0;
+    segment.sequence = 0;
+
+    // Indexes are "<prefix><time>_<sequence>"
+    size_t offset = prefix.size();
+    if (parseNumber(index, offset, '_', segment.time)) {
+      parseNumber(index, offset, '\0', segment.sequence);
+    }
+
+    segment.index = std::move(index);
+    segments.push_back(std::move(segment));
+  }
+
+  std::sort(segments.begin(),
+            segments.end(),
+            [](const Segment& a, const Segment& b) {
+              return std::tie(a.time, a.sequence) <
+                     std::tie(b.time, b.sequence);
+            });
+
+  return Status(0);
+}
+
+Status BufferedLogForwarder::readSegment(const Segment& segment,
+                                         std::vector<LogLine>& lines) {
+  std::string value;
+  auto status = getDatabaseValue(kLogs, segment.index, value);
+  if (!status.ok()) {
+    return status;
+  }
+
+  lines.clear();
+  if (value.empty() || value[0] != kSegmentMarker) {
+    lines.push_back({segment.time, std::move(value)});
+    return Status(0);
+  }
+
+  for (size_t offset = 1; offset < value.size();) {
+    size_t time = 0;
+    size_t size = 0;
+    if (!parseNumber(value, offset, ' ', time) ||
+        !parseNumber(value, offset, '\n', size) ||
+        size > value.size() - offset) {
+      return Status(1, "Malformed buffered log segment: " + segment.index);
+    }
+
+    lines.push_back({time, value.substr(offset, size)});
+    offset += size;
+  }
+
+  return Status(0);
+}
+
+Status BufferedLogForwarder::truncateSegment(const Segment& segment,
+                                             std::vector<LogLine>& lines,
+                                             size_t line_count) {
+  Status status;
+  if (line_count >= lines.size()) {
+    status = deleteDatabaseValue(kLogs, segment.index);
+  } else {
+    status =
+        setDatabaseValue(kLogs, segment.index, encodeSegment(lines, line_count));
+  }
+
   if (status.ok()) {
     RecursiveLock lock(count_mutex_);
-    if (buffer_count_ > 0) {
-      buffer_count_--;
-    }
+    buffer_count_ -= std::min(buffer_count_, std::min(line_count, lines.size()));
   }
+
   return status;
 }
 }
@@ -45,6 +45,12 @@ inline void iterate(std::vector<std::string>& input,
  * status and result logs. Subclasses take advantage of this reliable sending
  * logic, and implement their own methods for actually sending logs.
  *
+ * Logs are buffered as an append-only queue of segments: lines are collected
+ * in memory for a short time and persisted together as one database value.
+ * Segments are read whole, and acknowledged by deleting them (or rewriting
+ * the unsent tail). While a backlog remains, segments are drained without
+ * waiting for the log period.
+ *
  * Subclasses must define the send() method, and if a subclass overrides
  * setUp(), it **MUST** call this base class setUp() from that method.
  */
@@ -120,6 +126,9 @@ class BufferedLogForwarder : public InternalRunnable {
    */
   Status logStatus(const std::vector<StatusLogLine>& log, size_t time = 0);
 
+  /// Persist the lines that are still held in memory as new segments.
+  Status flush();
+
  protected:
   /**
    * @brief Send labeled result logs.
@@ -134,9 +143,9 @@ class BufferedLogForwarder : public InternalRunnable {
   /**
    * @brief Check for new logs and send.
    *
-   * Scan the logs domain for up to max_log_lines_ log lines.
-   * Sort those lines into status and request types then forward (send) each
-   * set. On success, clear the data and indexes. Calls purge upon completion.
+   * Read the oldest segments for up to max_log_lines_ log lines, results
+   * first. Forward (send) each set; on success, truncate the segments that
+   * were sent. Calls purge upon completion.
    */
   void check();
 
@@ -145,10 +154,18 @@ class BufferedLogForwarder : public InternalRunnable {
    *
    * Uses the buffered_log_max flag to determine the maximum number of buffered
    * logs. If this number is exceeded, the logs with the oldest timestamp are
-   * purged. Order of purging for logs with the same timestamp is undefined.
+   * purged. Logs with the same timestamp are purged in buffering order.
    */
   void purge();
 
+  /**
+   * @brief Persist the pending lines once held for the flush interval.
+   *
+   * Called from the run loop, so lines are not kept in memory for a whole
+   * log period when no further line arrives.
+   */
+  Status flushExpired();
+
  protected:
   /// Return whether the string is a result index
   bool isResultIndex(const std::string& index);
@@ -172,20 +189,40 @@ class BufferedLogForwarder : public InternalRunnable {
 
   std::string genIndex(bool results, size_t time = 0);
 
-  /**
-   * @brief Add a database value while maintaining count
-   *
-   */
-  Status addValueWithCount(const std::string& domain,
-                           const std::string& key,
-                           const std::string& value);
+  /// A buffered log line and the time it was logged
+  struct LogLine {
+    size_t time;
+    std::string data;
+  };
+
+  /// A segment of buffered lines, identified by its index
+  struct Segment {
+    std::string index;
+    size_t time;
+    size_t sequence;
+  };
+
+  /// Queue a line in memory, persisting the pending lines when needed
+  Status addLine(bool results, std::string line, size_t time);
+
+  /// Persist the pending lines, the caller must hold count_mutex_
+  Status flushPending();
+
+  /// List the segments of a log type, oldest first
+  Status listSegments(bool results, std::vector<Segment>& segments);
+
+  /// Read and decode the lines of a segment
+  Status readSegment(const Segment& segment, std::vector<LogLine>& lines);
 
   /**
-   * @brief Delete a database value while maintaining count
+   * @brief Drop the first line_count lines of a segment
    *
+   * The segment is deleted when no lines remain, otherwise the remaining
+   * lines are written back under the same index.
    */
-  Status deleteValueWithCount(const std::string& domain,
-                              const std::string& key);
+  Status truncateSegment(const Segment& segment,
+                         std::vector<LogLine>& lines,
+                         size_t line_count);
 
  protected:
   /// Seconds between flushing logs
@@ -210,7 +247,20 @@ class BufferedLogForwarder : public InternalRunnable {
   /// Stores the count of buffered logs
   size_t buffer_count_{0};
 
-  /// Protects the count of buffered logs
+  /// Lines not yet persisted, for results and statuses
+  std::vector<LogLine> pending_results_;
+  std::vector<LogLine> pending_statuses_;
+
+  /// Size of the pending lines
+  size_t pending_size_{0};
+
+  /// When the oldest pending line was queued
+  std::chrono::steady_clock::time_point pending_since_;
+
+  /// Set by check() when the last send succeeded and more logs remain
+  bool backlog_{false};
+
+  /// Protects the count of buffered logs and the pending lines
   RecursiveMutex count_mutex_;
 };
 }
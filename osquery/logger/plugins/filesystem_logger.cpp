@@ -49,6 +49,10 @@ class FilesystemLoggerPlugin : public LoggerPlugin {
   /// Log snapshot data to a distinct path.
   Status logSnapshot(const std::string& s) override;
 
+  /// Append a chunk of results or snapshot data with a single write.
+  Status logQueryResults(const QueryLogMetadata& metadata,
+                         std::vector<std::string>& lines) override;
+
   /**
    * @brief Initialize the logger plugin after osquery has begun.
    *
@@ -68,6 +72,10 @@ class FilesystemLoggerPlugin : public LoggerPlugin {
                          const std::string& filename,
                          bool empty = false);
 
+  /// Join the lines and write them to the filename.
+  Status logLinesToFile(const std::vector<std::string>& lines,
+                        const std::string& filename);
+
  private:
   /// The folder where Glog and the result/snapshot files are written.
   fs::path log_path_;
@@ -112,6 +120,35 @@ Status FilesystemLoggerPlugin::logStringToFile(const std::string& s,
   return status;
 }
 
+Status FilesystemLoggerPlugin::logLinesToFile(
+    const std::vector<std::string>& lines, const std::string& filename) {
+  if (lines.empty()) {
+    return Status(0, "OK");
+  }
+
+  size_t size = 0;
+  for (const auto& line : lines) {
+    size += line.size() + 1;
+  }
+
+  std::string joined;
+  joined.reserve(size);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    if (i > 0) {
+      joined += '\n';
+    }
+    joined += lines[i];
+  }
+  return logStringToFile(joined, filename);
+}
+
+Status FilesystemLoggerPlugin::logQueryResults(
+    const QueryLogMetadata& metadata, std::vector<std::string>& lines) {
+  return logLinesToFile(lines,
+                        (metadata.snapshot) ? kFilesystemLoggerSnapshots
+                                            : kFilesystemLoggerFilename);
+}
+
 Status FilesystemLoggerPlugin::logStatus(
     const std::vector<StatusLogLine>& log) {
   for (const auto& item : log) {
@@ -50,8 +50,18 @@ FLAG(
     "none",
     "Compression codec to use for compressing message sets ('none' or 'gzip')");
 
-/// How often to poll Kafka broker for publish results.
-const std::chrono::seconds kKafkaPollDuration = std::chrono::seconds(5);
+HIDDEN_FLAG(uint64,
+            logger_kafka_poll_interval,
+            500,
+            "Milliseconds between polls for Kafka delivery reports");
+
+HIDDEN_FLAG(uint64,
+            logger_kafka_linger,
+            10,
+            "Milliseconds to accumulate Kafka messages before sending");
+
+/// How long to serve delivery reports when the producer queue is full.
+const int kKafkaQueueFullWaitMs = 100;
 
 /// Default Kafka topic to publish to if payload name is not found.
 const std::string kKafkaBaseTopic("base_topic");
@@ -146,7 +156,7 @@ void KafkaProducerPlugin::pollKafka() {
 
 void KafkaProducerPlugin::start() {
   while (!interrupted() && running_.load()) {
-    pauseMilli(kKafkaPollDuration);
+    pauseMilli(FLAGS_logger_kafka_poll_interval);
     if (interrupted()) {
       return;
     }
@@ -193,7 +203,10 @@ void KafkaProducerPlugin::init(const std::string& name,
 
   if (!setConf(conf, "client.id", hostname) ||
       !setConf(conf, "bootstrap.servers", FLAGS_logger_kafka_brokers) ||
-      !setConf(conf, "compression.codec", FLAGS_logger_kafka_compression)) {
+      !setConf(conf, "compression.codec", FLAGS_logger_kafka_compression) ||
+      !setConf(conf,
+               "queue.buffering.max.ms",
+               std::to_string(FLAGS_logger_kafka_linger))) {
     return;
   }
 
@@ -235,14 +248,7 @@ Status KafkaProducerPlugin::logString(const std::string& payload) {
   }
 
   std::string name(getMsgName(payload));
-
-  rd_kafka_topic_t* topic = nullptr;
-  try {
-    topic = queryToTopics_.at(name);
-  } catch (const std::out_of_range& _) {
-    topic = queryToTopics_[kKafkaBaseTopic];
-  }
-
+  auto topic = getTopic(name);
   if (topic == nullptr) {
     std::string errMsg(
         "Could not publish message: Topic not configured for message name '" +
@@ -255,13 +261,40 @@ Status KafkaProducerPlugin::logString(const std::string& payload) {
   if (!status.ok()) {
     LOG(ERROR) << "Could not publish message: " << status.getMessage();
   }
+  return status;
+}
 
-  // Poll after every produce attempt.
-  pollKafka();
+Status KafkaProducerPlugin::logQueryResults(const QueryLogMetadata& metadata,
+                                           std::vector<std::string>& lines) {
+  if (!running_.load()) {
+    return Status(
+        1, "Cannot log because Kafka producer did not initiate properly.");
+  }
 
+  auto topic = getTopic(metadata.name);
+  if (topic == nullptr) {
+    std::string errMsg(
+        "Could not publish message: Topic not configured for message name '" +
+        metadata.name + "'");
+    LOG(ERROR) << errMsg;
+    return Status(2, errMsg);
+  }
+
+  Status status = publishMsgs(topic, lines);
+  if (!status.ok()) {
+    LOG(ERROR) << "Could not publish messages: " << status.getMessage();
+  }
   return status;
 }
 
+rd_kafka_topic_t* KafkaProducerPlugin::getTopic(const std::string& name) {
+  auto it = queryToTopics_.find(name);
+  if (it != queryToTopics_.end()) {
+    return it->second;
+  }
+  return queryToTopics_[kKafkaBaseTopic];
+}
+
 Status KafkaProducerPlugin::publishMsg(rd_kafka_topic_t* topic,
                                        const std::string& payload) {
   if (rd_kafka_produce(topic,
@@ -281,6 +314,58 @@ Status KafkaProducerPlugin::publishMsg(rd_kafka_topic_t* topic,
   return Status(0, "OK");
 }
 
+Status KafkaProducerPlugin::publishMsgs(
+    rd_kafka_topic_t* topic, const std::vector<std::string>& payloads) {
+  std::vector<rd_kafka_message_t> messages(payloads.size());
+  for (size_t i = 0; i < payloads.size(); ++i) {
+    auto& message = messages[i];
+    message = rd_kafka_message_t();
+    message.payload = const_cast<char*>(payloads[i].data());
+    message.len = payloads[i].size();
+    message.key = const_cast<char*>(msgKey_.data());
+    message.key_len = msgKey_.size();
+  }
+
+  size_t failed = 0;
+  auto produce = [&topic, &messages, &failed]() {
+    failed = 0;
+    rd_kafka_produce_batch(topic,
+                           RD_KAFKA_PARTITION_UA,
+                           RD_KAFKA_MSG_F_COPY,
+                           messages.data(),
+                           static_cast<int>(messages.size()));
+    // Keep the messages that were not queued, in order.
+    for (size_t i = 0; i < messages.size(); ++i) {
+      if (messages[i].err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+        messages[failed++] = messages[i];
+      }
+    }
+    messages.resize(failed);
+  };
+
+  produce();
+  if (failed > 0 && messages[0].err == RD_KAFKA_RESP_ERR__QUEUE_FULL) {
+    // Serve delivery reports to make room, then retry once.
+    {
+      WriteLock lock(producerMutex_);
+      rd_kafka_poll(producer_.get(), kKafkaQueueFullWaitMs);
+    }
+    for (auto& message : messages) {
+      message.err = RD_KAFKA_RESP_ERR_NO_ERROR;
+    }
+    produce();
+  }
+
+  if (failed > 0) {
+    return Status(1,
+                  "Failed to produce " + std::to_string(failed) +
+                      " messages on Kafka topic " +
+                      std::string(rd_kafka_topic_name(topic)) + " : " +
+                      rd_kafka_err2str(messages[0].err));
+  }
+  return Status(0, "OK");
+}
+
 inline rd_kafka_topic_t* KafkaProducerPlugin::initTopic(
     const std::string& topicName) {
   char errstr[512] = {0};
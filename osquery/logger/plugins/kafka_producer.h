@@ -33,11 +33,19 @@ class KafkaProducerPlugin : public LoggerPlugin, public InternalRunnable {
   /*
    * @brief Logs string s as payload to configured Kafka brokers.
    *
-   * Calls rd_kafka_poll regardless of production success.  rd_kafka_poll
-   * invokes callback that actually reports if message sends failed.
+   * The topic is found by the payload's "name" field. Delivery reports are
+   * served by the background poll.
    */
   Status logString(const std::string& s) override;
 
+  /**
+   * @brief Logs a chunk of query results as one batch of Kafka messages.
+   *
+   * The topic is chosen once for the chunk using the query name.
+   */
+  Status logQueryResults(const QueryLogMetadata& metadata,
+                         std::vector<std::string>& lines) override;
+
   /**
    * @brief Initializes the Kafka producer.
    *
@@ -80,6 +88,17 @@ class KafkaProducerPlugin : public LoggerPlugin, public InternalRunnable {
   virtual Status publishMsg(rd_kafka_topic_t* topic,
                             const std::string& payload);
 
+  /**
+   * @brief Publishes a batch of messages to a Kafka topic.
+   *
+   * @param topic Kafka topic to publish to
+   * @param payloads message bodies, copied by the producer
+   *
+   * @return Status of the publish attempt, failed if any message failed
+   */
+  virtual Status publishMsgs(rd_kafka_topic_t* topic,
+                             const std::vector<std::string>& payloads);
+
   /**
    * @brief Flushes all buffered messages to Kafka, waiting for a maximum of 3
    * seconds.  Wrapper with mutex locking around rd_kafka_flush.
@@ -102,6 +121,9 @@ class KafkaProducerPlugin : public LoggerPlugin, public InternalRunnable {
   /// Configures Kafka topics accordingly.
   bool configureTopics();
 
+  /// Find the topic for a query name, or the base topic.
+  rd_kafka_topic_t* getTopic(const std::string& name);
+
   /// Initiates Kafka topic.  Caller needs to handle rd_kafka_topic_t* cleanup.
   rd_kafka_topic_t* initTopic(const std::string& topicName);
 
@@ -21,6 +21,7 @@
 #include <osquery/logger.h>
 
 #include "osquery/logger/plugins/aws_log_forwarder.h"
+#include "osquery/logger/plugins/tests/aws_mock_forwarder.h"
 #include "osquery/tests/test_util.h"
 
 using namespace testing;
@@ -89,6 +90,10 @@ class DummyLogForwarder final : public IDummyLogForwarder {
     return 128U;
   }
 
+  std::size_t getMaxConcurrentBatches() const override {
+    return 1U;
+  }
+
   std::size_t getMaxRetryCount() const override {
     return 1U;
   }
@@ -177,4 +182,58 @@ TEST_F(AwsLoggerTests, test_send) {
             "test\":\"2\",\"log_type\":\"result\"}\n");
   EXPECT_EQ(third_batch[1], "{\"batch3\":\"3\",\"log_type\":\"result\"}\n");
 }
+
+static std::vector<std::string> generateLogLines(size_t count) {
+  std::vector<std::string> log_data;
+  for (size_t i = 0; i < count; i++) {
+    log_data.push_back("{ \"line\": \"" + std::to_string(i) + "\" }");
+  }
+
+  return log_data;
+}
+
+TEST_F(AwsLoggerTests, test_concurrent_send) {
+  MockAwsLogForwarder log_forwarder(4U, std::chrono::milliseconds(50));
+
+  // 4000 lines generate 8 full batches, sent 4 at a time
+  auto log_data = generateLogLines(4000U);
+  auto s = log_forwarder.send(log_data, "result");
+  EXPECT_TRUE(s.ok());
+
+  EXPECT_EQ(log_forwarder.accepted_records, 4000U);
+  EXPECT_EQ(log_forwarder.requestSizes().size(), 8U);
+  EXPECT_GT(log_forwarder.max_in_flight_requests, 1U);
+  EXPECT_LE(log_forwarder.max_in_flight_requests, 4U);
+}
+
+TEST_F(AwsLoggerTests, test_partial_failure_retry) {
+  // The endpoint accepts 200 records per request and throttles the others
+  MockAwsLogForwarder log_forwarder(1U, std::chrono::milliseconds(0), 200U);
+
+  auto log_data = generateLogLines(500U);
+  auto s = log_forwarder.send(log_data, "result");
+  EXPECT_TRUE(s.ok());
+
+  // Only the throttled records are sent again, so nothing is duplicated
+  EXPECT_EQ(log_forwarder.accepted_records, 500U);
+  EXPECT_EQ(log_forwarder.requestSizes(),
+            std::vector<size_t>({500U, 300U, 100U}));
+
+  // The throttling halved the following batches
+  log_data = generateLogLines(250U);
+  EXPECT_TRUE(log_forwarder.send(log_data, "result").ok());
+  EXPECT_EQ(log_forwarder.requestSizes(),
+            std::vector<size_t>({500U, 300U, 100U, 250U, 50U}));
+
+  log_data = generateLogLines(200U);
+  EXPECT_TRUE(log_forwarder.send(log_data, "result").ok());
+
+  // Batches accepted on first try grow back towards the protocol limit
+  log_data = generateLogLines(200U);
+  EXPECT_TRUE(log_forwarder.send(log_data, "result").ok());
+  EXPECT_EQ(
+      log_forwarder.requestSizes(),
+      std::vector<size_t>({500U, 300U, 100U, 250U, 50U, 125U, 75U, 200U}));
+  EXPECT_EQ(log_forwarder.accepted_records, 1150U);
+}
 }
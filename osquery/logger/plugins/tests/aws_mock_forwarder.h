@@ -0,0 +1,168 @@
+/**
+ *  Copyright (c) 2014-present, Facebook, Inc.
+ *  All rights reserved.
+ *
+ *  This source code is licensed under both the Apache 2.0 license (found in the
+ *  LICENSE file in the root directory of this source tree) and the GPLv2 (found
+ *  in the COPYING file in the root directory of this source tree).
+ *  You may select, at your option, one of the above-listed licenses.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <aws/kinesis/KinesisClient.h>
+#include <aws/kinesis/model/PutRecordsRequestEntry.h>
+#include <aws/kinesis/model/PutRecordsResult.h>
+
+#include "osquery/logger/plugins/aws_log_forwarder.h"
+
+namespace osquery {
+
+/// A successful PutRecords outcome built from the mock endpoint result
+class MockPutRecordsOutcome final
+    : public Aws::Kinesis::Model::PutRecordsOutcome {
+ public:
+  MockPutRecordsOutcome() = default;
+
+  explicit MockPutRecordsOutcome(
+      Aws::Kinesis::Model::PutRecordsResult&& put_result)
+      : Aws::Kinesis::Model::PutRecordsOutcome(std::move(put_result)) {}
+};
+
+using IMockLogForwarder =
+    AwsLogForwarder<Aws::Kinesis::Model::PutRecordsRequestEntry,
+                    Aws::Kinesis::KinesisClient,
+                    MockPutRecordsOutcome,
+                    Aws::Vector<Aws::Kinesis::Model::PutRecordsResultEntry>>;
+
+/**
+ * @brief A local Kinesis-like endpoint used to exercise the send path
+ *
+ * Each request takes request_latency to complete and accepts at most
+ * request_capacity records; the remaining ones are throttled the same way
+ * a saturated shard rejects them. A capacity of 0 accepts everything.
+ */
+class MockAwsLogForwarder final : public IMockLogForwarder {
+ public:
+  MockAwsLogForwarder(size_t concurrency,
+                      std::chrono::milliseconds request_latency,
+                      size_t request_capacity = 0U)
+      : IMockLogForwarder("mock", 10, 500),
+        concurrency_(concurrency),
+        request_latency_(request_latency),
+        request_capacity_(request_capacity) {}
+
+  using IMockLogForwarder::send;
+
+  /// Returns the amount of records contained in each request, in order
+  std::vector<size_t> requestSizes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return request_sizes_;
+  }
+
+ protected:
+  Status internalSetup() override {
+    return Status(0, "OK");
+  }
+
+  Outcome internalSend(const Batch& batch) override {
+    auto in_flight = ++in_flight_requests_;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      request_sizes_.push_back(batch.size());
+      if (in_flight > max_in_flight_requests) {
+        max_in_flight_requests = in_flight;
+      }
+    }
+
+    if (request_latency_.count() > 0) {
+      std::this_thread::sleep_for(request_latency_);
+    }
+
+    Aws::Vector<Aws::Kinesis::Model::PutRecordsResultEntry> entry_list;
+    int failed_record_count = 0;
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      Aws::Kinesis::Model::PutRecordsResultEntry entry;
+      if (request_capacity_ != 0U && i >= request_capacity_) {
+        entry.SetErrorCode("ProvisionedThroughputExceededException");
+        failed_record_count++;
+      } else {
+        accepted_records++;
+      }
+
+      entry_list.push_back(std::move(entry));
+    }
+
+    Aws::Kinesis::Model::PutRecordsResult result;
+    result.SetRecords(std::move(entry_list));
+    result.SetFailedRecordCount(failed_record_count);
+
+    --in_flight_requests_;
+    return Outcome(std::move(result));
+  }
+
+  void initializeRecord(Record& record,
+                        Aws::Utils::ByteBuffer& buffer) const override {
+    record.SetData(buffer);
+  }
+
+  size_t getMaxBytesPerRecord() const override {
+    return 1000000U;
+  }
+
+  size_t getMaxRecordsPerBatch() const override {
+    return 500U;
+  }
+
+  size_t getMaxBytesPerBatch() const override {
+    return 5000000U;
+  }
+
+  size_t getMaxConcurrentBatches() const override {
+    return concurrency_;
+  }
+
+  size_t getMaxRetryCount() const override {
+    return 100U;
+  }
+
+  size_t getInitialRetryDelay() const override {
+    return 0U;
+  }
+
+  bool appendNewlineSeparators() const override {
+    return false;
+  }
+
+  size_t getFailedRecordCount(Outcome& outcome) const override {
+    return static_cast<size_t>(outcome.GetResult().GetFailedRecordCount());
+  }
+
+  Result getResult(Outcome& outcome) const override {
+    return outcome.GetResult().GetRecords();
+  }
+
+ public:
+  /// Records accepted by the endpoint
+  std::atomic<size_t> accepted_records{0};
+
+  /// Highest amount of requests observed in flight at the same time
+  size_t max_in_flight_requests{0};
+
+ private:
+  size_t concurrency_;
+  std::chrono::milliseconds request_latency_;
+  size_t request_capacity_;
+
+  std::atomic<size_t> in_flight_requests_{0};
+  std::vector<size_t> request_sizes_;
+  mutable std::mutex mutex_;
+};
+}
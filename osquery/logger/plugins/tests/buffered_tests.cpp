@@ -17,6 +17,7 @@
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/property_tree/ptree.hpp>
 
+#include <osquery/database.h>
 #include <osquery/dispatcher.h>
 #include <osquery/logger.h>
 #include <osquery/system.h>
@@ -31,6 +32,7 @@ namespace pt = boost::property_tree;
 namespace osquery {
 
 DECLARE_uint64(buffered_log_max);
+DECLARE_uint64(buffered_log_flush_interval);
 
 // Check that the string matches the StatusLogLine
 MATCHER_P(MatchesStatus, expected, "") {
@@ -95,6 +97,7 @@ class MockBufferedLogForwarder : public BufferedLogForwarder {
   FRIEND_TEST(BufferedLogForwarderTests, test_split);
   FRIEND_TEST(BufferedLogForwarderTests, test_purge);
   FRIEND_TEST(BufferedLogForwarderTests, test_purge_max);
+  FRIEND_TEST(BufferedLogForwarderTests, test_flush_expired);
 
  private:
   bool checked_{false};
@@ -360,4 +363,30 @@ TEST_F(BufferedLogForwarderTests, test_purge_max) {
 
   runner.check();
 }
+
+// Pending lines are persisted once held for the flush interval, without
+// waiting for another line to arrive
+TEST_F(BufferedLogForwarderTests, test_flush_expired) {
+  auto flush_interval = FLAGS_buffered_log_flush_interval;
+  FLAGS_buffered_log_flush_interval = 50;
+
+  StrictMock<MockBufferedLogForwarder> runner("flush");
+  runner.logString("foo");
+
+  std::vector<std::string> indexes;
+  EXPECT_TRUE(runner.flushExpired().ok());
+  scanDatabaseKeys(kLogs, indexes, "flush_");
+  EXPECT_TRUE(indexes.empty());
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(60));
+  EXPECT_TRUE(runner.flushExpired().ok());
+  scanDatabaseKeys(kLogs, indexes, "flush_");
+  EXPECT_EQ(indexes.size(), 1U);
+
+  EXPECT_CALL(runner, send(ElementsAre("foo"), "result"))
+      .WillOnce(Return(Status(0)));
+  runner.check();
+
+  FLAGS_buffered_log_flush_interval = flush_interval;
+}
 }
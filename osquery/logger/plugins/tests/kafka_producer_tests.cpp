@@ -53,6 +53,15 @@ class MockKafkaProducerPlugin : public KafkaProducerPlugin {
     return Status(0, "OK");
   }
 
+  Status publishMsgs(rd_kafka_topic_t* topic,
+                     const std::vector<std::string>& payloads) override {
+    auto& msgs = publishedMsgs_[topic];
+    msgs.insert(msgs.end(), payloads.begin(), payloads.end());
+    timesBatched_++;
+
+    return Status(0, "OK");
+  }
+
   void flushMessages() override {
     timesFlushed_++;
   }
@@ -67,6 +76,8 @@ class MockKafkaProducerPlugin : public KafkaProducerPlugin {
   std::atomic<int> timesFlushed_;
 
   std::atomic<int> timesPolled_;
+
+  size_t timesBatched_{0};
 };
 
 class KafkaProducerPluginTest : public ::testing::Test {};
@@ -165,7 +176,8 @@ TEST_F(KafkaProducerPluginTest, logString_single_topic_happy_path) {
 
   EXPECT_EQ(msgs, mkpp.publishedMsgs_[topic]);
 
-  EXPECT_TRUE(mkpp.timesPolled_.load() == 4);
+  // Delivery reports are served by the background poll, not each produce.
+  EXPECT_TRUE(mkpp.timesPolled_.load() == 0);
 }
 
 TEST_F(KafkaProducerPluginTest, logString_multi_topic_happy_path) {
@@ -230,7 +242,32 @@ TEST_F(KafkaProducerPluginTest, logString_multi_topic_happy_path) {
   };
   EXPECT_EQ(expected, mkpp.publishedMsgs_[topic3]);
 
-  EXPECT_TRUE(mkpp.timesPolled_.load() == 8);
+  EXPECT_TRUE(mkpp.timesPolled_.load() == 0);
+}
+
+TEST_F(KafkaProducerPluginTest, logQueryResults_routes_by_metadata) {
+  MockKafkaProducerPlugin mkpp;
+
+  std::map<std::string, rd_kafka_topic_t*> qToT;
+  rd_kafka_topic_t* topicBase = reinterpret_cast<rd_kafka_topic_t*>(0x692870);
+  qToT[kKafkaBaseTopic] = topicBase;
+  rd_kafka_topic_t* topic1 = reinterpret_cast<rd_kafka_topic_t*>(0x692871);
+  qToT["topic1"] = topic1;
+  mkpp.setQueryToTopics(qToT);
+
+  // The lines are not parsed, the query name comes from the metadata.
+  QueryLogMetadata metadata;
+  metadata.name = "topic1";
+  std::vector<std::string> lines = {"{\"name\": \"other\"}", "1", "2"};
+  EXPECT_TRUE(mkpp.logQueryResults(metadata, lines));
+  EXPECT_EQ(lines, mkpp.publishedMsgs_[topic1]);
+  EXPECT_EQ(1U, mkpp.timesBatched_);
+
+  metadata.name = "topic10";
+  EXPECT_TRUE(mkpp.logQueryResults(metadata, lines));
+  EXPECT_EQ(lines, mkpp.publishedMsgs_[topicBase]);
+  EXPECT_EQ(2U, mkpp.timesBatched_);
+  EXPECT_TRUE(mkpp.timesPolled_.load() == 0);
 }
 
 TEST_F(KafkaProducerPluginTest, flush_on_stop) {
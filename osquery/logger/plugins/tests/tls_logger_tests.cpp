@@ -39,6 +39,9 @@ TEST_F(TLSLoggerTests, test_database) {
   status.message = "{\"status\": \"bar\"}";
   forwarder->logStatus({status});
 
+  // Persist the lines held in memory.
+  EXPECT_TRUE(forwarder->flush().ok());
+
   // Stop the server.
   TLSServerRunner::unsetClientConfig();
   TLSServerRunner::stop();
@@ -8,6 +8,10 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include <boost/format.hpp>
@@ -20,6 +24,8 @@
 #include <osquery/numeric_monitoring/pre_aggregation_cache.h>
 #include <osquery/registry_factory.h>
 
+#include "osquery/core/json.h"
+
 namespace osquery {
 
 FLAG(bool,
@@ -53,6 +59,7 @@ const auto& getAggregationTypeToStringTable() {
       {PreAggregationType::Sum, "sum"},
       {PreAggregationType::Min, "min"},
       {PreAggregationType::Max, "max"},
+      {PreAggregationType::Histogram, "histogram"},
   };
   return table;
 }
@@ -99,6 +106,57 @@ namespace {
 class FlusherIsScheduled {};
 FlusherIsScheduled schedule();
 
+/**
+ * The points recorded by a single thread.
+ * The mutex is only contended while the buffer is flushed.
+ */
+struct ThreadBuffer final {
+  std::mutex mutex;
+  PreAggregationCache cache;
+
+  /// Set when the thread exits, the buffer is dropped by the next flush.
+  std::atomic<bool> retired{false};
+};
+
+/// The points a point is dispatched as, histograms expand to percentiles.
+void expandPoint(std::vector<RecordedPoint>& records, const Point& point) {
+  if (point.pre_aggregation_type_ != PreAggregationType::Histogram) {
+    records.push_back({point.path_,
+                       point.value_,
+                       point.pre_aggregation_type_,
+                       point.time_point_});
+    return;
+  }
+
+  const auto& histogram = point.histogram_;
+  records.push_back({point.path_ + ".p50",
+                     histogram.percentile(0.5),
+                     PreAggregationType::None,
+                     point.time_point_});
+  records.push_back({point.path_ + ".p90",
+                     histogram.percentile(0.9),
+                     PreAggregationType::None,
+                     point.time_point_});
+  records.push_back({point.path_ + ".p99",
+                     histogram.percentile(0.99),
+                     PreAggregationType::None,
+                     point.time_point_});
+  records.push_back({point.path_ + ".max",
+                     point.value_,
+                     PreAggregationType::Max,
+                     point.time_point_});
+}
+
+PluginRequest toRequest(const RecordedPoint& record) {
+  return {
+      {recordKeys().path, record.path},
+      {recordKeys().value, std::to_string(record.value)},
+      {recordKeys().pre_aggregation, to<std::string>(record.pre_aggregation)},
+      {recordKeys().timestamp,
+       std::to_string(record.time_point.time_since_epoch().count())},
+  };
+}
+
 class PreAggregationBuffer final {
  public:
   static PreAggregationBuffer& get() {
@@ -113,51 +171,149 @@ class PreAggregationBuffer final {
               const PreAggregationType& pre_aggregation,
               const TimePoint& time_point) {
     if (0 == FLAGS_numeric_monitoring_pre_aggregation_time) {
-      dispatchOne(path, value, pre_aggregation, time_point);
+      std::vector<RecordedPoint> records;
+      expandPoint(records, Point(path, value, pre_aggregation, time_point));
+      for (const auto& record : records) {
+        dispatch(toRequest(record));
+      }
+      remember(records);
     } else {
-      std::lock_guard<std::mutex> lock(mutex_);
-      cache_.addPoint(Point(path, value, pre_aggregation, time_point));
+      auto& buffer = getThreadBuffer();
+      std::lock_guard<std::mutex> lock(buffer.mutex);
+      buffer.cache.addPoint(Point(path, value, pre_aggregation, time_point));
     }
   }
 
   void flush() {
     auto points = takeCachedPoints();
-    for (const auto& pt : points) {
-      dispatchOne(
-          pt.path_, pt.value_, pt.pre_aggregation_type_, pt.time_point_);
+    if (points.empty()) {
+      return;
+    }
+
+    std::vector<RecordedPoint> records;
+    records.reserve(points.size());
+    for (const auto& point : points) {
+      expandPoint(records, point);
+    }
+
+    if (!pluginAcceptsBatches()) {
+      for (const auto& record : records) {
+        dispatch(toRequest(record));
+      }
+      remember(records);
+      return;
+    }
+
+    auto batch = JSON::newArray();
+    for (const auto& record : records) {
+      auto object = batch.getObject();
+      for (const auto& field : toRequest(record)) {
+        batch.addCopy(field.first, field.second, object);
+      }
+      batch.push(object);
     }
+
+    std::string batch_string;
+    auto status = batch.toString(batch_string);
+    if (status.ok()) {
+      status = dispatch({{recordKeys().batch, batch_string}});
+    }
+    if (!status.ok()) {
+      LOG(ERROR) << "Data loss. Numeric monitoring batch of " << records.size()
+                 << " points dispatch failed: " << status.what();
+    }
+    remember(records);
+  }
+
+  std::vector<RecordedPoint> getRecordedPoints() {
+    std::lock_guard<std::mutex> lock(recorded_mutex_);
+    std::vector<RecordedPoint> records;
+    records.reserve(recorded_.size());
+    for (const auto& record : recorded_) {
+      records.push_back(record.second);
+    }
+    return records;
   }
 
  private:
+  /// Buffers are shared with the flusher, which may outlive the thread.
+  class ThreadBufferOwner final {
+   public:
+    explicit ThreadBufferOwner(PreAggregationBuffer& parent)
+        : buffer(std::make_shared<ThreadBuffer>()) {
+      std::lock_guard<std::mutex> lock(parent.buffers_mutex_);
+      parent.buffers_.push_back(buffer);
+    }
+
+    ~ThreadBufferOwner() {
+      buffer->retired = true;
+    }
+
+    std::shared_ptr<ThreadBuffer> buffer;
+  };
+
+  ThreadBuffer& getThreadBuffer() {
+    thread_local ThreadBufferOwner owner(*this);
+    return *owner.buffer;
+  }
+
+  /// Collect and merge the points of every thread.
   std::vector<Point> takeCachedPoints() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto points = cache_.takePoints();
-    return points;
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+
+    PreAggregationCache merged;
+    for (auto it = buffers_.begin(); it != buffers_.end();) {
+      auto& buffer = *it;
+      // Check before taking the points, the owner never records once retired.
+      bool retired = buffer->retired;
+      {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        for (auto& point : buffer->cache.takePoints()) {
+          merged.addPoint(std::move(point));
+        }
+      }
+
+      if (retired) {
+        it = buffers_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    return merged.takePoints();
   }
 
-  void dispatchOne(const std::string& path,
-                   const ValueType& value,
-                   const PreAggregationType& pre_aggregation,
-                   const TimePoint& time_point) {
+  /// Keep the latest point of each path for the osquery_metrics table.
+  void remember(const std::vector<RecordedPoint>& records) {
+    std::lock_guard<std::mutex> lock(recorded_mutex_);
+    for (const auto& record : records) {
+      recorded_[record.path] = record;
+    }
+  }
+
+  /// Only plugins of this process can opt in to batched requests.
+  static bool pluginAcceptsBatches() {
+    auto plugin = std::dynamic_pointer_cast<NumericMonitoringPlugin>(
+        Registry::get().plugin(registryName(),
+                               FLAGS_numeric_monitoring_plugins));
+    return plugin != nullptr && plugin->acceptsBatches();
+  }
+
+  Status dispatch(const PluginRequest& request) {
     auto status = Registry::call(
-        registryName(),
-        FLAGS_numeric_monitoring_plugins,
-        {
-            {recordKeys().path, path},
-            {recordKeys().value, std::to_string(value)},
-            {recordKeys().pre_aggregation, to<std::string>(pre_aggregation)},
-            {recordKeys().timestamp,
-             std::to_string(time_point.time_since_epoch().count())},
-        });
-    if (!status.ok()) {
+        registryName(), FLAGS_numeric_monitoring_plugins, request);
+    if (!status.ok() && request.count(recordKeys().batch) == 0) {
       LOG(ERROR) << "Data loss. Numeric monitoring point dispatch failed: "
                  << status.what();
     }
+    return status;
   }
 
  private:
-  PreAggregationCache cache_;
-  std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+  std::mutex buffers_mutex_;
+
+  std::map<std::string, RecordedPoint> recorded_;
+  std::mutex recorded_mutex_;
 };
 
 class PreAggregationFlusher : public InternalRunnable {
@@ -182,6 +338,17 @@ FlusherIsScheduled schedule() {
 
 } // namespace
 
+bool isEnabled() {
+  return FLAGS_enable_numeric_monitoring;
+}
+
+std::vector<RecordedPoint> getRecordedPoints() {
+  if (!FLAGS_enable_numeric_monitoring) {
+    return {};
+  }
+  return PreAggregationBuffer::get().getRecordedPoints();
+}
+
 void flushForTests() {
   PreAggregationBuffer::get().flush();
 }
@@ -11,6 +11,7 @@
 #include <osquery/plugin.h>
 #include <osquery/registry_factory.h>
 
+#include "osquery/core/json.h"
 #include "osquery/numeric_monitoring/plugin_interface.h"
 
 namespace osquery {
@@ -32,6 +33,7 @@ RecordKeys createRecordKeys() {
   keys.value = "value";
   keys.timestamp = "timestamp";
   keys.pre_aggregation = "pre_aggregation";
+  keys.batch = "batch";
   return keys;
 };
 
@@ -46,8 +48,49 @@ const RecordKeys& recordKeys() {
 
 Status NumericMonitoringPlugin::call(const PluginRequest& request,
                                      PluginResponse& response) {
+  auto batch = request.find(monitoring::recordKeys().batch);
+  if (batch == request.end()) {
+    return record(request);
+  }
+
+  auto doc = JSON::newArray();
+  if (!doc.fromString(batch->second).ok() || !doc.doc().IsArray()) {
+    return Status(1, "Invalid numeric monitoring batch");
+  }
+
+  std::vector<PluginRequest> points;
+  points.reserve(doc.doc().Size());
+  for (const auto& item : doc.doc().GetArray()) {
+    if (!item.IsObject()) {
+      continue;
+    }
+
+    PluginRequest point;
+    for (const auto& field : item.GetObject()) {
+      if (field.value.IsString()) {
+        point[field.name.GetString()] = field.value.GetString();
+      }
+    }
+    points.push_back(std::move(point));
+  }
+  return recordBatch(points);
+}
+
+Status NumericMonitoringPlugin::record(const PluginRequest& point) {
   // should be implemented in plugins
   return Status();
 }
 
+Status NumericMonitoringPlugin::recordBatch(
+    const std::vector<PluginRequest>& points) {
+  Status status;
+  for (const auto& point : points) {
+    auto point_status = record(point);
+    if (!point_status.ok()) {
+      status = point_status;
+    }
+  }
+  return status;
+}
+
 } // namespace osquery
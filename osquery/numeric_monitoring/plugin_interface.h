@@ -29,6 +29,9 @@ struct RecordKeys {
   std::string value;
   std::string timestamp;
   std::string pre_aggregation;
+
+  /// A JSON array of points, each an object with the keys above.
+  std::string batch;
 };
 
 const RecordKeys& recordKeys();
@@ -44,7 +47,30 @@ const char* registryName();
  */
 class NumericMonitoringPlugin : public Plugin {
  public:
+  /**
+   * @brief Unpack a request into one or more points.
+   *
+   * A request is either a single point, or holds the points of a flush of
+   * the pre-aggregation buffer under the `batch` key. Batches are only sent
+   * to plugins that opt in with acceptsBatches.
+   */
   Status call(const PluginRequest& request, PluginResponse& response) override;
+
+  /// Record a single point; should be implemented in plugins.
+  virtual Status record(const PluginRequest& point);
+
+  /// Record the points of a flush, by default one at a time.
+  virtual Status recordBatch(const std::vector<PluginRequest>& points);
+
+  /**
+   * @brief Whether a flush may be sent as a single `batch` request.
+   *
+   * Plugins that do not opt in, and extension plugins, receive a request
+   * with the `path`, `value` and `timestamp` keys for every point.
+   */
+  virtual bool acceptsBatches() const {
+    return false;
+  }
 };
 
 } // namespace osquery
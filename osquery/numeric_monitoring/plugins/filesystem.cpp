@@ -62,17 +62,31 @@ Status NumericMonitoringFilesystemPlugin::formTheLine(
   return Status();
 }
 
-Status NumericMonitoringFilesystemPlugin::call(const PluginRequest& request,
-                                               PluginResponse& response) {
+Status NumericMonitoringFilesystemPlugin::record(const PluginRequest& point) {
+  return recordBatch({point});
+}
+
+Status NumericMonitoringFilesystemPlugin::recordBatch(
+    const std::vector<PluginRequest>& points) {
   if (!isSetUp()) {
     return Status(1, "NumericMonitoringFilesystemPlugin is not set up");
   }
-  auto line = std::string{};
-  auto status = formTheLine(line, request);
-  if (status.ok()) {
-    std::unique_lock<std::mutex> lock(output_file_mutex_);
-    output_file_stream_ << line << std::endl;
+
+  auto lines = std::string{};
+  auto status = Status{};
+  for (const auto& point : points) {
+    auto line = std::string{};
+    auto line_status = formTheLine(line, point);
+    if (line_status.ok()) {
+      lines.append(line).push_back('\n');
+    } else {
+      status = line_status;
+    }
   }
+
+  // Write and flush the whole batch at once.
+  std::unique_lock<std::mutex> lock(output_file_mutex_);
+  output_file_stream_ << lines << std::flush;
   return status;
 }
 
@@ -27,7 +27,13 @@ class NumericMonitoringFilesystemPlugin : public NumericMonitoringPlugin {
   explicit NumericMonitoringFilesystemPlugin(
       boost::filesystem::path log_file_path);
 
-  Status call(const PluginRequest& request, PluginResponse& response) override;
+  Status record(const PluginRequest& point) override;
+
+  Status recordBatch(const std::vector<PluginRequest>& points) override;
+
+  bool acceptsBatches() const override {
+    return true;
+  }
 
   Status setUp() override;
 
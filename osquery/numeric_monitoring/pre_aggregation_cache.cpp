@@ -8,6 +8,9 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <algorithm>
+#include <cmath>
+
 #include <boost/io/detail/quoted_manip.hpp>
 
 #include "osquery/numeric_monitoring/pre_aggregation_cache.h"
@@ -16,6 +19,107 @@ namespace osquery {
 
 namespace monitoring {
 
+namespace {
+
+/// Each power of two is split in 2^kSubBucketBits buckets.
+const int kSubBucketBits = 4;
+const std::size_t kSubBuckets = 1 << kSubBucketBits;
+
+} // namespace
+
+std::size_t Histogram::bucketIndex(ValueType value) {
+  if (value < static_cast<ValueType>(kSubBuckets)) {
+    return (value < 0) ? 0 : static_cast<std::size_t>(value);
+  }
+
+  auto bits = static_cast<unsigned long long>(value);
+  int top_bit = 63 - __builtin_clzll(bits);
+  int shift = top_bit - kSubBucketBits;
+  auto sub_bucket = (bits >> shift) & (kSubBuckets - 1);
+  return kSubBuckets * (shift + 1) + sub_bucket;
+}
+
+ValueType Histogram::bucketValue(std::size_t index) {
+  if (index < kSubBuckets) {
+    return static_cast<ValueType>(index);
+  }
+
+  auto shift = index / kSubBuckets - 1;
+  auto sub_bucket = index % kSubBuckets;
+  auto lowest = static_cast<ValueType>(kSubBuckets + sub_bucket) << shift;
+  return lowest + ((static_cast<ValueType>(1) << shift) >> 1);
+}
+
+void Histogram::add(ValueType value) {
+  auto index = static_cast<std::uint32_t>(bucketIndex(value));
+  auto bucket = std::lower_bound(
+      buckets_.begin(),
+      buckets_.end(),
+      index,
+      [](const Bucket& lhs, std::uint32_t rhs) { return lhs.first < rhs; });
+  if (bucket != buckets_.end() && bucket->first == index) {
+    ++bucket->second;
+  } else {
+    buckets_.emplace(bucket, index, 1);
+  }
+  max_ = (count_ == 0) ? value : std::max(max_, value);
+  ++count_;
+}
+
+void Histogram::merge(const Histogram& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+
+  if (count_ == 0) {
+    buckets_ = other.buckets_;
+  } else {
+    std::vector<Bucket> merged;
+    merged.reserve(buckets_.size() + other.buckets_.size());
+
+    auto lhs = buckets_.cbegin();
+    auto rhs = other.buckets_.cbegin();
+    while (lhs != buckets_.cend() || rhs != other.buckets_.cend()) {
+      if (rhs == other.buckets_.cend() ||
+          (lhs != buckets_.cend() && lhs->first < rhs->first)) {
+        merged.push_back(*lhs++);
+      } else if (lhs == buckets_.cend() || rhs->first < lhs->first) {
+        merged.push_back(*rhs++);
+      } else {
+        merged.emplace_back(lhs->first, lhs->second + rhs->second);
+        ++lhs;
+        ++rhs;
+      }
+    }
+    buckets_.swap(merged);
+  }
+  max_ = (count_ == 0) ? other.max_ : std::max(max_, other.max_);
+  count_ += other.count_;
+}
+
+ValueType Histogram::percentile(double fraction) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  auto rank = static_cast<std::uint64_t>(std::ceil(fraction * count_));
+  rank = std::max<std::uint64_t>(1, std::min(rank, count_));
+
+  // The maximum is known exactly, the buckets only approximate it.
+  if (rank == count_) {
+    return max_;
+  }
+
+  std::uint64_t seen = 0;
+  for (const auto& bucket : buckets_) {
+    seen += bucket.second;
+    if (seen >= rank) {
+      return std::min(bucketValue(bucket.first), max_);
+    }
+  }
+  return max_;
+}
+
 Point::Point(std::string path,
              ValueType value,
              PreAggregationType pre_aggregation_type,
@@ -23,7 +127,11 @@ Point::Point(std::string path,
     : path_(std::move(path)),
       value_(std::move(value)),
       pre_aggregation_type_(std::move(pre_aggregation_type)),
-      time_point_(std::move(time_point)) {}
+      time_point_(std::move(time_point)) {
+  if (pre_aggregation_type_ == PreAggregationType::Histogram) {
+    histogram_.add(value_);
+  }
+}
 
 bool Point::tryToAggregate(const Point& new_point) {
   if (path_ != new_point.path_) {
@@ -56,6 +164,10 @@ bool Point::tryToAggregate(const Point& new_point) {
   case PreAggregationType::Max:
     value_ = std::max(value_, new_point.value_);
     break;
+  case PreAggregationType::Histogram:
+    value_ = std::max(value_, new_point.value_);
+    histogram_.merge(new_point.histogram_);
+    break;
   case PreAggregationType::InvalidTypeUpperLimit:
     // nothing to do, the type is invalid
     LOG(ERROR) << "Invalid Pre-aggregation type "
@@ -10,7 +10,10 @@
 
 #pragma once
 
+#include <cstdint>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <osquery/numeric_monitoring.h>
 
@@ -18,6 +21,45 @@ namespace osquery {
 
 namespace monitoring {
 
+/**
+ * Log-linear histogram, the layout used by HDR histograms.
+ * Values below 16 are counted exactly, larger values fall in one of 16
+ * buckets per power of two, so percentiles are accurate within 1/32.
+ * Negative values are counted as zero. Only the buckets holding values are
+ * stored, most points only ever see a few distinct buckets.
+ */
+class Histogram {
+ public:
+  void add(ValueType value);
+
+  void merge(const Histogram& other);
+
+  /**
+   * The value at or below which the given fraction of the values fall.
+   * @param fraction A number in (0, 1], e.g. 0.99 for the 99th percentile.
+   */
+  ValueType percentile(double fraction) const;
+
+  std::uint64_t count() const noexcept {
+    return count_;
+  }
+
+ private:
+  static std::size_t bucketIndex(ValueType value);
+
+  /// The middle of the range of values counted in a bucket.
+  static ValueType bucketValue(std::size_t index);
+
+ private:
+  /// A bucket index and the number of values counted in it.
+  using Bucket = std::pair<std::uint32_t, std::uint64_t>;
+
+  /// The non-empty buckets, sorted by index.
+  std::vector<Bucket> buckets_;
+  std::uint64_t count_{0};
+  ValueType max_{0};
+};
+
 /**
  * Monitoring system smallest unit
  * Consists of watched value itself, watching time, unique name for this set of
@@ -55,6 +97,9 @@ class Point {
   ValueType value_;
   PreAggregationType pre_aggregation_type_;
   TimePoint time_point_;
+
+  /// Only used by PreAggregationType::Histogram, value_ is then the maximum.
+  Histogram histogram_;
 };
 
 class PreAggregationCache {
@@ -8,6 +8,9 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <map>
+#include <thread>
+
 #include <gtest/gtest.h>
 
 #include <boost/filesystem.hpp>
@@ -41,6 +44,8 @@ GTEST_TEST(NumericMonitoringTests, PreAggregationTypeToStringAndBack) {
   testAggrTypeToStringAndBack(monitoring::PreAggregationType::Sum, "sum");
   testAggrTypeToStringAndBack(monitoring::PreAggregationType::Min, "min");
   testAggrTypeToStringAndBack(monitoring::PreAggregationType::Max, "max");
+  testAggrTypeToStringAndBack(monitoring::PreAggregationType::Histogram,
+                              "histogram");
 }
 
 GTEST_TEST(NumericMonitoringTests, PreAggregationTypeToStringRecall) {
@@ -63,15 +68,28 @@ const auto kNameForTestPlugin =
 
 class NumericMonitoringInMemoryTestPlugin : public NumericMonitoringPlugin {
  public:
-  Status call(const PluginRequest& request, PluginResponse& response) override {
-    NumericMonitoringInMemoryTestPlugin::points.push_back(request);
+  Status record(const PluginRequest& point) override {
+    NumericMonitoringInMemoryTestPlugin::points.push_back(point);
     return Status::success();
   }
 
+  Status recordBatch(const std::vector<PluginRequest>& batch) override {
+    ++NumericMonitoringInMemoryTestPlugin::batches;
+    return NumericMonitoringPlugin::recordBatch(batch);
+  }
+
+  bool acceptsBatches() const override {
+    return NumericMonitoringInMemoryTestPlugin::accepts_batches;
+  }
+
   static std::vector<PluginRequest> points;
+  static size_t batches;
+  static bool accepts_batches;
 };
 
 std::vector<PluginRequest> NumericMonitoringInMemoryTestPlugin::points;
+size_t NumericMonitoringInMemoryTestPlugin::batches{0};
+bool NumericMonitoringInMemoryTestPlugin::accepts_batches{false};
 
 REGISTER(NumericMonitoringInMemoryTestPlugin,
          monitoring::registryName(),
@@ -93,6 +111,8 @@ GTEST_TEST(NumericMonitoringTests, record_with_buffer) {
 
   monitoring::flushForTests();
   NumericMonitoringInMemoryTestPlugin::points.clear();
+  NumericMonitoringInMemoryTestPlugin::batches = 0;
+  NumericMonitoringInMemoryTestPlugin::accepts_batches = false;
 
   const auto monitoring_path = "some.path.to.heaven";
   monitoring::record(monitoring_path,
@@ -106,6 +126,8 @@ GTEST_TEST(NumericMonitoringTests, record_with_buffer) {
                      monitoring::PreAggregationType::Sum);
   monitoring::flushForTests();
 
+  // Plugins that do not opt in receive a request per point.
+  EXPECT_EQ(0U, NumericMonitoringInMemoryTestPlugin::batches);
   EXPECT_EQ(1, NumericMonitoringInMemoryTestPlugin::points.size());
   EXPECT_EQ(monitoring_path,
             NumericMonitoringInMemoryTestPlugin::points.back().at(
@@ -122,6 +144,72 @@ GTEST_TEST(NumericMonitoringTests, record_with_buffer) {
   Dispatcher::joinServices();
 }
 
+GTEST_TEST(NumericMonitoringTests, record_histogram_with_buffer) {
+  const auto isEnabled = FLAGS_enable_numeric_monitoring;
+  const auto plugins = FLAGS_numeric_monitoring_plugins;
+  const auto pre_aggregation_time =
+      FLAGS_numeric_monitoring_pre_aggregation_time;
+
+  FLAGS_enable_numeric_monitoring = true;
+  FLAGS_numeric_monitoring_plugins = kNameForTestPlugin;
+  FLAGS_numeric_monitoring_pre_aggregation_time = 1;
+
+  auto status = RegistryFactory::get().setActive(
+      monitoring::registryName(), FLAGS_numeric_monitoring_plugins);
+  ASSERT_TRUE(status.ok());
+
+  monitoring::flushForTests();
+  NumericMonitoringInMemoryTestPlugin::points.clear();
+  NumericMonitoringInMemoryTestPlugin::batches = 0;
+  NumericMonitoringInMemoryTestPlugin::accepts_batches = true;
+
+  // Points recorded by several threads are merged into a single batch.
+  const auto monitoring_path = "some.path.to.latency";
+  auto L_Record = [monitoring_path](int first) {
+    for (int i = first; i <= 100; i += 2) {
+      monitoring::record(monitoring_path,
+                         monitoring::ValueType{i},
+                         monitoring::PreAggregationType::Histogram);
+    }
+  };
+  std::thread odd(L_Record, 1);
+  std::thread even(L_Record, 2);
+  odd.join();
+  even.join();
+  monitoring::flushForTests();
+
+  EXPECT_EQ(1U, NumericMonitoringInMemoryTestPlugin::batches);
+  ASSERT_EQ(4U, NumericMonitoringInMemoryTestPlugin::points.size());
+  auto values = std::map<std::string, long long>{};
+  for (const auto& point : NumericMonitoringInMemoryTestPlugin::points) {
+    values[point.at(monitoring::recordKeys().path)] =
+        std::stoll(point.at(monitoring::recordKeys().value));
+  }
+  EXPECT_NEAR(50, values.at("some.path.to.latency.p50"), 2);
+  EXPECT_NEAR(90, values.at("some.path.to.latency.p90"), 3);
+  EXPECT_NEAR(99, values.at("some.path.to.latency.p99"), 4);
+  EXPECT_EQ(100, values.at("some.path.to.latency.max"));
+
+  // The latest points are kept for the osquery_metrics table.
+  auto recorded = false;
+  for (const auto& point : monitoring::getRecordedPoints()) {
+    if (point.path == "some.path.to.latency.max") {
+      EXPECT_EQ(100, point.value);
+      EXPECT_EQ(monitoring::PreAggregationType::Max, point.pre_aggregation);
+      recorded = true;
+    }
+  }
+  EXPECT_TRUE(recorded);
+
+  NumericMonitoringInMemoryTestPlugin::accepts_batches = false;
+  FLAGS_enable_numeric_monitoring = isEnabled;
+  FLAGS_numeric_monitoring_plugins = plugins;
+  FLAGS_numeric_monitoring_pre_aggregation_time = pre_aggregation_time;
+
+  Dispatcher::stopServices();
+  Dispatcher::joinServices();
+}
+
 GTEST_TEST(NumericMonitoringTests, record_without_buffer) {
   const auto isEnabled = FLAGS_enable_numeric_monitoring;
   const auto plugins = FLAGS_numeric_monitoring_plugins;
@@ -109,6 +109,65 @@ GTEST_TEST(PreAggregationPoint, tryToUpdate_max) {
   EXPECT_EQ(42, prev_pt.value_);
 }
 
+GTEST_TEST(PreAggregationHistogram, percentiles) {
+  auto histogram = monitoring::Histogram{};
+  EXPECT_EQ(0, histogram.percentile(0.5));
+
+  // Small values are counted exactly.
+  for (auto i = monitoring::ValueType{1}; i <= 10; ++i) {
+    histogram.add(i);
+  }
+  EXPECT_EQ(10U, histogram.count());
+  EXPECT_EQ(5, histogram.percentile(0.5));
+  EXPECT_EQ(9, histogram.percentile(0.9));
+  EXPECT_EQ(10, histogram.percentile(1.0));
+
+  // Large values are within 1/32 and never above the maximum.
+  auto other = monitoring::Histogram{};
+  for (auto i = monitoring::ValueType{1}; i <= 1000; ++i) {
+    other.add(i * 1000);
+  }
+  histogram.merge(other);
+  EXPECT_EQ(1010U, histogram.count());
+  EXPECT_NEAR(990000, histogram.percentile(0.99), 990000 / 32);
+  EXPECT_EQ(1000000, histogram.percentile(1.0));
+
+  auto largest = monitoring::Histogram{};
+  largest.add(std::numeric_limits<monitoring::ValueType>::max());
+  EXPECT_GT(largest.percentile(0.5), 0);
+}
+
+GTEST_TEST(PreAggregationHistogram, merge_interleaved) {
+  auto odd = monitoring::Histogram{};
+  auto even = monitoring::Histogram{};
+  for (auto i = monitoring::ValueType{0}; i < 20; ++i) {
+    (i % 2 == 0 ? even : odd).add(i);
+  }
+  even.add(5);
+
+  // Buckets found in both histograms are summed.
+  odd.merge(even);
+  EXPECT_EQ(21U, odd.count());
+  EXPECT_EQ(9, odd.percentile(0.5));
+  EXPECT_EQ(19, odd.percentile(1.0));
+}
+
+GTEST_TEST(PreAggregationPoint, tryToUpdate_histogram) {
+  const auto now = monitoring::Clock::now();
+  const auto path = "test.path.to.nowhere";
+  auto prev_pt = monitoring::Point(
+      path, 3, monitoring::PreAggregationType::Histogram, now);
+  auto new_pt = monitoring::Point(path,
+                                  42,
+                                  monitoring::PreAggregationType::Histogram,
+                                  now - std::chrono::seconds{2});
+  ASSERT_TRUE(prev_pt.tryToAggregate(new_pt));
+  EXPECT_EQ(now, prev_pt.time_point_);
+  EXPECT_EQ(42, prev_pt.value_);
+  EXPECT_EQ(2U, prev_pt.histogram_.count());
+  EXPECT_EQ(3, prev_pt.histogram_.percentile(0.5));
+}
+
 GTEST_TEST(PreAggregationCache, life_cycle) {
   const auto now = monitoring::Clock::now();
   auto cache = monitoring::PreAggregationCache{};
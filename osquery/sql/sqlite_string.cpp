@@ -17,11 +17,14 @@
 #endif
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include <boost/algorithm/string/regex.hpp>
+#include <boost/range/iterator_range.hpp>
 #include <boost/regex.hpp>
+#include <boost/utility/string_ref.hpp>
 
 #include "osquery/core/conversions.h"
 
@@ -53,28 +56,6 @@ static SplitResult tokenSplit(const std::string& input,
   return osquery::split(input, tokens);
 }
 
-/**
- * @brief A regex SQLite column string split implementation.
- *
- * Split a column value using a single or multi-character token and select an
- * expected index. The token input is considered a regex.
- *
- * Example:
- *   1. SELECT ip_address from addresses;
- *      192.168.0.1
- *   2. SELECT SPLIT(ip_address, "\.", 1) from addresses;
- *      168
- *   3. SELECT SPLIT(ip_address, "\.0", 0) from addresses;
- *      192.168
- */
-static SplitResult regexSplit(const std::string& input,
-                              const std::string& token) {
-  // Split using the token as a regex to support multi-character tokens.
-  std::vector<std::string> result;
-  boost::algorithm::split_regex(result, input, boost::regex(token));
-  return result;
-}
-
 static void callStringSplitFunc(sqlite3_context* context,
                                 int argc,
                                 sqlite3_value** argv,
@@ -118,10 +99,208 @@ static void tokenStringSplitFunc(sqlite3_context* context,
   callStringSplitFunc(context, argc, argv, tokenSplit);
 }
 
+/// Read a text argument without copying it.
+static boost::string_ref getTextArgument(sqlite3_value* value) {
+  auto text = reinterpret_cast<const char*>(sqlite3_value_text(value));
+  return boost::string_ref(text, static_cast<size_t>(sqlite3_value_bytes(value)));
+}
+
+/**
+ * @brief A regex argument, compiled once per statement.
+ *
+ * SQLite keeps the compiled pattern as auxiliary data for as long as the
+ * argument remains the same constant, such that each row reuses it.
+ */
+class RegexArgument {
+ public:
+  RegexArgument(sqlite3_context* context, sqlite3_value** argv, int index)
+      : context_(context), index_(index) {
+    regex_ = static_cast<boost::regex*>(sqlite3_get_auxdata(context, index));
+    if (regex_ != nullptr) {
+      return;
+    }
+
+    auto pattern = getTextArgument(argv[index]);
+    try {
+      compiled_ = std::make_unique<boost::regex>(pattern.begin(), pattern.end());
+      regex_ = compiled_.get();
+    } catch (const boost::regex_error& e) {
+      auto message = std::string("Invalid regex: ") + e.what();
+      sqlite3_result_error(context, message.c_str(), -1);
+    }
+  }
+
+  /// Hand the compiled pattern over to SQLite once it is no longer used.
+  ~RegexArgument() {
+    if (compiled_ != nullptr) {
+      sqlite3_set_auxdata(
+          context_, index_, compiled_.release(), deleteRegex);
+    }
+  }
+
+  /// The compiled pattern, or nullptr if it is invalid.
+  const boost::regex* get() const {
+    return regex_;
+  }
+
+ private:
+  static void deleteRegex(void* regex) {
+    delete static_cast<boost::regex*>(regex);
+  }
+
+ private:
+  sqlite3_context* context_{nullptr};
+  int index_{0};
+  const boost::regex* regex_{nullptr};
+  std::unique_ptr<boost::regex> compiled_;
+};
+
+/// Report an error raised while matching, such as an exhausted complexity.
+static void setRegexMatchError(sqlite3_context* context,
+                               const std::exception& e) {
+  auto message = std::string("Regex match failed: ") + e.what();
+  sqlite3_result_error(context, message.c_str(), -1);
+}
+
+/**
+ * @brief A regex SQLite column string split implementation.
+ *
+ * Split a column value using a single or multi-character token and select an
+ * expected index. The token input is considered a regex.
+ *
+ * Example:
+ *   1. SELECT ip_address from addresses;
+ *      192.168.0.1
+ *   2. SELECT SPLIT(ip_address, "\.", 1) from addresses;
+ *      168
+ *   3. SELECT SPLIT(ip_address, "\.0", 0) from addresses;
+ *      192.168
+ */
 static void regexStringSplitFunc(sqlite3_context* context,
                                  int argc,
                                  sqlite3_value** argv) {
-  callStringSplitFunc(context, argc, argv, regexSplit);
+  assert(argc == 3);
+  if (SQLITE_NULL == sqlite3_value_type(argv[0]) ||
+      SQLITE_NULL == sqlite3_value_type(argv[1]) ||
+      SQLITE_NULL == sqlite3_value_type(argv[2])) {
+    sqlite3_result_null(context);
+    return;
+  }
+
+  if (sqlite3_value_bytes(argv[1]) == 0) {
+    sqlite3_result_error(context, "Invalid input to split function", -1);
+    return;
+  }
+
+  RegexArgument regex(context, argv, 1);
+  if (regex.get() == nullptr) {
+    return;
+  }
+
+  // Split using the token as a regex to support multi-character tokens.
+  // The results are ranges within the input, nothing is copied.
+  auto input = getTextArgument(argv[0]);
+  auto index = static_cast<size_t>(sqlite3_value_int(argv[2]));
+  std::vector<boost::iterator_range<const char*>> result;
+  try {
+    boost::algorithm::split_regex(
+        result,
+        boost::make_iterator_range(input.begin(), input.end()),
+        *regex.get());
+  } catch (const std::exception& e) {
+    setRegexMatchError(context, e);
+    return;
+  }
+  if (index >= result.size()) {
+    sqlite3_result_null(context);
+    return;
+  }
+
+  // Yield the selected index.
+  const auto& selected = result[index];
+  sqlite3_result_text(context,
+                      selected.begin(),
+                      static_cast<int>(selected.size()),
+                      SQLITE_TRANSIENT);
+}
+
+/**
+ * @brief Return a capture group of the first match of a regex.
+ *
+ * Group 0 is the complete match. NULL is returned if the pattern does not
+ * match or if the group does not exist.
+ *
+ * Example:
+ *   1. SELECT regex_match("192.168.0.1", "([0-9]+)\.([0-9]+)", 2);
+ *      168
+ */
+static void regexMatchFunc(sqlite3_context* context,
+                           int argc,
+                           sqlite3_value** argv) {
+  assert(argc == 3);
+  if (SQLITE_NULL == sqlite3_value_type(argv[0]) ||
+      SQLITE_NULL == sqlite3_value_type(argv[1]) ||
+      SQLITE_NULL == sqlite3_value_type(argv[2])) {
+    sqlite3_result_null(context);
+    return;
+  }
+
+  RegexArgument regex(context, argv, 1);
+  if (regex.get() == nullptr) {
+    return;
+  }
+
+  auto input = getTextArgument(argv[0]);
+  auto group = static_cast<size_t>(sqlite3_value_int(argv[2]));
+  boost::cmatch match;
+  bool found = false;
+  try {
+    found =
+        boost::regex_search(input.begin(), input.end(), match, *regex.get());
+  } catch (const std::exception& e) {
+    setRegexMatchError(context, e);
+    return;
+  }
+
+  if (!found || group >= match.size() || !match[group].matched) {
+    sqlite3_result_null(context);
+    return;
+  }
+
+  sqlite3_result_text(context,
+                      match[group].first,
+                      static_cast<int>(match[group].length()),
+                      SQLITE_TRANSIENT);
+}
+
+/**
+ * @brief Implement the REGEXP operator, "X REGEXP Y" calls regexp(Y, X).
+ *
+ * Returns 1 if the pattern matches any part of the input.
+ */
+static void regexpFunc(sqlite3_context* context,
+                       int argc,
+                       sqlite3_value** argv) {
+  assert(argc == 2);
+  if (SQLITE_NULL == sqlite3_value_type(argv[0]) ||
+      SQLITE_NULL == sqlite3_value_type(argv[1])) {
+    sqlite3_result_null(context);
+    return;
+  }
+
+  RegexArgument regex(context, argv, 0);
+  if (regex.get() == nullptr) {
+    return;
+  }
+
+  auto input = getTextArgument(argv[1]);
+  try {
+    sqlite3_result_int(
+        context,
+        boost::regex_search(input.begin(), input.end(), *regex.get()) ? 1 : 0);
+  } catch (const std::exception& e) {
+    setRegexMatchError(context, e);
+  }
 }
 
 /**
@@ -169,6 +348,22 @@ void registerStringExtensions(sqlite3* db) {
                           regexStringSplitFunc,
                           nullptr,
                           nullptr);
+  sqlite3_create_function(db,
+                          "regex_match",
+                          3,
+                          SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                          nullptr,
+                          regexMatchFunc,
+                          nullptr,
+                          nullptr);
+  sqlite3_create_function(db,
+                          "regexp",
+                          2,
+                          SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                          nullptr,
+                          regexpFunc,
+                          nullptr,
+                          nullptr);
   sqlite3_create_function(db,
                           "inet_aton",
                           1,
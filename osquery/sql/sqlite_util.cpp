@@ -497,6 +497,65 @@ Status queryInternal(const std::string& q,
   return Status(0, "OK");
 }
 
+Status queryInternal(const std::string& q,
+                     QueryDataColumns& results,
+                     const SQLiteDBInstanceRef& instance) {
+  auto lock = instance->attachLock();
+
+  const char* tail = q.c_str();
+  Status status;
+  while (status.ok() && tail != nullptr && *tail != 0) {
+    sqlite3_stmt* stmt{nullptr};
+    auto rc = sqlite3_prepare_v2(instance->db(), tail, -1, &stmt, &tail);
+    if (rc != SQLITE_OK) {
+      status = Status(1, "Error running query: " +
+                             std::string(sqlite3_errmsg(instance->db())));
+      break;
+    }
+
+    if (stmt == nullptr) {
+      // This happens for a comment or white-space.
+      continue;
+    }
+
+    auto num_columns = sqlite3_column_count(stmt);
+    if (num_columns > 0) {
+      if (results.columns.empty()) {
+        // Name the columns before stepping, an empty result keeps them.
+        for (int i = 0; i < num_columns; ++i) {
+          results.columns.push_back(sqlite3_column_name(stmt, i));
+        }
+        results.values.resize(num_columns);
+      } else if (static_cast<size_t>(num_columns) != results.columns.size()) {
+        // Every column must hold a value for every row.
+        sqlite3_finalize(stmt);
+        status = Status(1,
+                        "Error running query: statements return a different "
+                        "number of columns");
+        break;
+      }
+    }
+
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+      for (int i = 0; i < num_columns; ++i) {
+        auto value =
+            reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+        results.values[i].emplace_back((value != nullptr) ? value
+                                                          : FLAGS_nullvalue);
+      }
+    }
+
+    if (rc != SQLITE_DONE) {
+      status = Status(1, "Error running query: " +
+                             std::string(sqlite3_errmsg(instance->db())));
+    }
+    sqlite3_finalize(stmt);
+  }
+
+  sqlite3_db_release_memory(instance->db());
+  return status;
+}
+
 Status getQueryColumnsInternal(const std::string& q,
                                TableColumns& columns,
                                const SQLiteDBInstanceRef& instance) {
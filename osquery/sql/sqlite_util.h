@@ -317,6 +317,22 @@ Status queryInternal(const std::string& q,
                      QueryData& results,
                      const SQLiteDBInstanceRef& instance);
 
+/**
+ * @brief SQLite Internal: Execute a query, collecting results by column
+ *
+ * Values are appended to their column as SQLite steps through the result,
+ * NULL values are replaced with the --nullvalue string.
+ *
+ * @param q the query to execute
+ * @param results The QueryDataColumns struct to emit values on query success.
+ * @param db the SQLite3 database to execute query q against
+ *
+ * @return A status indicating SQL query results.
+ */
+Status queryInternal(const std::string& q,
+                     QueryDataColumns& results,
+                     const SQLiteDBInstanceRef& instance);
+
 /**
  * @brief SQLite Intern: Analyze a query, providing information about the
  * result columns
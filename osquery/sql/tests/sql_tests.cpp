@@ -134,6 +134,50 @@ TEST_F(SQLTests, test_sql_base64_conditional_encode) {
   EXPECT_EQ(d2[0]["test"], "5oKq5Zug5oKq5p6c");
 }
 
+TEST_F(SQLTests, test_sql_regex) {
+  QueryData d;
+  query("select regex_split('192.168.0.1', '\\.', 1) as a, "
+        "regex_split('192.168.0.1', '\\.0', 0) as b, "
+        "regex_split('192.168.0.1', '\\.', 4) as c;",
+        d);
+  ASSERT_EQ(d.size(), 1U);
+  EXPECT_EQ(d[0]["a"], "168");
+  EXPECT_EQ(d[0]["b"], "192.168");
+  EXPECT_EQ(d[0]["c"], "");
+
+  QueryData d2;
+  query("select regex_match('192.168.0.1', '([0-9]+)\\.([0-9]+)', 2) as a, "
+        "regex_match('192.168.0.1', '[0-9]+', 0) as b, "
+        "regex_match('192.168.0.1', '([a-z]+)', 1) as c;",
+        d2);
+  ASSERT_EQ(d2.size(), 1U);
+  EXPECT_EQ(d2[0]["a"], "168");
+  EXPECT_EQ(d2[0]["b"], "192");
+  EXPECT_EQ(d2[0]["c"], "");
+
+  // The compiled pattern is reused across rows.
+  QueryData d3;
+  query("with v(x) as (values ('/bin/ls'), ('/usr/bin/ls'), ('/tmp/x')) "
+        "select x from v where x regexp '^/(usr/)?bin/';",
+        d3);
+  ASSERT_EQ(d3.size(), 2U);
+  EXPECT_EQ(d3[1]["x"], "/usr/bin/ls");
+
+  QueryData d4;
+  auto status = query("select regex_match('a', '(', 0);", d4);
+  EXPECT_FALSE(status.ok());
+
+  // Errors raised while matching are reported by the query.
+  auto input = std::string(64, 'x');
+  for (const auto& function : {"regex_match('" + input + "', '(x+x+)+y', 0)",
+                               "regex_split('" + input + "', '(x+x+)+y', 0)",
+                               "'" + input + "' regexp '(x+x+)+y'"}) {
+    QueryData d5;
+    status = query("select " + function + ";", d5);
+    EXPECT_FALSE(status.ok());
+  }
+}
+
 TEST_F(SQLTests, test_sql_md5) {
   QueryData d;
   query("select md5('test') as test;", d);
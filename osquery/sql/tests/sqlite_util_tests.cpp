@@ -92,6 +92,49 @@ TEST_F(SQLiteUtilTests, test_direct_query_execution) {
   EXPECT_EQ(results, getTestDBExpectedResults());
 }
 
+TEST_F(SQLiteUtilTests, test_direct_query_columns) {
+  auto dbc = getTestDBC();
+  QueryDataColumns results;
+  auto status = queryInternal(kTestQuery, results, dbc);
+  ASSERT_TRUE(status.ok());
+
+  auto expected = getTestDBExpectedResults();
+  ASSERT_EQ(results.rows(), expected.size());
+  ASSERT_EQ(results.columns.size(), results.values.size());
+  for (size_t i = 0; i < results.columns.size(); i++) {
+    for (size_t row = 0; row < results.rows(); row++) {
+      EXPECT_EQ(results.values[i][row],
+                expected[row].at(results.columns[i]));
+    }
+  }
+
+  // Errors are reported like the row-based query.
+  QueryDataColumns failed;
+  status = queryInternal("SELECT * FROM no_such_table", failed, dbc);
+  EXPECT_FALSE(status.ok());
+  EXPECT_EQ(failed.rows(), 0U);
+
+  // An empty result still names its columns.
+  QueryDataColumns empty;
+  status = queryInternal(
+      "SELECT username, age FROM test_table WHERE age > 100", empty, dbc);
+  ASSERT_TRUE(status.ok());
+  EXPECT_EQ(empty.columns, ColumnNames({"username", "age"}));
+  EXPECT_EQ(empty.values.size(), 2U);
+  EXPECT_EQ(empty.rows(), 0U);
+
+  // Statements with a different number of columns cannot share the result.
+  QueryDataColumns mismatched;
+  status = queryInternal(
+      "SELECT username FROM test_table; SELECT * FROM test_table",
+      mismatched,
+      dbc);
+  EXPECT_FALSE(status.ok());
+  for (const auto& values : mismatched.values) {
+    EXPECT_EQ(values.size(), mismatched.rows());
+  }
+}
+
 TEST_F(SQLiteUtilTests, test_passing_callback_no_data_param) {
   char* err = nullptr;
   auto dbc = getTestDBC();
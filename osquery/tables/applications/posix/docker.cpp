@@ -8,14 +8,23 @@
  *  You may select, at your option, one of the above-listed licenses.
  */
 
+#include <poll.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <regex>
+#include <memory>
+#include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/noncopyable.hpp>
 #include <boost/property_tree/json_parser.hpp>
 
 #include <boost/asio.hpp>
@@ -27,6 +36,7 @@
 
 #include <osquery/flags.h>
 #include <osquery/logger.h>
+#include <osquery/mutex.h>
 #include <osquery/tables.h>
 
 #include "osquery/core/conversions.h"
@@ -54,8 +64,285 @@ FLAG(string,
      "/var/run/docker.sock",
      "Docker UNIX domain socket path");
 
+HIDDEN_FLAG(uint32,
+            docker_api_concurrency,
+            8,
+            "Maximum number of concurrent docker API calls within a query");
+
+HIDDEN_FLAG(uint32,
+            docker_api_timeout,
+            30,
+            "Seconds to wait for data from the docker daemon (0 = no timeout)");
+
 namespace tables {
 
+/// Maximum number of idle connections kept to the docker daemon.
+const size_t kDockerMaxIdleConnections{8};
+
+/// Bytes requested from the socket for each receive.
+const size_t kDockerReceiveSize{16384};
+
+/**
+ * @brief A keep-alive HTTP/1.1 connection to the docker UNIX socket.
+ *
+ * Connections are returned to a pool after a complete response was read,
+ * such that API calls do not pay for a new connection each time.
+ */
+class DockerConnection : private boost::noncopyable {
+ public:
+  explicit DockerConnection(const std::string& path)
+      : path_(path), socket_(getIOService()) {}
+
+  /// The socket path this connection was opened to.
+  const std::string& path() const {
+    return path_;
+  }
+
+  /// Connect to the docker socket.
+  Status connect();
+
+  /**
+   * @brief Send a GET request and read the complete response.
+   *
+   * @param uri Relative URI to request.
+   * @param status_line The HTTP response status line.
+   * @param body The response body, chunked encoding is removed.
+   * @param reusable Set if the connection may be used for another request.
+   * @return Failure if the request could not be sent or the response read.
+   */
+  Status get(const std::string& uri,
+             std::string& status_line,
+             std::string& body,
+             bool& reusable);
+
+ private:
+  /// Read a line without its CRLF terminator.
+  void readLine(std::string& line);
+
+  /// Append exactly size bytes of the response to output.
+  void read(size_t size, std::string& output);
+
+  /// Append the remaining response until the daemon closes the connection.
+  void readToEnd(std::string& output);
+
+  /**
+   * @brief Receive more of the response into the buffer.
+   *
+   * A blocking asio read would wait forever for a daemon that stopped
+   * answering; the socket is polled for docker_api_timeout seconds first.
+   *
+   * @return False once the daemon closed the connection.
+   */
+  bool receive();
+
+  /// Blocking operations do not need a running IO service.
+  static boost::asio::io_service& getIOService() {
+    static boost::asio::io_service io_service;
+    return io_service;
+  }
+
+ private:
+  std::string path_;
+  local::stream_protocol::socket socket_;
+  boost::asio::streambuf buffer_;
+};
+
+Status DockerConnection::connect() {
+  boost::system::error_code ec;
+  socket_.connect(local::stream_protocol::endpoint(path_), ec);
+  if (ec) {
+    return Status(1, "Error connecting to docker sock: " + ec.message());
+  }
+  return Status(0);
+}
+
+void DockerConnection::readLine(std::string& line) {
+  static const char kLineEnd[] = "\r\n";
+  for (;;) {
+    auto data = boost::asio::buffer_cast<const char*>(buffer_.data());
+    auto end = data + buffer_.size();
+    auto found = std::search(data, end, kLineEnd, kLineEnd + 2);
+    if (found != end) {
+      line.assign(data, found);
+      buffer_.consume(static_cast<size_t>(found - data) + 2);
+      return;
+    }
+
+    if (!receive()) {
+      throw boost::system::system_error(boost::asio::error::eof);
+    }
+  }
+}
+
+void DockerConnection::read(size_t size, std::string& output) {
+  while (buffer_.size() < size) {
+    if (!receive()) {
+      throw boost::system::system_error(boost::asio::error::eof);
+    }
+  }
+
+  auto offset = output.size();
+  output.resize(offset + size);
+  buffer_.sgetn(&output[offset], static_cast<std::streamsize>(size));
+}
+
+void DockerConnection::readToEnd(std::string& output) {
+  while (receive()) {
+  }
+  read(buffer_.size(), output);
+}
+
+bool DockerConnection::receive() {
+  pollfd fds[] = {{socket_.native_handle(), POLLIN, 0}};
+  auto timeout = (FLAGS_docker_api_timeout > 0)
+                     ? static_cast<int>(FLAGS_docker_api_timeout * 1000)
+                     : -1;
+
+  int status = 0;
+  do {
+    errno = 0;
+    status = ::poll(fds, 1, timeout);
+  } while (status < 0 && errno == EINTR);
+
+  if (status == 0) {
+    throw std::runtime_error("timed out waiting for the docker daemon");
+  } else if (status < 0) {
+    throw boost::system::system_error(errno,
+                                      boost::system::system_category());
+  }
+
+  boost::system::error_code ec;
+  auto size = socket_.read_some(buffer_.prepare(kDockerReceiveSize), ec);
+  if (ec == boost::asio::error::eof) {
+    return false;
+  } else if (ec) {
+    throw boost::system::system_error(ec);
+  }
+
+  buffer_.commit(size);
+  return true;
+}
+
+Status DockerConnection::get(const std::string& uri,
+                             std::string& status_line,
+                             std::string& body,
+                             bool& reusable) {
+  reusable = false;
+  body.clear();
+
+  try {
+    auto request = "GET " + uri +
+                   " HTTP/1.1\r\nHost: docker\r\nAccept: */*\r\n"
+                   "Connection: keep-alive\r\n\r\n";
+    boost::asio::write(socket_, boost::asio::buffer(request));
+
+    readLine(status_line);
+    reusable = boost::starts_with(status_line, "HTTP/1.1 ");
+
+    // Parse the headers that describe the body framing.
+    bool chunked = false;
+    bool has_length = false;
+    size_t length = 0;
+    std::string header;
+    for (readLine(header); !header.empty(); readLine(header)) {
+      auto separator = header.find(':');
+      if (separator == std::string::npos) {
+        continue;
+      }
+
+      auto name = header.substr(0, separator);
+      auto value = header.substr(separator + 1);
+      boost::algorithm::trim(value);
+      if (boost::iequals(name, "Content-Length")) {
+        has_length = true;
+        length = static_cast<size_t>(std::stoull(value));
+      } else if (boost::iequals(name, "Transfer-Encoding")) {
+        chunked = boost::icontains(value, "chunked");
+      } else if (boost::iequals(name, "Connection")) {
+        reusable = !boost::iequals(value, "close");
+      }
+    }
+
+    if (chunked) {
+      std::string chunk_header;
+      for (;;) {
+        readLine(chunk_header);
+        auto chunk_size =
+            static_cast<size_t>(std::stoull(chunk_header, nullptr, 16));
+        if (chunk_size == 0) {
+          break;
+        }
+        read(chunk_size, body);
+
+        // Each chunk is followed by a CRLF.
+        readLine(chunk_header);
+      }
+
+      // Skip the optional trailers.
+      for (readLine(header); !header.empty(); readLine(header)) {
+      }
+    } else if (has_length) {
+      read(length, body);
+    } else {
+      readToEnd(body);
+      reusable = false;
+    }
+  } catch (const std::exception& e) {
+    reusable = false;
+    return Status(1, std::string("Error calling docker API: ") + e.what());
+  }
+
+  return Status(0);
+}
+
+/// Idle connections to the docker daemon.
+Mutex kDockerConnectionsMutex;
+std::vector<std::unique_ptr<DockerConnection>> kDockerConnections;
+
+/// Open a new connection to the docker socket.
+Status openDockerConnection(std::unique_ptr<DockerConnection>& connection) {
+  connection = std::make_unique<DockerConnection>(FLAGS_docker_socket);
+  return connection->connect();
+}
+
+/**
+ * @brief Take an idle connection from the pool or open a new one.
+ *
+ * @param reused Set if the connection was already used, it may have been
+ * closed by the daemon since.
+ */
+Status acquireDockerConnection(std::unique_ptr<DockerConnection>& connection,
+                               bool& reused) {
+  {
+    WriteLock lock(kDockerConnectionsMutex);
+    while (!kDockerConnections.empty()) {
+      connection = std::move(kDockerConnections.back());
+      kDockerConnections.pop_back();
+      if (connection->path() == FLAGS_docker_socket) {
+        reused = true;
+        return Status(0);
+      }
+    }
+  }
+
+  reused = false;
+  return openDockerConnection(connection);
+}
+
+/// Drop the idle connections, for instance after the daemon restarted.
+void clearDockerConnections() {
+  WriteLock lock(kDockerConnectionsMutex);
+  kDockerConnections.clear();
+}
+
+/// Return a connection with no pending response to the pool.
+void releaseDockerConnection(std::unique_ptr<DockerConnection> connection) {
+  WriteLock lock(kDockerConnectionsMutex);
+  if (kDockerConnections.size() < kDockerMaxIdleConnections) {
+    kDockerConnections.push_back(std::move(connection));
+  }
+}
+
 /**
  * @brief Makes API calls to the docker UNIX socket.
  *
@@ -65,56 +352,100 @@ namespace tables {
  *         message.
  */
 Status dockerApi(const std::string& uri, pt::ptree& tree) {
-  static const std::regex httpOkRegex("HTTP/1\\.(0|1) 200 OK\\\r");
+  std::string status_line;
+  std::string body;
 
-  try {
-    local::stream_protocol::endpoint ep(FLAGS_docker_socket);
-    local::stream_protocol::iostream stream(ep);
-    if (!stream) {
-      return Status(
-          1, "Error connecting to docker sock: " + stream.error().message());
-    }
+  std::unique_ptr<DockerConnection> connection;
+  bool reused = false;
+  auto s = acquireDockerConnection(connection, reused);
+  if (!s.ok()) {
+    return s;
+  }
 
-    // Since keep-alive connections are not used, use HTTP/1.0
-    stream << "GET " << uri
-           << " HTTP/1.0\r\nAccept: */*\r\nConnection: close\r\n\r\n"
-           << std::flush;
-    if (stream.eof()) {
-      stream.close();
-      return Status(1, "Empty docker API response for: " + uri);
-    }
+  bool reusable = false;
+  s = connection->get(uri, status_line, body, reusable);
 
-    // All status responses are expected to be 200
-    std::string str;
-    getline(stream, str);
+  // An idle connection may have been closed by the daemon, retry once with
+  // a new connection. The other idle connections are likely closed as well.
+  if (!s.ok() && reused) {
+    clearDockerConnections();
 
-    std::smatch match;
-    if (!std::regex_match(str, match, httpOkRegex)) {
-      stream.close();
-      return Status(1, "Invalid docker API response for " + uri + ": " + str);
+    s = openDockerConnection(connection);
+    if (s.ok()) {
+      s = connection->get(uri, status_line, body, reusable);
     }
+  }
 
-    // Skip empty line between header and body
-    while (!stream.eof() && str != "\r") {
-      getline(stream, str);
-    }
+  if (s.ok() && reusable) {
+    releaseDockerConnection(std::move(connection));
+  }
 
-    try {
-      pt::read_json(stream, tree);
-    } catch (const pt::ptree_error& e) {
-      stream.close();
-      return Status(
-          1, "Error reading docker API response for " + uri + ": " + e.what());
-    }
+  if (!s.ok()) {
+    return s;
+  }
 
-    stream.close();
-  } catch (const std::exception& e) {
-    return Status(1, std::string("Error calling docker API: ") + e.what());
+  // All status responses are expected to be 200
+  if (!boost::starts_with(status_line, "HTTP/1.1 200") &&
+      !boost::starts_with(status_line, "HTTP/1.0 200")) {
+    return Status(
+        1, "Invalid docker API response for " + uri + ": " + status_line);
+  }
+
+  try {
+    std::istringstream stream(body);
+    pt::read_json(stream, tree);
+  } catch (const pt::ptree_error& e) {
+    return Status(
+        1, "Error reading docker API response for " + uri + ": " + e.what());
   }
 
   return Status(0);
 }
 
+/// The result of one of the docker API calls made concurrently.
+struct DockerApiResponse {
+  Status status;
+  pt::ptree tree;
+};
+
+/**
+ * @brief Makes several API calls concurrently.
+ *
+ * Per-container endpoints, such as stats, may block for about a second in the
+ * daemon. The calls are spread over up to docker_api_concurrency threads.
+ *
+ * @param uris Relative URIs to invoke GET HTTP method.
+ * @return The responses, in the order of the URIs.
+ */
+std::vector<DockerApiResponse> dockerApiParallel(
+    const std::vector<std::string>& uris) {
+  std::vector<DockerApiResponse> responses(uris.size());
+
+  std::atomic<size_t> next_uri{0};
+  auto L_Worker = [&uris, &responses, &next_uri]() {
+    for (auto i = next_uri++; i < uris.size(); i = next_uri++) {
+      responses[i].status = dockerApi(uris[i], responses[i].tree);
+    }
+  };
+
+  auto thread_count = std::min(
+      static_cast<size_t>(std::max(FLAGS_docker_api_concurrency, 1U)),
+      uris.size());
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < thread_count; ++i) {
+    threads.emplace_back(L_Worker);
+  }
+
+  // The calling thread works too.
+  L_Worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return responses;
+}
+
 /**
  * @brief Entry point for docker_version table.
  */
@@ -382,6 +713,7 @@ QueryData genContainers(QueryContext& context) {
     return results;
   }
 
+  std::vector<std::string> uris;
   for (const auto& entry : containers) {
     const pt::ptree& container = entry.second;
     Row r;
@@ -403,10 +735,16 @@ QueryData genContainers(QueryContext& context) {
     r["state"] = container.get<std::string>("State", "");
     r["status"] = container.get<std::string>("Status", "");
 
-    pt::ptree container_details;
-    s = dockerApi("/containers/" + r["id"] + "/json?stream=false",
-                  container_details);
-    if (s.ok()) {
+    uris.push_back("/containers/" + r["id"] + "/json?stream=false");
+    results.push_back(std::move(r));
+  }
+
+  // Inspect the containers concurrently.
+  auto responses = dockerApiParallel(uris);
+  for (size_t i = 0; i < results.size(); ++i) {
+    auto& r = results[i];
+    const auto& container_details = responses[i].tree;
+    if (responses[i].status.ok()) {
       r["pid"] =
           BIGINT(container_details.get_child("State").get<pid_t>("Pid", -1));
       r["started_at"] = container_details.get_child("State").get<std::string>(
@@ -464,8 +802,6 @@ QueryData genContainers(QueryContext& context) {
       }
     }
 #endif
-
-    results.push_back(r);
   }
 
   return results;
@@ -602,34 +938,38 @@ QueryData genContainerProcesses(QueryContext& context) {
   QueryData results;
   std::string ps_args;
 
-  for (const auto& id : context.constraints["id"].getAll(EQUALS)) {
-    if (!checkConstraintValue(id)) {
-      continue;
-    }
+  if (isPlatform(PlatformType::TYPE_OSX)) {
+    // osx: 19 fields
+    // currently OS X Docker API will only return
+    // "PID","USER","TIME","COMMAND" fields
+    ps_args =
+        "pid,state,uid,gid,svuid,svgid,rss,vsz,etime,ppid,pgid,wq,nice,user,"
+        "time,pcpu,pmem,comm,command";
+  } else if (isPlatform(PlatformType::TYPE_LINUX)) {
+    // linux: 21 fields
+    ps_args =
+        "pid,state,uid,gid,euid,egid,suid,sgid,rss,vsz,etime,ppid,pgrp,nlwp,"
+        "nice,user,time,pcpu,pmem,comm,cmd";
+  } else {
+    return results;
+  }
 
-    pt::ptree container;
-
-    if (isPlatform(PlatformType::TYPE_OSX)) {
-      // osx: 19 fields
-      // currently OS X Docker API will only return
-      // "PID","USER","TIME","COMMAND" fields
-      ps_args =
-          "pid,state,uid,gid,svuid,svgid,rss,vsz,etime,ppid,pgid,wq,nice,user,"
-          "time,pcpu,pmem,comm,command";
-    } else if (isPlatform(PlatformType::TYPE_LINUX)) {
-      // linux: 21 fields
-      ps_args =
-          "pid,state,uid,gid,euid,egid,suid,sgid,rss,vsz,etime,ppid,pgrp,nlwp,"
-          "nice,user,time,pcpu,pmem,comm,cmd";
-    } else {
-      continue;
+  std::vector<std::string> ids;
+  std::vector<std::string> uris;
+  for (const auto& id : context.constraints["id"].getAll(EQUALS)) {
+    if (checkConstraintValue(id)) {
+      ids.push_back(id);
+      uris.push_back("/containers/" + id + "/top?ps_args=axwwo%20" + ps_args);
     }
+  }
 
-    auto s = dockerApi("/containers/" + id + "/top?ps_args=axwwo%20" + ps_args,
-                       container);
-
-    if (!s.ok()) {
-      VLOG(1) << "Error getting docker container " << id << ": " << s.what();
+  auto responses = dockerApiParallel(uris);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    const auto& id = ids[i];
+    const auto& container = responses[i].tree;
+    if (!responses[i].status.ok()) {
+      VLOG(1) << "Error getting docker container " << id << ": "
+              << responses[i].status.what();
       continue;
     }
 
@@ -784,16 +1124,23 @@ std::string getNetworkBytes(const pt::ptree& tree, const std::string& key) {
  */
 QueryData genContainerStats(QueryContext& context) {
   QueryData results;
+  std::vector<std::string> ids;
+  std::vector<std::string> uris;
   for (const auto& id : context.constraints["id"].getAll(EQUALS)) {
-    if (!checkConstraintValue(id)) {
-      continue;
+    if (checkConstraintValue(id)) {
+      ids.push_back(id);
+      uris.push_back("/containers/" + id + "/stats?stream=false");
     }
+  }
 
-    pt::ptree container;
-    Status s =
-        dockerApi("/containers/" + id + "/stats?stream=false", container);
-    if (!s.ok()) {
-      VLOG(1) << "Error getting docker container " << id << ": " << s.what();
+  // Each stats call blocks while the daemon samples the container.
+  auto responses = dockerApiParallel(uris);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    const auto& id = ids[i];
+    const auto& container = responses[i].tree;
+    if (!responses[i].status.ok()) {
+      VLOG(1) << "Error getting docker container " << id << ": "
+              << responses[i].status.what();
       continue;
     }
 
@@ -14,6 +14,7 @@
 #include <osquery/registry_factory.h>
 #include <osquery/sql.h>
 
+#include "osquery/events/linux/auditfilter.h"
 #include "osquery/tables/events/linux/process_events.h"
 
 namespace osquery {
@@ -70,6 +71,8 @@ Status AuditProcessEventSubscriber::ProcessEvents(
 
   emitted_row_list.reserve(event_list.size());
 
+  auto filter = GetAuditTableFilter("process_events");
+
   for (const auto& event : event_list) {
     if (event.type != AuditEvent::Type::Syscall) {
       continue;
@@ -87,6 +90,10 @@ Status AuditProcessEventSubscriber::ProcessEvents(
       continue;
     }
 
+    if (!filter->accepts(syscall_event_record->fields)) {
+      continue;
+    }
+
     const AuditEventRecord* execve_event_record =
         GetEventRecord(event, AUDIT_EXECVE);
     if (execve_event_record == nullptr) {
@@ -142,7 +149,7 @@ Status AuditProcessEventSubscriber::ProcessEvents(
         row["cmdline"] += " ";
       }
 
-      row["cmdline"] += DecodeAuditPathValues(arg.second);
+      row["cmdline"] += DecodeAuditPathValues(arg.second.to_string());
     }
 
     // There may be a better way to calculate actual size from audit.
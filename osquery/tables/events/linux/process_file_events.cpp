@@ -59,9 +59,24 @@ HIDDEN_FLAG(bool,
             false,
             "Show debug messages for the FIM table");
 
+HIDDEN_FLAG(uint64,
+            audit_fim_state_memory_limit,
+            32,
+            "Memory limit (MB) for the process and inode state of the FIM "
+            "table; least recently used entries are dropped");
+
 REGISTER(ProcessFileEventSubscriber, "event_subscriber", "process_file_events");
 
 namespace {
+/// Removed inode paths are reclaimed when using more than this amount
+const std::size_t kFimMinimumCompactionSize = 64U * 1024U;
+
+/// The memory limit of each one of the FIM state maps
+std::size_t GetFimMapMemoryLimit() {
+  return static_cast<std::size_t>(FLAGS_audit_fim_state_memory_limit) *
+         1024U * 1024U / 2U;
+}
+
 std::ostream& operator<<(std::ostream& stream,
                          AuditdFimSyscallContext::Type type) {
   switch (type) {
@@ -512,14 +527,14 @@ bool HandleFileDescriptorSyscallRecord(
   }
 
   // Complete the syscall context
-  AuditdFimInodeDescriptor* ino_desc;
-  if (!fim_context.inode_map.getReference(ino_desc, fd_desc->inode)) {
+  AuditdFimInodeReference ino_ref;
+  if (!fim_context.inode_map.getReference(ino_ref, fd_desc->inode)) {
     syscall_context.partial = true;
     return true;
   }
 
   AuditdFimIOData data;
-  data.target = ino_desc->path;
+  data.target = ino_ref.path.to_string();
   data.type = (write_operation ? AuditdFimIOData::Type::Write
                                : AuditdFimIOData::Type::Read);
   data.state_changed = state_changed;
@@ -578,14 +593,14 @@ bool HandleCloseSyscallRecord(AuditdFimContext& fim_context,
     return false;
   }
 
-  AuditdFimInodeDescriptor* ino_desc;
-  if (!fim_context.inode_map.getReference(ino_desc, fd_desc.inode)) {
+  AuditdFimInodeReference ino_ref;
+  if (!fim_context.inode_map.getReference(ino_ref, fd_desc.inode)) {
     syscall_context.partial = true;
     return true;
   }
 
   AuditdFimIOData data;
-  data.target = ino_desc->path;
+  data.target = ino_ref.path.to_string();
   data.type = AuditdFimIOData::Type::Close;
   data.state_changed = true;
   syscall_context.syscall_data = data;
@@ -823,8 +838,8 @@ bool HandleOpenOrCreateSyscallRecord(AuditdFimContext& fim_context,
     input_path_working_dir = syscall_context.cwd;
     input_inode = syscall_context.path_record_map[0].inode;
 
-    AuditdFimInodeDescriptor* ino_desc;
-    if (!fim_context.inode_map.getReference(ino_desc, input_inode)) {
+    AuditdFimInodeReference ino_ref;
+    if (!fim_context.inode_map.getReference(ino_ref, input_inode)) {
       syscall_context.partial = true;
       return false;
     }
@@ -1030,6 +1045,14 @@ bool AuditSyscallRecordHandler(AuditdFimContext& fim_context,
                                bool& skip_row_emission) noexcept {
   skip_row_emission = false;
 
+  // The process is gone; drop all of its descriptors at once. This syscall
+  // never returns, so the record has no exit code
+  if (syscall_context.syscall_number == __NR_exit_group) {
+    skip_row_emission = true;
+    fim_context.process_map.remove(syscall_context.process_id);
+    return false;
+  }
+
   if (!GetIntegerFieldFromMap(
           syscall_context.return_value, record.fields, "exit", 16, 0U)) {
     VLOG(1) << "Malformed AUDIT_SYSCALL record received. The "
@@ -1327,199 +1350,295 @@ const std::set<int>& ProcessFileEventSubscriber::GetSyscallSet() noexcept {
                                             __NR_ftruncate,
                                             __NR_clone,
                                             __NR_fork,
-                                            __NR_vfork};
+                                            __NR_vfork,
+                                            __NR_exit_group};
   return syscall_set;
 }
 
+std::uint32_t AuditdFimPathArena::add(boost::string_ref path) {
+  auto offset = static_cast<std::uint32_t>(buffer_.size());
+  buffer_.append(path.data(), path.size());
+  return offset;
+}
+
+void AuditdFimPathArena::release(std::uint32_t size) {
+  released_size_ += size;
+}
+
+boost::string_ref AuditdFimPathArena::get(std::uint32_t offset,
+                                          std::uint32_t size) const {
+  return boost::string_ref(buffer_.data() + offset, size);
+}
+
+std::size_t AuditdFimPathArena::releasedSize() const {
+  return released_size_;
+}
+
+std::size_t AuditdFimPathArena::memoryUsage() const {
+  return buffer_.capacity();
+}
+
+void AuditdFimPathArena::clear() {
+  std::string().swap(buffer_);
+  released_size_ = 0U;
+}
+
+void AuditdFimPathArena::swap(AuditdFimPathArena& other) {
+  buffer_.swap(other.buffer_);
+  std::swap(released_size_, other.released_size_);
+}
+
 AuditdFimInodeMap::AuditdFimInodeMap() {
   save(STDIN_FILENO, AuditdFimInodeDescriptor::Type::File, "stdin");
   save(STDOUT_FILENO, AuditdFimInodeDescriptor::Type::File, "stdout");
   save(STDERR_FILENO, AuditdFimInodeDescriptor::Type::File, "stderr");
 }
 
-bool AuditdFimInodeMap::getReference(AuditdFimInodeDescriptor*& ino_desc,
+bool AuditdFimInodeMap::getReference(AuditdFimInodeReference& ino_ref,
                                      ino_t inode) {
-  auto it = data_.find(inode);
-  if (it == data_.end()) {
+  auto entry = data_.find(inode);
+  if (entry == nullptr) {
     return false;
   }
 
-  ino_desc = &it->second;
+  entry->last_access = ++access_counter_;
+
+  ino_ref.type = entry->type;
+  ino_ref.path = path_arena_.get(entry->path_offset, entry->path_size);
   return true;
 }
 
 bool AuditdFimInodeMap::takeAndRemove(AuditdFimInodeDescriptor& ino_desc,
                                       ino_t inode) {
-  auto it = data_.find(inode);
-  if (it == data_.end()) {
+  auto entry = data_.find(inode);
+  if (entry == nullptr) {
     return false;
   }
 
-  ino_desc = it->second;
-  data_.erase(it);
+  ino_desc.type = entry->type;
+  ino_desc.path =
+      path_arena_.get(entry->path_offset, entry->path_size).to_string();
 
+  remove(inode);
   return true;
 }
 
 void AuditdFimInodeMap::save(ino_t inode,
                              AuditdFimInodeDescriptor::Type type,
                              const std::string& path) {
-  AuditdFimInodeDescriptor ino_desc;
-  ino_desc.type = type;
-  ino_desc.path = path;
+  bool inserted = false;
+  auto& entry = data_.emplace(inode, inserted);
+
+  if (!inserted) {
+    if (path_arena_.get(entry.path_offset, entry.path_size) == path) {
+      entry.type = type;
+      entry.last_access = ++access_counter_;
+      return;
+    }
 
-  data_[inode] = ino_desc;
+    path_arena_.release(entry.path_size);
+  }
 
-  if (data_.size() > 20000) {
-    data_.erase(data_.begin());
+  entry.type = type;
+  entry.path_offset = path_arena_.add(path);
+  entry.path_size = static_cast<std::uint32_t>(path.size());
+  entry.last_access = ++access_counter_;
+
+  if (memoryUsage() > GetFimMapMemoryLimit()) {
+    evict();
   }
 }
 
 void AuditdFimInodeMap::remove(ino_t inode) {
+  auto entry = data_.find(inode);
+  if (entry == nullptr) {
+    return;
+  }
+
+  path_arena_.release(entry->path_size);
   data_.erase(inode);
+
+  if (path_arena_.releasedSize() > kFimMinimumCompactionSize &&
+      path_arena_.releasedSize() * 2U > path_arena_.memoryUsage()) {
+    compactPaths();
+  }
 }
 
 void AuditdFimInodeMap::clear() {
   data_.clear();
+  path_arena_.clear();
 }
 
-AuditdFimFdMap::AuditdFimFdMap(pid_t process_id) {
-  setProcessId(process_id);
+std::size_t AuditdFimInodeMap::size() const {
+  return data_.size();
 }
 
-void AuditdFimFdMap::setProcessId(pid_t process_id) {
-  process_id_ = process_id;
+std::size_t AuditdFimInodeMap::memoryUsage() const {
+  return data_.size() * decltype(data_)::itemSize() +
+         path_arena_.memoryUsage();
 }
 
-bool AuditdFimFdMap::getReference(AuditdFimFdDescriptor*& fd_desc,
-                                  std::uint64_t fd) {
-  auto it = data_.find(fd);
-  if (it == data_.end()) {
-    printUntrackedFdWarning(fd);
-    return false;
-  }
+void AuditdFimInodeMap::evict() {
+  auto memory_limit = GetFimMapMemoryLimit();
+
+  while (data_.size() != 0U && memoryUsage() > memory_limit) {
+    std::vector<std::uint64_t> access_list;
+    access_list.reserve(data_.size());
+    data_.forEach([&access_list](ino_t, const Entry& entry) {
+      access_list.push_back(entry.last_access);
+    });
+
+    // Drop the least recently used quarter of the inodes
+    auto threshold_it = access_list.begin() + (access_list.size() / 4U);
+    std::nth_element(access_list.begin(), threshold_it, access_list.end());
+    auto threshold = *threshold_it;
+
+    std::vector<ino_t> evicted_list;
+    data_.forEach([&evicted_list, threshold](ino_t inode, const Entry& entry) {
+      if (entry.last_access <= threshold) {
+        evicted_list.push_back(inode);
+      }
+    });
 
-  fd_desc = &it->second;
-  return true;
-}
+    for (auto inode : evicted_list) {
+      auto entry = data_.find(inode);
+      path_arena_.release(entry->path_size);
+      data_.erase(inode);
+    }
 
-bool AuditdFimFdMap::duplicate(std::uint64_t fd, std::uint64_t new_fd) {
-  auto it = data_.find(fd);
-  if (it == data_.end()) {
-    printUntrackedFdWarning(fd);
-    return false;
+    compactPaths();
   }
+}
 
-  data_.insert({new_fd, it->second});
-  return true;
+void AuditdFimInodeMap::compactPaths() {
+  AuditdFimPathArena new_arena;
+
+  data_.forEach([this, &new_arena](ino_t, Entry& entry) {
+    auto path = path_arena_.get(entry.path_offset, entry.path_size);
+    entry.path_offset = new_arena.add(path);
+  });
+
+  path_arena_.swap(new_arena);
 }
 
-bool AuditdFimFdMap::takeAndRemove(AuditdFimFdDescriptor& fd_desc,
-                                   std::uint64_t fd) {
-  auto it = data_.find(fd);
-  if (it == data_.end()) {
-    printUntrackedFdWarning(fd);
+bool AuditdFimProcessMap::getReference(AuditdFimFdDescriptor*& fd_desc,
+                                       pid_t process_id,
+                                       std::uint64_t fd) {
+  if (getProcess(process_id) == nullptr) {
+    printUntrackedPidWarning(process_id);
     return false;
   }
 
-  fd_desc = it->second;
-  data_.erase(it);
+  fd_desc = fd_map_.find({process_id, fd});
+  if (fd_desc == nullptr) {
+    printUntrackedFdWarning(process_id);
+    return false;
+  }
 
   return true;
 }
 
-void AuditdFimFdMap::save(std::uint64_t fd,
-                          ino_t inode,
-                          AuditdFimFdDescriptor::OperationType last_operation) {
-  AuditdFimFdDescriptor fd_desc;
-  fd_desc.inode = inode;
-  fd_desc.last_operation = last_operation;
-
-  data_.insert({fd, fd_desc});
-}
+void AuditdFimProcessMap::create(pid_t process_id) {
+  remove(process_id);
 
-void AuditdFimFdMap::clear() {
-  data_.clear();
+  bool inserted = false;
+  process_map_.emplace(process_id, inserted).last_access = ++access_counter_;
 }
 
-void AuditdFimFdMap::printUntrackedFdWarning(std::uint64_t fd) {
-  if (!FLAGS_audit_show_untracked_res_warnings) {
+void AuditdFimProcessMap::remove(pid_t process_id) {
+  auto process = process_map_.find(process_id);
+  if (process == nullptr) {
     return;
   }
 
-  auto current_time = std::time(nullptr);
-  bool show_warning = false;
-
-  if ((current_time - warning_suppression_timer_) > 300) {
-    warning_suppression_timer_ = current_time;
-    show_warning = true;
+  for (auto fd : process->fd_list) {
+    fd_map_.erase({process_id, fd});
   }
 
-  if (show_warning) {
-    VLOG(1) << "Untracked file descriptor from process " << process_id_;
-  }
-}
-
-bool AuditdFimProcessMap::getReference(AuditdFimFdDescriptor*& fd_desc,
-                                       pid_t process_id,
-                                       std::uint64_t fd) {
-  auto process_it = data_.find(process_id);
-  if (process_it == data_.end()) {
-    printUntrackedPidWarning(process_id);
-    return false;
-  }
-
-  AuditdFimFdMap& fd_map = process_it->second;
-  return fd_map.getReference(fd_desc, fd);
-}
-
-void AuditdFimProcessMap::create(pid_t process_id) {
-  auto process_it = data_.find(process_id);
-  if (process_it != data_.end()) {
-    process_it->second.clear();
-  } else {
-    data_.insert({process_id, AuditdFimFdMap(process_id)});
-  }
+  process_map_.erase(process_id);
 }
 
 bool AuditdFimProcessMap::duplicate(pid_t process_id,
                                     std::uint64_t fd,
                                     std::uint64_t new_fd) {
-  auto process_it = data_.find(process_id);
-  if (process_it == data_.end()) {
+  auto process = getProcess(process_id);
+  if (process == nullptr) {
     printUntrackedPidWarning(process_id);
     return false;
   }
 
-  AuditdFimFdMap& fd_map = process_it->second;
-  return fd_map.duplicate(fd, new_fd);
+  auto fd_desc = fd_map_.find({process_id, fd});
+  if (fd_desc == nullptr) {
+    printUntrackedFdWarning(process_id);
+    return false;
+  }
+
+  // dup2/dup3 silently close the target descriptor
+  auto new_fd_desc = *fd_desc;
+  saveDescriptor(*process, process_id, new_fd, new_fd_desc);
+  return true;
 }
 
 bool AuditdFimProcessMap::clone(pid_t old_pid, pid_t new_pid) {
-  auto process_it = data_.find(old_pid);
-  if (process_it == data_.end()) {
+  if (old_pid == new_pid) {
+    return true;
+  }
+
+  auto old_process = getProcess(old_pid);
+  if (old_process == nullptr) {
     printUntrackedPidWarning(old_pid);
     return false;
   }
 
-  AuditdFimFdMap fd_map = process_it->second;
-  fd_map.setProcessId(new_pid);
+  auto fd_list = old_process->fd_list;
+  create(new_pid);
+
+  auto new_process = process_map_.find(new_pid);
+  new_process->fd_list.reserve(fd_list.size());
+
+  for (auto fd : fd_list) {
+    auto fd_desc = fd_map_.find({old_pid, fd});
+    if (fd_desc == nullptr) {
+      continue;
+    }
+
+    auto new_fd_desc = *fd_desc;
+    saveDescriptor(*new_process, new_pid, fd, new_fd_desc);
+  }
+
+  if (memoryUsage() > GetFimMapMemoryLimit()) {
+    evict();
+  }
 
-  data_.insert({new_pid, fd_map});
   return true;
 }
 
 bool AuditdFimProcessMap::takeAndRemove(AuditdFimFdDescriptor& fd_desc,
                                         pid_t process_id,
                                         std::uint64_t fd) {
-  auto process_it = data_.find(process_id);
-  if (process_it == data_.end()) {
+  auto process = getProcess(process_id);
+  if (process == nullptr) {
     printUntrackedPidWarning(process_id);
     return false;
   }
 
-  AuditdFimFdMap& fd_map = process_it->second;
-  return fd_map.takeAndRemove(fd_desc, fd);
+  auto stored_fd_desc = fd_map_.find({process_id, fd});
+  if (stored_fd_desc == nullptr) {
+    printUntrackedFdWarning(process_id);
+    return false;
+  }
+
+  fd_desc = *stored_fd_desc;
+  fd_map_.erase({process_id, fd});
+
+  auto& fd_list = process->fd_list;
+  auto fd_it = std::find(fd_list.begin(), fd_list.end(), fd);
+  if (fd_it != fd_list.end()) {
+    *fd_it = fd_list.back();
+    fd_list.pop_back();
+  }
+
+  return true;
 }
 
 void AuditdFimProcessMap::save(
@@ -1527,23 +1646,105 @@ void AuditdFimProcessMap::save(
     pid_t process_id,
     ino_t inode,
     AuditdFimFdDescriptor::OperationType last_operation) {
-  auto process_it = data_.find(process_id);
-  if (process_it == data_.end()) {
-    process_it = data_.insert({process_id, AuditdFimFdMap(process_id)}).first;
-
-    // Try to limit the amount of processes we are tracking. When
-    // removing, start from the oldest ones
-    if (data_.size() > 4096) {
-      data_.erase(data_.begin());
-    }
+  auto process = getProcess(process_id);
+  if (process == nullptr) {
+    create(process_id);
+    process = process_map_.find(process_id);
   }
 
-  AuditdFimFdMap& fd_map = process_it->second;
-  return fd_map.save(fd, inode, last_operation);
+  AuditdFimFdDescriptor fd_desc;
+  fd_desc.inode = inode;
+  fd_desc.last_operation = last_operation;
+  saveDescriptor(*process, process_id, fd, fd_desc);
+
+  if (memoryUsage() > GetFimMapMemoryLimit()) {
+    evict();
+  }
 }
 
 void AuditdFimProcessMap::clear() {
-  data_.clear();
+  process_map_.clear();
+  fd_map_.clear();
+}
+
+std::size_t AuditdFimProcessMap::processCount() const {
+  return process_map_.size();
+}
+
+std::size_t AuditdFimProcessMap::fdCount() const {
+  return fd_map_.size();
+}
+
+std::size_t AuditdFimProcessMap::memoryUsage() const {
+  return process_map_.size() * decltype(process_map_)::itemSize() +
+         fd_map_.size() *
+             (decltype(fd_map_)::itemSize() + sizeof(std::uint64_t));
+}
+
+AuditdFimProcessMap::ProcessEntry* AuditdFimProcessMap::getProcess(
+    pid_t process_id) {
+  auto process = process_map_.find(process_id);
+  if (process != nullptr) {
+    process->last_access = ++access_counter_;
+  }
+
+  return process;
+}
+
+void AuditdFimProcessMap::saveDescriptor(ProcessEntry& process,
+                                         pid_t process_id,
+                                         std::uint64_t fd,
+                                         const AuditdFimFdDescriptor& fd_desc) {
+  bool inserted = false;
+  fd_map_.emplace({process_id, fd}, inserted) = fd_desc;
+
+  if (inserted) {
+    process.fd_list.push_back(fd);
+  }
+}
+
+void AuditdFimProcessMap::evict() {
+  auto memory_limit = GetFimMapMemoryLimit();
+
+  while (process_map_.size() != 0U && memoryUsage() > memory_limit) {
+    std::vector<std::uint64_t> access_list;
+    access_list.reserve(process_map_.size());
+    process_map_.forEach([&access_list](pid_t, const ProcessEntry& process) {
+      access_list.push_back(process.last_access);
+    });
+
+    // Drop the least recently used quarter of the processes
+    auto threshold_it = access_list.begin() + (access_list.size() / 4U);
+    std::nth_element(access_list.begin(), threshold_it, access_list.end());
+    auto threshold = *threshold_it;
+
+    std::vector<pid_t> evicted_list;
+    process_map_.forEach(
+        [&evicted_list, threshold](pid_t process_id,
+                                   const ProcessEntry& process) {
+          if (process.last_access <= threshold) {
+            evicted_list.push_back(process_id);
+          }
+        });
+
+    for (auto process_id : evicted_list) {
+      remove(process_id);
+    }
+  }
+}
+
+void AuditdFimProcessMap::printUntrackedFdWarning(pid_t pid) {
+  if (!FLAGS_audit_show_untracked_res_warnings) {
+    return;
+  }
+
+  auto current_time = std::time(nullptr);
+  if ((current_time - fd_warning_suppression_timer_) <= 300) {
+    return;
+  }
+
+  fd_warning_suppression_timer_ = current_time;
+  VLOG(1) << "Untracked file descriptor from process " << pid;
 }
 
 void AuditdFimProcessMap::printUntrackedPidWarning(pid_t pid) {
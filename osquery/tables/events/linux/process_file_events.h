@@ -12,11 +12,17 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <limits>
+#include <map>
 #include <set>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include <boost/utility/string_ref.hpp>
 #include <boost/variant.hpp>
 
 #include "osquery/events/linux/auditeventpublisher.h"
@@ -38,13 +44,222 @@ struct AuditdFimFdDescriptor final {
   OperationType last_operation;
 };
 
+/// A reference to an inode descriptor; valid until the inode map is modified
+struct AuditdFimInodeReference final {
+  AuditdFimInodeDescriptor::Type type;
+  boost::string_ref path;
+};
+
+/**
+ * @brief A flat, open addressing hash table (linear probing).
+ *
+ * Values live inline in a single slot array, so lookups don't chase nodes
+ * and the memory used by the table is known from its capacity. Pointers to
+ * values are invalidated by insertions.
+ */
+template <typename Key, typename Value, typename Hasher>
+class AuditdFimFlatTable final {
+ public:
+  /// Returns the value for the given key, or nullptr
+  Value* find(const Key& key) {
+    auto index = findSlot(key);
+    return index == kInvalidIndex ? nullptr : &slot_list_[index].value;
+  }
+
+  /// Returns the value for the given key, inserting a default one if missing
+  Value& emplace(const Key& key, bool& inserted) {
+    inserted = false;
+
+    auto index = findSlot(key);
+    if (index != kInvalidIndex) {
+      return slot_list_[index].value;
+    }
+
+    if ((used_count_ + deleted_count_ + 1U) * 4U > slot_list_.size() * 3U) {
+      // Rehash in place when most of the load is made of deleted slots
+      std::size_t new_capacity = kMinimumCapacity;
+      if (slot_list_.size() > new_capacity) {
+        new_capacity = slot_list_.size();
+      }
+
+      if ((used_count_ + 1U) * 2U > new_capacity) {
+        new_capacity *= 2U;
+      }
+
+      rehash(new_capacity);
+    }
+
+    auto mask = slot_list_.size() - 1U;
+    for (index = Hasher()(key) & mask;
+         slot_list_[index].state == SlotState::Used;
+         index = (index + 1U) & mask) {
+    }
+
+    auto& slot = slot_list_[index];
+    if (slot.state == SlotState::Deleted) {
+      --deleted_count_;
+    }
+
+    slot.key = key;
+    slot.value = Value();
+    slot.state = SlotState::Used;
+    ++used_count_;
+
+    inserted = true;
+    return slot.value;
+  }
+
+  /// Removes the given key, returns false if it was not found
+  bool erase(const Key& key) {
+    auto index = findSlot(key);
+    if (index == kInvalidIndex) {
+      return false;
+    }
+
+    auto& slot = slot_list_[index];
+    slot.value = Value();
+    slot.state = SlotState::Deleted;
+
+    --used_count_;
+    ++deleted_count_;
+    return true;
+  }
+
+  /// Calls the given function for each (key, value) pair
+  template <typename Callable>
+  void forEach(Callable callable) {
+    for (auto& slot : slot_list_) {
+      if (slot.state == SlotState::Used) {
+        callable(static_cast<const Key&>(slot.key), slot.value);
+      }
+    }
+  }
+
+  /// Removes all items and releases the memory
+  void clear() {
+    std::vector<Slot>().swap(slot_list_);
+    used_count_ = 0U;
+    deleted_count_ = 0U;
+  }
+
+  std::size_t size() const {
+    return used_count_;
+  }
+
+  /// Approximate memory used per item, including the load factor headroom
+  static constexpr std::size_t itemSize() {
+    return sizeof(Slot) * 2U;
+  }
+
+ private:
+  enum class SlotState : std::uint8_t { Empty, Used, Deleted };
+
+  struct Slot final {
+    Key key{};
+    Value value{};
+    SlotState state{SlotState::Empty};
+  };
+
+  static constexpr std::size_t kInvalidIndex =
+      std::numeric_limits<std::size_t>::max();
+
+  static constexpr std::size_t kMinimumCapacity = 16U;
+
+  std::size_t findSlot(const Key& key) const {
+    if (slot_list_.empty()) {
+      return kInvalidIndex;
+    }
+
+    auto mask = slot_list_.size() - 1U;
+    for (auto index = Hasher()(key) & mask;; index = (index + 1U) & mask) {
+      const auto& slot = slot_list_[index];
+      if (slot.state == SlotState::Empty) {
+        return kInvalidIndex;
+      }
+
+      if (slot.state == SlotState::Used && slot.key == key) {
+        return index;
+      }
+    }
+  }
+
+  void rehash(std::size_t new_capacity) {
+    std::vector<Slot> old_slot_list(new_capacity);
+    old_slot_list.swap(slot_list_);
+    deleted_count_ = 0U;
+
+    auto mask = slot_list_.size() - 1U;
+    for (auto& old_slot : old_slot_list) {
+      if (old_slot.state != SlotState::Used) {
+        continue;
+      }
+
+      auto index = Hasher()(old_slot.key) & mask;
+      while (slot_list_[index].state == SlotState::Used) {
+        index = (index + 1U) & mask;
+      }
+
+      slot_list_[index] = std::move(old_slot);
+    }
+  }
+
+ private:
+  std::vector<Slot> slot_list_;
+  std::size_t used_count_{0U};
+  std::size_t deleted_count_{0U};
+};
+
+/// Mixes the bits of an integer key (from MurmurHash3)
+struct AuditdFimIntegerHasher final {
+  std::size_t operator()(std::uint64_t value) const {
+    value ^= value >> 33U;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33U;
+    value *= 0xc4ceb3fe1a85ec53ULL;
+    value ^= value >> 33U;
+    return static_cast<std::size_t>(value);
+  }
+};
+
+/**
+ * @brief Append-only storage for the paths of the inode map.
+ *
+ * Paths are referenced by offset and size. Removed paths are only accounted
+ * for; their space is reclaimed when the owner copies the live paths into a
+ * new arena.
+ */
+class AuditdFimPathArena final {
+ public:
+  /// Copies the given path into the arena, returns its offset
+  std::uint32_t add(boost::string_ref path);
+
+  /// Marks a path of the given size as unused
+  void release(std::uint32_t size);
+
+  /// Returns a view of the path at the given offset
+  boost::string_ref get(std::uint32_t offset, std::uint32_t size) const;
+
+  /// Bytes used by removed paths
+  std::size_t releasedSize() const;
+
+  /// Bytes used by all paths
+  std::size_t memoryUsage() const;
+
+  void clear();
+  void swap(AuditdFimPathArena& other);
+
+ private:
+  std::string buffer_;
+  std::size_t released_size_{0U};
+};
+
 /// A global inode map
 class AuditdFimInodeMap final {
  public:
   AuditdFimInodeMap();
 
   /// Returns a reference to the specified inode object
-  bool getReference(AuditdFimInodeDescriptor*& ino_desc, ino_t inode);
+  bool getReference(AuditdFimInodeReference& ino_ref, ino_t inode);
 
   /// Removes and returns the specified inode object
   bool takeAndRemove(AuditdFimInodeDescriptor& ino_desc, ino_t inode);
@@ -60,53 +275,55 @@ class AuditdFimInodeMap final {
   /// Removes all inodes from the map
   void clear();
 
- private:
-  /// The global inode map
-  std::map<ino_t, AuditdFimInodeDescriptor> data_;
-};
-
-/// Contains
-class AuditdFimFdMap final {
- public:
-  AuditdFimFdMap(pid_t process_id);
+  /// Returns the number of tracked inodes
+  std::size_t size() const;
 
-  /// Sets the new proces id that owns this fd map
-  void setProcessId(pid_t process_id);
+  /// Approximate memory used by the map
+  std::size_t memoryUsage() const;
 
-  /// Returns a reference to the specified fd object
-  bool getReference(AuditdFimFdDescriptor*& fd_desc, std::uint64_t fd);
+ private:
+  struct Entry final {
+    AuditdFimInodeDescriptor::Type type;
+    std::uint32_t path_offset;
+    std::uint32_t path_size;
+    std::uint64_t last_access;
+  };
 
-  /// Duplicates the specified fd (used for dup/dup2/dup3)
-  bool duplicate(std::uint64_t fd, std::uint64_t new_fd);
+  /// Drops the least recently used inodes until within the memory limit
+  void evict();
 
-  /// Removes and returns the specified fd object
-  bool takeAndRemove(AuditdFimFdDescriptor& fd_desc, std::uint64_t fd);
+  /// Copies the live paths into a new arena, dropping the removed ones
+  void compactPaths();
 
-  /// Saves a new fd in the map
-  void save(std::uint64_t fd,
-            ino_t inode,
-            AuditdFimFdDescriptor::OperationType last_operation =
-                AuditdFimFdDescriptor::OperationType::Open);
+ private:
+  /// The global inode map
+  AuditdFimFlatTable<ino_t, Entry, AuditdFimIntegerHasher> data_;
 
-  /// Removes all items from the map
-  void clear();
+  /// The storage for the inode paths
+  AuditdFimPathArena path_arena_;
 
- private:
-  /// Prints a warning when an untracked fd is found
-  void printUntrackedFdWarning(std::uint64_t fd);
+  /// Incremented on each access, used for LRU eviction
+  std::uint64_t access_counter_{0U};
+};
 
- private:
-  /// The process id that owns this fd map
-  pid_t process_id_;
+/// The key of the fd map, a file descriptor of a process
+struct AuditdFimFdKey final {
+  pid_t process_id;
+  std::uint64_t fd;
 
-  /// A time-based filter to avoid spamming the warning log
-  std::time_t warning_suppression_timer_{0};
+  bool operator==(const AuditdFimFdKey& other) const {
+    return process_id == other.process_id && fd == other.fd;
+  }
+};
 
-  /// A map of all the known file descriptors for this process
-  std::unordered_map<std::uint64_t, AuditdFimFdDescriptor> data_;
+struct AuditdFimFdKeyHasher final {
+  std::size_t operator()(const AuditdFimFdKey& key) const {
+    return AuditdFimIntegerHasher()(
+        (static_cast<std::uint64_t>(key.process_id) << 32U) ^ key.fd);
+  }
 };
 
-/// A utility class to track processes and their fd maps
+/// A utility class to track processes and their file descriptors
 class AuditdFimProcessMap final {
  public:
   /// Returns a reference to the specified fd object
@@ -117,6 +334,9 @@ class AuditdFimProcessMap final {
   /// Creates a new empty process
   void create(pid_t process_id);
 
+  /// Removes the specified process and all of its file descriptors
+  void remove(pid_t process_id);
+
   /// Duplicates the specified fd. Used for dup/dup2/dup3
   bool duplicate(pid_t process_id, std::uint64_t fd, std::uint64_t new_fd);
 
@@ -138,16 +358,57 @@ class AuditdFimProcessMap final {
   /// Removes all items
   void clear();
 
+  /// Returns the number of tracked processes
+  std::size_t processCount() const;
+
+  /// Returns the number of tracked file descriptors
+  std::size_t fdCount() const;
+
+  /// Approximate memory used by the map
+  std::size_t memoryUsage() const;
+
  private:
+  struct ProcessEntry final {
+    /// The file descriptors of this process, to copy or drop them in bulk
+    std::vector<std::uint64_t> fd_list;
+
+    std::uint64_t last_access;
+  };
+
+  /// Returns the specified process, and marks it as recently used
+  ProcessEntry* getProcess(pid_t process_id);
+
+  /// Stores a descriptor, adding the fd to the process when it is new
+  void saveDescriptor(ProcessEntry& process,
+                      pid_t process_id,
+                      std::uint64_t fd,
+                      const AuditdFimFdDescriptor& fd_desc);
+
+  /// Drops the least recently used processes until within the memory limit
+  void evict();
+
   /// Prints a warning (VLOG) when an untracked pid is found
   void printUntrackedPidWarning(pid_t pid);
 
+  /// Prints a warning when an untracked fd is found
+  void printUntrackedFdWarning(pid_t pid);
+
  private:
   /// Time-based filtering to avoid spamming the warning log
   std::map<pid_t, std::time_t> warning_suppression_filter_;
 
-  /// An fd map for each process
-  std::map<pid_t, AuditdFimFdMap> data_;
+  /// A time-based filter for the untracked fd warning
+  std::time_t fd_warning_suppression_timer_{0};
+
+  /// The tracked processes
+  AuditdFimFlatTable<pid_t, ProcessEntry, AuditdFimIntegerHasher> process_map_;
+
+  /// The file descriptors of all the tracked processes
+  AuditdFimFlatTable<AuditdFimFdKey, AuditdFimFdDescriptor, AuditdFimFdKeyHasher>
+      fd_map_;
+
+  /// Incremented on each access, used for LRU eviction
+  std::uint64_t access_counter_{0U};
 };
 
 /// A simple vector of strings
@@ -17,6 +17,7 @@
 
 #include "osquery/core/conversions.h"
 #include "osquery/events/linux/auditeventpublisher.h"
+#include "osquery/events/linux/auditfilter.h"
 #include "osquery/tables/events/linux/socket_events.h"
 
 namespace osquery {
@@ -123,6 +124,8 @@ Status SocketEventSubscriber::ProcessEvents(
 
   emitted_row_list.reserve(event_list.size());
 
+  auto filter = GetAuditTableFilter("socket_events");
+
   for (const auto& event : event_list) {
     if (event.type != AuditEvent::Type::Syscall) {
       continue;
@@ -194,6 +197,18 @@ Status SocketEventSubscriber::ProcessEvents(
       continue;
     }
 
+    if (!filter->empty()) {
+      long family = -1;
+      if (!safeStrtol(row["family"], 10, family).ok()) {
+        family = -1;
+      }
+
+      if (!filter->accepts(syscall_event_record->fields,
+                           static_cast<int>(family))) {
+        continue;
+      }
+    }
+
     emitted_row_list.push_back(row);
   }
 
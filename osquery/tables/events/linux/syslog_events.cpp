@@ -54,8 +54,9 @@ class SyslogEventSubscriber : public EventSubscriber<SyslogEventPublisher> {
 REGISTER(SyslogEventSubscriber, "event_subscriber", "syslog_events");
 
 Status SyslogEventSubscriber::Callback(const ECRef& ec, const SCRef& sc) {
-  Row r(ec->fields);
-  add(r);
+  // The rows are copied, other subscribers may receive the same context.
+  auto rows = ec->rows;
+  addBatch(rows);
   return Status(0, "OK");
 }
 }
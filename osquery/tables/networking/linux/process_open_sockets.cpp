@@ -54,24 +54,21 @@ QueryData genOpenSockets(QueryContext& context) {
    * sockets associated with pids in the list, so it will also be used to filter
    * the sockets later if pid_filter is set.
    *
-   * 2. Collect the inode for the network namespace associated with each pid.
-   * Every time a new namespace is found execute step 3 to get socket basic
-   * information.
+   * 2. Collect the inode for the network namespace associated with each pid,
+   * and remember the first pid found in each namespace.
    *
-   * 3. Collect basic socket information for all sockets under a specifc network
-   * namespace. This is done by reading through files under /proc/<pid>/net for
-   * the first pid we find in a certain namespace. Notice this will collect
-   * information for all sockets on the namespace not only for sockets
-   * associated with the specific pid, therefore only needs to be run once. From
-   * this step we collect the inodes of each of the sockets, and will use that
-   * to correlate the socket information with the information collect on steps
-   * 1 and 2.
+   * 3. For each namespace, collect basic socket information for all of its
+   * sockets. In the namespace of osquery this is requested from the kernel
+   * with NETLINK_SOCK_DIAG, other namespaces are read from /proc/<pid>/net
+   * using the first pid found in the namespace. The socket inodes are
+   * correlated with the information collected on steps 1 and 2, and the rows
+   * of a namespace are added before the next one is enumerated.
    */
 
-  /* Use a set to record the namespaces already processed */
-  std::set<ino_t> netns_list;
+  /* Record the namespaces in the order they are found */
+  std::vector<std::pair<ino_t, std::string>> netns_list;
+  std::set<ino_t> netns_seen;
   SocketInodeToProcessInfoMap inode_proc_map;
-  SocketInfoList socket_list;
   for (const auto& pid : pids) {
     /* Step 1 */
     status = procGetSocketInodeToProcessInfoMap(pid, inode_proc_map);
@@ -98,69 +95,125 @@ QueryData genOpenSockets(QueryContext& context) {
               << pid << ": " << status.what();
     }
 
-    if (netns_list.count(ns) == 0) {
-      netns_list.insert(ns);
-
-      /* Step 3 */
-      for (const auto& pair : kLinuxProtocolNames) {
-        status = procGetSocketList(AF_INET, pair.first, ns, pid, socket_list);
-        if (!status.ok()) {
-          VLOG(1)
-              << "Results for process_open_sockets might be incomplete. Failed "
-                 "to acquire basic socket information for AF_INET "
-              << pair.second << ": " << status.what();
-        }
+    if (netns_seen.insert(ns).second) {
+      netns_list.push_back(std::make_pair(ns, pid));
+    }
+  }
+
+  /* The constrained pids do not own any socket. */
+  if (pid_filter && inode_proc_map.empty()) {
+    return results;
+  }
+
+  /* Only enumerate the families, protocols and TCP states that are asked for.
+   * SQLite filters the rows again, this only has to select a superset.
+   */
+  auto families = context.constraints["family"].getAll<int>(EQUALS);
+  auto protocols = context.constraints["protocol"].getAll<int>(EQUALS);
+  auto L_Enumerate = [&families, &protocols](int family, int protocol) {
+    return (families.empty() || families.count(family) > 0) &&
+           (protocols.empty() || protocols.count(protocol) > 0);
+  };
+
+  std::uint32_t tcp_state_mask = ~0U;
+  if (context.constraints["state"].exists(EQUALS)) {
+    tcp_state_mask = 0U;
+    for (const auto& state : context.constraints["state"].getAll(EQUALS)) {
+      auto it = std::find(tcp_states.begin(), tcp_states.end(), state);
+      if (it == tcp_states.begin()) {
+        /* Out of range states are reported as UNKNOWN. */
+        tcp_state_mask = ~0U;
+        break;
+      } else if (it != tcp_states.end()) {
+        tcp_state_mask |= 1U << (it - tcp_states.begin());
+      }
+    }
+  }
+
+  ino_t self_ns = 0;
+  if (!procGetNetNamespace(self_ns).ok()) {
+    VLOG(1) << "Failed to acquire the network namespace of osquery";
+  }
 
-        status = procGetSocketList(AF_INET6, pair.first, ns, pid, socket_list);
-        if (!status.ok()) {
-          VLOG(1)
-              << "Results for process_open_sockets might be incomplete. Failed "
-                 "to acquire basic socket information for AF_INET6 "
-              << pair.second << ": " << status.what();
+  /* Finally correlate all the information. Go through the sockets of the
+   * namespace and correlate them with the pid and fd collected from step 1.
+   * If filtering only take sockets for which the inode is available on the
+   * inode to process information map.
+   */
+  auto L_AddRows = [&results, &inode_proc_map, pid_filter](
+                       const SocketInfoList& socket_list) {
+    for (const auto& info : socket_list) {
+      Row r;
+      auto proc_it = inode_proc_map.find(info.socket);
+      if (proc_it != inode_proc_map.end()) {
+        r["pid"] = proc_it->second.pid;
+        r["fd"] = proc_it->second.fd;
+      } else if (!pid_filter) {
+        r["pid"] = "-1";
+        r["fd"] = "-1";
+      } else {
+        /* If we're filtering by pid we only care about sockets associated
+         * with pids on the list.*/
+        continue;
+      }
+
+      r["socket"] = info.socket;
+      r["family"] = std::to_string(info.family);
+      r["protocol"] = std::to_string(info.protocol);
+      r["local_address"] = info.local_address;
+      r["local_port"] = std::to_string(info.local_port);
+      r["remote_address"] = info.remote_address;
+      r["remote_port"] = std::to_string(info.remote_port);
+      r["path"] = info.unix_socket_path;
+      r["state"] = info.state;
+      r["net_namespace"] = std::to_string(info.net_ns);
+
+      results.push_back(std::move(r));
+    }
+  };
+
+  const auto* inode_filter = (pid_filter) ? &inode_proc_map : nullptr;
+  for (const auto& netns : netns_list) {
+    auto ns = netns.first;
+    const auto& pid = netns.second;
+    bool sock_diag = (ns == self_ns);
+
+    /* Step 3 */
+    auto L_GetSocketList = [&](int family, int protocol) {
+      if (!L_Enumerate(family, protocol)) {
+        return;
+      }
+
+      SocketInfoList socket_list;
+      if (sock_diag) {
+        status = procGetSocketListDiag(
+            family, protocol, ns, tcp_state_mask, inode_filter, socket_list);
+        if (status.ok()) {
+          L_AddRows(socket_list);
+          return;
+        } else if (family == AF_UNIX || protocol == IPPROTO_TCP) {
+          /* Without the diag modules every request would fail. */
+          VLOG(1) << "Falling back to /proc/net: " << status.what();
+          sock_diag = false;
         }
+        socket_list.clear();
       }
-      status = procGetSocketList(AF_UNIX, IPPROTO_IP, ns, pid, socket_list);
+
+      status = procGetSocketList(family, protocol, ns, pid, socket_list);
       if (!status.ok()) {
         VLOG(1)
             << "Results for process_open_sockets might be incomplete. Failed "
-               "to acquire basic socket information for AF_UNIX: "
-            << status.what();
+               "to acquire basic socket information for family "
+            << family << " and protocol " << protocol << ": " << status.what();
       }
-    }
-  }
+      L_AddRows(socket_list);
+    };
 
-  /* Finally correlate all the information. Go through all the sockets
-   * collected on step 3 and correlate that with the pid and fd collected from
-   * step 1. If filtering only take sockets for which the inode is available on
-   * the inode to process information map.
-   */
-  for (const auto& info : socket_list) {
-    Row r;
-    auto proc_it = inode_proc_map.find(info.socket);
-    if (proc_it != inode_proc_map.end()) {
-      r["pid"] = proc_it->second.pid;
-      r["fd"] = proc_it->second.fd;
-    } else if (!pid_filter) {
-      r["pid"] = "-1";
-      r["fd"] = "-1";
-    } else {
-      /* If we're filtering by pid we only care about sockets associated with
-       * pids on the list.*/
-      continue;
+    for (const auto& pair : kLinuxProtocolNames) {
+      L_GetSocketList(AF_INET, pair.first);
+      L_GetSocketList(AF_INET6, pair.first);
     }
-
-    r["socket"] = info.socket;
-    r["family"] = std::to_string(info.family);
-    r["protocol"] = std::to_string(info.protocol);
-    r["local_address"] = info.local_address;
-    r["local_port"] = std::to_string(info.local_port);
-    r["remote_address"] = info.remote_address;
-    r["remote_port"] = std::to_string(info.remote_port);
-    r["path"] = info.unix_socket_path;
-    r["state"] = info.state;
-    r["net_namespace"] = std::to_string(info.net_ns);
-
-    results.push_back(std::move(r));
+    L_GetSocketList(AF_UNIX, IPPROTO_IP);
   }
 
   return results;
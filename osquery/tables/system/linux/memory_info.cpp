@@ -10,13 +10,14 @@
 
 #include <string>
 
-#include <boost/algorithm/string.hpp>
+#include <fcntl.h>
 
 #include <osquery/core.h>
-#include <osquery/tables.h>
 #include <osquery/filesystem.h>
+#include <osquery/tables.h>
 
 #include "osquery/core/conversions.h"
+#include "osquery/filesystem/linux/proc.h"
 
 namespace osquery {
 namespace tables {
@@ -39,19 +40,20 @@ QueryData getMemoryInfo(QueryContext& context) {
   QueryData results;
   Row r;
 
-  std::string meminfo_content;
-  if (forensicReadFile(kMemInfoPath, meminfo_content).ok()) {
+  boost::string_ref meminfo_content;
+  if (procReadFile(AT_FDCWD, kMemInfoPath.c_str(), meminfo_content).ok()) {
     // Able to read meminfo file, now grab info we want
-    for (const auto& line : split(meminfo_content, "\n")) {
-      std::vector<std::string> tokens;
-      boost::split(
-          tokens, line, boost::is_any_of("\t "), boost::token_compress_on);
+    ProcTokenizer lines(meminfo_content, "\n");
+    boost::string_ref line;
+    while (lines.next(line)) {
       // Look for mapping
       for (const auto& singleMap : kMemInfoMap) {
-        if (line.find(singleMap.second) == 0) {
-          long value = 0;
-          if (safeStrtol(tokens[1], 10, value)) {
-            r[singleMap.first] = BIGINT(value * 1024l);
+        if (line.starts_with(singleMap.second)) {
+          boost::string_ref value;
+          ProcTokenizer tokens(line.substr(singleMap.second.size()), "\t ");
+          std::uint64_t kilobytes = 0;
+          if (tokens.next(value) && procParseUInt(value, kilobytes)) {
+            r[singleMap.first] = BIGINT(kilobytes * 1024);
           }
           break;
         }
@@ -27,12 +27,18 @@ QueryData genMounts(QueryContext& context) {
     return {};
   }
 
+  // The entry strings are stored in a buffer reused for every line.
+  struct mntent entry;
+  char buffer[4096];
   struct mntent* ent = nullptr;
-  while ((ent = getmntent(mounts))) {
+  while ((ent = getmntent_r(mounts, &entry, buffer, sizeof(buffer)))) {
     Row r;
 
     r["device"] = std::string(ent->mnt_fsname);
-    r["device_alias"] = canonicalize_file_name(ent->mnt_fsname);
+    // Pseudo filesystems do not have a device path to resolve.
+    r["device_alias"] = (ent->mnt_fsname[0] == '/')
+                            ? canonicalize_file_name(ent->mnt_fsname)
+                            : r["device"];
     r["path"] = std::string(ent->mnt_dir);
     r["type"] = std::string(ent->mnt_type);
     r["flags"] = std::string(ent->mnt_opts);
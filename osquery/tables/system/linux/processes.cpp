@@ -10,7 +10,11 @@
 
 #include <map>
 #include <string>
+#include <unordered_map>
 
+#include <climits>
+
+#include <fcntl.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -24,6 +28,7 @@
 #include <osquery/filesystem.h>
 #include <osquery/filesystem/linux/proc.h>
 #include <osquery/logger.h>
+#include <osquery/mutex.h>
 #include <osquery/tables.h>
 
 #include "osquery/core/conversions.h"
@@ -39,51 +44,19 @@ inline std::string getProcAttr(const std::string& attr,
   return "/proc/" + pid + "/" + attr;
 }
 
-inline std::string readProcCMDLine(const std::string& pid) {
-  auto attr = getProcAttr("cmdline", pid);
+inline std::string readProcCMDLine(const ProcDirectory& proc) {
+  boost::string_ref content;
+  proc.read("cmdline", content);
 
-  std::string content;
-  readFile(attr, content);
+  std::string cmdline = content.to_string();
   // Remove \0 delimiters.
-  std::replace_if(content.begin(),
-                  content.end(),
+  std::replace_if(cmdline.begin(),
+                  cmdline.end(),
                   [](const char& c) { return c == 0; },
                   ' ');
   // Remove trailing delimiter.
-  boost::algorithm::trim(content);
-  return content;
-}
-
-inline std::string readProcLink(const std::string& attr,
-                                const std::string& pid) {
-  // The exe is a symlink to the binary on-disk.
-  auto attr_path = getProcAttr(attr, pid);
-
-  std::string result = "";
-  struct stat sb;
-  if (lstat(attr_path.c_str(), &sb) != -1) {
-    // Some symlinks may report 'st_size' as zero
-    // Use PATH_MAX as best guess
-    // For cases when 'st_size' is not zero but smaller than
-    // PATH_MAX we will still use PATH_MAX to minimize chance
-    // of output trucation during race condition
-    ssize_t buf_size = sb.st_size < PATH_MAX ? PATH_MAX : sb.st_size;
-    // +1 for \0, since readlink does not append a null
-    char* linkname = static_cast<char*>(malloc(buf_size + 1));
-    ssize_t r = readlink(attr_path.c_str(), linkname, buf_size);
-
-    if (r > 0) { // Success check
-      // r may not be equal to buf_size
-      // if r == buf_size there was race condition
-      // and link is longer than buf_size and because of this
-      // truncated
-      linkname[r] = '\0';
-      result = std::string(linkname);
-    }
-    free(linkname);
-  }
-
-  return result;
+  boost::algorithm::trim(cmdline);
+  return cmdline;
 }
 
 // In the case where the linked binary path ends in " (deleted)", and a file
@@ -157,47 +130,49 @@ void genProcessEnvironment(const std::string& pid, QueryData& results) {
 }
 
 void genProcessMap(const std::string& pid, QueryData& results) {
-  auto map = getProcAttr("maps", pid);
-
-  std::string content;
-  readFile(map, content);
-  for (auto& line : osquery::split(content, "\n")) {
-    auto fields = osquery::split(line, " ");
+  boost::string_ref content;
+  procReadFile(AT_FDCWD, getProcAttr("maps", pid).c_str(), content);
+
+  ProcTokenizer lines(content, "\n");
+  boost::string_ref line;
+  while (lines.next(line)) {
+    // The address range, permissions, offset, device and inode fields.
+    boost::string_ref fields[5];
+    size_t count = 0;
+    ProcTokenizer tokens(line, " ");
+    while (count < 5 && tokens.next(fields[count])) {
+      count++;
+    }
     // If can't read address, not sure.
-    if (fields.size() < 5) {
+    if (count < 5) {
       continue;
     }
 
-    Row r;
-    r["pid"] = pid;
-    if (!fields[0].empty()) {
-      auto addresses = osquery::split(fields[0], "-");
-      if (addresses.size() >= 2) {
-        r["start"] = "0x" + addresses[0];
-        r["end"] = "0x" + addresses[1];
-      } else {
-        // Problem with the address format.
-        continue;
-      }
+    auto delim = fields[0].find('-');
+    if (delim == boost::string_ref::npos) {
+      // Problem with the address format.
+      continue;
     }
 
-    r["permissions"] = fields[1];
-    try {
-      auto offset = std::stoll(fields[2], nullptr, 16);
-      r["offset"] = (offset != 0) ? BIGINT(offset) : r["start"];
+    Row r;
+    r["pid"] = pid;
+    r["start"] = "0x" + fields[0].substr(0, delim).to_string();
+    r["end"] = "0x" + fields[0].substr(delim + 1).to_string();
+    r["permissions"] = fields[1].to_string();
 
-    } catch (const std::exception& e) {
+    std::uint64_t offset = 0;
+    if (!procParseHex(fields[2], offset) ||
+        offset > static_cast<std::uint64_t>(LLONG_MAX)) {
       // Value was out of range or could not be interpreted as a hex long long.
       r["offset"] = "-1";
+    } else {
+      r["offset"] = (offset != 0) ? BIGINT(offset) : r["start"];
     }
-    r["device"] = fields[3];
-    r["inode"] = fields[4];
+    r["device"] = fields[3].to_string();
+    r["inode"] = fields[4].to_string();
 
-    // Path name must be trimmed.
-    if (fields.size() > 5) {
-      boost::trim(fields[5]);
-      r["path"] = fields[5];
-    }
+    // Path name is the rest of the line, and must be trimmed.
+    r["path"] = procTrim(tokens.rest()).to_string();
 
     // BSS with name in pathname.
     r["pseudo"] = (fields[4] == "0" && !r["path"].empty()) ? "1" : "0";
@@ -228,77 +203,115 @@ struct SimpleProcStat : private boost::noncopyable {
   std::string system_time;
   std::string start_time;
 
+  /**
+   * @brief Identifies a single process image.
+   *
+   * The start time (in clock ticks) tells apart a reused pid, the argument
+   * block addresses change when the process calls exec.
+   */
+  std::string exec_id;
+
   /// For errors processing proc data.
   Status status;
 
-  explicit SimpleProcStat(const std::string& pid);
+  explicit SimpleProcStat(const ProcDirectory& proc);
 };
 
-SimpleProcStat::SimpleProcStat(const std::string& pid) {
-  std::string content;
-  if (readFile(getProcAttr("stat", pid), content).ok()) {
-    auto start = content.find_last_of(")");
+/// The fields of /proc/<pid>/stat following the command name.
+const size_t kProcStatFields = 47;
+
+SimpleProcStat::SimpleProcStat(const ProcDirectory& proc) {
+  boost::string_ref content;
+  if (proc.read("stat", content).ok()) {
+    auto start = content.rfind(')');
     // Start parsing stats from ") <MODE>..."
-    if (start == std::string::npos || content.size() <= start + 2) {
+    if (start == boost::string_ref::npos || content.size() <= start + 2) {
       status = Status(1, "Invalid /proc/stat header");
       return;
     }
 
-    auto details = osquery::split(content.substr(start + 2), " ");
-    if (details.size() <= 19) {
+    boost::string_ref details[kProcStatFields];
+    size_t count = 0;
+    ProcTokenizer tokens(content.substr(start + 2), " \n");
+    while (count < kProcStatFields && tokens.next(details[count])) {
+      count++;
+    }
+
+    std::uint64_t start_ticks = 0;
+    if (count <= 19 || !procParseUInt(details[19], start_ticks)) {
       status = Status(1, "Invalid /proc/stat content");
       return;
     }
 
-    this->state = details.at(0);
-    this->parent = details.at(1);
-    this->group = details.at(2);
-    this->user_time = details.at(11);
-    this->system_time = details.at(12);
-    this->nice = details.at(16);
-    this->threads = details.at(17);
-    this->start_time = TEXT(std::stol(details.at(19)) / 100);
+    this->state = details[0].to_string();
+    this->parent = details[1].to_string();
+    this->group = details[2].to_string();
+    this->user_time = details[11].to_string();
+    this->system_time = details[12].to_string();
+    this->nice = details[16].to_string();
+    this->threads = details[17].to_string();
+    this->start_time = TEXT(start_ticks / 100);
+    this->exec_id = details[19].to_string();
+    // The arg_start and arg_end fields were added in Linux 3.5.
+    if (count > 46) {
+      this->exec_id += ":" + details[45].to_string() + ":" +
+                       details[46].to_string();
+    }
   }
 
   // /proc/N/status may be not available, or readable by this user.
-  if (!readFile(getProcAttr("status", pid), content).ok()) {
+  if (!proc.read("status", content).ok()) {
     status = Status(1, "Cannot read /proc/status");
     return;
   }
 
-  for (const auto& line : osquery::split(content, "\n")) {
+  // Memory is reported in kB.
+  auto L_Kilobytes = [](boost::string_ref value) {
+    if (value.ends_with("kB")) {
+      value.remove_suffix(2);
+    }
+    return procTrim(value).to_string() + "000";
+  };
+
+  // Format is: R E S F
+  auto L_Ids = [](boost::string_ref value,
+                  std::string& real,
+                  std::string& effective,
+                  std::string& saved) {
+    boost::string_ref ids[5];
+    size_t count = 0;
+    ProcTokenizer tokens(value, "\t ");
+    while (count < 5 && tokens.next(ids[count])) {
+      count++;
+    }
+    if (count == 4) {
+      real = ids[0].to_string();
+      effective = ids[1].to_string();
+      saved = ids[2].to_string();
+    }
+  };
+
+  ProcTokenizer lines(content, "\n");
+  boost::string_ref line;
+  while (lines.next(line)) {
     // Status lines are formatted: Key: Value....\n.
-    auto detail = osquery::split(line, ':', 1);
-    if (detail.size() != 2) {
+    boost::string_ref key;
+    boost::string_ref value;
+    if (!procSplitKeyValue(line, key, value)) {
       continue;
     }
 
     // There are specific fields from each detail.
-    if (detail.at(0) == "Name") {
-      this->name = detail.at(1);
-    } else if (detail.at(0) == "VmRSS") {
-      detail[1].erase(detail.at(1).end() - 3, detail.at(1).end());
-      // Memory is reported in kB.
-      this->resident_size = detail.at(1) + "000";
-    } else if (detail.at(0) == "VmSize") {
-      detail[1].erase(detail.at(1).end() - 3, detail.at(1).end());
-      // Memory is reported in kB.
-      this->total_size = detail.at(1) + "000";
-    } else if (detail.at(0) == "Gid") {
-      // Format is: R E - -
-      auto gid_detail = osquery::split(detail.at(1), "\t");
-      if (gid_detail.size() == 4) {
-        this->real_gid = gid_detail.at(0);
-        this->effective_gid = gid_detail.at(1);
-        this->saved_gid = gid_detail.at(2);
-      }
-    } else if (detail.at(0) == "Uid") {
-      auto uid_detail = osquery::split(detail.at(1), "\t");
-      if (uid_detail.size() == 4) {
-        this->real_uid = uid_detail.at(0);
-        this->effective_uid = uid_detail.at(1);
-        this->saved_uid = uid_detail.at(2);
-      }
+    if (key == "Name") {
+      this->name = value.to_string();
+    } else if (key == "VmRSS") {
+      this->resident_size = L_Kilobytes(value);
+    } else if (key == "VmSize") {
+      this->total_size = L_Kilobytes(value);
+    } else if (key == "Gid") {
+      L_Ids(value, this->real_gid, this->effective_gid, this->saved_gid);
+    } else if (key == "Uid") {
+      L_Ids(value, this->real_uid, this->effective_uid, this->saved_uid);
     }
   }
 }
@@ -315,31 +328,34 @@ struct SimpleProcIo : private boost::noncopyable {
   /// For errors processing proc data.
   Status status;
 
-  explicit SimpleProcIo(const std::string& pid);
+  SimpleProcIo(const std::string& pid, const ProcDirectory& proc);
 };
 
-SimpleProcIo::SimpleProcIo(const std::string& pid) {
-  std::string content;
-  if (!readFile(getProcAttr("io", pid), content).ok()) {
+SimpleProcIo::SimpleProcIo(const std::string& pid, const ProcDirectory& proc) {
+  boost::string_ref content;
+  if (!proc.read("io", content).ok()) {
     status = Status(
         1, "Cannot read /proc/" + pid + "/io (is osquery running as root?)");
     return;
   }
 
-  for (const auto& line : osquery::split(content, "\n")) {
+  ProcTokenizer lines(content, "\n");
+  boost::string_ref line;
+  while (lines.next(line)) {
     // IO lines are formatted: Key: Value....\n.
-    auto detail = osquery::split(line, ':', 1);
-    if (detail.size() != 2) {
+    boost::string_ref key;
+    boost::string_ref value;
+    if (!procSplitKeyValue(line, key, value)) {
       continue;
     }
 
     // There are specific fields from each detail
-    if (detail.at(0) == "read_bytes") {
-      this->read_bytes = detail.at(1);
-    } else if (detail.at(0) == "write_bytes") {
-      this->write_bytes = detail.at(1);
-    } else if (detail.at(0) == "cancelled_write_bytes") {
-      this->cancelled_write_bytes = detail.at(1);
+    if (key == "read_bytes") {
+      this->read_bytes = value.to_string();
+    } else if (key == "write_bytes") {
+      this->write_bytes = value.to_string();
+    } else if (key == "cancelled_write_bytes") {
+      this->cancelled_write_bytes = value.to_string();
     }
   }
 }
@@ -396,30 +412,99 @@ int getOnDisk(const std::string& pid, std::string& path) {
   }
 }
 
+/**
+ * @brief The process details that do not change during the life of an image.
+ *
+ * The exe link is read for every row, an entry is only reused while the link
+ * and the exec_id of the process match. This way the on_disk check, which may
+ * scan the process memory maps, follows the deletion of the binary.
+ *
+ * The command line is not cached: processes may rewrite their arguments
+ * after exec (e.g. setproctitle).
+ */
+struct CachedProcessImage {
+  std::string exec_id;
+  std::string exe_link;
+  std::string path;
+  int on_disk{-1};
+};
+
+/// Process images, keyed by pid, reused across queries.
+std::unordered_map<std::string, CachedProcessImage> kProcessImageCache;
+
+/// Protects the process image cache, tables may be generated concurrently.
+Mutex kProcessImageCacheMutex;
+
+void getProcessImage(const std::string& pid,
+                     const ProcDirectory& proc,
+                     const std::string& exec_id,
+                     CachedProcessImage& image) {
+  auto exe_link = proc.readLink("exe");
+  if (!exec_id.empty()) {
+    ReadLock lock(kProcessImageCacheMutex);
+    auto it = kProcessImageCache.find(pid);
+    if (it != kProcessImageCache.end() && it->second.exec_id == exec_id &&
+        it->second.exe_link == exe_link) {
+      image = it->second;
+      return;
+    }
+  }
+
+  image.exec_id = exec_id;
+  image.exe_link = exe_link;
+  image.path = exe_link;
+  image.on_disk = getOnDisk(pid, image.path);
+
+  // Kernel threads and zombies do not have an image worth keeping.
+  if (!exec_id.empty() && !exe_link.empty()) {
+    WriteLock lock(kProcessImageCacheMutex);
+    kProcessImageCache[pid] = image;
+  }
+}
+
+/// Drop the cached images of processes that were not found by a full scan.
+void expireProcessImages(const std::set<std::string>& pidlist) {
+  WriteLock lock(kProcessImageCacheMutex);
+  for (auto it = kProcessImageCache.begin(); it != kProcessImageCache.end();) {
+    if (pidlist.count(it->first) == 0) {
+      it = kProcessImageCache.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 void genProcess(const std::string& pid, QueryData& results) {
+  // The files of the process are opened relative to its directory.
+  ProcDirectory proc(pid);
+  if (!proc.isValid()) {
+    return;
+  }
+
   // Parse the process stat and status.
-  SimpleProcStat proc_stat(pid);
-  // Parse the process io
-  SimpleProcIo proc_io(pid);
+  SimpleProcStat proc_stat(proc);
 
   if (!proc_stat.status.ok()) {
     VLOG(1) << proc_stat.status.getMessage() << " for pid " << pid;
     return;
   }
 
+  CachedProcessImage image;
+  getProcessImage(pid, proc, proc_stat.exec_id, image);
+
   Row r;
   r["pid"] = pid;
   r["parent"] = proc_stat.parent;
-  r["path"] = readProcLink("exe", pid);
+  r["path"] = std::move(image.path);
   r["name"] = proc_stat.name;
   r["pgroup"] = proc_stat.group;
   r["state"] = proc_stat.state;
   r["nice"] = proc_stat.nice;
   r["threads"] = proc_stat.threads;
   // Read/parse cmdline arguments.
-  r["cmdline"] = readProcCMDLine(pid);
-  r["cwd"] = readProcLink("cwd", pid);
-  r["root"] = readProcLink("root", pid);
+  r["cmdline"] = readProcCMDLine(proc);
+  r["cwd"] = proc.readLink("cwd");
+  r["root"] = proc.readLink("root");
   r["uid"] = proc_stat.real_uid;
   r["euid"] = proc_stat.effective_uid;
   r["suid"] = proc_stat.saved_uid;
@@ -427,7 +512,7 @@ void genProcess(const std::string& pid, QueryData& results) {
   r["egid"] = proc_stat.effective_gid;
   r["sgid"] = proc_stat.saved_gid;
 
-  r["on_disk"] = INTEGER(getOnDisk(pid, r["path"]));
+  r["on_disk"] = INTEGER(image.on_disk);
 
   // size/memory information
   r["wired_size"] = "0"; // No support for unpagable counters in linux.
@@ -441,6 +526,8 @@ void genProcess(const std::string& pid, QueryData& results) {
   r["system_time"] = std::to_string(sys_time * kMSIn1CLKTCK);
   r["start_time"] = proc_stat.start_time;
 
+  // Parse the process io
+  SimpleProcIo proc_io(pid, proc);
   if (!proc_io.status.ok()) {
     // /proc/<pid>/io can require root to access, so don't fail if we can't
     VLOG(1) << proc_io.status.getMessage();
@@ -486,6 +573,10 @@ QueryData genProcesses(QueryContext& context) {
     genProcess(pid, results);
   }
 
+  if (!context.hasConstraint("pid", EQUALS)) {
+    expireProcessImages(pidlist);
+  }
+
   return results;
 }
 
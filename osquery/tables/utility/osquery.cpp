@@ -15,6 +15,7 @@
 #include <osquery/filesystem.h>
 #include <osquery/flags.h>
 #include <osquery/logger.h>
+#include <osquery/numeric_monitoring.h>
 #include <osquery/packs.h>
 #include <osquery/registry.h>
 #include <osquery/sql.h>
@@ -263,5 +264,21 @@ QueryData genOsquerySchedule(QueryContext& context) {
       true);
   return results;
 }
+
+QueryData genOsqueryMetrics(QueryContext& context) {
+  QueryData results;
+
+  for (const auto& point : monitoring::getRecordedPoints()) {
+    Row r;
+    r["path"] = point.path;
+    r["value"] = BIGINT(point.value);
+    r["pre_aggregation"] = to<std::string>(point.pre_aggregation);
+    r["time"] = BIGINT(std::chrono::duration_cast<std::chrono::seconds>(
+                           point.time_point.time_since_epoch())
+                           .count());
+    results.push_back(std::move(r));
+  }
+  return results;
+}
 } // namespace tables
 } // namespace osquery
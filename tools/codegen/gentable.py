@@ -237,6 +237,13 @@ class TableState(Singleton):
             self.has_options = True
         if "event_subscriber" in self.attributes:
             self.generator = True
+        cache_sources = self.attributes.get("cache_source", [])
+        if not isinstance(cache_sources, list):
+            cache_sources = [cache_sources]
+        if len(cache_sources) > 0 and self.class_name != "":
+            print(lightred(
+                "Event subscriber tables cannot use a cache_source: %s" % (path)))
+            exit(1)
         if "cacheable" in self.attributes:
             if self.generator:
                 print(lightred(
@@ -287,6 +294,7 @@ class TableState(Singleton):
             has_options=self.has_options,
             has_column_aliases=self.has_column_aliases,
             generator=self.generator,
+            cache_sources=cache_sources,
             attribute_set=[TABLE_ATTRIBUTES[attr] for attr in self.attributes if attr in TABLE_ATTRIBUTES],
         )
 